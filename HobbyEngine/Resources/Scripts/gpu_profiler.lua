@@ -0,0 +1,12 @@
+timeCount = 0
+
+function update(deltaTime)
+	timeCount = timeCount + deltaTime
+
+	if (timeCount > 500)
+	then
+		timeCount = 0
+		updateText(gpuProfilerReport())
+	end
+
+end
@@ -0,0 +1,24 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+
+#ifdef INSTANCED
+layout (location = 5) in mat4 aModel;
+#else
+uniform mat4 model;
+#endif
+
+uniform mat4 view;
+uniform mat4 projection;
+
+// The colour pass tests depth with GL_EQUAL, so the position has to be computed exactly as in game_object_vs.glsl
+invariant gl_Position;
+
+void main()
+{
+#ifdef INSTANCED
+	mat4 model = aModel;
+#endif
+
+	vec3 fragPos = vec3(model * vec4(aPos, 1.0));
+	gl_Position = projection * view * vec4(fragPos, 1.0);
+}
@@ -1,11 +1,27 @@
 #version 330 core
 out vec4 FragColor;
 
+#ifdef TEXTURE_ARRAYS
+#define MATERIAL_SAMPLER sampler2DArray
+#define MATERIAL_TEXTURE(map, layer) texture(map, vec3(UV, layer))
+
+// Layers of the diffuse, specular or packed, reflection and normal maps in their texture arrays
+uniform vec4 materialLayers;
+#else
+#define MATERIAL_SAMPLER sampler2D
+#define MATERIAL_TEXTURE(map, layer) texture(map, UV)
+#endif
+
 struct Material {
-	sampler2D diffuse;
-	sampler2D specular;
-	sampler2D reflectionMap;
+	MATERIAL_SAMPLER diffuse;
+#ifdef PACKED_MATERIAL
+	// Specular intensity in r, reflection mask in g and shininess / 255 in b
+	MATERIAL_SAMPLER packedMap;
+#else
+	MATERIAL_SAMPLER specular;
+	MATERIAL_SAMPLER reflectionMap;
 	float shininess;
+#endif
 };
 
 struct Light {
@@ -18,54 +34,140 @@ struct Light {
 in vec3 FragPos;
 in vec2 UV;
 in mat3 TBN;
-in vec4 FragPosLightSpace;
+in float ViewDepth;
 
 uniform vec3 viewPos;
-uniform sampler2D normalMap;
-uniform sampler2D shadowMap;
+uniform MATERIAL_SAMPLER normalMap;
 uniform samplerCube skybox;
 uniform Material material;
 uniform Light light;
 
-void main() 
+// Clustered point and spot lights, three texels per light: position and range, color and cosine of the inner
+// cone angle, direction and cosine of the outer cone angle
+uniform samplerBuffer lightData;
+
+// Offset and count of each cluster's lights in lightIndices
+uniform usamplerBuffer lightGrid;
+uniform usamplerBuffer lightIndices;
+
+uniform vec2 clusterTileSize;
+uniform float clusterDepthScale;
+uniform float clusterDepthBias;
+
+#define CLUSTER_TILES_X 16
+#define CLUSTER_TILES_Y 9
+#define CLUSTER_SLICES 24
+
+#ifdef RECEIVE_SHADOWS
+#define MAX_CASCADES 4
+
+uniform sampler2DArray shadowMap;
+uniform mat4 lightSpaceMatrices[MAX_CASCADES];
+
+// Far distance of each cascade along the view direction
+uniform float cascadeSplits[MAX_CASCADES];
+uniform int cascadeCount;
+#endif
+
+// Feature defines are prepended by the renderer: NORMAL_MAP, REFLECTION, RECEIVE_SHADOWS, PCF_KERNEL_SIZE,
+// PACKED_MATERIAL and TEXTURE_ARRAYS
+
+void main()
 {
-	vec3 ambient = light.ambient * texture(material.diffuse, UV).rgb;
+	vec3 diffuseColor = MATERIAL_TEXTURE(material.diffuse, materialLayers.x).rgb;
+#ifdef PACKED_MATERIAL
+	vec4 packedMaterial = MATERIAL_TEXTURE(material.packedMap, materialLayers.y);
+	vec3 specularColor = vec3(packedMaterial.r);
+	vec3 reflectionMask = vec3(packedMaterial.g);
+	float shininess = max(packedMaterial.b * 255.0, 1.0);
+#else
+	vec3 specularColor = MATERIAL_TEXTURE(material.specular, materialLayers.y).rgb;
+	vec3 reflectionMask = MATERIAL_TEXTURE(material.reflectionMap, materialLayers.z).rgb;
+	float shininess = material.shininess;
+#endif
+
+	vec3 ambient = light.ambient * diffuseColor;
 
-	vec3 normal = texture(normalMap, UV).rgb;
+#ifdef NORMAL_MAP
+	vec3 normal = MATERIAL_TEXTURE(normalMap, materialLayers.w).rgb;
 	normal = normalize(normal * 2.0 - 1.0);
 	normal = normalize(TBN * normal);
+#else
+	vec3 normal = normalize(TBN[2]);
+#endif
 
 	vec3 lightDir = normalize(-light.direction);
 	float diff = max(dot(normal, lightDir), 0.0);
-	vec3 diffuse = light.diffuse * diff * texture(material.diffuse, UV).rgb;
+	vec3 diffuse = light.diffuse * diff * diffuseColor;
 
 	vec3 viewDir = normalize(viewPos - FragPos);
 	vec3 reflectDir = reflect(-lightDir, normal);
-	float spec = pow(max(dot(viewDir, reflectDir), 0.0), material.shininess);
-	vec3 specular = light.specular * spec * texture(material.specular, UV).rgb;
+	float spec = pow(max(dot(viewDir, reflectDir), 0.0), shininess);
+	vec3 specular = light.specular * spec * specularColor;
 
-	vec3 projCoords = (FragPosLightSpace.xyz / FragPosLightSpace.w) * 0.5 + 0.5;
-	float bias = max(0.05 * (1.0 - dot(normal, lightDir)), 0.001);
 	float shadow = 0.0;
-	vec2 texelSize = 1.0 / textureSize(shadowMap, 0);
-	for(int x = -1; x <= 1; ++x)
-	{
-		for(int y = -1; y <= 1; ++y)
-		{
-			float pcfDepth = texture(shadowMap, projCoords.xy + vec2(x, y) * texelSize).r; 
-			shadow += projCoords.z - bias > pcfDepth ? 1.0 : 0.0;        
-		}    
+#ifdef RECEIVE_SHADOWS
+	int cascade = 0;
+	while (cascade < cascadeCount && ViewDepth > cascadeSplits[cascade]) {
+		++cascade;
 	}
-	shadow /= 9.0;
 
-	if (projCoords.z > 1.0) {
-		shadow = 0.0;
+	// Fragments beyond the last cascade aren't shadowed
+	if (cascade < cascadeCount) {
+		vec4 fragPosLightSpace = lightSpaceMatrices[cascade] * vec4(FragPos, 1.0);
+		vec3 projCoords = (fragPosLightSpace.xyz / fragPosLightSpace.w) * 0.5 + 0.5;
+		float bias = max(0.05 * (1.0 - dot(normal, lightDir)), 0.001);
+		vec2 texelSize = 1.0 / textureSize(shadowMap, 0).xy;
+		const int pcfRadius = PCF_KERNEL_SIZE / 2;
+		for(int x = -pcfRadius; x <= pcfRadius; ++x)
+		{
+			for(int y = -pcfRadius; y <= pcfRadius; ++y)
+			{
+				float pcfDepth = texture(shadowMap, vec3(projCoords.xy + vec2(x, y) * texelSize, cascade)).r;
+				shadow += projCoords.z - bias > pcfDepth ? 1.0 : 0.0;
+			}
+		}
+		shadow /= float((2 * pcfRadius + 1) * (2 * pcfRadius + 1));
+
+		if (projCoords.z > 1.0) {
+			shadow = 0.0;
+		}
 	}
+#endif
 
+	vec3 reflection = vec3(0.0);
+#ifdef REFLECTION
 	vec3 R = reflect(-viewDir, normal);
-	vec3 reflection = texture(skybox, R).rgb * texture(material.reflectionMap, UV).rgb;
+	reflection = texture(skybox, R).rgb * reflectionMask;
+#endif
+
+	// Only the lights binned into this fragment's cluster are evaluated
+	ivec2 tile = min(ivec2(gl_FragCoord.xy / clusterTileSize), ivec2(CLUSTER_TILES_X - 1, CLUSTER_TILES_Y - 1));
+	int slice = clamp(int(log(ViewDepth) * clusterDepthScale - clusterDepthBias), 0, CLUSTER_SLICES - 1);
+	uvec2 cluster = texelFetch(lightGrid, tile.x + tile.y * CLUSTER_TILES_X + slice * CLUSTER_TILES_X * CLUSTER_TILES_Y).rg;
+
+	vec3 clusteredLighting = vec3(0.0);
+	for (uint i = 0u; i < cluster.y; ++i) {
+		int light = int(texelFetch(lightIndices, int(cluster.x + i)).r);
+		vec4 positionRange = texelFetch(lightData, light * 3);
+		vec4 colorInner = texelFetch(lightData, light * 3 + 1);
+		vec4 directionOuter = texelFetch(lightData, light * 3 + 2);
+
+		vec3 toLight = positionRange.xyz - FragPos;
+		float distance = length(toLight);
+		vec3 pointLightDir = toLight / distance;
+
+		// Inverse square falloff windowed to reach zero at the light's range
+		float window = clamp(1.0 - pow(distance / positionRange.w, 4.0), 0.0, 1.0);
+		float attenuation = window * window / (distance * distance + 1.0);
+		attenuation *= smoothstep(directionOuter.w, colorInner.w, dot(-pointLightDir, directionOuter.xyz));
+
+		float pointDiff = max(dot(normal, pointLightDir), 0.0);
+		float pointSpec = pow(max(dot(viewDir, reflect(-pointLightDir, normal)), 0.0), shininess);
+		clusteredLighting += colorInner.rgb * attenuation * (pointDiff * diffuseColor + pointSpec * specularColor);
+	}
+
+	vec3 lighting = ambient + (1.0 - shadow) * (diffuse + specular + 0.5 * reflection) + clusteredLighting;
 
-	vec3 lighting = ambient + (1.0 - shadow) * (diffuse + specular + 0.5 * reflection);
-	
 	FragColor = vec4(lighting, 1.0);
-}
\ No newline at end of file
+}
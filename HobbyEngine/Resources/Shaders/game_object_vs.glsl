@@ -8,16 +8,29 @@ layout (location = 4) in vec3 aBitangent;
 out vec3 FragPos;
 out vec2 UV;
 out mat3 TBN;
-out vec4 FragPosLightSpace;
+out float ViewDepth;
 
-uniform mat4 model;
 uniform mat4 view;
 uniform mat4 projection;
-uniform mat4 lightSpaceMatrix;
+
+#ifdef INSTANCED
+// Instances that passed the GPU culling. Transforms don't scale, so the model matrix rotates the normals as is.
+layout (location = 5) in mat4 aModel;
+#else
+uniform mat4 model;
 uniform mat3 normalMatrix;
+#endif
+
+// Must match the depth pre-pass exactly, see depth_prepass_vs.glsl
+invariant gl_Position;
 
 void main()
 {
+#ifdef INSTANCED
+	mat4 model = aModel;
+	mat3 normalMatrix = mat3(aModel);
+#endif
+
 	FragPos = vec3(model * vec4(aPos, 1.0));
 	UV = vec2(aUV.x, aUV.y);
 
@@ -26,7 +39,8 @@ void main()
 	vec3 N = normalize(vec3(normalMatrix * aNormal));
 	TBN = mat3(T, B, N);
 
-	FragPosLightSpace = lightSpaceMatrix * vec4(FragPos, 1.0);
+	// Distance along the view direction selects the shadow cascade
+	ViewDepth = -(view * vec4(FragPos, 1.0)).z;
 
 	gl_Position = projection * view * vec4(FragPos, 1.0);
 }
\ No newline at end of file
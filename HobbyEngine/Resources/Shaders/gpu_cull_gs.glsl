@@ -0,0 +1,21 @@
+#version 330 core
+
+// A vertex shader writes one output per instance, so the visible instances are compacted here by emitting a
+// point only for them
+layout (points) in;
+layout (points, max_vertices = 1) out;
+
+in mat4 Model[];
+flat in int Visible[];
+
+// Captured by transform feedback into the group's range of the visible instance buffer
+out mat4 InstanceModel;
+
+void main()
+{
+	if (Visible[0] != 0) {
+		InstanceModel = Model[0];
+		EmitVertex();
+		EndPrimitive();
+	}
+}
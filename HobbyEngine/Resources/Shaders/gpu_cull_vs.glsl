@@ -0,0 +1,89 @@
+#version 330 core
+#define MAX_HI_Z_LEVELS 16
+
+// Same near limit as the occlusion culler, boxes reaching behind it are never occluded
+#define NEAR_W 0.1
+
+layout (location = 0) in mat4 aModel;
+
+out mat4 Model;
+flat out int Visible;
+
+uniform mat4 viewProjection;
+
+// Local bounds of the group's mesh
+uniform vec3 boundsMin;
+uniform vec3 boundsMax;
+
+// Depth pyramid of the occlusion culler with the levels packed one after another, no levels if it's disabled
+uniform samplerBuffer hiZ;
+uniform int hiZLevels;
+uniform int hiZOffsets[MAX_HI_Z_LEVELS];
+uniform ivec2 hiZSizes[MAX_HI_Z_LEVELS];
+
+// Same test as OcclusionCuller::isVisible, on the level where the box covers at most 2x2 texels
+bool occluded(vec2 minPos, vec2 maxPos, float nearestDepth)
+{
+	ivec2 p0 = max(ivec2(floor(minPos * vec2(hiZSizes[0]))), ivec2(0));
+	ivec2 p1 = min(ivec2(floor(maxPos * vec2(hiZSizes[0]))), hiZSizes[0] - 1);
+	if (p0.x > p1.x || p0.y > p1.y) {
+		// Off screen, left to the frustum culling
+		return false;
+	}
+
+	int size = max(p1.x - p0.x, p1.y - p0.y);
+	int level = 0;
+	while (size > 1 && level + 1 < hiZLevels) {
+		size /= 2;
+		p0 /= 2;
+		p1 /= 2;
+		++level;
+	}
+
+	for (int y = p0.y; y <= p1.y; ++y) {
+		for (int x = p0.x; x <= p1.x; ++x) {
+			if (nearestDepth <= texelFetch(hiZ, hiZOffsets[level] + y * hiZSizes[level].x + x).r) {
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+void main()
+{
+	Model = aModel;
+
+	mat4 mvp = viewProjection * aModel;
+
+	// The box is outside the frustum if all of its corners are outside the same plane
+	int outside = 63;
+	bool crossesNear = false;
+	vec2 minPos = vec2(1.0e30);
+	vec2 maxPos = vec2(-1.0e30);
+	float nearestDepth = 1.0e30;
+	for (int i = 0; i < 8; ++i) {
+		vec3 corner = mix(boundsMin, boundsMax, vec3(float(i & 1), float((i >> 1) & 1), float((i >> 2) & 1)));
+		vec4 clip = mvp * vec4(corner, 1.0);
+
+		int planes = (clip.x < -clip.w ? 1 : 0) | (clip.x > clip.w ? 2 : 0) | (clip.y < -clip.w ? 4 : 0)
+			| (clip.y > clip.w ? 8 : 0) | (clip.z < -clip.w ? 16 : 0) | (clip.z > clip.w ? 32 : 0);
+		outside &= planes;
+
+		if (clip.w < NEAR_W) {
+			crossesNear = true;
+		}
+		else {
+			vec3 ndc = clip.xyz / clip.w;
+			minPos = min(minPos, ndc.xy * 0.5 + 0.5);
+			maxPos = max(maxPos, ndc.xy * 0.5 + 0.5);
+			nearestDepth = min(nearestDepth, ndc.z * 0.5 + 0.5);
+		}
+	}
+
+	bool visible = outside == 0;
+	if (visible && hiZLevels > 0 && !crossesNear) {
+		visible = !occluded(minPos, maxPos, nearestDepth);
+	}
+	Visible = visible ? 1 : 0;
+}
@@ -3,10 +3,11 @@ out vec4 FragColor;
   
 in vec2 TexCoords;
 
-uniform sampler2D depthMap;
+uniform sampler2DArray depthMap;
+uniform int layer;
 
 void main()
 {             
-    float depthValue = texture(depthMap, TexCoords).r;
+    float depthValue = texture(depthMap, vec3(TexCoords, layer)).r;
     FragColor = vec4(vec3(depthValue), 1.0);
-}  
\ No newline at end of file
+}
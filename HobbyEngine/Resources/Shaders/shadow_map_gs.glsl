@@ -0,0 +1,26 @@
+#version 330 core
+#define MAX_CASCADES 4
+
+layout (triangles) in;
+layout (triangle_strip, max_vertices = 12) out;
+
+uniform mat4 lightSpaceMatrices[MAX_CASCADES];
+
+// Cascades the object was not culled from
+uniform int cascadeMask;
+
+void main()
+{
+	for (int cascade = 0; cascade < MAX_CASCADES; ++cascade) {
+		if ((cascadeMask & (1 << cascade)) == 0) {
+			continue;
+		}
+
+		for (int i = 0; i < 3; ++i) {
+			gl_Layer = cascade;
+			gl_Position = lightSpaceMatrices[cascade] * gl_in[i].gl_Position;
+			EmitVertex();
+		}
+		EndPrimitive();
+	}
+}
@@ -1,10 +1,24 @@
 #version 330 core
 layout (location = 0) in vec3 aPos;
 
+#ifdef INSTANCED
+layout (location = 5) in mat4 aModel;
+#else
 uniform mat4 model;
+#endif
+
 uniform mat4 lightSpaceMatrix;
 
 void main()
 {
-    gl_Position = lightSpaceMatrix * model * vec4(aPos, 1.0);
-}  
\ No newline at end of file
+#ifdef INSTANCED
+	mat4 model = aModel;
+#endif
+
+#ifdef LAYERED
+	// The geometry shader projects the triangle into each cascade it's drawn to
+	gl_Position = model * vec4(aPos, 1.0);
+#else
+	gl_Position = lightSpaceMatrix * model * vec4(aPos, 1.0);
+#endif
+}
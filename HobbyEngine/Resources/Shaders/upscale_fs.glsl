@@ -0,0 +1,12 @@
+#version 330 core
+out vec4 FragColor;
+
+in vec2 TexCoords;
+
+uniform sampler2D scene;
+uniform vec2 cornerMax;
+
+void main()
+{
+    FragColor = vec4(texture(scene, min(TexCoords, cornerMax)).rgb, 1.0);
+}
@@ -0,0 +1,13 @@
+#version 330 core
+out vec2 TexCoords;
+
+// Size of the rendered corner in texture coordinates
+uniform vec2 cornerSize;
+
+void main()
+{
+    // A triangle covering the whole screen, from the vertex index alone
+    vec2 position = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+    TexCoords = position * cornerSize;
+    gl_Position = vec4(position * 2.0 - 1.0, 0.0, 1.0);
+}
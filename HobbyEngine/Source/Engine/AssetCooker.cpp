@@ -0,0 +1,324 @@
+#include "AssetCooker.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <map>
+
+#include <sol/sol.hpp>
+#include <tinyxml2/tinyxml2.h>
+
+#include "JobSystem.h"
+#include "../ResourceCache/ImageLoader.h"
+#include "../ResourceCache/LuaLoader.h"
+#include "../ResourceCache/ModelLoader.h"
+#include "../ResourceCache/TextLoader.h"
+#include "../ResourceCache/TextureCompressor.h"
+#include "../Utils/DebugLogger.h"
+#include "../Utils/FileUtils.h"
+
+namespace
+{
+	const char* RESOURCE_DIRECTORY = "Resources/";
+	const char* COOKED_DIRECTORY = "Cooked/";
+	const char* MANIFEST_FILE = "Resources/Cooked/manifest.xml";
+
+	// Changing any of the cooked formats has to bump this, so the old files aren't taken as up to date. The
+	// sources are hashed together with it, and the manifest records it for ResCache to check the hashes.
+	const char* COOKER_VERSION = "1";
+
+	int luaWriter(lua_State*, const void* data, size_t size, void* userData)
+	{
+		auto out = (std::vector<char>*)userData;
+		out->insert(out->end(), (const char*)data, (const char*)data + size);
+		return 0;
+	}
+}
+
+bool AssetCooker::run(int argc, char** argv)
+{
+	auto startTime = std::chrono::high_resolution_clock::now();
+
+	bool force = false;
+	int nWorkers = 0;
+	for (int i = 1; i < argc; ++i) {
+		std::string arg(argv[i]);
+		if (arg == "--force") {
+			force = true;
+		}
+		else if (arg == "--workers" && i + 1 < argc) {
+			nWorkers = std::atoi(argv[++i]);
+		}
+		else if (arg != "--cook") {
+			DebugLogger::log("AssetCooker::run: unknown command line argument " + arg);
+		}
+	}
+
+	// Hashes and cooked files of the previous run
+	std::map<std::string, std::pair<std::string, std::string>> previous;
+	tinyxml2::XMLDocument manifest;
+	if (!force && manifest.LoadFile(MANIFEST_FILE) == tinyxml2::XML_SUCCESS && manifest.FirstChildElement("Manifest")) {
+		auto root = manifest.FirstChildElement("Manifest");
+		for (auto elem = root->FirstChildElement("Asset"); elem; elem = elem->NextSiblingElement("Asset")) {
+			auto source = elem->Attribute("source");
+			auto cooked = elem->Attribute("cooked");
+			auto hash = elem->Attribute("hash");
+			if (source && cooked && hash) {
+				previous[source] = std::make_pair(std::string(hash), std::string(cooked));
+			}
+		}
+	}
+
+	std::vector<Asset> assets;
+	std::error_code err;
+	for (auto it = std::filesystem::recursive_directory_iterator(RESOURCE_DIRECTORY, err); it != std::filesystem::recursive_directory_iterator(); it.increment(err)) {
+		if (err) {
+			break;
+		}
+		if (!it->is_regular_file()) {
+			continue;
+		}
+
+		std::string source = std::filesystem::relative(it->path(), RESOURCE_DIRECTORY).generic_string();
+		if (source.compare(0, strlen(COOKED_DIRECTORY), COOKED_DIRECTORY) == 0) {
+			continue;
+		}
+
+		Asset asset;
+		asset.source = source;
+		asset.cooked = cookedName(source);
+		if (!asset.cooked.empty()) {
+			assets.push_back(asset);
+		}
+	}
+
+	if (err) {
+		DebugLogger::log("AssetCooker::run: could not list " + std::string(RESOURCE_DIRECTORY) + ": " + err.message());
+		return false;
+	}
+
+	// Every thread pulls the next asset when it's done with one, as the textures take far longer than the rest
+	JobSystem jobSystem;
+	jobSystem.init(nWorkers);
+
+	std::atomic<size_t> nextAsset{ 0 };
+	jobSystem.parallelFor(jobSystem.nThreads(), 1, [&](size_t, size_t, int) {
+		for (size_t i = nextAsset++; i < assets.size(); i = nextAsset++) {
+			Asset& asset = assets[i];
+			if (!FileUtils::hashFile((RESOURCE_DIRECTORY + asset.source).c_str(), COOKER_VERSION, asset.hash)) {
+				asset.error = "could not read the source file";
+				continue;
+			}
+
+			auto it = previous.find(asset.source);
+			if (it != previous.end() && it->second.first == asset.hash && it->second.second == asset.cooked
+				&& std::filesystem::exists(RESOURCE_DIRECTORY + asset.cooked)) {
+				asset.upToDate = true;
+				asset.success = true;
+				continue;
+			}
+
+			cook(asset);
+		}
+	});
+
+	size_t nCooked = 0;
+	size_t nUpToDate = 0;
+	size_t nFailed = 0;
+	for (auto it = assets.begin(); it != assets.end(); ++it) {
+		if (!it->success) {
+			DebugLogger::log("AssetCooker: could not cook " + it->source + ": " + it->error);
+			++nFailed;
+		}
+		else if (it->upToDate) {
+			++nUpToDate;
+		}
+		else {
+			++nCooked;
+		}
+	}
+
+	bool manifestWritten = writeManifest(assets);
+
+	float ms = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - startTime).count();
+	char line[256];
+	snprintf(line, sizeof(line), "AssetCooker: %zu assets cooked, %zu up to date, %zu failed in %.1f ms on %d threads",
+		nCooked, nUpToDate, nFailed, ms, jobSystem.nThreads());
+	DebugLogger::log(line);
+
+	return manifestWritten && nFailed == 0;
+}
+
+std::string AssetCooker::cookedName(const std::string& source)
+{
+	size_t dot = source.find_last_of('.');
+	if (dot == std::string::npos) {
+		return std::string();
+	}
+
+	std::string extension = source.substr(dot + 1);
+	std::transform(extension.begin(), extension.end(), extension.begin(), [](char c) { return (char)tolower(c); });
+
+	std::string cooked = COOKED_DIRECTORY + source.substr(0, dot);
+	if (extension == "obj") {
+		return cooked + ".hmesh";
+	}
+	if (extension == "jpg" || extension == "jpeg" || extension == "png" || extension == "bmp") {
+		return cooked + ".dds";
+	}
+	if (extension == "lua") {
+		return cooked + ".luac";
+	}
+	if (extension == "xml") {
+		return cooked + ".xml";
+	}
+	return std::string();
+}
+
+void AssetCooker::cook(Asset& asset)
+{
+	std::string extension = asset.cooked.substr(asset.cooked.find_last_of('.') + 1);
+
+	std::vector<char> out;
+	bool success = false;
+	if (extension == "hmesh") {
+		success = cookMesh(asset.source, out, asset.error);
+	}
+	else if (extension == "dds") {
+		success = cookTexture(asset.source, out, asset.error);
+	}
+	else if (extension == "luac") {
+		success = cookScript(asset.source, out, asset.error);
+	}
+	else if (extension == "xml") {
+		success = cookXML(asset.source, out, asset.error);
+	}
+
+	if (!success) {
+		return;
+	}
+
+	std::filesystem::path path(RESOURCE_DIRECTORY + asset.cooked);
+	std::error_code err;
+	std::filesystem::create_directories(path.parent_path(), err);
+
+	std::ofstream file(path, std::ios::binary);
+	if (err || !file || !file.write(out.data(), out.size())) {
+		asset.error = "could not write " + path.generic_string();
+		return;
+	}
+
+	asset.success = true;
+}
+
+bool AssetCooker::cookMesh(const std::string& source, std::vector<char>& out, std::string& error)
+{
+	ObjLoader loader;
+	Resource resource(source);
+	auto handle = ResCache::loadFile(loader, resource, RESOURCE_DIRECTORY + source);
+	auto mesh = handle ? std::dynamic_pointer_cast<ModelResProcessedData>(handle->processedData) : nullptr;
+	if (!mesh) {
+		error = "could not load the model";
+		return false;
+	}
+
+	out = BinaryMeshLoader::write(*mesh);
+	return true;
+}
+
+bool AssetCooker::cookTexture(const std::string& source, std::vector<char>& out, std::string& error)
+{
+	// Image loaders keep state between the size query and the load, so each texture gets its own
+	ImageLoader loader;
+	Resource resource(source);
+	auto handle = ResCache::loadFile(loader, resource, RESOURCE_DIRECTORY + source);
+	auto image = handle ? std::dynamic_pointer_cast<ImageResProcessedData>(handle->processedData) : nullptr;
+	if (!image || image->width() <= 0 || image->height() <= 0) {
+		error = "could not load the image";
+		return false;
+	}
+
+	out = TextureCompressor::compressToDDS((const unsigned char*)handle->buffer, image->width(), image->height(), image->nChannels());
+	return true;
+}
+
+bool AssetCooker::cookScript(const std::string& source, std::vector<char>& out, std::string& error)
+{
+	LuaLoader loader;
+	Resource resource(source);
+	auto handle = ResCache::loadFile(loader, resource, RESOURCE_DIRECTORY + source);
+	if (!handle) {
+		error = "could not load the script";
+		return false;
+	}
+
+	// Only compiled, not run. Debug information is kept so errors still point at the source lines.
+	sol::state lua;
+	auto chunk = LuaLoader::chunk(*handle);
+	std::string chunkName = "@" + source;
+	if (luaL_loadbufferx(lua.lua_state(), chunk.data(), chunk.size(), chunkName.c_str(), "t") != LUA_OK) {
+		error = lua_tostring(lua.lua_state(), -1);
+		return false;
+	}
+
+	lua_dump(lua.lua_state(), luaWriter, &out, 0);
+	lua_pop(lua.lua_state(), 1);
+	return true;
+}
+
+bool AssetCooker::cookXML(const std::string& source, std::vector<char>& out, std::string& error)
+{
+	TextLoader loader;
+	Resource resource(source);
+	auto handle = ResCache::loadFile(loader, resource, RESOURCE_DIRECTORY + source);
+	if (!handle) {
+		error = "could not load the file";
+		return false;
+	}
+
+	tinyxml2::XMLDocument doc;
+	tinyxml2::XMLError xmlError = doc.Parse(handle->buffer);
+	if (xmlError != tinyxml2::XML_SUCCESS) {
+		error = "could not parse XML, error " + std::to_string(xmlError);
+		return false;
+	}
+
+	tinyxml2::XMLPrinter printer(nullptr, true);
+	doc.Print(&printer);
+	out.assign(printer.CStr(), printer.CStr() + printer.CStrSize() - 1);
+	return true;
+}
+
+bool AssetCooker::writeManifest(const std::vector<Asset>& assets)
+{
+	tinyxml2::XMLDocument doc;
+	auto root = doc.NewElement("Manifest");
+	root->SetAttribute("version", COOKER_VERSION);
+	doc.InsertEndChild(root);
+
+	for (auto it = assets.begin(); it != assets.end(); ++it) {
+		if (!it->success) {
+			continue;
+		}
+
+		auto elem = doc.NewElement("Asset");
+		elem->SetAttribute("source", it->source.c_str());
+		elem->SetAttribute("cooked", it->cooked.c_str());
+		elem->SetAttribute("hash", it->hash.c_str());
+		root->InsertEndChild(elem);
+	}
+
+	std::error_code err;
+	std::filesystem::create_directories(std::filesystem::path(MANIFEST_FILE).parent_path(), err);
+	if (err || doc.SaveFile(MANIFEST_FILE) != tinyxml2::XML_SUCCESS) {
+		DebugLogger::log(std::string("AssetCooker::writeManifest: could not write ") + MANIFEST_FILE);
+		return false;
+	}
+	return true;
+}
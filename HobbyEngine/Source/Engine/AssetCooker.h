@@ -0,0 +1,47 @@
+#ifndef ASSET_COOKER_H
+#define ASSET_COOKER_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Converts the resources under Resources/ into the forms the runtime loads without parsing or encoding, run with
+// --cook instead of starting the game. OBJ models become binary meshes, images become BC1 or BC3 compressed DDS
+// textures with mip levels, Lua scripts are precompiled to bytecode, and XML files are checked and written
+// without whitespace and comments. The cooked files go into Resources/Cooked/ with a manifest mapping each
+// source to its cooked file, which the resource cache reads at startup.
+//
+// Each source's content hash is stored in the manifest, and sources whose hash hasn't changed since the last run
+// aren't cooked again. The assets are cooked in parallel on the job system's threads.
+class AssetCooker
+{
+public:
+	// Command line options: --force cooks every asset, --workers <n> sets the number of worker threads. Returns
+	// false if any asset couldn't be cooked.
+	bool run(int argc, char** argv);
+
+private:
+	struct Asset
+	{
+		// Paths relative to the resource directory
+		std::string source;
+		std::string cooked;
+		std::string hash;
+		bool upToDate = false;
+		bool success = false;
+		std::string error;
+	};
+
+	// Cooked file name for a source, or an empty string if it isn't cooked
+	static std::string cookedName(const std::string& source);
+
+	static void cook(Asset& asset);
+	static bool cookMesh(const std::string& source, std::vector<char>& out, std::string& error);
+	static bool cookTexture(const std::string& source, std::vector<char>& out, std::string& error);
+	static bool cookScript(const std::string& source, std::vector<char>& out, std::string& error);
+	static bool cookXML(const std::string& source, std::vector<char>& out, std::string& error);
+
+	bool writeManifest(const std::vector<Asset>& assets);
+};
+
+#endif // !ASSET_COOKER_H
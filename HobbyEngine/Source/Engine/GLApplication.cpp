@@ -1,24 +1,33 @@
 #include "GLApplication.h"
 
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 
 #include "../GameObjects/TransformComponent.h"
+#include "../Renderer/GLExtensions.h"
 #include "../ResourceCache/FontLoader.h"
+#include "../ResourceCache/CompressedTextureLoader.h"
 #include "../ResourceCache/ImageLoader.h"
 #include "../ResourceCache/LuaLoader.h"
 #include "../ResourceCache/ModelLoader.h"
 #include "../ResourceCache/TextLoader.h"
 #include "../Utils/DebugLogger.h"
+#include "../Utils/Profiler.h"
 #include "../Utils/XMLUtils.h"
 
 Game Game::gameInstance;
 
 void Game::updateResolution(int width, int height)
 {
+	// The renderer picks the new size up from the next render state
 	m_screenWidth = width;
 	m_screenHeight = height;
-	m_renderer->updateScreenSize(m_screenWidth, m_screenHeight);
 }
 
 Game::Game()
@@ -27,6 +36,7 @@ Game::Game()
 	m_goFactory = new GOFactory;
 	m_inputSystem = new InputSystem;
 	m_renderer = new Renderer;
+	m_jobSystem = new JobSystem;
 
 	m_deltaTime = 0;
 	m_lastFrame = 0;
@@ -36,11 +46,17 @@ void framebufferSizeCallback(GLFWwindow* window, int width, int height)
 {
 	Game* game = static_cast<Game*>(glfwGetWindowUserPointer(window));
 	game->updateResolution(width, height);
-	glViewport(0, 0, width, height);
 }
 
 Game::~Game()
 {
+	stopRenderThread();
+
+	// Scene resources are released through the renderer, so the scene and its snapshots have to go first
+	m_renderStates[0] = RenderState();
+	m_renderStates[1] = RenderState();
+	m_scene.destroy();
+
 	if (m_resCache != nullptr) {
 		delete m_resCache;
 		m_resCache = nullptr;
@@ -66,26 +82,54 @@ Game::~Game()
 		m_renderer = nullptr;
 	}
 
+	if (m_jobSystem != nullptr) {
+		delete m_jobSystem;
+		m_jobSystem = nullptr;
+	}
+
 	if (m_window != nullptr) {
 		glfwDestroyWindow(m_window);
 		m_window = nullptr;
+		glfwTerminate();
+	}
+
+	if (m_headlessContext != nullptr) {
+		delete m_headlessContext;
+		m_headlessContext = nullptr;
+	}
+}
+
+void Game::swapBuffers()
+{
+	if (m_headless) {
+		m_headlessContext->swapBuffers();
+	}
+	else {
+		glfwSwapBuffers(m_window);
 	}
 }
 
-bool Game::init()
+bool Game::init(int argc, char** argv)
 {
 	// Init resource cache
+	std::shared_ptr<IResLoader> compressedTextureLoader(new CompressedTextureLoader());
 	std::shared_ptr<IResLoader> fontLoader(new FontLoader());
 	std::shared_ptr<IResLoader> imageLoader(new ImageLoader());
 	std::shared_ptr<IResLoader> luaLoader(new LuaLoader());
 	std::shared_ptr<IResLoader> objLoader(new ObjLoader());
 	std::shared_ptr<IResLoader> textLoader(new TextLoader());
+	std::shared_ptr<IResLoader> binaryMeshLoader(new BinaryMeshLoader());
 
+	m_resCache->registerLoader(compressedTextureLoader);
 	m_resCache->registerLoader(fontLoader);
 	m_resCache->registerLoader(imageLoader);
 	m_resCache->registerLoader(luaLoader);
 	m_resCache->registerLoader(objLoader);
 	m_resCache->registerLoader(textLoader);
+	m_resCache->registerLoader(binaryMeshLoader);
+
+	// Resources cooked by the asset cooker are loaded from their cooked files
+	m_resCache->loadManifest("Resources/Cooked/manifest.xml");
 
 	// Load game config
 	tinyxml2::XMLDocument configDoc;
@@ -109,26 +153,86 @@ bool Game::init()
 		m_screenHeight = 1200;
 	}
 
-	if (glfwInit() == GLFW_FALSE) {
-		LOG_DEBUG("Could not initialize GLFW");
-		return false;
+	// Profiler capture settings, a capture is started with F11 when the profiler is compiled in
+	auto profilerElem = configRoot->FirstChildElement("Profiler");
+	if (profilerElem) {
+		XMLUtils::xmlAttribToInt(profilerElem, "captureFrames", m_profileCaptureFrames);
+		auto captureFile = profilerElem->Attribute("file");
+		if (captureFile) {
+			m_profileCaptureFile = captureFile;
+		}
 	}
 
-	if (!initWindow()) {
-		return false;
+	auto renderThreadElem = configRoot->FirstChildElement("RenderThread");
+	if (renderThreadElem) {
+		auto enabled = renderThreadElem->Attribute("enabled");
+		m_renderThreadEnabled = enabled && std::string(enabled) == std::string("true");
 	}
 
-	if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress)) {
-		LOG_DEBUG("Failed to initialize GLAD");
-		glfwTerminate();
-		return false;
+	// Worker threads for the renderer's frame preparation, zero workers uses all but one hardware thread
+	int nWorkers = 0;
+	auto jobSystemElem = configRoot->FirstChildElement("JobSystem");
+	if (jobSystemElem) {
+		XMLUtils::xmlAttribToInt(jobSystemElem, "workers", nWorkers);
 	}
+	m_jobSystem->init(nWorkers);
+
+	// Headless mode renders a fixed number of frames without a window and reports the frame timings
+	auto headlessElem = configRoot->FirstChildElement("Headless");
+	if (headlessElem) {
+		auto enabled = headlessElem->Attribute("enabled");
+		m_headless = enabled && std::string(enabled) == std::string("true");
+		XMLUtils::xmlAttribToInt(headlessElem, "frames", m_headlessFrames);
+		XMLUtils::xmlAttribToInt(headlessElem, "warmupFrames", m_headlessWarmupFrames);
+		XMLUtils::xmlAttribToInt(headlessElem, "deltaTime", m_headlessDeltaTime);
+		auto reportFile = headlessElem->Attribute("report");
+		if (reportFile) {
+			m_headlessReportFile = reportFile;
+		}
+	}
+
+	for (int i = 1; i < argc; ++i) {
+		std::string arg(argv[i]);
+		if (arg == "--headless") {
+			m_headless = true;
+		}
+		else if (arg == "--frames" && i + 1 < argc) {
+			m_headlessFrames = std::atoi(argv[++i]);
+		}
+		else if (arg == "--report" && i + 1 < argc) {
+			m_headlessReportFile = argv[++i];
+		}
+		else {
+			LOG_DEBUG("Game::init: unknown command line argument " + arg);
+		}
+	}
+
+	if (m_headless) {
+		if (!initHeadless()) {
+			return false;
+		}
+	}
+	else {
+		if (glfwInit() == GLFW_FALSE) {
+			LOG_DEBUG("Could not initialize GLFW");
+			return false;
+		}
+
+		if (!initWindow()) {
+			return false;
+		}
 
-	glViewport(0, 0, m_screenWidth, m_screenHeight);
+		if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress)) {
+			LOG_DEBUG("Failed to initialize GLAD");
+			glfwTerminate();
+			return false;
+		}
+		GLExtensions::init((GLADloadproc)glfwGetProcAddress);
 
-	glfwSetWindowUserPointer(m_window, this);
+		glfwSetWindowUserPointer(m_window, this);
 
-	glfwSetFramebufferSizeCallback(m_window, framebufferSizeCallback);
+		glfwSetFramebufferSizeCallback(m_window, framebufferSizeCallback);
+	}
 
 	m_inputSystem->init(m_window);
 
@@ -139,6 +243,10 @@ bool Game::init()
 	// Init renderer
 	m_renderer->init(m_screenWidth, m_screenHeight);
 
+	if (m_headless && !m_renderer->createOffscreenTarget()) {
+		return false;
+	}
+
 	// Load scene
 	tinyxml2::XMLDocument sceneDoc;
 	if (!XMLUtils::loadXMLFile("Scenes/scene_1.xml", sceneDoc)) {
@@ -147,22 +255,59 @@ bool Game::init()
 	}
 	auto sceneRoot = sceneDoc.FirstChildElement();
 
-	return m_scene.init(sceneRoot, m_window);;
+	if (!m_scene.init(sceneRoot, m_window)) {
+		return false;
+	}
+
+	// Shader variants requested by the scene's materials have been compiling while the scene loaded
+	return m_renderer->finishPrograms();
 }
 
 bool gamma = false;
 
 void Game::processInput()
 {
+	PROFILE_FUNCTION();
+
 	if (m_inputSystem->isPressed(GLFW_KEY_ESCAPE)) {
 		glfwSetWindowShouldClose(m_window, true);
 	}
+
+#ifdef PROFILE_ENABLED
+	bool captureKeyDown = m_inputSystem->isPressed(GLFW_KEY_F11);
+	if (captureKeyDown && !m_profileCaptureKeyDown) {
+		Profiler::instance().startCapture(m_profileCaptureFrames, m_profileCaptureFile);
+	}
+	m_profileCaptureKeyDown = captureKeyDown;
+#endif // PROFILE_ENABLED
 }
 
 int Game::run()
+{
+	PROFILE_THREAD_NAME("Main");
+
+	if (m_renderThreadEnabled) {
+		startRenderThread();
+	}
+
+	int result = m_headless ? runHeadless() : runWindowed();
+
+	stopRenderThread();
+
+	if (m_headless) {
+		reportHeadlessTimings();
+	}
+
+	return result;
+}
+
+int Game::runWindowed()
 {
 	m_lastFrame = glfwGetTime();
 	while (!glfwWindowShouldClose(m_window)) {
+		PROFILE_FRAME();
+		PROFILE_SCOPE("Frame");
+
 		double currentFrame = glfwGetTime();
 		m_deltaTime = currentFrame - m_lastFrame;
 		m_lastFrame = currentFrame;
@@ -173,16 +318,225 @@ int Game::run()
 
 		m_scene.update(deltaTimeMillis);
 
-		m_renderer->renderScene(m_scene);
+		submitFrame();
 
+		PROFILE_SCOPE("glfwPollEvents");
 		glfwPollEvents();
 	}
 
-	glfwTerminate();
+	return 1;
+}
+
+int Game::runHeadless()
+{
+	std::vector<double>& frameTimes = m_headlessFrameTimes;
+	frameTimes.reserve(m_headlessFrames);
+
+	auto runStart = std::chrono::steady_clock::now();
+
+	// Every frame advances the scene by the same amount of time, so runs are comparable with each other
+	for (int frame = 0; frame < m_headlessWarmupFrames + m_headlessFrames; ++frame) {
+		PROFILE_FRAME();
+		PROFILE_SCOPE("Frame");
+
+		if (frame == m_headlessWarmupFrames) {
+			runStart = std::chrono::steady_clock::now();
+		}
+
+		auto frameStart = std::chrono::steady_clock::now();
+
+		m_scene.update(m_headlessDeltaTime);
+
+		submitFrame();
+
+		if (frame >= m_headlessWarmupFrames) {
+			std::chrono::duration<double, std::milli> frameTime = std::chrono::steady_clock::now() - frameStart;
+			frameTimes.push_back(frameTime.count());
+		}
+	}
+
+	// Let the render thread finish the last frame before stopping the clock
+	stopRenderThread();
+
+	std::chrono::duration<double, std::milli> totalTime = std::chrono::steady_clock::now() - runStart;
+	m_headlessTotalTime = totalTime.count();
 
 	return 1;
 }
 
+void Game::submitFrame()
+{
+	PROFILE_FUNCTION();
+
+	RenderState& state = m_renderStates[m_writeState];
+	state.capture(m_scene, m_screenWidth, m_screenHeight);
+
+	if (!m_renderThread.joinable()) {
+		m_renderer->renderScene(state);
+		return;
+	}
+
+	// Hand the snapshot over once the render thread is done with the previous one, the snapshot it was
+	// drawing becomes the one the next frame is captured into
+	{
+		PROFILE_SCOPE("Wait for render thread");
+		std::unique_lock<std::mutex> lock(m_renderMutex);
+		m_renderCondition.wait(lock, [this]() { return !m_renderStateReady; });
+		m_readState = m_writeState;
+		m_renderStateReady = true;
+	}
+	m_renderCondition.notify_all();
+
+	m_writeState = 1 - m_writeState;
+}
+
+void Game::startRenderThread()
+{
+	if (m_renderThread.joinable()) {
+		return;
+	}
+
+	// The context can only be current on one thread at a time
+	releaseContext();
+
+	m_stopRenderThread = false;
+	m_renderThread = std::thread(&Game::renderThreadMain, this);
+}
+
+void Game::stopRenderThread()
+{
+	if (!m_renderThread.joinable()) {
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(m_renderMutex);
+		m_stopRenderThread = true;
+	}
+	m_renderCondition.notify_all();
+	m_renderThread.join();
+
+	makeContextCurrent();
+}
+
+void Game::renderThreadMain()
+{
+	PROFILE_THREAD_NAME("Render");
+
+	makeContextCurrent();
+
+	while (true) {
+		int index;
+		{
+			std::unique_lock<std::mutex> lock(m_renderMutex);
+			m_renderCondition.wait(lock, [this]() { return m_renderStateReady || m_stopRenderThread; });
+			if (!m_renderStateReady) {
+				break;
+			}
+			index = m_readState;
+		}
+
+		m_renderer->renderScene(m_renderStates[index]);
+
+		{
+			std::lock_guard<std::mutex> lock(m_renderMutex);
+			m_renderStateReady = false;
+		}
+		m_renderCondition.notify_all();
+	}
+
+	releaseContext();
+}
+
+void Game::makeContextCurrent()
+{
+	if (m_headless) {
+		m_headlessContext->makeCurrent();
+	}
+	else {
+		glfwMakeContextCurrent(m_window);
+	}
+}
+
+void Game::releaseContext()
+{
+	if (m_headless) {
+		m_headlessContext->releaseCurrent();
+	}
+	else {
+		glfwMakeContextCurrent(nullptr);
+	}
+}
+
+void Game::reportHeadlessTimings()
+{
+	std::vector<double>& frameTimes = m_headlessFrameTimes;
+	double totalTime = m_headlessTotalTime;
+
+	if (frameTimes.empty()) {
+		return;
+	}
+
+	std::vector<double> sorted = frameTimes;
+	std::sort(sorted.begin(), sorted.end());
+
+	auto percentile = [&sorted](double p) { return sorted[std::min((size_t)(p * sorted.size()), sorted.size() - 1)]; };
+
+	double average = totalTime / frameTimes.size();
+
+	char line[256];
+	snprintf(line, sizeof(line), "Headless run: %zu frames in %.1f ms, avg %.3f ms (%.1f fps), min %.3f, p50 %.3f, p95 %.3f, p99 %.3f, max %.3f ms",
+		frameTimes.size(), totalTime, average, 1000.0 / average, sorted.front(), percentile(0.5), percentile(0.95), percentile(0.99), sorted.back());
+
+	// The report is the whole point of a headless run, so it's printed regardless of the log level
+	DebugLogger::log(line);
+	DebugLogger::log(m_renderer->gpuProfiler().report());
+
+	auto cacheStats = m_renderer->programCache().stats();
+	snprintf(line, sizeof(line), "Shader programs created in %.1f ms, program binary cache %s, %u hits, %u misses, %u rejected",
+		m_renderer->programCreationMs(), m_renderer->programCache().enabled() ? "enabled" : "disabled", cacheStats.hits, cacheStats.misses, cacheStats.rejected);
+	DebugLogger::log(line);
+
+	if (m_headlessReportFile.empty()) {
+		return;
+	}
+
+	std::ofstream out(m_headlessReportFile);
+	if (!out) {
+		LOG_DEBUG("Game::reportHeadlessTimings: could not open " + m_headlessReportFile);
+		return;
+	}
+
+	snprintf(line, sizeof(line), "{\n\t\"frames\": %zu,\n\t\"width\": %d,\n\t\"height\": %d,\n\t\"totalMs\": %.3f,\n", frameTimes.size(), m_screenWidth, m_screenHeight, totalTime);
+	out << line;
+	snprintf(line, sizeof(line), "\t\"cpuFrameMs\": { \"average\": %.3f, \"min\": %.3f, \"p50\": %.3f, \"p95\": %.3f, \"p99\": %.3f, \"max\": %.3f },\n",
+		average, sorted.front(), percentile(0.5), percentile(0.95), percentile(0.99), sorted.back());
+	out << line;
+	snprintf(line, sizeof(line), "\t\"programCreationMs\": %.3f,\n\t\"programBinaryCache\": { \"enabled\": %s, \"hits\": %u, \"misses\": %u, \"rejected\": %u },\n",
+		m_renderer->programCreationMs(), m_renderer->programCache().enabled() ? "true" : "false", cacheStats.hits, cacheStats.misses, cacheStats.rejected);
+	out << line;
+
+	out << "\t\"gpuZones\": [";
+	auto gpuStats = m_renderer->gpuProfiler().zoneStats();
+	for (auto it = gpuStats.begin(); it != gpuStats.end(); ++it) {
+		snprintf(line, sizeof(line), "%s\n\t\t{ \"name\": \"%s\", \"depth\": %d, \"average\": %.3f, \"p50\": %.3f, \"p95\": %.3f, \"p99\": %.3f, \"max\": %.3f }",
+			it == gpuStats.begin() ? "" : ",", it->name.c_str(), it->depth, it->averageMs, it->p50Ms, it->p95Ms, it->p99Ms, it->maxMs);
+		out << line;
+	}
+	out << "\n\t]\n}\n";
+}
+
+bool Game::initHeadless()
+{
+	m_headlessContext = new HeadlessContext;
+	if (!m_headlessContext->init()) {
+		LOG_DEBUG("Game::initHeadless: could not create headless OpenGL context");
+		return false;
+	}
+
+	return true;
+}
+
 int Game::initWindow()
 {
 	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
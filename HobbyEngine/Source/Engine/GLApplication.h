@@ -1,13 +1,20 @@
 #ifndef GL_APPLICATION_H
 #define GL_APPLICATION_H
 
+#include <condition_variable>
 #include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
 
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
 
 #include "../GameObjects/GameObject.h"
+#include "HeadlessContext.h"
 #include "InputSystem.h"
+#include "JobSystem.h"
 #include "../ResourceCache/ResourceCache.h"
 #include "../Renderer/Renderer.h"
 #include "Scene.h"
@@ -19,38 +26,83 @@ public:
 	static Game& instance() { return gameInstance; }
 	~Game();
 
-	bool init();
+	// Command line options override the game config: --headless, --frames <n>, --report <file>
+	bool init(int argc = 0, char** argv = nullptr);
 	int run();
 
+	bool headless() { return m_headless; }
+
 	ResCache& resourceCache() { return *m_resCache; }
 	GOFactory& goFactory() { return *m_goFactory; }
 	InputSystem& inputSystem() { return *m_inputSystem; }
 	UIElementFactory& uiElementFactory() { return *m_uiElementFactory; }
+	Renderer& renderer() { return *m_renderer; }
+	JobSystem& jobSystem() { return *m_jobSystem; }
 
 	void updateResolution(int width, int height);
 
-	void swapBuffers() { glfwSwapBuffers(m_window); }
+	void swapBuffers();
 
 private:
 	Game();
 	int initWindow();
+	bool initHeadless();
 	void processInput();
+	int runWindowed();
+	int runHeadless();
+	void reportHeadlessTimings();
+
+	// Captures the scene into a render state and renders it, either right away or on the render thread
+	void submitFrame();
+
+	void startRenderThread();
+	void stopRenderThread();
+	void renderThreadMain();
+	void makeContextCurrent();
+	void releaseContext();
 
 	static Game gameInstance;
 
 	ResCache* m_resCache;
 	GOFactory* m_goFactory;
 	InputSystem* m_inputSystem;
-	UIElementFactory* m_uiElementFactory;
+	UIElementFactory* m_uiElementFactory = nullptr;
 
 	Renderer* m_renderer;
+	JobSystem* m_jobSystem;
 
 	double m_deltaTime;
 	double m_lastFrame;
 
 	Scene m_scene;
 
-	GLFWwindow* m_window;
+	GLFWwindow* m_window = nullptr;
+
+	bool m_headless = false;
+	HeadlessContext* m_headlessContext = nullptr;
+	int m_headlessFrames = 600;
+	int m_headlessWarmupFrames = 10;
+	int m_headlessDeltaTime = 16;
+	std::string m_headlessReportFile;
+	std::vector<double> m_headlessFrameTimes;
+	double m_headlessTotalTime = 0.0;
+
+	// The main thread captures the next frame into one render state while the render thread draws the other
+	RenderState m_renderStates[2];
+	int m_writeState = 0;
+	int m_readState = 0;
+	bool m_renderThreadEnabled = false;
+	std::thread m_renderThread;
+	std::mutex m_renderMutex;
+	std::condition_variable m_renderCondition;
+	bool m_renderStateReady = false;
+	bool m_stopRenderThread = false;
+
+	int m_profileCaptureFrames = 300;
+	std::string m_profileCaptureFile = "profile_capture.json";
+#ifdef PROFILE_ENABLED
+	bool m_profileCaptureKeyDown = false;
+#endif // PROFILE_ENABLED
 
 	int m_screenWidth;
 	int m_screenHeight;
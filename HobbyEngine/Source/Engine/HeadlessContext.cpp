@@ -0,0 +1,181 @@
+#include "HeadlessContext.h"
+
+#include <cstring>
+#include <string>
+
+#ifdef HEADLESS_EGL
+#include <EGL/eglext.h>
+#endif // HEADLESS_EGL
+
+#include "../Renderer/GLExtensions.h"
+#include "../Utils/DebugLogger.h"
+
+#ifdef HEADLESS_EGL
+
+static void* getProcAddress(const char* name)
+{
+	return (void*)eglGetProcAddress(name);
+}
+
+HeadlessContext::~HeadlessContext()
+{
+	if (m_display != EGL_NO_DISPLAY) {
+		eglMakeCurrent(m_display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+		if (m_context != EGL_NO_CONTEXT) {
+			eglDestroyContext(m_display, m_context);
+		}
+		if (m_surface != EGL_NO_SURFACE) {
+			eglDestroySurface(m_display, m_surface);
+		}
+		eglTerminate(m_display);
+	}
+}
+
+bool HeadlessContext::init()
+{
+	// Prefer the surfaceless platform, it doesn't need an X or Wayland server
+	const char* clientExtensions = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+	auto getPlatformDisplay = (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+	if (getPlatformDisplay && clientExtensions && strstr(clientExtensions, "EGL_MESA_platform_surfaceless")) {
+		m_display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+	}
+	if (m_display == EGL_NO_DISPLAY) {
+		m_display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+	}
+
+	EGLint major, minor;
+	if (m_display == EGL_NO_DISPLAY || !eglInitialize(m_display, &major, &minor)) {
+		LOG_DEBUG("HeadlessContext::init: could not initialize EGL display");
+		return false;
+	}
+
+	if (!eglBindAPI(EGL_OPENGL_API)) {
+		LOG_DEBUG("HeadlessContext::init: could not bind the OpenGL API");
+		return false;
+	}
+
+	// Without surfaceless contexts the context is made current with a pbuffer, which the config has to support
+	const char* extensions = eglQueryString(m_display, EGL_EXTENSIONS);
+	bool surfaceless = extensions && strstr(extensions, "EGL_KHR_surfaceless_context");
+	EGLint configAttribs[] = {
+		EGL_SURFACE_TYPE, surfaceless ? 0 : EGL_PBUFFER_BIT,
+		EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+		EGL_NONE
+	};
+	EGLConfig config;
+	EGLint nConfigs;
+	if (!eglChooseConfig(m_display, configAttribs, &config, 1, &nConfigs) || nConfigs == 0) {
+		LOG_DEBUG("HeadlessContext::init: could not find an EGL config");
+		return false;
+	}
+
+	if (!surfaceless) {
+		EGLint surfaceAttribs[] = {
+			EGL_WIDTH, 1,
+			EGL_HEIGHT, 1,
+			EGL_NONE
+		};
+		m_surface = eglCreatePbufferSurface(m_display, config, surfaceAttribs);
+		if (m_surface == EGL_NO_SURFACE) {
+			LOG_DEBUG("HeadlessContext::init: could not create a pbuffer surface");
+			return false;
+		}
+	}
+
+	EGLint contextAttribs[] = {
+		EGL_CONTEXT_MAJOR_VERSION, 3,
+		EGL_CONTEXT_MINOR_VERSION, 3,
+		EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+		EGL_NONE
+	};
+	m_context = eglCreateContext(m_display, config, EGL_NO_CONTEXT, contextAttribs);
+	if (m_context == EGL_NO_CONTEXT) {
+		LOG_DEBUG("HeadlessContext::init: could not create an OpenGL 3.3 core context");
+		return false;
+	}
+
+	if (!makeCurrent()) {
+		LOG_DEBUG("HeadlessContext::init: could not make the context current");
+		return false;
+	}
+
+	if (!gladLoadGLLoader((GLADloadproc)getProcAddress)) {
+		LOG_DEBUG("HeadlessContext::init: failed to initialize GLAD");
+		return false;
+	}
+	GLExtensions::init((GLADloadproc)getProcAddress);
+
+	LOG_DEBUG("HeadlessContext::init: EGL " + std::to_string(major) + "." + std::to_string(minor) + (surfaceless ? " surfaceless" : " pbuffer")
+		+ ", renderer " + std::string((const char*)glGetString(GL_RENDERER)));
+
+	return true;
+}
+
+bool HeadlessContext::makeCurrent()
+{
+	return eglMakeCurrent(m_display, m_surface, m_surface, m_context) == EGL_TRUE;
+}
+
+void HeadlessContext::releaseCurrent()
+{
+	eglMakeCurrent(m_display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+}
+
+#else
+
+HeadlessContext::~HeadlessContext()
+{
+	if (m_window != nullptr) {
+		glfwDestroyWindow(m_window);
+		m_window = nullptr;
+		glfwTerminate();
+	}
+}
+
+bool HeadlessContext::init()
+{
+	if (glfwInit() == GLFW_FALSE) {
+		LOG_DEBUG("HeadlessContext::init: could not initialize GLFW");
+		return false;
+	}
+
+	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+	glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+
+	m_window = glfwCreateWindow(1, 1, "HobbyEngine", nullptr, nullptr);
+	if (m_window == nullptr) {
+		LOG_DEBUG("HeadlessContext::init: could not create a hidden window");
+		glfwTerminate();
+		return false;
+	}
+
+	glfwMakeContextCurrent(m_window);
+
+	if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress)) {
+		LOG_DEBUG("HeadlessContext::init: failed to initialize GLAD");
+		return false;
+	}
+	GLExtensions::init((GLADloadproc)glfwGetProcAddress);
+
+	return true;
+}
+
+bool HeadlessContext::makeCurrent()
+{
+	glfwMakeContextCurrent(m_window);
+	return true;
+}
+
+void HeadlessContext::releaseCurrent()
+{
+	glfwMakeContextCurrent(nullptr);
+}
+
+#endif // HEADLESS_EGL
+
+void HeadlessContext::swapBuffers()
+{
+	glFinish();
+}
@@ -0,0 +1,50 @@
+#ifndef HEADLESS_CONTEXT_H
+#define HEADLESS_CONTEXT_H
+
+#include <glad/glad.h>
+
+// EGL is the default on Linux, where build and benchmark machines often have no display. Defining HEADLESS_GLFW
+// falls back to the hidden window there too, and HEADLESS_EGL enables EGL on other platforms that have it.
+#if defined(__linux__) && !defined(HEADLESS_GLFW) && !defined(HEADLESS_EGL)
+#define HEADLESS_EGL
+#endif
+
+#ifdef HEADLESS_EGL
+#include <EGL/egl.h>
+#else
+#include <GLFW/glfw3.h>
+#endif // HEADLESS_EGL
+
+// OpenGL context without a visible window. With EGL the context needs no display server: it is created on the
+// surfaceless platform when Mesa has it (which also covers llvmpipe on machines without a GPU), or with a 1x1
+// pbuffer on drivers without surfaceless contexts. Elsewhere a hidden GLFW window is used, which still needs a
+// display. Nothing is ever presented, so the renderer draws into its own framebuffer object either way.
+class HeadlessContext
+{
+public:
+	HeadlessContext() = default;
+	~HeadlessContext();
+
+	// Creates the context, makes it current and loads the GL functions
+	bool init();
+
+	// Moves the context between threads, it has to be released on one thread before it is made current on another
+	bool makeCurrent();
+	void releaseCurrent();
+
+	// Headless frames are never presented, finishing the frame keeps the frame timings honest
+	void swapBuffers();
+
+private:
+#ifdef HEADLESS_EGL
+	EGLDisplay m_display = EGL_NO_DISPLAY;
+	EGLContext m_context = EGL_NO_CONTEXT;
+
+	// Only created when the driver has no surfaceless contexts
+	EGLSurface m_surface = EGL_NO_SURFACE;
+#else
+	GLFWwindow* m_window = nullptr;
+#endif // HEADLESS_EGL
+};
+
+#endif // !HEADLESS_CONTEXT_H
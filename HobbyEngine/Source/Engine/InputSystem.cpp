@@ -7,10 +7,21 @@ void InputSystem::init(GLFWwindow* window)
 
 bool InputSystem::isPressed(int key)
 {
+	// There is no window when running headless
+	if (m_window == nullptr) {
+		return false;
+	}
+
 	return glfwGetKey(m_window, key) == GLFW_PRESS;
 }
 
 void InputSystem::getMousePos(double& xpos, double& ypos)
 {
+	if (m_window == nullptr) {
+		xpos = 0.0;
+		ypos = 0.0;
+		return;
+	}
+
 	glfwGetCursorPos(m_window, &xpos, &ypos);
 }
@@ -0,0 +1,121 @@
+#include "JobSystem.h"
+
+#include <algorithm>
+#include <string>
+
+#include "../Utils/DebugLogger.h"
+#include "../Utils/Profiler.h"
+
+JobSystem::~JobSystem()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stop = true;
+	}
+	m_wakeCondition.notify_all();
+
+	for (auto it = m_workers.begin(); it != m_workers.end(); ++it) {
+		it->join();
+	}
+}
+
+bool JobSystem::init(int nWorkers)
+{
+	if (nWorkers <= 0) {
+		nWorkers = std::max((int)std::thread::hardware_concurrency() - 1, 0);
+	}
+
+	for (int i = 0; i < nWorkers; ++i) {
+		m_workers.push_back(std::thread(&JobSystem::workerMain, this, i));
+	}
+
+	LOG_DEBUG("JobSystem::init: started " + std::to_string(nWorkers) + " worker threads");
+
+	return true;
+}
+
+void JobSystem::parallelFor(size_t count, size_t minRange, const RangeJob& job)
+{
+	if (count == 0) {
+		return;
+	}
+
+	minRange = std::max(minRange, (size_t)1);
+	size_t nRanges = std::min((size_t)nThreads(), (count + minRange - 1) / minRange);
+
+	if (nRanges <= 1) {
+		job(0, count, nThreads() - 1);
+		return;
+	}
+
+	std::lock_guard<std::mutex> submitLock(m_submitMutex);
+
+	{
+		// Workers that woke up late for the previous job may still be leaving it
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_doneCondition.wait(lock, [this]() { return m_activeWorkers == 0; });
+
+		m_job = &job;
+		m_count = count;
+		m_nRanges = nRanges;
+		m_rangeSize = (count + nRanges - 1) / nRanges;
+		m_nextRange.store(0);
+		m_pendingRanges.store(nRanges);
+		++m_generation;
+	}
+	m_wakeCondition.notify_all();
+
+	runRanges(nThreads() - 1);
+
+	std::unique_lock<std::mutex> lock(m_mutex);
+	m_doneCondition.wait(lock, [this]() { return m_pendingRanges.load() == 0; });
+	m_job = nullptr;
+}
+
+void JobSystem::runRanges(int threadIndex)
+{
+	while (true) {
+		size_t range = m_nextRange.fetch_add(1);
+		if (range >= m_nRanges) {
+			return;
+		}
+
+		size_t begin = range * m_rangeSize;
+		size_t end = std::min(begin + m_rangeSize, m_count);
+		if (begin < end) {
+			(*m_job)(begin, end, threadIndex);
+		}
+
+		if (m_pendingRanges.fetch_sub(1) == 1) {
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_doneCondition.notify_all();
+		}
+	}
+}
+
+void JobSystem::workerMain(int threadIndex)
+{
+	PROFILE_THREAD_NAME("Worker " + std::to_string(threadIndex));
+
+	uint64_t generation = 0;
+
+	while (true) {
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_wakeCondition.wait(lock, [this, generation]() { return m_stop || m_generation != generation; });
+			if (m_stop) {
+				return;
+			}
+			generation = m_generation;
+			++m_activeWorkers;
+		}
+
+		runRanges(threadIndex);
+
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			--m_activeWorkers;
+		}
+		m_doneCondition.notify_all();
+	}
+}
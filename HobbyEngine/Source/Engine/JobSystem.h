@@ -0,0 +1,56 @@
+#ifndef JOB_SYSTEM_H
+#define JOB_SYSTEM_H
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Pool of worker threads for data parallel work. parallelFor splits an index range into contiguous ranges,
+// which the workers and the calling thread pick up until all of them are done. Each call gets a thread index
+// in [0, nThreads()), so jobs can write into per thread arrays without synchronization. The calling thread
+// always has the last index.
+class JobSystem
+{
+public:
+	typedef std::function<void(size_t begin, size_t end, int threadIndex)> RangeJob;
+
+	JobSystem() = default;
+	~JobSystem();
+
+	// Zero workers uses one less than the number of hardware threads
+	bool init(int nWorkers);
+
+	int nThreads() const { return m_workers.size() + 1; }
+
+	// Blocks until the job has been run for the whole range [0, count). Ranges are at least minRange long,
+	// so small counts run on the calling thread only.
+	void parallelFor(size_t count, size_t minRange, const RangeJob& job);
+
+private:
+	void workerMain(int threadIndex);
+	void runRanges(int threadIndex);
+
+	std::vector<std::thread> m_workers;
+
+	// Only one parallelFor runs at a time
+	std::mutex m_submitMutex;
+
+	std::mutex m_mutex;
+	std::condition_variable m_wakeCondition;
+	std::condition_variable m_doneCondition;
+	bool m_stop = false;
+	uint64_t m_generation = 0;
+	int m_activeWorkers = 0;
+
+	const RangeJob* m_job = nullptr;
+	size_t m_count = 0;
+	size_t m_rangeSize = 0;
+	size_t m_nRanges = 0;
+	std::atomic<size_t> m_nextRange{ 0 };
+	std::atomic<size_t> m_pendingRanges{ 0 };
+};
+
+#endif // !JOB_SYSTEM_H
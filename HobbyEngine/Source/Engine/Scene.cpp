@@ -7,8 +7,14 @@
 #include "GLApplication.h"
 #include "../ResourceCache/ResourceCache.h"
 #include "../Utils/DebugLogger.h"
+#include "../Utils/Profiler.h"
 #include "../Utils/XMLUtils.h"
 
+namespace
+{
+	uint64_t lastStaticVersion = 0;
+}
+
 Scene::~Scene()
 {
 	m_gameObjects.clear();
@@ -16,6 +22,8 @@ Scene::~Scene()
 
 bool Scene::init(tinyxml2::XMLElement* data, GLFWwindow* window)
 {
+	PROFILE_FUNCTION();
+
 	auto cameraElement = data->FirstChildElement("Camera");
 
 	if (!cameraElement) {
@@ -74,6 +82,10 @@ bool Scene::init(tinyxml2::XMLElement* data, GLFWwindow* window)
 		m_gameObjects.push_back(gameObject);
 	}
 
+	// Merge static game objects sharing a material into batches, so they don't cost a draw call each
+	m_staticBatches = StaticBatch::buildBatches(m_gameObjects);
+	m_staticVersion = ++lastStaticVersion;
+
 	auto uiElementFactory = Game::instance().uiElementFactory();
 
 	auto uiElements = data->FirstChildElement("UIElements");
@@ -86,6 +98,12 @@ bool Scene::init(tinyxml2::XMLElement* data, GLFWwindow* window)
 		}
 	}
 
+	auto renderingElement = data->FirstChildElement("Rendering");
+	if (renderingElement) {
+		auto depthPrepass = renderingElement->Attribute("depthPrepass");
+		m_depthPrepass = depthPrepass && std::string(depthPrepass) == std::string("true");
+	}
+
 	auto lightingElement = data->FirstChildElement("Lighting");
 
 	if (lightingElement) {
@@ -128,8 +146,24 @@ bool Scene::init(tinyxml2::XMLElement* data, GLFWwindow* window)
 	return true;
 }
 
+void Scene::destroy()
+{
+	m_staticBatches.clear();
+	m_staticVersion = ++lastStaticVersion;
+
+	for (auto it = m_gameObjects.begin(); it != m_gameObjects.end(); ++it) {
+		(*it)->destroy();
+	}
+	m_gameObjects.clear();
+
+	m_uiElements.clear();
+	m_skybox.reset();
+}
+
 bool Scene::update(int deltaTime)
 {
+	PROFILE_FUNCTION();
+
 	m_camera.update(deltaTime);
 
 	for (auto it = m_gameObjects.begin(); it != m_gameObjects.end(); ++it) {
@@ -137,18 +171,9 @@ bool Scene::update(int deltaTime)
 	}
 	
 	for (auto it = m_uiElements.begin(); it != m_uiElements.end(); ++it) {
+		PROFILE_SCOPE("UIElement::update");
 		(*it)->update(deltaTime);
 	}
 
 	return true;
 }
-
-glm::mat4 Scene::lightSpaceMatrix()
-{
-	glm::vec3 cameraPosition = glm::vec3(m_camera.position.x, 0.0f, m_camera.position.z);
-	glm::mat4 view = glm::lookAt(cameraPosition + m_lighting.direction * -1.0f, cameraPosition, glm::vec3(0.0f, 1.0f, 0.0f));
-
-	glm::mat4 projection = glm::ortho(-15.0f, 15.0f, -15.0f, 15.0f, -10.0f, 20.0f);
-
-	return projection * view;
-}
@@ -10,6 +10,7 @@
 #include "../GameObjects/GameObject.h"
 #include "../Renderer/Camera.h"
 #include "../Renderer/Skybox.h"
+#include "../Renderer/StaticBatch.h"
 #include "../UI/UIElement.h"
 
 struct SceneLighting {
@@ -29,22 +30,33 @@ public:
 
 	bool update(int deltaTime);
 
+	// Releases the scene's game objects and GL resources, must be called while the renderer is still alive
+	void destroy();
+
 	std::vector<std::shared_ptr<GameObject>>& gameObjects() { return m_gameObjects; }
 	std::vector<std::shared_ptr<UIElement>>& uiElements() { return m_uiElements; }
+	std::vector<std::shared_ptr<StaticBatch>>& staticBatches() { return m_staticBatches; }
+
+	// Changes whenever the static batches are built or released, the renderer caches their shadows until it does
+	uint64_t staticVersion() const { return m_staticVersion; }
 
 	Camera& camera() { return m_camera; }
 	SceneLighting& lighting() { return m_lighting; }
 	std::shared_ptr<Skybox> skybox() { return m_skybox; }
 
-	glm::mat4 lightSpaceMatrix();
+	// Scenes with a lot of overdraw can lay down depth in a pre-pass, so the lighting is computed once per pixel
+	bool depthPrepass() const { return m_depthPrepass; }
 
 private:
 	std::vector<std::shared_ptr<GameObject>> m_gameObjects;
 	std::vector<std::shared_ptr<UIElement>> m_uiElements;
+	std::vector<std::shared_ptr<StaticBatch>> m_staticBatches;
+	uint64_t m_staticVersion = 0;
 
 	Camera m_camera;
 	SceneLighting m_lighting;
 	std::shared_ptr<Skybox> m_skybox;
+	bool m_depthPrepass = false;
 };
 
 #endif // !SCENE_H
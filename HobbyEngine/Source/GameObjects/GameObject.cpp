@@ -1,10 +1,12 @@
 #include "GameObject.h"
 
+#include "LightComponent.h"
 #include "LuaComponent.h"
 #include "ParticleSystemComponent.h"
 #include "RenderComponent.h"
 #include "TransformComponent.h"
 #include "../Utils/DebugLogger.h"
+#include "../Utils/Profiler.h"
 
 GameObject::~GameObject()
 {
@@ -12,6 +14,11 @@ GameObject::~GameObject()
 
 int GameObject::init(tinyxml2::XMLElement* data)
 {
+	auto staticAttrib = data->Attribute("static");
+	if (staticAttrib && std::string(staticAttrib) == std::string("true")) {
+		m_isStatic = true;
+	}
+
 	return 1;
 }
 
@@ -31,6 +38,7 @@ void GameObject::destroy()
 void GameObject::update(int deltaTime)
 {
 	for (auto it = m_components.begin(); it != m_components.end(); ++it) {
+		PROFILE_SCOPE(it->first);
 		it->second->update(deltaTime);
 	}
 }
@@ -46,6 +54,7 @@ GOFactory::GOFactory()
 	m_GOComponentCreators["LuaComponent"] = createLuaComponent; 
 	m_GOComponentCreators["RenderComponent"] = createRenderComponent;
 	m_GOComponentCreators["ParticleSystemComponent"] = createParticleSystemComponent;
+	m_GOComponentCreators["LightComponent"] = createLightComponent;
 }
 
 GOFactory::~GOFactory()
@@ -34,6 +34,9 @@ public:
 
 	uint64_t getId() const { return m_id; }
 
+	// Static game objects never move after the scene has been loaded, which allows the renderer to batch them
+	bool isStatic() const { return m_isStatic; }
+
 	template <class T>
 	std::weak_ptr<T> findComponent(ComponentId id)
 	{
@@ -53,6 +56,7 @@ private:
 	void addComponent(std::shared_ptr<IGOComponent> component);
 
 	uint64_t m_id;
+	bool m_isStatic = false;
 	GOComponentsMap m_components;
 };
 
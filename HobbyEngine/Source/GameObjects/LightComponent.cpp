@@ -0,0 +1,65 @@
+#include "LightComponent.h"
+
+#include <algorithm>
+#include <string>
+
+#include "../Utils/DebugLogger.h"
+#include "../Utils/XMLUtils.h"
+
+bool LightComponent::init(tinyxml2::XMLElement* data)
+{
+	auto lightElem = data->FirstChildElement("Light");
+	if (!lightElem) {
+		LOG_DEBUG("LightComponent::init: could not find Light element");
+		return false;
+	}
+
+	auto typeAttrib = lightElem->Attribute("type");
+	if (typeAttrib && std::string(typeAttrib) == std::string("spot")) {
+		type = LightType::Spot;
+	}
+	else if (typeAttrib && std::string(typeAttrib) != std::string("point")) {
+		LOG_DEBUG("LightComponent::init: unknown light type " + std::string(typeAttrib));
+		return false;
+	}
+
+	if (!XMLUtils::xmlAttribToFloat(lightElem, "range", range) || range <= 0.0f) {
+		LOG_DEBUG("LightComponent::init: light must have a positive range");
+		return false;
+	}
+	XMLUtils::xmlAttribToFloat(lightElem, "intensity", intensity);
+
+	auto colorElem = data->FirstChildElement("Color");
+	if (colorElem) {
+		if (!XMLUtils::xmlAttribToFloat(colorElem, "r", color.r) || !XMLUtils::xmlAttribToFloat(colorElem, "g", color.g) ||
+			!XMLUtils::xmlAttribToFloat(colorElem, "b", color.b)) {
+			return false;
+		}
+	}
+
+	if (type == LightType::Spot) {
+		auto directionElem = data->FirstChildElement("Direction");
+		if (directionElem) {
+			float x, y, z;
+			if (!XMLUtils::xmlXYZAttribsToFloat(directionElem, x, y, z)) {
+				return false;
+			}
+			direction = glm::normalize(glm::vec3(x, y, z));
+		}
+
+		auto coneElem = data->FirstChildElement("Cone");
+		if (coneElem) {
+			XMLUtils::xmlAttribToFloat(coneElem, "inner", innerAngle);
+			XMLUtils::xmlAttribToFloat(coneElem, "outer", outerAngle);
+		}
+		outerAngle = std::min(outerAngle, 89.0f);
+		innerAngle = std::min(innerAngle, outerAngle);
+	}
+
+	return true;
+}
+
+IGOComponent* createLightComponent()
+{
+	return new LightComponent;
+}
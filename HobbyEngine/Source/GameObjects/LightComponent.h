@@ -0,0 +1,40 @@
+#ifndef LIGHT_COMPONENT_H
+#define LIGHT_COMPONENT_H
+
+#include <glm/glm.hpp>
+#include <tinyxml2/tinyxml2.h>
+
+#include "GameObject.h"
+
+// Point or spot light at the position of the game object's transform. Spot lights point along their direction
+// rotated by the transform. Lights don't affect anything beyond their range, which keeps them in as few
+// light clusters as possible.
+class LightComponent : public IGOComponent
+{
+public:
+	enum class LightType
+	{
+		Point,
+		Spot
+	};
+
+	virtual bool init(tinyxml2::XMLElement* data);
+	virtual ComponentId componentId() const { return COMPONENT_ID; }
+
+	LightType type = LightType::Point;
+	glm::vec3 color = glm::vec3(1.0f, 1.0f, 1.0f);
+	float intensity = 1.0f;
+	float range = 5.0f;
+
+	glm::vec3 direction = glm::vec3(0.0f, -1.0f, 0.0f);
+
+	// Cone angles of spot lights in degrees, the light fades out between the inner and outer angle
+	float innerAngle = 20.0f;
+	float outerAngle = 30.0f;
+private:
+	const ComponentId COMPONENT_ID = "LightComponent";
+};
+
+IGOComponent* createLightComponent();
+
+#endif // !LIGHT_COMPONENT_H
@@ -3,6 +3,7 @@
 #include <glm/glm.hpp>
 
 #include "../Engine/GLApplication.h"
+#include "../ResourceCache/LuaLoader.h"
 #include "../ResourceCache/ResourceCache.h"
 #include "ParticleSystemComponent.h"
 #include "TransformComponent.h"
@@ -34,8 +35,7 @@ bool LuaComponent::init(tinyxml2::XMLElement* data)
 
 	initLuaState();
 
-	const char* scriptText = scriptHandle->buffer;
-	auto res = m_state.script(scriptText);
+	auto res = m_state.script(LuaLoader::chunk(*scriptHandle));
 
 	m_luaUpdate = m_state["update"];
 
@@ -5,7 +5,7 @@
 #include <string>
 
 #include "../Engine/GLApplication.h"
-#include "../ResourceCache/ImageLoader.h"
+#include "../Renderer/TextureUtils.h"
 #include "../ResourceCache/ResourceCache.h"
 #include "TransformComponent.h"
 #include "../Utils/DebugLogger.h"
@@ -13,6 +13,8 @@
 
 ParticleSystemComponent::~ParticleSystemComponent()
 {
+	GLStateCache& glState = Game::instance().renderer().glState();
+
 	if (m_particles != nullptr) {
 		delete[] m_particles;
 		m_particles = nullptr;
@@ -28,15 +30,15 @@ ParticleSystemComponent::~ParticleSystemComponent()
 		m_colorBufferData = nullptr;
 	}
 
-	glDeleteTextures(1, &m_texture);
-	glDeleteBuffers(1, &m_VBO);
-	glDeleteBuffers(1, &m_positionSizeBuffer);
-	glDeleteBuffers(1, &m_colorBuffer);
-	glDeleteVertexArrays(1, &m_VAO);
+	glState.deleteTexture(m_texture);
+	glState.deleteBuffer(m_VBO);
+	glState.deleteVertexArray(m_VAO);
 }
 
 bool ParticleSystemComponent::init(tinyxml2::XMLElement* data)
 {
+	GLStateCache& glState = Game::instance().renderer().glState();
+
 	auto particleSystemElem = data->FirstChildElement("ParticleSystem");
 	if (!particleSystemElem) {
 		LOG_DEBUG("ParticleSystemComponent::init: could not find ParticleSystem element.");
@@ -205,17 +207,18 @@ bool ParticleSystemComponent::init(tinyxml2::XMLElement* data)
 		LOG_DEBUG("ParticleSystemComponent::init: could not get handle for texture resource.");
 		return false;
 	}
-	auto imageData = std::static_pointer_cast<ImageResProcessedData>(imageHandle->processedData);
-
 	glGenTextures(1, &m_texture);
-	glBindTexture(GL_TEXTURE_2D, m_texture);
+	glState.bindTexture(0, GL_TEXTURE_2D, m_texture);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, imageData->width(), imageData->height(), 0, GL_RGBA, GL_UNSIGNED_BYTE, imageHandle->buffer);
-	glGenerateMipmap(GL_TEXTURE_2D);
-	glBindTexture(GL_TEXTURE_2D, 0);
+	bool uploaded = TextureUtils::uploadTexture(GL_TEXTURE_2D, imageHandle, true);
+	glState.bindTexture(0, GL_TEXTURE_2D, 0);
+	if (!uploaded) {
+		LOG_DEBUG("ParticleSystemComponent::init: could not upload texture.");
+		return false;
+	}
 
 	glGenVertexArrays(1, &m_VAO);
 
@@ -229,17 +232,9 @@ bool ParticleSystemComponent::init(tinyxml2::XMLElement* data)
 	};
 
 	glGenBuffers(1, &m_VBO);
-	glBindBuffer(GL_ARRAY_BUFFER, m_VBO);
+	glState.bindBuffer(GL_ARRAY_BUFFER, m_VBO);
 	glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
 
-	glGenBuffers(1, &m_positionSizeBuffer);
-	glBindBuffer(GL_ARRAY_BUFFER, m_positionSizeBuffer);
-	glBufferData(GL_ARRAY_BUFFER, 4 * m_maxParticles * sizeof(float), NULL, GL_STREAM_DRAW);
-
-	glGenBuffers(1, &m_colorBuffer);
-	glBindBuffer(GL_ARRAY_BUFFER, m_colorBuffer);
-	glBufferData(GL_ARRAY_BUFFER, 4 * m_maxParticles * sizeof(float), NULL, GL_STREAM_DRAW);
-
 	return true;
 }
 
@@ -296,15 +291,17 @@ void ParticleSystemComponent::update(int deltaTime)
 			activeParticles++;
 			Particle& p = m_particles[i];
 
-			m_positionSizeBufferData[4 * i + 0] = p.position.x;
-			m_positionSizeBufferData[4 * i + 1] = p.position.y;
-			m_positionSizeBufferData[4 * i + 2] = p.position.z;
-			m_positionSizeBufferData[4 * i + 3] = p.size;
+			// Live particles are packed to the start of the buffers, they are the only ones uploaded
+			int j = m_gpuBufferSize;
+			m_positionSizeBufferData[4 * j + 0] = p.position.x;
+			m_positionSizeBufferData[4 * j + 1] = p.position.y;
+			m_positionSizeBufferData[4 * j + 2] = p.position.z;
+			m_positionSizeBufferData[4 * j + 3] = p.size;
 
-			m_colorBufferData[4 * i + 0] = p.color.r;
-			m_colorBufferData[4 * i + 1] = p.color.g;
-			m_colorBufferData[4 * i + 2] = p.color.b;
-			m_colorBufferData[4 * i + 3] = p.color.a;
+			m_colorBufferData[4 * j + 0] = p.color.r;
+			m_colorBufferData[4 * j + 1] = p.color.g;
+			m_colorBufferData[4 * j + 2] = p.color.b;
+			m_colorBufferData[4 * j + 3] = p.color.a;
 
 			m_gpuBufferSize++;
 		}
@@ -315,14 +312,6 @@ void ParticleSystemComponent::update(int deltaTime)
 		return;
 	}
 
-	glBindBuffer(GL_ARRAY_BUFFER, m_positionSizeBuffer);
-	glBufferData(GL_ARRAY_BUFFER, 4 * m_maxParticles * sizeof(float), NULL, GL_STREAM_DRAW);
-	glBufferSubData(GL_ARRAY_BUFFER, 0, 4 * m_gpuBufferSize * sizeof(float), m_positionSizeBufferData);
-
-	glBindBuffer(GL_ARRAY_BUFFER, m_colorBuffer);
-	glBufferData(GL_ARRAY_BUFFER, 4 * m_maxParticles * sizeof(float), NULL, GL_STREAM_DRAW);
-	glBufferSubData(GL_ARRAY_BUFFER, 0, 4 * m_gpuBufferSize * sizeof(float), m_colorBufferData);
-
 	if (m_hasLifetime) {
 		m_life -= deltaTime;
 		if (m_life <= 0) {
@@ -36,9 +36,11 @@ public:
 	uint32_t texture() { return m_texture; }
 	uint32_t vao() { return m_VAO; }
 	uint32_t vbo() { return m_VBO; }
-	uint32_t positionSizeBuffer() { return m_positionSizeBuffer; }
-	uint32_t colorBuffer() { return m_colorBuffer; }
 	uint32_t bufferSize() { return m_gpuBufferSize; }
+
+	// Position and size, and color of the live particles as vec4s, bufferSize() of each
+	const float* positionSizeData() { return m_positionSizeBufferData; }
+	const float* colorData() { return m_colorBufferData; }
 	int maxParticles() { return m_maxParticles; }
 
 	Particle* particles() { return m_particles; }
@@ -55,8 +57,6 @@ private:
 	uint32_t m_texture;
 	uint32_t m_VAO;
 	uint32_t m_VBO;
-	uint32_t m_positionSizeBuffer;
-	uint32_t m_colorBuffer;
 	float* m_positionSizeBufferData;
 	float* m_colorBufferData;
 	uint32_t m_gpuBufferSize;
@@ -1,14 +1,18 @@
 #include "RenderComponent.h"
 
+#include <algorithm>
+#include <map>
 #include <memory>
 
 #include "../Engine/GLApplication.h"
-#include "../ResourceCache/ImageLoader.h"
 #include "../ResourceCache/ModelLoader.h"
 #include "../Utils/DebugLogger.h"
+#include "../Utils/XMLUtils.h"
 
-bool RenderComponent::loadTexture(tinyxml2::XMLElement* elem, uint32_t& buffer)
+bool RenderComponent::loadTexture(tinyxml2::XMLElement* elem, uint32_t& buffer, std::string& file, const glm::vec4& fallback)
 {
+	Renderer& renderer = Game::instance().renderer();
+
 	auto texturePath = elem->Attribute("file");
 
 	if (!texturePath) {
@@ -16,43 +20,77 @@ bool RenderComponent::loadTexture(tinyxml2::XMLElement* elem, uint32_t& buffer)
 		return false;
 	}
 
-	Resource textureResource(texturePath);
-	auto textureHandle = Game::instance().resourceCache().getHandle(textureResource);
+	file = texturePath;
+
+	// Components using the same file share the texture, which is drawn with the fallback colour until its first
+	// mip levels have been streamed in
+	buffer = renderer.textureStreamer().request(renderer.glState(), file, fallback);
 
-	if (!textureHandle) {
-		LOG_DEBUG("RenderComponent::loadTexture: could not load texture - could not get texture file handle");
+	if (buffer == 0) {
+		LOG_DEBUG("RenderComponent::loadTexture: could not load texture " + file);
 		return false;
 	}
+	return true;
+}
 
-	glGenTextures(1, &buffer);
-	glBindTexture(GL_TEXTURE_2D, buffer);
+RenderComponent::~RenderComponent()
+{
+	GLStateCache& glState = Game::instance().renderer().glState();
 
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	for (auto it = m_lods.begin(); it != m_lods.end(); ++it) {
+		if (!it->ownsBuffers) {
+			continue;
+		}
+		glState.deleteBuffer(it->vbo);
+		glState.deleteBuffer(it->uvs);
+		glState.deleteBuffer(it->normals);
+		glState.deleteBuffer(it->tangents);
+		glState.deleteBuffer(it->bitangents);
+		glState.deleteBuffer(it->ebo);
+		glState.deleteVertexArray(it->vao);
+	}
+	Game::instance().renderer().textureStreamer().release(glState, m_normalMap);
+}
 
-	auto textureProcessedData = std::dynamic_pointer_cast<ImageResProcessedData>(textureHandle->processedData);
+void RenderComponent::createMeshBuffers(ModelResProcessedData& mesh, const std::vector<unsigned short>& indices, MeshLOD& lod)
+{
+	GLStateCache& glState = Game::instance().renderer().glState();
 
-	// TODO: Sometimes when the same texture is used this throws a read access violation from reading the textureHandle->buffer
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, textureProcessedData->width(), textureProcessedData->height(), 0, GL_RGB, GL_UNSIGNED_BYTE, textureHandle->buffer);
-	glGenerateMipmap(GL_TEXTURE_2D);
+	auto& vertices = mesh.vertices();
+	auto& uvs = mesh.uvs();
+	auto& normals = mesh.normals();
+	auto& tangents = mesh.tangents();
+	auto& bitangents = mesh.bitangents();
 
-	glBindTexture(GL_TEXTURE_2D, 0);
+	glGenVertexArrays(1, &lod.vao);
 
-	return true;
-}
+	glGenBuffers(1, &lod.vbo);
+	glState.bindBuffer(GL_ARRAY_BUFFER, lod.vbo);
+	glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(glm::vec3), &vertices[0], GL_STATIC_DRAW);
 
-RenderComponent::~RenderComponent()
-{
-	glDeleteBuffers(1, &m_VBO);
-	glDeleteBuffers(1, &m_uvBuffer);
-	glDeleteBuffers(1, &m_normalBuffer);
-	glDeleteBuffers(1, &m_tangentBuffer);
-	glDeleteBuffers(1, &m_bitangentBuffer);
-	glDeleteBuffers(1, &m_EBO);
-	glDeleteTextures(1, &m_normalMap);
-	glDeleteVertexArrays(1, &m_VAO);
+	glGenBuffers(1, &lod.uvs);
+	glState.bindBuffer(GL_ARRAY_BUFFER, lod.uvs);
+	glBufferData(GL_ARRAY_BUFFER, uvs.size() * sizeof(glm::vec2), &uvs[0], GL_STATIC_DRAW);
+
+	glGenBuffers(1, &lod.normals);
+	glState.bindBuffer(GL_ARRAY_BUFFER, lod.normals);
+	glBufferData(GL_ARRAY_BUFFER, normals.size() * sizeof(glm::vec3), &normals[0], GL_STATIC_DRAW);
+
+	glGenBuffers(1, &lod.tangents);
+	glState.bindBuffer(GL_ARRAY_BUFFER, lod.tangents);
+	glBufferData(GL_ARRAY_BUFFER, tangents.size() * sizeof(glm::vec3), &tangents[0], GL_STATIC_DRAW);
+
+	glGenBuffers(1, &lod.bitangents);
+	glState.bindBuffer(GL_ARRAY_BUFFER, lod.bitangents);
+	glBufferData(GL_ARRAY_BUFFER, bitangents.size() * sizeof(glm::vec3), &bitangents[0], GL_STATIC_DRAW);
+
+	glGenBuffers(1, &lod.ebo);
+	glState.bindBuffer(GL_ELEMENT_ARRAY_BUFFER, lod.ebo);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned short), &indices[0], GL_STATIC_DRAW);
+
+	lod.nIndices = indices.size();
+	lod.indexOffset = 0;
+	lod.ownsBuffers = true;
 }
 
 bool RenderComponent::init(tinyxml2::XMLElement* data)
@@ -80,50 +118,104 @@ bool RenderComponent::init(tinyxml2::XMLElement* data)
 	}
 
 	std::shared_ptr<ModelResProcessedData> processedModelData = std::dynamic_pointer_cast<ModelResProcessedData>(modelHandle->processedData);
+	m_modelData = processedModelData;
+
+	// Levels of detail, either simplified from the model with a ratio of its triangles or loaded from a file.
+	// The simplified LODs' indices are appended to the model's index buffer. The LODs are added to m_lods as
+	// they're parsed, so the destructor deletes the buffers of loaded LODs if a later one fails.
+	std::vector<unsigned short> indices = processedModelData->indices();
+	for (auto lodElem = data->FirstChildElement("LOD"); lodElem; lodElem = lodElem->NextSiblingElement("LOD")) {
+		MeshLOD lod;
+		float ratio;
+		if (!XMLUtils::xmlAttribToFloat(lodElem, "screenSize", lod.screenSize)) {
+			LOG_DEBUG("RenderComponent::init: could not initialize component - missing screenSize attribute in LOD tag");
+			return false;
+		}
 
-	auto vertices = processedModelData->vertices();
-	auto uvs = processedModelData->uvs();
-	auto normals = processedModelData->normals();
-	auto tangents = processedModelData->tangents();
-	auto bitangents = processedModelData->bitangents();
-	auto indices = processedModelData->indices();
-
-	glGenVertexArrays(1, &m_VAO);
-
-	glGenBuffers(1, &m_VBO);
-	glBindBuffer(GL_ARRAY_BUFFER, m_VBO);
-	glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(glm::vec3), &vertices[0], GL_STATIC_DRAW);
+		auto lodPath = lodElem->Attribute("file");
+		if (lodPath) {
+			Resource lodResource(lodPath);
+			auto lodHandle = Game::instance().resourceCache().getHandle(lodResource);
+			if (!lodHandle) {
+				LOG_DEBUG("RenderComponent::init: could not initialize component - could not get LOD model file handle");
+				return false;
+			}
+			auto lodData = std::dynamic_pointer_cast<ModelResProcessedData>(lodHandle->processedData);
+			if (!lodData) {
+				LOG_DEBUG("RenderComponent::init: could not initialize component - LOD file " + std::string(lodPath) + " is not a model");
+				return false;
+			}
+			createMeshBuffers(*lodData, lodData->indices(), lod);
+		}
+		else if (XMLUtils::xmlAttribToFloat(lodElem, "ratio", ratio)) {
+			auto& lodIndices = processedModelData->simplifiedIndices(std::max(0.0f, std::min(ratio, 1.0f)));
+			lod.nIndices = lodIndices.size();
+			lod.indexOffset = indices.size() * sizeof(unsigned short);
+			indices.insert(indices.end(), lodIndices.begin(), lodIndices.end());
+		}
+		else {
+			LOG_DEBUG("RenderComponent::init: could not initialize component - LOD tag needs a file or a ratio attribute");
+			return false;
+		}
+		m_lods.push_back(lod);
+	}
 
-	glGenBuffers(1, &m_uvBuffer);
-	glBindBuffer(GL_ARRAY_BUFFER, m_uvBuffer);
-	glBufferData(GL_ARRAY_BUFFER, uvs.size() * sizeof(glm::vec2), &uvs[0], GL_STATIC_DRAW);
+	MeshLOD& fullMesh = m_lods[0];
+	createMeshBuffers(*processedModelData, indices, fullMesh);
+	fullMesh.nIndices = processedModelData->indices().size();
+
+	for (auto it = m_lods.begin() + 1; it != m_lods.end(); ++it) {
+		if (!it->ownsBuffers) {
+			int nIndices = it->nIndices;
+			size_t indexOffset = it->indexOffset;
+			float screenSize = it->screenSize;
+			*it = fullMesh;
+			it->nIndices = nIndices;
+			it->indexOffset = indexOffset;
+			it->screenSize = screenSize;
+			it->ownsBuffers = false;
+		}
+	}
 
-	glGenBuffers(1, &m_normalBuffer);
-	glBindBuffer(GL_ARRAY_BUFFER, m_normalBuffer);
-	glBufferData(GL_ARRAY_BUFFER, normals.size() * sizeof(glm::vec3), &normals[0], GL_STATIC_DRAW);
+	// Coarser LODs are used at smaller screen sizes
+	std::sort(m_lods.begin() + 1, m_lods.end(), [](const MeshLOD& a, const MeshLOD& b) { return a.screenSize > b.screenSize; });
 
-	glGenBuffers(1, &m_tangentBuffer);
-	glBindBuffer(GL_ARRAY_BUFFER, m_tangentBuffer);
-	glBufferData(GL_ARRAY_BUFFER, tangents.size() * sizeof(glm::vec3), &tangents[0], GL_STATIC_DRAW);
+	auto& vertices = processedModelData->vertices();
+	for (auto it = vertices.begin(); it != vertices.end(); ++it) {
+		m_localBounds.expand(*it);
+	}
 
-	glGenBuffers(1, &m_bitangentBuffer);
-	glBindBuffer(GL_ARRAY_BUFFER, m_bitangentBuffer);
-	glBufferData(GL_ARRAY_BUFFER, bitangents.size() * sizeof(glm::vec3), &bitangents[0], GL_STATIC_DRAW);
+	// Occluders hide other objects from the occlusion culler, preferably with a simplified mesh given in the file
+	// attribute. Without it the rendered mesh is used.
+	auto occluderElem = data->FirstChildElement("Occluder");
+	if (occluderElem) {
+		auto occluderPath = occluderElem->Attribute("file");
+		if (occluderPath) {
+			Resource occluderResource(occluderPath);
+			auto occluderHandle = Game::instance().resourceCache().getHandle(occluderResource);
+			if (!occluderHandle) {
+				LOG_DEBUG("RenderComponent::init: could not initialize component - could not get occluder model file handle");
+				return false;
+			}
+			m_occluderData = std::dynamic_pointer_cast<ModelResProcessedData>(occluderHandle->processedData);
+		}
+		else {
+			m_occluderData = m_modelData;
+		}
+	}
 
-	glGenBuffers(1, &m_EBO);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_EBO);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned short), &indices[0], GL_STATIC_DRAW);
+	// GPU culled components take their model matrix from an instance attribute
+	m_gpuCulled = data->FirstChildElement("GPUCulling") != nullptr;
+	m_shaderVariant.instanced = m_gpuCulled;
 
-	m_nIndices = processedModelData->indices().size();
+	// With texture arrays all the 2D textures of the component are layers of array pages
+	m_shaderVariant.textureArrays = Game::instance().renderer().textureStreamer().textureArrays();
 
+	// Without a normal map the shader variant uses the vertex normals
 	auto normalMapData = data->FirstChildElement("NormalMap");
+	m_shaderVariant.normalMapping = normalMapData != nullptr;
 
-	if (!normalMapData) {
-		LOG_DEBUG("RenderComponent::init: could not initialize component - could not find valid normal map element.");
-		return false;
-	}
-
-	if (!loadTexture(normalMapData, m_normalMap)) {
+	if (normalMapData && !loadTexture(normalMapData, m_normalMap, m_normalMapFile, glm::vec4(0.5f, 0.5f, 1.0f, 1.0f))) {
 		LOG_DEBUG("RenderComponent::init: could not initialize component - could not load normal map.");
 		return false;
 	}
@@ -135,13 +227,10 @@ bool RenderComponent::init(tinyxml2::XMLElement* data)
 		auto shininess = materialData->FirstChildElement("Shininess");
 		auto reflectionMap = materialData->FirstChildElement("ReflectionMap");
 
-		if (!diffuseMap || !specularMap || !reflectionMap || !shininess || !shininess->Attribute("value")) {
-			LOG_DEBUG("RenderComponent::init: could not initialize component - could not find valid diffuse, specular and reflection map or shininess elements in material data");
-			return false;
-		}
+		auto shadows = materialData->FirstChildElement("Shadows");
 
-		if (!loadTexture(diffuseMap, m_material.diffuseMap) || !loadTexture(specularMap, m_material.specularMap) || !loadTexture(reflectionMap, m_material.reflectionMap)) {
-			LOG_DEBUG("RenderComponent::init: could not initialize component - could not load diffuse, specular and reflection maps");
+		if (!diffuseMap || !specularMap || !shininess || !shininess->Attribute("value")) {
+			LOG_DEBUG("RenderComponent::init: could not initialize component - could not find valid diffuse and specular map or shininess elements in material data");
 			return false;
 		}
 
@@ -155,11 +244,65 @@ bool RenderComponent::init(tinyxml2::XMLElement* data)
 			return false;
 		}
 
+		if (!loadTexture(diffuseMap, m_material.diffuseMap, m_material.diffuseMapFile, glm::vec4(0.5f, 0.5f, 0.5f, 1.0f))) {
+			LOG_DEBUG("RenderComponent::init: could not initialize component - could not load diffuse map");
+			return false;
+		}
+
+		// Materials without a reflection map don't sample the skybox
+		m_shaderVariant.reflection = reflectionMap != nullptr;
+
+		// The specular map, reflection map and shininess are packed into one texture when the streamer can decode
+		// both maps, otherwise they're loaded as they are
+		Renderer& renderer = Game::instance().renderer();
+		auto specularFile = specularMap->Attribute("file");
+		auto reflectionFile = reflectionMap ? reflectionMap->Attribute("file") : "";
+		m_shaderVariant.packedMaterial = specularFile && reflectionFile && renderer.textureStreamer().canPackMaterial(specularFile, reflectionFile);
+
+		if (m_shaderVariant.packedMaterial) {
+			m_material.specularMapFile = specularFile;
+			m_material.reflectionMapFile = reflectionFile;
+			m_material.packedMap = renderer.textureStreamer().requestPackedMaterial(renderer.glState(), specularFile, reflectionFile, m_material.shininess);
+			if (m_material.packedMap == 0) {
+				LOG_DEBUG("RenderComponent::init: could not initialize component - could not load packed material " + m_material.specularMapFile);
+				return false;
+			}
+		}
+		else if (!loadTexture(specularMap, m_material.specularMap, m_material.specularMapFile, glm::vec4(0.0f, 0.0f, 0.0f, 1.0f))) {
+			LOG_DEBUG("RenderComponent::init: could not initialize component - could not load specular map");
+			return false;
+		}
+		else if (reflectionMap && !loadTexture(reflectionMap, m_material.reflectionMap, m_material.reflectionMapFile, glm::vec4(0.0f, 0.0f, 0.0f, 1.0f))) {
+			LOG_DEBUG("RenderComponent::init: could not initialize component - could not load reflection map");
+			return false;
+		}
+
+		if (shadows) {
+			auto receive = shadows->Attribute("receive");
+			m_shaderVariant.receiveShadows = !receive || std::string(receive) == std::string("true");
+
+			// The kernel is centered on the sample, so its size has to be odd
+			int pcfKernelSize = m_shaderVariant.pcfKernelSize;
+			XMLUtils::xmlAttribToInt(shadows, "pcfKernelSize", pcfKernelSize);
+			m_shaderVariant.pcfKernelSize = std::max(1, std::min(pcfKernelSize | 1, 15));
+		}
 	}
 
+	m_shaderVariantKey = Game::instance().renderer().requestShaderVariant(m_shaderVariant);
+
+	// Components with equal material keys share an id, which the renderer sorts draws by
+	static std::map<std::string, uint32_t> materialIds;
+	auto materialIt = materialIds.insert(std::make_pair(materialKey(), (uint32_t)materialIds.size())).first;
+	m_materialId = materialIt->second;
+
 	return true;
 }
 
+std::string RenderComponent::materialKey()
+{
+	return m_normalMapFile + ";" + m_material.diffuseMapFile + ";" + m_material.specularMapFile + ";" + m_material.reflectionMapFile + ";" + std::to_string(m_material.shininess) + ";" + std::to_string(m_shaderVariant.key());
+}
+
 IGOComponent* createRenderComponent()
 {
 	return new RenderComponent;
@@ -167,6 +310,10 @@ IGOComponent* createRenderComponent()
 
 Material::~Material()
 {
-	glDeleteTextures(1, &diffuseMap);
-	glDeleteTextures(1, &specularMap);
+	Renderer& renderer = Game::instance().renderer();
+
+	renderer.textureStreamer().release(renderer.glState(), diffuseMap);
+	renderer.textureStreamer().release(renderer.glState(), specularMap);
+	renderer.textureStreamer().release(renderer.glState(), reflectionMap);
+	renderer.textureStreamer().release(renderer.glState(), packedMap);
 }
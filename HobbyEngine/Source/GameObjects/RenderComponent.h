@@ -1,19 +1,59 @@
 #ifndef RENDER_COMPONENT_H
 #define RENDER_COMPONENT_H
 
+#include <memory>
+#include <string>
+#include <vector>
+
 #include <glm/glm.hpp>
 #include <tinyxml2/tinyxml2.h>
 
 #include "GameObject.h"
+#include "../Renderer/AABB.h"
+#include "../Renderer/ShaderVariant.h"
+
+class ModelResProcessedData;
 
 struct Material {
 	Material() = default;
 	~Material();
 
-	uint32_t diffuseMap;
-	uint32_t specularMap;
-	uint32_t reflectionMap;
+	// Handles of the textures in the renderer's texture streamer
+	uint32_t diffuseMap = 0;
+	uint32_t specularMap = 0;
+	uint32_t reflectionMap = 0;
 	float shininess;
+
+	// Replaces the specular and reflection maps when the shader variant has packedMaterial set
+	uint32_t packedMap = 0;
+
+	// Source files of the textures, used for identifying materials that can be batched together
+	std::string diffuseMapFile;
+	std::string specularMapFile;
+	std::string reflectionMapFile;
+};
+
+// Vertex and index buffers of one level of detail. LODs simplified from the model share its buffers and draw
+// their own range of the index buffer, LODs loaded from a file have buffers of their own.
+struct MeshLOD
+{
+	uint32_t vao = 0;
+	uint32_t vbo = 0;
+	uint32_t uvs = 0;
+	uint32_t normals = 0;
+	uint32_t tangents = 0;
+	uint32_t bitangents = 0;
+	uint32_t ebo = 0;
+
+	int nIndices = 0;
+
+	// Offset of the first index in bytes
+	size_t indexOffset = 0;
+
+	// Used once the object's projected height is below this fraction of the screen height
+	float screenSize = 0.0f;
+
+	bool ownsBuffers = false;
 };
 
 class RenderComponent : public IGOComponent
@@ -26,38 +66,70 @@ public:
 
 	virtual ComponentId componentId() const { return COMPONENT_ID; }
 
-	uint32_t vao() { return m_VAO; }
-	uint32_t vbo() { return m_VBO; }
-	uint32_t uvs() { return m_uvBuffer; }
-	uint32_t normals() { return m_normalBuffer; }
-	uint32_t tangents() { return m_tangentBuffer; }
-	uint32_t bitangents() { return m_bitangentBuffer; }
-	uint32_t ebo() { return m_EBO; }
+	// Buffers of the full detail mesh
+	uint32_t vao() { return m_lods[0].vao; }
+	uint32_t vbo() { return m_lods[0].vbo; }
+	uint32_t uvs() { return m_lods[0].uvs; }
+	uint32_t normals() { return m_lods[0].normals; }
+	uint32_t tangents() { return m_lods[0].tangents; }
+	uint32_t bitangents() { return m_lods[0].bitangents; }
+	uint32_t ebo() { return m_lods[0].ebo; }
 
 	uint32_t normalMap() { return m_normalMap; }
 
 	Material& material() { return m_material; }
 
-	int nIndices() { return m_nIndices; }
+	int nIndices() { return m_lods[0].nIndices; }
+
+	// LOD 0 is the full mesh, the rest follow from the finest to the coarsest
+	int nLods() { return m_lods.size(); }
+	MeshLOD& lod(int lod) { return m_lods[lod]; }
+
+	std::shared_ptr<ModelResProcessedData> modelData() { return m_modelData; }
+
+	// Mesh rasterized by the occlusion culler, empty if the component doesn't occlude anything
+	std::shared_ptr<ModelResProcessedData> occluderData() { return m_occluderData; }
+	const AABB& localBounds() { return m_localBounds; }
+
+	// Returns a key that is equal for all render components that can share the same draw state
+	std::string materialKey();
+	uint32_t materialId() { return m_materialId; }
+
+	// Shader features of the material, the normal map and reflection map are optional
+	const ShaderVariant& shaderVariant() { return m_shaderVariant; }
+	uint32_t shaderVariantKey() { return m_shaderVariantKey; }
+
+	// Drawn instanced together with the other components of the same mesh and material, and culled on the GPU
+	bool gpuCulled() { return m_gpuCulled; }
+
+	// Set when the component's mesh has been merged into a static batch and shouldn't be drawn separately
+	bool batched = false;
+
+	// LOD the object was drawn with last frame, only touched by the renderer to switch LODs with hysteresis
+	int lastLod = 0;
 
 private:
-	bool loadTexture(tinyxml2::XMLElement* elem, uint32_t& buffer);
+	// Requests the texture from the renderer's texture streamer, fallback is the colour drawn until it's loaded
+	bool loadTexture(tinyxml2::XMLElement* elem, uint32_t& buffer, std::string& file, const glm::vec4& fallback);
+	void createMeshBuffers(ModelResProcessedData& mesh, const std::vector<unsigned short>& indices, MeshLOD& lod);
 
 	const ComponentId COMPONENT_ID = "RenderComponent";
 
-	uint32_t m_VAO;
-	uint32_t m_VBO;
-	uint32_t m_uvBuffer;
-	uint32_t m_normalBuffer;
-	uint32_t m_tangentBuffer;
-	uint32_t m_bitangentBuffer;
-	uint32_t m_EBO;
+	std::vector<MeshLOD> m_lods = std::vector<MeshLOD>(1);
 
-	uint32_t m_normalMap;
+	uint32_t m_normalMap = 0;
+	std::string m_normalMapFile;
 
 	Material m_material;
+	uint32_t m_materialId = 0;
+
+	ShaderVariant m_shaderVariant;
+	uint32_t m_shaderVariantKey = 0;
+	bool m_gpuCulled = false;
 
-	int m_nIndices;
+	std::shared_ptr<ModelResProcessedData> m_modelData;
+	std::shared_ptr<ModelResProcessedData> m_occluderData;
+	AABB m_localBounds;
 
 };
 
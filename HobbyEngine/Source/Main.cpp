@@ -1,9 +1,20 @@
+#include <string>
+
+#include "Engine/AssetCooker.h"
 #include "Engine/GLApplication.h"
 
-int main() {
+int main(int argc, char** argv) {
+	// The asset cooker runs instead of the game, without a window or an OpenGL context
+	for (int i = 1; i < argc; ++i) {
+		if (std::string(argv[i]) == "--cook") {
+			AssetCooker cooker;
+			return cooker.run(argc, argv) ? 0 : -1;
+		}
+	}
+
 	Game& game = Game::instance();
 
-	if (!game.init()) {
+	if (!game.init(argc, argv)) {
 		return -1;
 	}
 	
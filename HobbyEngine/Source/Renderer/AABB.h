@@ -0,0 +1,43 @@
+#ifndef AABB_H
+#define AABB_H
+
+#include <cfloat>
+
+#include <glm/glm.hpp>
+
+// Axis aligned bounding box, used mainly for culling
+struct AABB
+{
+	glm::vec3 min = glm::vec3(FLT_MAX);
+	glm::vec3 max = glm::vec3(-FLT_MAX);
+
+	bool isValid() const { return min.x <= max.x && min.y <= max.y && min.z <= max.z; }
+
+	glm::vec3 center() const { return (min + max) * 0.5f; }
+	glm::vec3 extents() const { return (max - min) * 0.5f; }
+
+	void expand(const glm::vec3& point)
+	{
+		min = glm::min(min, point);
+		max = glm::max(max, point);
+	}
+
+	void expand(const AABB& other)
+	{
+		min = glm::min(min, other.min);
+		max = glm::max(max, other.max);
+	}
+
+	// Returns the box enclosing this box after transforming it with the given matrix
+	AABB transformed(const glm::mat4& transform) const
+	{
+		AABB res;
+		for (int i = 0; i < 8; ++i) {
+			glm::vec3 corner((i & 1) ? max.x : min.x, (i & 2) ? max.y : min.y, (i & 4) ? max.z : min.z);
+			res.expand(glm::vec3(transform * glm::vec4(corner, 1.0f)));
+		}
+		return res;
+	}
+};
+
+#endif // !AABB_H
@@ -0,0 +1,37 @@
+#ifndef DRAW_PACKET_H
+#define DRAW_PACKET_H
+
+#include <glm/glm.hpp>
+
+#include "../GameObjects/RenderComponent.h"
+
+// Everything needed to submit one draw call, prepared from the render state on the worker threads so that
+// the render thread only has to sort the packets and issue the GL calls
+struct DrawPacket
+{
+	uint64_t id;
+
+	// Shader variant in the top 12 bits, then 20 bits of material and the vertex array in the lower 32 bits.
+	// Draws with equal keys share their state.
+	uint64_t sortKey;
+
+	// Distance along the camera's view direction, equal keys are drawn front to back
+	float depth;
+
+	glm::mat4 model;
+	glm::mat3 normalMatrix;
+
+	// Shadow cascades the packet casts shadows into, one bit per cascade
+	uint32_t cascadeMask;
+
+	// Height of the object's bounding sphere relative to the screen height
+	float screenSize;
+
+	// Mesh LOD of the render component, picked from the object's size on screen
+	int lod;
+
+	// Owned by the render state the packet was prepared from
+	RenderComponent* renderComponent;
+};
+
+#endif // !DRAW_PACKET_H
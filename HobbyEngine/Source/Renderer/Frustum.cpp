@@ -0,0 +1,47 @@
+#include "Frustum.h"
+
+void Frustum::update(const glm::mat4& viewProjection)
+{
+	// Gribb-Hartmann plane extraction, glm matrices are column major so rows are read manually
+	glm::vec4 row0(viewProjection[0][0], viewProjection[1][0], viewProjection[2][0], viewProjection[3][0]);
+	glm::vec4 row1(viewProjection[0][1], viewProjection[1][1], viewProjection[2][1], viewProjection[3][1]);
+	glm::vec4 row2(viewProjection[0][2], viewProjection[1][2], viewProjection[2][2], viewProjection[3][2]);
+	glm::vec4 row3(viewProjection[0][3], viewProjection[1][3], viewProjection[2][3], viewProjection[3][3]);
+
+	m_planes[0] = row3 + row0; // Left
+	m_planes[1] = row3 - row0; // Right
+	m_planes[2] = row3 + row1; // Bottom
+	m_planes[3] = row3 - row1; // Top
+	m_planes[4] = row3 + row2; // Near
+	m_planes[5] = row3 - row2; // Far
+
+	for (int i = 0; i < 6; ++i) {
+		float length = glm::length(glm::vec3(m_planes[i]));
+		m_planes[i] = m_planes[i] / length;
+	}
+}
+
+bool Frustum::intersects(const AABB& box) const
+{
+	glm::vec3 center = box.center();
+	glm::vec3 extents = box.extents();
+
+	for (int i = 0; i < 6; ++i) {
+		glm::vec3 normal = glm::vec3(m_planes[i]);
+		float radius = glm::dot(extents, glm::abs(normal));
+		if (glm::dot(normal, center) + m_planes[i].w < -radius) {
+			return false;
+		}
+	}
+	return true;
+}
+
+bool Frustum::intersects(const glm::vec3& center, float radius) const
+{
+	for (int i = 0; i < 6; ++i) {
+		if (glm::dot(glm::vec3(m_planes[i]), center) + m_planes[i].w < -radius) {
+			return false;
+		}
+	}
+	return true;
+}
@@ -0,0 +1,26 @@
+#ifndef FRUSTUM_H
+#define FRUSTUM_H
+
+#include <glm/glm.hpp>
+
+#include "AABB.h"
+
+// View frustum defined by six planes, extracted from a view projection matrix. Works for both perspective
+// and orthographic projections, so it is used for culling against the camera as well as the light.
+class Frustum
+{
+public:
+	Frustum() = default;
+	explicit Frustum(const glm::mat4& viewProjection) { update(viewProjection); }
+
+	void update(const glm::mat4& viewProjection);
+
+	bool intersects(const AABB& box) const;
+	bool intersects(const glm::vec3& center, float radius) const;
+
+private:
+	// Planes are stored as (normal, distance), normals point inside the frustum
+	glm::vec4 m_planes[6];
+};
+
+#endif // !FRUSTUM_H
@@ -0,0 +1,38 @@
+#include "GLExtensions.h"
+
+#include <set>
+
+#include "../Utils/DebugLogger.h"
+
+namespace
+{
+	GLADloadproc extensionLoader = nullptr;
+	std::set<std::string> extensions;
+}
+
+void GLExtensions::init(GLADloadproc loader)
+{
+	extensionLoader = loader;
+	extensions.clear();
+
+	int nExtensions = 0;
+	glGetIntegerv(GL_NUM_EXTENSIONS, &nExtensions);
+	for (int i = 0; i < nExtensions; ++i) {
+		auto name = glGetStringi(GL_EXTENSIONS, i);
+		if (name) {
+			extensions.insert((const char*)name);
+		}
+	}
+
+	LOG_DEBUG("GLExtensions::init: " + std::to_string(extensions.size()) + " extensions supported");
+}
+
+bool GLExtensions::supported(const std::string& name)
+{
+	return extensions.find(name) != extensions.end();
+}
+
+void* GLExtensions::procAddress(const char* name)
+{
+	return extensionLoader ? extensionLoader(name) : nullptr;
+}
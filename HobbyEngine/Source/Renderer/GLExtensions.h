@@ -0,0 +1,22 @@
+#ifndef GL_EXTENSIONS_H
+#define GL_EXTENSIONS_H
+
+#include <string>
+
+#include <glad/glad.h>
+
+// The GLAD loader is generated for core profile only, so the extensions the renderer can make use of are
+// detected here and their functions are loaded with the same loader GLAD used for the core functions
+class GLExtensions
+{
+public:
+	// Has to be called with the context current, after GLAD has been loaded
+	static void init(GLADloadproc loader);
+
+	static bool supported(const std::string& name);
+
+	// Returns nullptr if the function isn't available
+	static void* procAddress(const char* name);
+};
+
+#endif // !GL_EXTENSIONS_H
@@ -0,0 +1,233 @@
+#include "GLStateCache.h"
+
+GLStateCache::GLStateCache()
+{
+	reset();
+}
+
+void GLStateCache::reset()
+{
+	m_program = UNKNOWN;
+	m_activeUnit = UNKNOWN;
+	for (int i = 0; i < MAX_TEXTURE_UNITS; ++i) {
+		m_textures[i] = UNKNOWN;
+		m_textureTargets[i] = 0;
+	}
+	m_buffers.clear();
+	m_vao = UNKNOWN;
+	m_readFramebuffer = UNKNOWN;
+	m_drawFramebuffer = UNKNOWN;
+
+	m_capabilities.clear();
+	m_depthMask = -1;
+	m_colorMask = -1;
+	m_depthFunc = 0;
+	m_cullFace = 0;
+	m_blendSrc = 0;
+	m_blendDst = 0;
+	for (int i = 0; i < 4; ++i) {
+		m_viewport[i] = -1;
+	}
+}
+
+void GLStateCache::beginFrame()
+{
+	m_lastFrameStats = m_frameStats;
+	m_frameStats = Stats();
+}
+
+bool GLStateCache::track(bool changed)
+{
+	if (changed) {
+		m_frameStats.issued++;
+		m_totalStats.issued++;
+	}
+	else {
+		m_frameStats.filtered++;
+		m_totalStats.filtered++;
+	}
+	return changed;
+}
+
+void GLStateCache::useProgram(uint32_t program)
+{
+	if (track(m_program != program)) {
+		glUseProgram(program);
+		m_program = program;
+	}
+}
+
+void GLStateCache::bindTexture(uint32_t unit, GLenum target, uint32_t texture)
+{
+	if (unit >= MAX_TEXTURE_UNITS) {
+		glActiveTexture(GL_TEXTURE0 + unit);
+		glBindTexture(target, texture);
+		m_activeUnit = unit;
+		return;
+	}
+
+	if (!track(m_textures[unit] != texture || m_textureTargets[unit] != target)) {
+		return;
+	}
+
+	if (track(m_activeUnit != unit)) {
+		glActiveTexture(GL_TEXTURE0 + unit);
+		m_activeUnit = unit;
+	}
+
+	glBindTexture(target, texture);
+	m_textures[unit] = texture;
+	m_textureTargets[unit] = target;
+}
+
+void GLStateCache::bindBuffer(GLenum target, uint32_t buffer)
+{
+	auto it = m_buffers.find(target);
+	if (track(it == m_buffers.end() || it->second != buffer)) {
+		glBindBuffer(target, buffer);
+		m_buffers[target] = buffer;
+	}
+}
+
+void GLStateCache::bindVertexArray(uint32_t vao)
+{
+	if (track(m_vao != vao)) {
+		glBindVertexArray(vao);
+		m_vao = vao;
+
+		// The element array buffer binding is part of the VAO state
+		m_buffers.erase(GL_ELEMENT_ARRAY_BUFFER);
+	}
+}
+
+void GLStateCache::bindFramebuffer(GLenum target, uint32_t framebuffer)
+{
+	bool read = target == GL_FRAMEBUFFER || target == GL_READ_FRAMEBUFFER;
+	bool draw = target == GL_FRAMEBUFFER || target == GL_DRAW_FRAMEBUFFER;
+
+	bool changed = (read && m_readFramebuffer != framebuffer) || (draw && m_drawFramebuffer != framebuffer);
+	if (track(changed)) {
+		glBindFramebuffer(target, framebuffer);
+		if (read) {
+			m_readFramebuffer = framebuffer;
+		}
+		if (draw) {
+			m_drawFramebuffer = framebuffer;
+		}
+	}
+}
+
+void GLStateCache::setEnabled(GLenum capability, bool enabled)
+{
+	auto it = m_capabilities.find(capability);
+	if (track(it == m_capabilities.end() || it->second != enabled)) {
+		if (enabled) {
+			glEnable(capability);
+		}
+		else {
+			glDisable(capability);
+		}
+		m_capabilities[capability] = enabled;
+	}
+}
+
+void GLStateCache::depthMask(bool enabled)
+{
+	if (track(m_depthMask != (enabled ? 1 : 0))) {
+		glDepthMask(enabled ? GL_TRUE : GL_FALSE);
+		m_depthMask = enabled ? 1 : 0;
+	}
+}
+
+void GLStateCache::colorMask(bool enabled)
+{
+	if (track(m_colorMask != (enabled ? 1 : 0))) {
+		GLboolean mask = enabled ? GL_TRUE : GL_FALSE;
+		glColorMask(mask, mask, mask, mask);
+		m_colorMask = enabled ? 1 : 0;
+	}
+}
+
+void GLStateCache::depthFunc(GLenum func)
+{
+	if (track(m_depthFunc != func)) {
+		glDepthFunc(func);
+		m_depthFunc = func;
+	}
+}
+
+void GLStateCache::cullFace(GLenum mode)
+{
+	if (track(m_cullFace != mode)) {
+		glCullFace(mode);
+		m_cullFace = mode;
+	}
+}
+
+void GLStateCache::blendFunc(GLenum src, GLenum dst)
+{
+	if (track(m_blendSrc != src || m_blendDst != dst)) {
+		glBlendFunc(src, dst);
+		m_blendSrc = src;
+		m_blendDst = dst;
+	}
+}
+
+void GLStateCache::viewport(int x, int y, int width, int height)
+{
+	if (track(m_viewport[0] != x || m_viewport[1] != y || m_viewport[2] != width || m_viewport[3] != height)) {
+		glViewport(x, y, width, height);
+		m_viewport[0] = x;
+		m_viewport[1] = y;
+		m_viewport[2] = width;
+		m_viewport[3] = height;
+	}
+}
+
+void GLStateCache::deleteTexture(uint32_t texture)
+{
+	for (int i = 0; i < MAX_TEXTURE_UNITS; ++i) {
+		if (m_textures[i] == texture) {
+			m_textures[i] = UNKNOWN;
+		}
+	}
+	glDeleteTextures(1, &texture);
+}
+
+void GLStateCache::deleteBuffer(uint32_t buffer)
+{
+	for (auto it = m_buffers.begin(); it != m_buffers.end(); ++it) {
+		if (it->second == buffer) {
+			it->second = UNKNOWN;
+		}
+	}
+	glDeleteBuffers(1, &buffer);
+}
+
+void GLStateCache::deleteVertexArray(uint32_t vao)
+{
+	if (m_vao == vao) {
+		m_vao = UNKNOWN;
+		m_buffers.erase(GL_ELEMENT_ARRAY_BUFFER);
+	}
+	glDeleteVertexArrays(1, &vao);
+}
+
+void GLStateCache::deleteProgram(uint32_t program)
+{
+	if (m_program == program) {
+		m_program = UNKNOWN;
+	}
+	glDeleteProgram(program);
+}
+
+void GLStateCache::deleteFramebuffer(uint32_t framebuffer)
+{
+	if (m_readFramebuffer == framebuffer) {
+		m_readFramebuffer = UNKNOWN;
+	}
+	if (m_drawFramebuffer == framebuffer) {
+		m_drawFramebuffer = UNKNOWN;
+	}
+	glDeleteFramebuffers(1, &framebuffer);
+}
@@ -0,0 +1,84 @@
+#ifndef GL_STATE_CACHE_H
+#define GL_STATE_CACHE_H
+
+#include <cstdint>
+#include <map>
+
+#include <glad/glad.h>
+
+// Thin layer that remembers the currently bound OpenGL state and filters out calls that wouldn't change it.
+// All binds done by the renderer and the GL resources it draws should go through this class, otherwise the
+// cached state gets out of sync with the context. If GL state is changed behind the cache's back, reset()
+// makes it forget everything.
+class GLStateCache
+{
+public:
+	struct Stats
+	{
+		uint64_t issued = 0;
+		uint64_t filtered = 0;
+	};
+
+	GLStateCache();
+
+	void reset();
+
+	// Starts a new frame for the frame statistics
+	void beginFrame();
+
+	void useProgram(uint32_t program);
+	void bindTexture(uint32_t unit, GLenum target, uint32_t texture);
+	void bindBuffer(GLenum target, uint32_t buffer);
+	void bindVertexArray(uint32_t vao);
+	void bindFramebuffer(GLenum target, uint32_t framebuffer);
+
+	void setEnabled(GLenum capability, bool enabled);
+	void depthMask(bool enabled);
+	void colorMask(bool enabled);
+	void depthFunc(GLenum func);
+	void cullFace(GLenum mode);
+	void blendFunc(GLenum src, GLenum dst);
+	void viewport(int x, int y, int width, int height);
+
+	// Deleted objects may get their names reused, so any cached binding to them has to be forgotten
+	void deleteTexture(uint32_t texture);
+	void deleteBuffer(uint32_t buffer);
+	void deleteVertexArray(uint32_t vao);
+	void deleteProgram(uint32_t program);
+	void deleteFramebuffer(uint32_t framebuffer);
+
+	const Stats& frameStats() { return m_frameStats; }
+	const Stats& lastFrameStats() { return m_lastFrameStats; }
+	const Stats& totalStats() { return m_totalStats; }
+
+private:
+	static const uint32_t UNKNOWN = 0xFFFFFFFF;
+	static const int MAX_TEXTURE_UNITS = 16;
+
+	// Returns true if the call should be issued
+	bool track(bool changed);
+
+	uint32_t m_program;
+	uint32_t m_activeUnit;
+	uint32_t m_textures[MAX_TEXTURE_UNITS];
+	GLenum m_textureTargets[MAX_TEXTURE_UNITS];
+	std::map<GLenum, uint32_t> m_buffers;
+	uint32_t m_vao;
+	uint32_t m_readFramebuffer;
+	uint32_t m_drawFramebuffer;
+
+	std::map<GLenum, bool> m_capabilities;
+	int m_depthMask;
+	int m_colorMask;
+	GLenum m_depthFunc;
+	GLenum m_cullFace;
+	GLenum m_blendSrc;
+	GLenum m_blendDst;
+	int m_viewport[4];
+
+	Stats m_frameStats;
+	Stats m_lastFrameStats;
+	Stats m_totalStats;
+};
+
+#endif // !GL_STATE_CACHE_H
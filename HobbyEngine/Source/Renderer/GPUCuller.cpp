@@ -0,0 +1,268 @@
+#include "GPUCuller.h"
+
+#include <algorithm>
+#include <cstddef>
+
+#include <glad/glad.h>
+#include <glm/gtc/type_ptr.hpp>
+
+#include "GLExtensions.h"
+#include "../Utils/DebugLogger.h"
+#include "../Utils/Profiler.h"
+
+void GPUCuller::init(GLStateCache& glState, bool enabled, bool hiZ, bool indirect, uint32_t program)
+{
+	m_enabled = enabled && program != 0 && program != (uint32_t)-1;
+	m_hiZ = hiZ;
+	m_program = program;
+
+	// Indirect draws are core since 4.3, writing query results into a buffer since 4.4
+	bool queryBuffers = GLAD_GL_VERSION_4_4 || GLExtensions::supported("GL_ARB_query_buffer_object");
+	m_indirect = m_enabled && indirect && GLAD_GL_VERSION_4_3 && queryBuffers;
+	if (m_enabled && indirect && !m_indirect) {
+		LOG_DEBUG("GPUCuller::init: indirect draws or query buffer objects aren't supported, reading back the visible instance counts");
+	}
+
+	glGenBuffers(1, &m_instanceBuffer);
+	glGenBuffers(1, &m_visibleBuffer);
+
+	// The culling pass reads the instance matrices as four vec4 attributes per point
+	glGenVertexArrays(1, &m_cullVAO);
+	glState.bindVertexArray(m_cullVAO);
+	glState.bindBuffer(GL_ARRAY_BUFFER, m_instanceBuffer);
+	for (int i = 0; i < 4; ++i) {
+		glVertexAttribPointer(i, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (void*)(i * sizeof(glm::vec4)));
+		glEnableVertexAttribArray(i);
+	}
+	glState.bindVertexArray(0);
+
+	if (m_indirect) {
+		glGenBuffers(1, &m_indirectBuffer);
+	}
+
+	if (m_enabled && m_hiZ) {
+		glGenBuffers(1, &m_hiZBuffer);
+		glState.bindBuffer(GL_TEXTURE_BUFFER, m_hiZBuffer);
+		glBufferData(GL_TEXTURE_BUFFER, sizeof(float), nullptr, GL_STREAM_DRAW);
+
+		glGenTextures(1, &m_hiZTexture);
+		glState.bindTexture(0, GL_TEXTURE_BUFFER, m_hiZTexture);
+		glTexBuffer(GL_TEXTURE_BUFFER, GL_R32F, m_hiZBuffer);
+
+		glState.bindTexture(0, GL_TEXTURE_BUFFER, 0);
+		glState.bindBuffer(GL_TEXTURE_BUFFER, 0);
+	}
+}
+
+void GPUCuller::destroy(GLStateCache& glState)
+{
+	glState.deleteVertexArray(m_cullVAO);
+	glState.deleteBuffer(m_instanceBuffer);
+	glState.deleteBuffer(m_visibleBuffer);
+	glState.deleteBuffer(m_indirectBuffer);
+	glState.deleteBuffer(m_hiZBuffer);
+	glState.deleteTexture(m_hiZTexture);
+	if (!m_queries.empty()) {
+		glDeleteQueries((GLsizei)m_queries.size(), m_queries.data());
+		m_queries.clear();
+	}
+}
+
+void GPUCuller::cull(GLStateCache& glState, const std::vector<RenderObject>& instances, const glm::mat4& viewProjection, const OcclusionCuller* occlusionCuller)
+{
+	PROFILE_FUNCTION();
+
+	m_groups.clear();
+	m_instances.clear();
+	m_commands.clear();
+	m_resultsRead = false;
+
+	if (instances.empty()) {
+		return;
+	}
+
+	// Instances sharing a mesh and a material are drawn together
+	m_order.resize(instances.size());
+	for (size_t i = 0; i < m_order.size(); ++i) {
+		m_order[i] = i;
+	}
+	std::sort(m_order.begin(), m_order.end(), [&instances](size_t a, size_t b) {
+		RenderComponent* componentA = instances[a].renderComponent.get();
+		RenderComponent* componentB = instances[b].renderComponent.get();
+		if (componentA->modelData() != componentB->modelData()) {
+			return componentA->modelData() < componentB->modelData();
+		}
+		if (componentA->materialId() != componentB->materialId()) {
+			return componentA->materialId() < componentB->materialId();
+		}
+		return instances[a].id < instances[b].id;
+	});
+
+	for (auto it = m_order.begin(); it != m_order.end(); ++it) {
+		const RenderObject& instance = instances[*it];
+		RenderComponent* renderComponent = instance.renderComponent.get();
+		if (m_groups.empty() || m_groups.back().renderComponent->modelData() != renderComponent->modelData()
+			|| m_groups.back().renderComponent->materialId() != renderComponent->materialId()) {
+			Group group;
+			group.renderComponent = renderComponent;
+			group.firstInstance = m_instances.size();
+			group.nInstances = 0;
+			m_groups.push_back(group);
+		}
+		m_instances.push_back(instance.model);
+		++m_groups.back().nInstances;
+	}
+
+	// Orphaned each frame, so the upload doesn't wait for the last frame's draws
+	glState.bindBuffer(GL_ARRAY_BUFFER, m_instanceBuffer);
+	glBufferData(GL_ARRAY_BUFFER, m_instances.size() * sizeof(glm::mat4), m_instances.data(), GL_STREAM_DRAW);
+
+	if (!m_enabled) {
+		return;
+	}
+
+	if (m_instances.size() > m_visibleCapacity) {
+		m_visibleCapacity = m_instances.size();
+		glState.bindBuffer(GL_ARRAY_BUFFER, m_visibleBuffer);
+		glBufferData(GL_ARRAY_BUFFER, m_visibleCapacity * sizeof(glm::mat4), nullptr, GL_STREAM_COPY);
+	}
+
+	if (m_queries.size() < m_groups.size()) {
+		size_t nQueries = m_queries.size();
+		m_queries.resize(m_groups.size());
+		glGenQueries((GLsizei)(m_queries.size() - nQueries), &m_queries[nQueries]);
+	}
+	m_nVisible.resize(m_groups.size());
+
+	// The instance counts are filled in by the queries
+	if (m_indirect) {
+		for (auto it = m_groups.begin(); it != m_groups.end(); ++it) {
+			DrawElementsIndirectCommand command;
+			command.count = it->renderComponent->nIndices();
+			command.instanceCount = 0;
+			command.firstIndex = 0;
+			command.baseVertex = 0;
+			command.baseInstance = 0;
+			m_commands.push_back(command);
+		}
+		glState.bindBuffer(GL_DRAW_INDIRECT_BUFFER, m_indirectBuffer);
+		glBufferData(GL_DRAW_INDIRECT_BUFFER, m_commands.size() * sizeof(DrawElementsIndirectCommand), m_commands.data(), GL_STREAM_DRAW);
+	}
+
+	glState.useProgram(m_program);
+	glUniformMatrix4fv(glGetUniformLocation(m_program, "viewProjection"), 1, GL_FALSE, glm::value_ptr(viewProjection));
+
+	int hiZLevels = 0;
+	if (m_hiZ && occlusionCuller) {
+		uploadHierarchicalZ(glState, *occlusionCuller);
+		hiZLevels = std::min((int)occlusionCuller->nLevels(), MAX_HI_Z_LEVELS);
+	}
+	glUniform1i(glGetUniformLocation(m_program, "hiZLevels"), hiZLevels);
+
+	glState.bindVertexArray(m_cullVAO);
+	glState.setEnabled(GL_RASTERIZER_DISCARD, true);
+
+	// glBindBufferRange also binds the generic binding point, which the state cache has to know about
+	glState.bindBuffer(GL_TRANSFORM_FEEDBACK_BUFFER, m_visibleBuffer);
+	if (m_indirect) {
+		glState.bindBuffer(GL_QUERY_BUFFER, m_indirectBuffer);
+	}
+
+	int boundsMinLocation = glGetUniformLocation(m_program, "boundsMin");
+	int boundsMaxLocation = glGetUniformLocation(m_program, "boundsMax");
+	for (size_t i = 0; i < m_groups.size(); ++i) {
+		const Group& group = m_groups[i];
+		const AABB& bounds = group.renderComponent->localBounds();
+		glUniform3fv(boundsMinLocation, 1, glm::value_ptr(bounds.min));
+		glUniform3fv(boundsMaxLocation, 1, glm::value_ptr(bounds.max));
+
+		glBindBufferRange(GL_TRANSFORM_FEEDBACK_BUFFER, 0, m_visibleBuffer, group.firstInstance * sizeof(glm::mat4), group.nInstances * sizeof(glm::mat4));
+
+		glBeginQuery(GL_TRANSFORM_FEEDBACK_PRIMITIVES_WRITTEN, m_queries[i]);
+		glBeginTransformFeedback(GL_POINTS);
+		glDrawArrays(GL_POINTS, group.firstInstance, group.nInstances);
+		glEndTransformFeedback();
+		glEndQuery(GL_TRANSFORM_FEEDBACK_PRIMITIVES_WRITTEN);
+
+		// With a query buffer bound, the result is written at the offset instead of to client memory
+		if (m_indirect) {
+			glGetQueryObjectuiv(m_queries[i], GL_QUERY_RESULT, (GLuint*)(i * sizeof(DrawElementsIndirectCommand) + offsetof(DrawElementsIndirectCommand, instanceCount)));
+		}
+	}
+
+	if (m_indirect) {
+		glState.bindBuffer(GL_QUERY_BUFFER, 0);
+	}
+	glState.setEnabled(GL_RASTERIZER_DISCARD, false);
+}
+
+void GPUCuller::uploadHierarchicalZ(GLStateCache& glState, const OcclusionCuller& occlusionCuller)
+{
+	// The levels aren't sized like the mip levels of a texture, so they are packed into a texture buffer and
+	// addressed with their offsets
+	int offsets[MAX_HI_Z_LEVELS];
+	int sizes[MAX_HI_Z_LEVELS * 2];
+	int nLevels = std::min((int)occlusionCuller.nLevels(), MAX_HI_Z_LEVELS);
+
+	m_hiZData.clear();
+	for (int i = 0; i < nLevels; ++i) {
+		offsets[i] = (int)m_hiZData.size();
+		sizes[i * 2] = occlusionCuller.levelWidth(i);
+		sizes[i * 2 + 1] = occlusionCuller.levelHeight(i);
+		m_hiZData.insert(m_hiZData.end(), occlusionCuller.levelDepth(i).begin(), occlusionCuller.levelDepth(i).end());
+	}
+
+	glState.bindBuffer(GL_TEXTURE_BUFFER, m_hiZBuffer);
+	glBufferData(GL_TEXTURE_BUFFER, m_hiZData.size() * sizeof(float), m_hiZData.data(), GL_STREAM_DRAW);
+	glState.bindBuffer(GL_TEXTURE_BUFFER, 0);
+
+	glState.bindTexture(HI_Z_TEXTURE_UNIT, GL_TEXTURE_BUFFER, m_hiZTexture);
+	glUniform1i(glGetUniformLocation(m_program, "hiZ"), HI_Z_TEXTURE_UNIT);
+	glUniform1iv(glGetUniformLocation(m_program, "hiZOffsets"), nLevels, offsets);
+	glUniform2iv(glGetUniformLocation(m_program, "hiZSizes"), nLevels, sizes);
+}
+
+uint32_t GPUCuller::nVisible(size_t group)
+{
+	// Blocks until the culling pass has finished, the results are kept for the rest of the frame
+	if (!m_resultsRead) {
+		PROFILE_SCOPE("Read GPU culling results");
+		for (size_t i = 0; i < m_groups.size(); ++i) {
+			glGetQueryObjectuiv(m_queries[i], GL_QUERY_RESULT, &m_nVisible[i]);
+		}
+		m_resultsRead = true;
+	}
+	return m_nVisible[group];
+}
+
+void GPUCuller::bindInstances(GLStateCache& glState, size_t group, bool allInstances)
+{
+	// Without culling the instance buffer holds every instance in the same layout
+	bool visibleOnly = m_enabled && !allInstances;
+	size_t offset = m_groups[group].firstInstance * sizeof(glm::mat4);
+
+	glState.bindBuffer(GL_ARRAY_BUFFER, visibleOnly ? m_visibleBuffer : m_instanceBuffer);
+	for (int i = 0; i < 4; ++i) {
+		glVertexAttribPointer(5 + i, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (void*)(offset + i * sizeof(glm::vec4)));
+		glVertexAttribDivisor(5 + i, 1);
+		glEnableVertexAttribArray(5 + i);
+	}
+}
+
+void GPUCuller::draw(GLStateCache& glState, size_t group, bool allInstances)
+{
+	const Group& drawGroup = m_groups[group];
+	bool visibleOnly = m_enabled && !allInstances;
+
+	// The groups have their own vertex buffers, so each indirect draw takes one command
+	if (visibleOnly && m_indirect) {
+		glState.bindBuffer(GL_DRAW_INDIRECT_BUFFER, m_indirectBuffer);
+		glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_SHORT, (void*)(group * sizeof(DrawElementsIndirectCommand)), 1, 0);
+		return;
+	}
+
+	uint32_t nInstances = visibleOnly ? nVisible(group) : drawGroup.nInstances;
+	if (nInstances > 0) {
+		glDrawElementsInstanced(GL_TRIANGLES, drawGroup.renderComponent->nIndices(), GL_UNSIGNED_SHORT, (void*)0, nInstances);
+	}
+}
@@ -0,0 +1,105 @@
+#ifndef GPU_CULLER_H
+#define GPU_CULLER_H
+
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "GLStateCache.h"
+#include "OcclusionCuller.h"
+#include "RenderState.h"
+
+// Culling of instanced objects on the GPU, for scenes with more instances than the draw packet preparation can
+// cull each frame. The instances are grouped by mesh and material and their model matrices uploaded into one
+// buffer. A culling pass with rasterization disabled tests each instance's bounds against the frustum, and
+// optionally against the occlusion culler's hierarchical-Z, and transform feedback writes the matrices of the
+// visible ones packed into the group's range of a second buffer. Each group is then drawn with one instanced
+// draw from that buffer.
+//
+// The number of visible instances is counted by a primitive query per group. With GL 4.4 query buffer objects
+// the count is written straight into an indirect draw buffer and the groups are drawn with
+// glMultiDrawElementsIndirect, so nothing is read back. Otherwise the counts are read back before the first
+// pass drawing them, the culling is issued before the shadow maps so the GPU has finished it by then.
+class GPUCuller
+{
+public:
+	// Instances of one mesh with one material, drawn with the representative render component's buffers
+	struct Group
+	{
+		RenderComponent* renderComponent;
+		uint32_t firstInstance;
+		uint32_t nInstances;
+	};
+
+	GPUCuller() = default;
+
+	// The program is linked from gpu_cull_vs.glsl and gpu_cull_gs.glsl with InstanceModel captured. When culling
+	// is disabled, every instance is drawn.
+	void init(GLStateCache& glState, bool enabled, bool hiZ, bool indirect, uint32_t program);
+
+	// Deletes the buffers, the vertex array and the texture through the state cache, called by the renderer
+	// before the cache goes away
+	void destroy(GLStateCache& glState);
+
+	bool enabled() const { return m_enabled; }
+	bool indirect() const { return m_indirect; }
+
+	// Groups and uploads the instances and issues the culling pass, without waiting for it. The hierarchical-Z
+	// is used if the occlusion culler is given and has been built this frame.
+	void cull(GLStateCache& glState, const std::vector<RenderObject>& instances, const glm::mat4& viewProjection, const OcclusionCuller* occlusionCuller);
+
+	const std::vector<Group>& groups() const { return m_groups; }
+
+	// Points the instance matrix attributes at locations 5 to 8 of the bound vertex array at the group's
+	// instances. The shadow maps are drawn with all instances, the camera passes with the visible ones.
+	void bindInstances(GLStateCache& glState, size_t group, bool allInstances);
+
+	// Draws the group's mesh once for each instance bound with bindInstances
+	void draw(GLStateCache& glState, size_t group, bool allInstances);
+
+	size_t nInstances() const { return m_instances.size(); }
+
+private:
+	// Layout of the commands read by glMultiDrawElementsIndirect
+	struct DrawElementsIndirectCommand
+	{
+		uint32_t count;
+		uint32_t instanceCount;
+		uint32_t firstIndex;
+		int32_t baseVertex;
+		uint32_t baseInstance;
+	};
+
+	static const int MAX_HI_Z_LEVELS = 16;
+	static const int HI_Z_TEXTURE_UNIT = 9;
+
+	void uploadHierarchicalZ(GLStateCache& glState, const OcclusionCuller& occlusionCuller);
+	uint32_t nVisible(size_t group);
+
+	bool m_enabled = false;
+	bool m_hiZ = false;
+	bool m_indirect = false;
+	uint32_t m_program = 0;
+
+	uint32_t m_cullVAO = 0;
+	uint32_t m_instanceBuffer = 0;
+	uint32_t m_visibleBuffer = 0;
+	size_t m_visibleCapacity = 0;
+	uint32_t m_indirectBuffer = 0;
+	uint32_t m_hiZBuffer = 0;
+	uint32_t m_hiZTexture = 0;
+
+	std::vector<Group> m_groups;
+	std::vector<glm::mat4> m_instances;
+	std::vector<size_t> m_order;
+	std::vector<DrawElementsIndirectCommand> m_commands;
+	std::vector<float> m_hiZData;
+
+	// Primitive queries of the groups, the results are read back only without indirect draws
+	std::vector<uint32_t> m_queries;
+	std::vector<uint32_t> m_nVisible;
+	bool m_resultsRead = false;
+};
+
+#endif // !GPU_CULLER_H
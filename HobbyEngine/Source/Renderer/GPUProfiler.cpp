@@ -0,0 +1,284 @@
+#include "GPUProfiler.h"
+
+#include <algorithm>
+#include <cstdio>
+
+GPUProfiler::~GPUProfiler()
+{
+	for (int i = 0; i < FRAME_LATENCY; ++i) {
+		if (!m_frames[i].queries.empty()) {
+			glDeleteQueries(m_frames[i].queries.size(), &m_frames[i].queries[0]);
+		}
+	}
+}
+
+void GPUProfiler::init(bool enabled, bool perDrawTiming, size_t historySize)
+{
+	m_enabled = enabled;
+	m_perDrawTiming = perDrawTiming;
+	m_historySize = std::max(historySize, (size_t)1);
+}
+
+void GPUProfiler::beginFrame()
+{
+	if (!m_enabled) {
+		return;
+	}
+
+	m_currentFrame = (m_currentFrame + 1) % FRAME_LATENCY;
+	Frame& frame = m_frames[m_currentFrame];
+
+	// If the GPU is still more than FRAME_LATENCY frames behind, the frame is dropped instead of stalling
+	if (frame.pending) {
+		collect(frame);
+	}
+
+	frame.nUsedQueries = 0;
+	frame.zones.clear();
+	frame.pending = false;
+
+	m_zoneStack.clear();
+	m_segmentOpen = false;
+	m_recording = true;
+}
+
+void GPUProfiler::endFrame()
+{
+	if (!m_recording) {
+		return;
+	}
+
+	while (!m_zoneStack.empty()) {
+		endZone();
+	}
+
+	Frame& frame = m_frames[m_currentFrame];
+	frame.pending = frame.nUsedQueries > 0;
+	m_recording = false;
+}
+
+void GPUProfiler::beginZone(const std::string& name)
+{
+	if (!m_recording) {
+		return;
+	}
+
+	Frame& frame = m_frames[m_currentFrame];
+
+	stopSegment();
+
+	Zone zone;
+	zone.parent = m_zoneStack.empty() ? -1 : m_zoneStack.back();
+	zone.depth = m_zoneStack.size();
+	zone.path = zone.parent == -1 ? name : frame.zones[zone.parent].path + "/" + name;
+
+	frame.zones.push_back(zone);
+	m_zoneStack.push_back(frame.zones.size() - 1);
+
+	startSegment();
+}
+
+void GPUProfiler::endZone()
+{
+	if (!m_recording || m_zoneStack.empty()) {
+		return;
+	}
+
+	stopSegment();
+	m_zoneStack.pop_back();
+
+	// Resume the parent zone
+	if (!m_zoneStack.empty()) {
+		startSegment();
+	}
+}
+
+void GPUProfiler::startSegment()
+{
+	Frame& frame = m_frames[m_currentFrame];
+
+	if (frame.nUsedQueries == frame.queries.size()) {
+		uint32_t query;
+		glGenQueries(1, &query);
+		frame.queries.push_back(query);
+	}
+
+	size_t index = frame.nUsedQueries++;
+	frame.zones[m_zoneStack.back()].segments.push_back(index);
+
+	glBeginQuery(GL_TIME_ELAPSED, frame.queries[index]);
+	m_segmentOpen = true;
+}
+
+void GPUProfiler::stopSegment()
+{
+	if (m_segmentOpen) {
+		glEndQuery(GL_TIME_ELAPSED);
+		m_segmentOpen = false;
+	}
+}
+
+bool GPUProfiler::collect(Frame& frame)
+{
+	// Queries finish in order, so if the last one is available all of them are
+	int available = 0;
+	glGetQueryObjectiv(frame.queries[frame.nUsedQueries - 1], GL_QUERY_RESULT_AVAILABLE, &available);
+	if (!available) {
+		return false;
+	}
+
+	std::vector<uint64_t> times(frame.zones.size(), 0);
+
+	for (size_t i = 0; i < frame.zones.size(); ++i) {
+		for (auto it = frame.zones[i].segments.begin(); it != frame.zones[i].segments.end(); ++it) {
+			GLuint64 elapsed = 0;
+			glGetQueryObjectui64v(frame.queries[*it], GL_QUERY_RESULT, &elapsed);
+			times[i] += elapsed;
+		}
+	}
+
+	// Children are always recorded after their parents, so walking backwards accumulates nested times
+	for (size_t i = frame.zones.size(); i-- > 0;) {
+		if (frame.zones[i].parent != -1) {
+			times[frame.zones[i].parent] += times[i];
+		}
+	}
+
+	std::lock_guard<std::mutex> lock(m_historyMutex);
+
+	// The same zone may be opened several times in a frame, those are summed up
+	std::map<std::string, float> frameTimes;
+	for (size_t i = 0; i < frame.zones.size(); ++i) {
+		Zone& zone = frame.zones[i];
+		frameTimes[zone.path] += times[i] / 1000000.0f;
+
+		if (m_history.find(zone.path) == m_history.end()) {
+			History& history = m_history[zone.path];
+			size_t separator = zone.path.rfind('/');
+			history.name = separator == std::string::npos ? zone.path : zone.path.substr(separator + 1);
+			history.depth = zone.depth;
+
+			// Keep children right after their parent in the listing
+			auto insertAt = m_zoneOrder.end();
+			if (zone.parent != -1) {
+				std::string parentPath = frame.zones[zone.parent].path;
+				insertAt = std::find(m_zoneOrder.begin(), m_zoneOrder.end(), parentPath);
+				while (insertAt != m_zoneOrder.end() && (*insertAt == parentPath || insertAt->compare(0, parentPath.size() + 1, parentPath + "/") == 0)) {
+					++insertAt;
+				}
+			}
+			m_zoneOrder.insert(insertAt, zone.path);
+		}
+	}
+
+	for (auto it = frameTimes.begin(); it != frameTimes.end(); ++it) {
+		History& history = m_history[it->first];
+		if (history.samples.size() < m_historySize) {
+			history.samples.push_back(it->second);
+		}
+		else {
+			history.samples[history.next] = it->second;
+		}
+		history.next = (history.next + 1) % m_historySize;
+	}
+
+	return true;
+}
+
+GPUProfiler::ZoneStats GPUProfiler::computeStats(const History& history) const
+{
+	ZoneStats stats = {};
+	stats.name = history.name;
+	stats.depth = history.depth;
+
+	if (history.samples.empty()) {
+		return stats;
+	}
+
+	std::vector<float> sorted = history.samples;
+	std::sort(sorted.begin(), sorted.end());
+
+	float sum = 0.0f;
+	for (auto it = sorted.begin(); it != sorted.end(); ++it) {
+		sum += *it;
+	}
+
+	auto percentile = [&sorted](float p) { return sorted[std::min((size_t)(p * sorted.size()), sorted.size() - 1)]; };
+
+	size_t last = (history.next + history.samples.size() - 1) % history.samples.size();
+	stats.lastMs = history.samples[last];
+	stats.averageMs = sum / sorted.size();
+	stats.p50Ms = percentile(0.50f);
+	stats.p95Ms = percentile(0.95f);
+	stats.p99Ms = percentile(0.99f);
+	stats.maxMs = sorted.back();
+
+	return stats;
+}
+
+std::vector<GPUProfiler::ZoneStats> GPUProfiler::zoneStats() const
+{
+	std::lock_guard<std::mutex> lock(m_historyMutex);
+
+	std::vector<ZoneStats> stats;
+	for (auto it = m_zoneOrder.begin(); it != m_zoneOrder.end(); ++it) {
+		stats.push_back(computeStats(m_history.at(*it)));
+	}
+	return stats;
+}
+
+bool GPUProfiler::zoneStats(const std::string& path, ZoneStats& stats) const
+{
+	std::lock_guard<std::mutex> lock(m_historyMutex);
+
+	auto it = m_history.find(path);
+	if (it == m_history.end()) {
+		return false;
+	}
+	stats = computeStats(it->second);
+	return true;
+}
+
+std::string GPUProfiler::report() const
+{
+	if (!m_enabled) {
+		return "GPU profiler disabled";
+	}
+
+	std::string report = "GPU ms: avg / p50 / p95 / p99 / max";
+
+	char line[256];
+	auto stats = zoneStats();
+	for (auto it = stats.begin(); it != stats.end(); ++it) {
+		snprintf(line, sizeof(line), "\n%*s%s: %.2f / %.2f / %.2f / %.2f / %.2f", it->depth * 2, "", it->name.c_str(),
+			it->averageMs, it->p50Ms, it->p95Ms, it->p99Ms, it->maxMs);
+		report += line;
+	}
+
+	return report;
+}
+
+GPUTimerScope::GPUTimerScope(GPUProfiler& profiler, const char* name) :
+	m_profiler(profiler),
+	m_active(profiler.enabled())
+{
+	if (m_active) {
+		m_profiler.beginZone(name);
+	}
+}
+
+GPUTimerScope::GPUTimerScope(GPUProfiler& profiler, const char* name, uint64_t drawId) :
+	m_profiler(profiler),
+	m_active(profiler.perDrawTiming())
+{
+	if (m_active) {
+		m_profiler.beginZone(std::string(name) + " " + std::to_string(drawId));
+	}
+}
+
+GPUTimerScope::~GPUTimerScope()
+{
+	if (m_active) {
+		m_profiler.endZone();
+	}
+}
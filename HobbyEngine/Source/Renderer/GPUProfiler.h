@@ -0,0 +1,116 @@
+#ifndef GPU_PROFILER_H
+#define GPU_PROFILER_H
+
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <glad/glad.h>
+
+// Measures GPU time of named zones with GL_TIME_ELAPSED queries. Queries of a frame are read back only after
+// FRAME_LATENCY frames, so the CPU never waits on the GPU for the results. Time elapsed queries can't be
+// nested, so opening a zone inside another one pauses the outer zone's query and starts a new segment for it
+// once the inner zone has ended. A zone's time includes the time of its children.
+class GPUProfiler
+{
+public:
+	struct ZoneStats
+	{
+		std::string name;
+		int depth;
+		float lastMs;
+		float averageMs;
+		float p50Ms;
+		float p95Ms;
+		float p99Ms;
+		float maxMs;
+	};
+
+	GPUProfiler() = default;
+	~GPUProfiler();
+
+	void init(bool enabled, bool perDrawTiming, size_t historySize);
+
+	bool enabled() const { return m_enabled; }
+	bool perDrawTiming() const { return m_enabled && m_perDrawTiming; }
+
+	// Reads back the results of the oldest frame in the ring and starts recording a new frame
+	void beginFrame();
+	void endFrame();
+
+	void beginZone(const std::string& name);
+	void endZone();
+
+	// Statistics over the last historySize frames, in the order the zones were first seen. These may be
+	// called from other threads than the one rendering.
+	std::vector<ZoneStats> zoneStats() const;
+	bool zoneStats(const std::string& path, ZoneStats& stats) const;
+
+	// Human readable table of the zone statistics, one zone per line
+	std::string report() const;
+
+private:
+	static const int FRAME_LATENCY = 4;
+
+	struct Zone
+	{
+		std::string path;
+		int parent;
+		int depth;
+		std::vector<size_t> segments;
+	};
+
+	struct Frame
+	{
+		std::vector<uint32_t> queries;
+		size_t nUsedQueries = 0;
+		std::vector<Zone> zones;
+		bool pending = false;
+	};
+
+	struct History
+	{
+		std::string name;
+		int depth;
+		std::vector<float> samples;
+		size_t next = 0;
+	};
+
+	void startSegment();
+	void stopSegment();
+	bool collect(Frame& frame);
+	ZoneStats computeStats(const History& history) const;
+
+	bool m_enabled = false;
+	bool m_perDrawTiming = false;
+	size_t m_historySize = 120;
+
+	Frame m_frames[FRAME_LATENCY];
+	int m_currentFrame = 0;
+	bool m_recording = false;
+
+	std::vector<int> m_zoneStack;
+	bool m_segmentOpen = false;
+
+	mutable std::mutex m_historyMutex;
+	std::map<std::string, History> m_history;
+	std::vector<std::string> m_zoneOrder;
+};
+
+// Times the GPU work issued during its lifetime. The draw id overload is only active when per draw timing
+// is enabled, so it can be left in the draw functions.
+class GPUTimerScope
+{
+public:
+	GPUTimerScope(GPUProfiler& profiler, const char* name);
+	GPUTimerScope(GPUProfiler& profiler, const char* name, uint64_t drawId);
+	~GPUTimerScope();
+
+private:
+	GPUProfiler& m_profiler;
+	bool m_active;
+};
+
+#endif // !GPU_PROFILER_H
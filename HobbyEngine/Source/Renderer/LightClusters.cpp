@@ -0,0 +1,216 @@
+#include "LightClusters.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include <glad/glad.h>
+
+#include "../Utils/Profiler.h"
+
+namespace
+{
+	bool sphereIntersectsAABB(const glm::vec3& center, float radius, const AABB& box)
+	{
+		glm::vec3 closest = glm::clamp(center, box.min, box.max);
+		glm::vec3 d = closest - center;
+		return glm::dot(d, d) <= radius * radius;
+	}
+
+	// Range of tiles covered by [minExtent, maxExtent] on one axis of view space, for a sphere between the depths
+	// zNear and zFar. Returns false if the range is outside the frustum.
+	bool tileRange(float minExtent, float maxExtent, float zNear, float zFar, float tanHalfFov, int nTiles, int& first, int& last)
+	{
+		float ndcMin = (minExtent < 0.0f ? minExtent / zNear : minExtent / zFar) / tanHalfFov;
+		float ndcMax = (maxExtent > 0.0f ? maxExtent / zNear : maxExtent / zFar) / tanHalfFov;
+		if (ndcMax < -1.0f || ndcMin > 1.0f) {
+			return false;
+		}
+
+		first = std::max(0, (int)std::floor((ndcMin * 0.5f + 0.5f) * nTiles));
+		last = std::min(nTiles - 1, (int)std::floor((ndcMax * 0.5f + 0.5f) * nTiles));
+		return true;
+	}
+}
+
+void LightClusters::init(GLStateCache& glState)
+{
+	m_clusterLights.resize(N_CLUSTERS * MAX_LIGHTS_PER_CLUSTER);
+	m_clusterLightCounts.resize(N_CLUSTERS);
+	m_grid.resize(N_CLUSTERS * 2);
+	m_clusterBounds.resize(N_CLUSTERS);
+
+	auto createTextureBuffer = [&glState](uint32_t& buffer, uint32_t& texture, GLenum format, size_t size) {
+		glGenBuffers(1, &buffer);
+		glState.bindBuffer(GL_TEXTURE_BUFFER, buffer);
+		glBufferData(GL_TEXTURE_BUFFER, size, nullptr, GL_STREAM_DRAW);
+
+		glGenTextures(1, &texture);
+		glState.bindTexture(0, GL_TEXTURE_BUFFER, texture);
+		glTexBuffer(GL_TEXTURE_BUFFER, format, buffer);
+	};
+
+	createTextureBuffer(m_lightBuffer, m_lightTexture, GL_RGBA32F, sizeof(glm::vec4) * 3);
+	createTextureBuffer(m_gridBuffer, m_gridTexture, GL_RG32UI, sizeof(uint32_t) * m_grid.size());
+	createTextureBuffer(m_indexBuffer, m_indexTexture, GL_R32UI, sizeof(uint32_t));
+
+	glState.bindTexture(0, GL_TEXTURE_BUFFER, 0);
+	glState.bindBuffer(GL_TEXTURE_BUFFER, 0);
+}
+
+void LightClusters::computeClusterBounds()
+{
+	// Exponential slices keep the clusters roughly cubical, instead of very deep near the camera
+	for (int i = 0; i <= SLICES; ++i) {
+		m_sliceDepths[i] = m_nearPlane * std::pow(m_farPlane / m_nearPlane, (float)i / SLICES);
+	}
+
+	float tanHalfFovY = std::tan(m_fovY * 0.5f);
+	float tanHalfFovX = tanHalfFovY * m_aspect;
+
+	for (int slice = 0; slice < SLICES; ++slice) {
+		for (int y = 0; y < TILES_Y; ++y) {
+			for (int x = 0; x < TILES_X; ++x) {
+				AABB& bounds = m_clusterBounds[x + y * TILES_X + slice * TILES_X * TILES_Y];
+				bounds = AABB();
+
+				float ndcX[2] = { -1.0f + 2.0f * x / TILES_X, -1.0f + 2.0f * (x + 1) / TILES_X };
+				float ndcY[2] = { -1.0f + 2.0f * y / TILES_Y, -1.0f + 2.0f * (y + 1) / TILES_Y };
+				float depths[2] = { m_sliceDepths[slice], m_sliceDepths[slice + 1] };
+				for (int c = 0; c < 8; ++c) {
+					float depth = depths[(c >> 2) & 1];
+					bounds.expand(glm::vec3(ndcX[c & 1] * tanHalfFovX * depth, ndcY[(c >> 1) & 1] * tanHalfFovY * depth, -depth));
+				}
+			}
+		}
+	}
+}
+
+void LightClusters::destroy(GLStateCache& glState)
+{
+	glState.deleteTexture(m_lightTexture);
+	glState.deleteTexture(m_gridTexture);
+	glState.deleteTexture(m_indexTexture);
+	glState.deleteBuffer(m_lightBuffer);
+	glState.deleteBuffer(m_gridBuffer);
+	glState.deleteBuffer(m_indexBuffer);
+}
+
+void LightClusters::build(const std::vector<RenderLight>& lights, const glm::mat4& view, float fovY, float aspect, float nearPlane, float farPlane, JobSystem& jobSystem)
+{
+	PROFILE_FUNCTION();
+
+	if (fovY != m_fovY || aspect != m_aspect || nearPlane != m_nearPlane || farPlane != m_farPlane) {
+		m_fovY = fovY;
+		m_aspect = aspect;
+		m_nearPlane = nearPlane;
+		m_farPlane = farPlane;
+		computeClusterBounds();
+	}
+
+	m_nLights = lights.size();
+	m_lightData.resize(m_nLights * 3);
+	m_viewSpaceLights.resize(m_nLights);
+	for (size_t i = 0; i < m_nLights; ++i) {
+		const RenderLight& light = lights[i];
+		m_lightData[i * 3] = glm::vec4(light.position, light.range);
+		m_lightData[i * 3 + 1] = glm::vec4(light.color, light.cosInnerAngle);
+		m_lightData[i * 3 + 2] = glm::vec4(light.direction, light.cosOuterAngle);
+		m_viewSpaceLights[i] = glm::vec4(glm::vec3(view * glm::vec4(light.position, 1.0f)), light.range);
+	}
+
+	float tanHalfFovY = std::tan(m_fovY * 0.5f);
+	float tanHalfFovX = tanHalfFovY * m_aspect;
+
+	// Each slice is binned by one thread, so the clusters' light lists are written without synchronization
+	jobSystem.parallelFor(SLICES, 1, [&](size_t begin, size_t end, int) {
+		for (size_t slice = begin; slice < end; ++slice) {
+			uint32_t* counts = &m_clusterLightCounts[slice * TILES_X * TILES_Y];
+			std::fill(counts, counts + TILES_X * TILES_Y, 0);
+
+			float sliceNear = m_sliceDepths[slice];
+			float sliceFar = m_sliceDepths[slice + 1];
+
+			for (size_t i = 0; i < m_nLights; ++i) {
+				glm::vec3 center(m_viewSpaceLights[i]);
+				float radius = m_viewSpaceLights[i].w;
+				float depth = -center.z;
+				if (depth + radius < sliceNear || depth - radius > sliceFar) {
+					continue;
+				}
+
+				float zNear = std::max(sliceNear, depth - radius);
+				float zFar = std::min(sliceFar, depth + radius);
+
+				int firstX, lastX, firstY, lastY;
+				if (!tileRange(center.x - radius, center.x + radius, zNear, zFar, tanHalfFovX, TILES_X, firstX, lastX) ||
+					!tileRange(center.y - radius, center.y + radius, zNear, zFar, tanHalfFovY, TILES_Y, firstY, lastY)) {
+					continue;
+				}
+
+				for (int y = firstY; y <= lastY; ++y) {
+					for (int x = firstX; x <= lastX; ++x) {
+						int tile = x + y * TILES_X;
+						size_t cluster = tile + slice * TILES_X * TILES_Y;
+						if (counts[tile] < MAX_LIGHTS_PER_CLUSTER && sphereIntersectsAABB(center, radius, m_clusterBounds[cluster])) {
+							m_clusterLights[cluster * MAX_LIGHTS_PER_CLUSTER + counts[tile]++] = (uint32_t)i;
+						}
+					}
+				}
+			}
+		}
+	});
+
+	m_lightIndices.clear();
+	for (size_t cluster = 0; cluster < N_CLUSTERS; ++cluster) {
+		uint32_t count = m_clusterLightCounts[cluster];
+		m_grid[cluster * 2] = (uint32_t)m_lightIndices.size();
+		m_grid[cluster * 2 + 1] = count;
+
+		const uint32_t* clusterLights = &m_clusterLights[cluster * MAX_LIGHTS_PER_CLUSTER];
+		m_lightIndices.insert(m_lightIndices.end(), clusterLights, clusterLights + count);
+	}
+}
+
+void LightClusters::upload(GLStateCache& glState)
+{
+	PROFILE_FUNCTION();
+
+	// The buffers are orphaned every frame, so the driver doesn't have to wait for the previous frame's draws
+	glState.bindBuffer(GL_TEXTURE_BUFFER, m_lightBuffer);
+	glBufferData(GL_TEXTURE_BUFFER, std::max<size_t>(m_lightData.size(), 1) * sizeof(glm::vec4), nullptr, GL_STREAM_DRAW);
+	if (!m_lightData.empty()) {
+		glBufferSubData(GL_TEXTURE_BUFFER, 0, m_lightData.size() * sizeof(glm::vec4), m_lightData.data());
+	}
+
+	glState.bindBuffer(GL_TEXTURE_BUFFER, m_gridBuffer);
+	glBufferData(GL_TEXTURE_BUFFER, m_grid.size() * sizeof(uint32_t), m_grid.data(), GL_STREAM_DRAW);
+
+	glState.bindBuffer(GL_TEXTURE_BUFFER, m_indexBuffer);
+	glBufferData(GL_TEXTURE_BUFFER, std::max<size_t>(m_lightIndices.size(), 1) * sizeof(uint32_t), nullptr, GL_STREAM_DRAW);
+	if (!m_lightIndices.empty()) {
+		glBufferSubData(GL_TEXTURE_BUFFER, 0, m_lightIndices.size() * sizeof(uint32_t), m_lightIndices.data());
+	}
+
+	glState.bindBuffer(GL_TEXTURE_BUFFER, 0);
+}
+
+void LightClusters::bindTextures(GLStateCache& glState, int firstUnit)
+{
+	glState.bindTexture(firstUnit, GL_TEXTURE_BUFFER, m_lightTexture);
+	glState.bindTexture(firstUnit + 1, GL_TEXTURE_BUFFER, m_gridTexture);
+	glState.bindTexture(firstUnit + 2, GL_TEXTURE_BUFFER, m_indexTexture);
+}
+
+void LightClusters::setUniforms(uint32_t program, int firstUnit, int screenWidth, int screenHeight)
+{
+	glUniform1i(glGetUniformLocation(program, "lightData"), firstUnit);
+	glUniform1i(glGetUniformLocation(program, "lightGrid"), firstUnit + 1);
+	glUniform1i(glGetUniformLocation(program, "lightIndices"), firstUnit + 2);
+
+	glUniform2f(glGetUniformLocation(program, "clusterTileSize"), (float)screenWidth / TILES_X, (float)screenHeight / TILES_Y);
+
+	// slice = log(depth) * scale - bias, the inverse of the slice depths
+	float scale = SLICES / std::log(m_farPlane / m_nearPlane);
+	glUniform1f(glGetUniformLocation(program, "clusterDepthScale"), scale);
+	glUniform1f(glGetUniformLocation(program, "clusterDepthBias"), std::log(m_nearPlane) * scale);
+}
@@ -0,0 +1,86 @@
+#ifndef LIGHT_CLUSTERS_H
+#define LIGHT_CLUSTERS_H
+
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "AABB.h"
+#include "GLStateCache.h"
+#include "RenderState.h"
+#include "../Engine/JobSystem.h"
+
+// Clustered forward lighting. The view frustum is split into screen space tiles and exponentially spaced depth
+// slices, and each frame the point and spot lights are binned on the CPU into the clusters their range
+// overlaps. The game object shader finds the cluster of a fragment from its window position and view depth, and
+// loops only over that cluster's lights. Clusters take at most MAX_LIGHTS_PER_CLUSTER lights, so the cost per
+// fragment stays bounded however many lights the scene has.
+//
+// The lights and cluster lists are stored in texture buffers, as uniform buffers would be too small for them and
+// shader storage buffers aren't available in OpenGL 3.3.
+class LightClusters
+{
+public:
+	static const int TILES_X = 16;
+	static const int TILES_Y = 9;
+	static const int SLICES = 24;
+	static const int N_CLUSTERS = TILES_X * TILES_Y * SLICES;
+	static const int MAX_LIGHTS_PER_CLUSTER = 64;
+
+	LightClusters() = default;
+
+	void init(GLStateCache& glState);
+
+	// Deletes the buffers and textures through the state cache, called by the renderer before the cache goes away
+	void destroy(GLStateCache& glState);
+
+	// Bins the lights into the clusters of the view frustum, the depth slices are split between the job system's
+	// threads
+	void build(const std::vector<RenderLight>& lights, const glm::mat4& view, float fovY, float aspect, float nearPlane, float farPlane, JobSystem& jobSystem);
+
+	// Uploads the lights and cluster lists of the last build
+	void upload(GLStateCache& glState);
+
+	// The texture buffers are bound to firstUnit and the two units after it
+	void bindTextures(GLStateCache& glState, int firstUnit);
+	void setUniforms(uint32_t program, int firstUnit, int screenWidth, int screenHeight);
+
+	size_t nLights() const { return m_nLights; }
+	size_t nLightIndices() const { return m_lightIndices.size(); }
+
+private:
+	void computeClusterBounds();
+
+	uint32_t m_lightBuffer = 0;
+	uint32_t m_lightTexture = 0;
+	uint32_t m_gridBuffer = 0;
+	uint32_t m_gridTexture = 0;
+	uint32_t m_indexBuffer = 0;
+	uint32_t m_indexTexture = 0;
+
+	float m_fovY = 0.0f;
+	float m_aspect = 0.0f;
+	float m_nearPlane = 0.0f;
+	float m_farPlane = 0.0f;
+
+	float m_sliceDepths[SLICES + 1];
+	std::vector<AABB> m_clusterBounds;
+
+	size_t m_nLights = 0;
+
+	// Three texels per light: position and range, color and cosine of the inner cone angle, direction and cosine
+	// of the outer cone angle
+	std::vector<glm::vec4> m_lightData;
+	std::vector<glm::vec4> m_viewSpaceLights;
+
+	// Fixed size light lists per cluster, filled in parallel and compacted into the index list for uploading
+	std::vector<uint32_t> m_clusterLights;
+	std::vector<uint32_t> m_clusterLightCounts;
+
+	// Offset and count of each cluster's lights in the index list
+	std::vector<uint32_t> m_grid;
+	std::vector<uint32_t> m_lightIndices;
+};
+
+#endif // !LIGHT_CLUSTERS_H
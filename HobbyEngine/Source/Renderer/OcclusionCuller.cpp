@@ -0,0 +1,282 @@
+#include "OcclusionCuller.h"
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#include <emmintrin.h>
+#define OCCLUSION_CULLER_SSE2
+#endif
+
+#include "../ResourceCache/ModelLoader.h"
+#include "../Utils/Profiler.h"
+
+namespace
+{
+	// Clip space w is the view space depth, triangles and boxes closer than the near plane aren't clipped but
+	// skipped and treated as visible
+	const float NEAR_W = 0.1f;
+}
+
+void OcclusionCuller::init(bool enabled, int width, int height)
+{
+	m_enabled = enabled;
+	m_width = (std::max(width, 4) + 3) & ~3;
+	m_height = std::max(height, 1);
+
+	m_levels.clear();
+	int levelWidth = m_width;
+	int levelHeight = m_height;
+	while (true) {
+		DepthLevel level;
+		level.width = levelWidth;
+		level.height = levelHeight;
+		level.depth.resize(levelWidth * levelHeight, 1.0f);
+		m_levels.push_back(level);
+
+		if (levelWidth == 1 && levelHeight == 1) {
+			break;
+		}
+		levelWidth = (levelWidth + 1) / 2;
+		levelHeight = (levelHeight + 1) / 2;
+	}
+}
+
+void OcclusionCuller::build(const std::vector<RenderOccluder>& occluders, const glm::mat4& viewProjection, JobSystem& jobSystem)
+{
+	PROFILE_FUNCTION();
+
+	m_viewProjection = viewProjection;
+	m_nCulled = 0;
+
+	m_threadTriangles.resize(jobSystem.nThreads());
+	for (auto it = m_threadTriangles.begin(); it != m_threadTriangles.end(); ++it) {
+		it->clear();
+	}
+
+	jobSystem.parallelFor(occluders.size(), 4, [&](size_t begin, size_t end, int threadIndex) {
+		PROFILE_SCOPE("Set up occluders");
+		for (size_t i = begin; i < end; ++i) {
+			setupTriangles(occluders[i], m_threadTriangles[threadIndex]);
+		}
+	});
+
+	m_nOccluderTriangles = 0;
+	for (auto it = m_threadTriangles.begin(); it != m_threadTriangles.end(); ++it) {
+		m_nOccluderTriangles += it->size();
+	}
+
+	// Bands of rows are rasterized independently, so no two threads write the same pixels
+	int nBands = (m_height + BAND_HEIGHT - 1) / BAND_HEIGHT;
+	jobSystem.parallelFor(nBands, 1, [&](size_t begin, size_t end, int) {
+		PROFILE_SCOPE("Rasterize occluders");
+		for (size_t band = begin; band < end; ++band) {
+			rasterizeBand((int)band);
+		}
+	});
+
+	buildHierarchicalZ();
+}
+
+void OcclusionCuller::setupTriangles(const RenderOccluder& occluder, std::vector<Triangle>& triangles)
+{
+	auto& vertices = occluder.mesh->vertices();
+	auto& indices = occluder.mesh->indices();
+	glm::mat4 modelViewProjection = m_viewProjection * occluder.model;
+
+	for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+		glm::vec3 screen[3];
+		bool nearClipped = false;
+		for (int v = 0; v < 3; ++v) {
+			glm::vec4 clip = modelViewProjection * glm::vec4(vertices[indices[i + v]], 1.0f);
+			if (clip.w < NEAR_W) {
+				nearClipped = true;
+				break;
+			}
+			glm::vec3 ndc = glm::vec3(clip) / clip.w;
+			screen[v] = glm::vec3((ndc.x * 0.5f + 0.5f) * m_width, (ndc.y * 0.5f + 0.5f) * m_height, ndc.z * 0.5f + 0.5f);
+		}
+		if (nearClipped) {
+			continue;
+		}
+
+		// Twice the signed area, positive for counter-clockwise front faces
+		float area = (screen[1].x - screen[0].x) * (screen[2].y - screen[0].y) - (screen[2].x - screen[0].x) * (screen[1].y - screen[0].y);
+		if (area <= 0.0f) {
+			continue;
+		}
+
+		Triangle triangle;
+		triangle.minX = std::max(0, (int)std::floor(std::min(screen[0].x, std::min(screen[1].x, screen[2].x))));
+		triangle.maxX = std::min(m_width - 1, (int)std::ceil(std::max(screen[0].x, std::max(screen[1].x, screen[2].x))));
+		triangle.minY = std::max(0, (int)std::floor(std::min(screen[0].y, std::min(screen[1].y, screen[2].y))));
+		triangle.maxY = std::min(m_height - 1, (int)std::ceil(std::max(screen[0].y, std::max(screen[1].y, screen[2].y))));
+		if (triangle.minX > triangle.maxX || triangle.minY > triangle.maxY) {
+			continue;
+		}
+
+		// Edge i is opposite to vertex i
+		for (int e = 0; e < 3; ++e) {
+			const glm::vec3& a = screen[(e + 1) % 3];
+			const glm::vec3& b = screen[(e + 2) % 3];
+			triangle.edgeA[e] = a.y - b.y;
+			triangle.edgeB[e] = b.x - a.x;
+			triangle.edgeC[e] = a.x * b.y - a.y * b.x;
+		}
+
+		// Depth plane from the barycentric weights, which are the edge functions divided by the area
+		triangle.depthA = (triangle.edgeA[0] * screen[0].z + triangle.edgeA[1] * screen[1].z + triangle.edgeA[2] * screen[2].z) / area;
+		triangle.depthB = (triangle.edgeB[0] * screen[0].z + triangle.edgeB[1] * screen[1].z + triangle.edgeB[2] * screen[2].z) / area;
+		triangle.depthC = (triangle.edgeC[0] * screen[0].z + triangle.edgeC[1] * screen[1].z + triangle.edgeC[2] * screen[2].z) / area;
+
+		triangles.push_back(triangle);
+	}
+}
+
+void OcclusionCuller::rasterizeBand(int band)
+{
+	int minY = band * BAND_HEIGHT;
+	int maxY = std::min(m_height, minY + BAND_HEIGHT) - 1;
+
+	std::vector<float>& depth = m_levels[0].depth;
+	std::fill(depth.begin() + minY * m_width, depth.begin() + (maxY + 1) * m_width, 1.0f);
+
+	for (auto threadIt = m_threadTriangles.begin(); threadIt != m_threadTriangles.end(); ++threadIt) {
+		for (auto it = threadIt->begin(); it != threadIt->end(); ++it) {
+			if (it->maxY >= minY && it->minY <= maxY) {
+				rasterizeTriangle(*it, std::max(minY, it->minY), std::min(maxY, it->maxY));
+			}
+		}
+	}
+}
+
+void OcclusionCuller::rasterizeTriangle(const Triangle& t, int minY, int maxY)
+{
+	float* depth = m_levels[0].depth.data();
+
+	// Four pixels per step, starting from a multiple of four so a step never crosses the end of a row
+	int minX = t.minX & ~3;
+
+#ifdef OCCLUSION_CULLER_SSE2
+	__m128 edgeA0 = _mm_set1_ps(t.edgeA[0]);
+	__m128 edgeA1 = _mm_set1_ps(t.edgeA[1]);
+	__m128 edgeA2 = _mm_set1_ps(t.edgeA[2]);
+	__m128 depthA = _mm_set1_ps(t.depthA);
+	__m128 zero = _mm_setzero_ps();
+	__m128 pixelOffsets = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+
+	for (int y = minY; y <= maxY; ++y) {
+		float py = y + 0.5f;
+		__m128 row0 = _mm_set1_ps(t.edgeB[0] * py + t.edgeC[0]);
+		__m128 row1 = _mm_set1_ps(t.edgeB[1] * py + t.edgeC[1]);
+		__m128 row2 = _mm_set1_ps(t.edgeB[2] * py + t.edgeC[2]);
+		__m128 rowDepth = _mm_set1_ps(t.depthB * py + t.depthC);
+
+		float* rowPixels = depth + y * m_width;
+		for (int x = minX; x <= t.maxX; x += 4) {
+			__m128 px = _mm_add_ps(_mm_set1_ps((float)x), pixelOffsets);
+
+			__m128 inside = _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(edgeA0, px), row0), zero);
+			inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(edgeA1, px), row1), zero));
+			inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(edgeA2, px), row2), zero));
+			if (_mm_movemask_ps(inside) == 0) {
+				continue;
+			}
+
+			__m128 pixelDepth = _mm_add_ps(_mm_mul_ps(depthA, px), rowDepth);
+			__m128 current = _mm_loadu_ps(rowPixels + x);
+			__m128 closest = _mm_min_ps(current, pixelDepth);
+			_mm_storeu_ps(rowPixels + x, _mm_or_ps(_mm_and_ps(inside, closest), _mm_andnot_ps(inside, current)));
+		}
+	}
+#else
+	for (int y = minY; y <= maxY; ++y) {
+		float py = y + 0.5f;
+		float* rowPixels = depth + y * m_width;
+		for (int x = minX; x <= t.maxX; ++x) {
+			float px = x + 0.5f;
+			bool inside = t.edgeA[0] * px + t.edgeB[0] * py + t.edgeC[0] >= 0.0f
+				&& t.edgeA[1] * px + t.edgeB[1] * py + t.edgeC[1] >= 0.0f
+				&& t.edgeA[2] * px + t.edgeB[2] * py + t.edgeC[2] >= 0.0f;
+			if (inside) {
+				rowPixels[x] = std::min(rowPixels[x], t.depthA * px + t.depthB * py + t.depthC);
+			}
+		}
+	}
+#endif
+}
+
+void OcclusionCuller::buildHierarchicalZ()
+{
+	PROFILE_FUNCTION();
+
+	for (size_t i = 1; i < m_levels.size(); ++i) {
+		const DepthLevel& src = m_levels[i - 1];
+		DepthLevel& dst = m_levels[i];
+
+		for (int y = 0; y < dst.height; ++y) {
+			int y0 = y * 2;
+			int y1 = std::min(y0 + 1, src.height - 1);
+			for (int x = 0; x < dst.width; ++x) {
+				int x0 = x * 2;
+				int x1 = std::min(x0 + 1, src.width - 1);
+				dst.depth[y * dst.width + x] = std::max(std::max(src.depth[y0 * src.width + x0], src.depth[y0 * src.width + x1]),
+					std::max(src.depth[y1 * src.width + x0], src.depth[y1 * src.width + x1]));
+			}
+		}
+	}
+}
+
+bool OcclusionCuller::isVisible(const AABB& bounds) const
+{
+	float minX = FLT_MAX, minY = FLT_MAX, maxX = -FLT_MAX, maxY = -FLT_MAX;
+	float nearestDepth = FLT_MAX;
+
+	for (int i = 0; i < 8; ++i) {
+		glm::vec3 corner((i & 1) ? bounds.max.x : bounds.min.x, (i & 2) ? bounds.max.y : bounds.min.y, (i & 4) ? bounds.max.z : bounds.min.z);
+		glm::vec4 clip = m_viewProjection * glm::vec4(corner, 1.0f);
+		if (clip.w < NEAR_W) {
+			return true;
+		}
+
+		glm::vec3 ndc = glm::vec3(clip) / clip.w;
+		minX = std::min(minX, (ndc.x * 0.5f + 0.5f) * m_width);
+		maxX = std::max(maxX, (ndc.x * 0.5f + 0.5f) * m_width);
+		minY = std::min(minY, (ndc.y * 0.5f + 0.5f) * m_height);
+		maxY = std::max(maxY, (ndc.y * 0.5f + 0.5f) * m_height);
+		nearestDepth = std::min(nearestDepth, ndc.z * 0.5f + 0.5f);
+	}
+
+	int x0 = std::max(0, (int)std::floor(minX));
+	int x1 = std::min(m_width - 1, (int)std::floor(maxX));
+	int y0 = std::max(0, (int)std::floor(minY));
+	int y1 = std::min(m_height - 1, (int)std::floor(maxY));
+	if (x0 > x1 || y0 > y1) {
+		// Off screen, left to the frustum culling
+		return true;
+	}
+
+	// Pick the level where the box covers at most 2x2 texels
+	int size = std::max(x1 - x0, y1 - y0);
+	size_t level = 0;
+	while (size > 1 && level + 1 < m_levels.size()) {
+		size /= 2;
+		x0 /= 2;
+		x1 /= 2;
+		y0 /= 2;
+		y1 /= 2;
+		++level;
+	}
+
+	const DepthLevel& depthLevel = m_levels[level];
+	for (int y = y0; y <= y1; ++y) {
+		for (int x = x0; x <= x1; ++x) {
+			if (nearestDepth <= depthLevel.depth[y * depthLevel.width + x]) {
+				return true;
+			}
+		}
+	}
+
+	++m_nCulled;
+	return false;
+}
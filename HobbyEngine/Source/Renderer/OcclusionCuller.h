@@ -0,0 +1,92 @@
+#ifndef OCCLUSION_CULLER_H
+#define OCCLUSION_CULLER_H
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "AABB.h"
+#include "RenderState.h"
+#include "../Engine/JobSystem.h"
+
+// Software occlusion culling. The occluder meshes of the scene are rasterized on the CPU into a small depth
+// buffer, four pixels at a time with SSE2, and a hierarchical-Z pyramid of the farthest depths is built from
+// it. Bounding boxes are then tested against the pyramid level where they cover only a few texels, and boxes
+// behind the occluders everywhere are culled before their draw packets are emitted.
+//
+// Occluders should be low-poly meshes that stay inside the rendered mesh, otherwise objects that are visible
+// through the gaps of the real mesh may be culled. Only front faces are rasterized, so the meshes must be
+// wound counter-clockwise like the rendered ones.
+class OcclusionCuller
+{
+public:
+	OcclusionCuller() = default;
+
+	// The width is rounded up to a multiple of four for the SIMD rasterizer
+	void init(bool enabled, int width, int height);
+
+	bool enabled() const { return m_enabled; }
+
+	// Rasterizes the occluders and builds the hierarchical-Z, split between the job system's threads
+	void build(const std::vector<RenderOccluder>& occluders, const glm::mat4& viewProjection, JobSystem& jobSystem);
+
+	// Returns false if the box is hidden behind the occluders. Can be called from several threads after build.
+	bool isVisible(const AABB& bounds) const;
+
+	// Hierarchical-Z levels for the GPU culling, level 0 is the rasterized depth buffer
+	size_t nLevels() const { return m_levels.size(); }
+	int levelWidth(size_t level) const { return m_levels[level].width; }
+	int levelHeight(size_t level) const { return m_levels[level].height; }
+	const std::vector<float>& levelDepth(size_t level) const { return m_levels[level].depth; }
+
+	size_t nOccluderTriangles() const { return m_nOccluderTriangles; }
+	uint32_t nCulled() const { return m_nCulled; }
+
+private:
+	// Screen space triangle set up for rasterization. Edge functions are positive inside, and the depth is
+	// interpolated linearly in screen space.
+	struct Triangle
+	{
+		float edgeA[3];
+		float edgeB[3];
+		float edgeC[3];
+		float depthA;
+		float depthB;
+		float depthC;
+		int minX;
+		int maxX;
+		int minY;
+		int maxY;
+	};
+
+	static const int BAND_HEIGHT = 8;
+
+	void setupTriangles(const RenderOccluder& occluder, std::vector<Triangle>& triangles);
+	void rasterizeBand(int band);
+	void rasterizeTriangle(const Triangle& triangle, int minY, int maxY);
+	void buildHierarchicalZ();
+
+	bool m_enabled = false;
+	int m_width = 0;
+	int m_height = 0;
+
+	glm::mat4 m_viewProjection;
+
+	std::vector<std::vector<Triangle>> m_threadTriangles;
+	size_t m_nOccluderTriangles = 0;
+
+	// Level 0 is the rasterized depth buffer, each level above it holds the farthest depth of 2x2 texels below
+	struct DepthLevel
+	{
+		int width;
+		int height;
+		std::vector<float> depth;
+	};
+	std::vector<DepthLevel> m_levels;
+
+	mutable std::atomic<uint32_t> m_nCulled{ 0 };
+};
+
+#endif // !OCCLUSION_CULLER_H
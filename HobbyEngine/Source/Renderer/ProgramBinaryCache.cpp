@@ -0,0 +1,161 @@
+#include "ProgramBinaryCache.h"
+
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <vector>
+
+#include <glad/glad.h>
+
+#include "../Utils/DebugLogger.h"
+
+namespace
+{
+	const uint32_t CACHE_FILE_MAGIC = 0x42505248; // "HRPB"
+
+	struct CacheFileHeader
+	{
+		uint32_t magic;
+		uint32_t binaryFormat;
+		uint32_t binaryLength;
+	};
+
+	// 64-bit FNV-1a, good enough for telling shader sources apart
+	uint64_t hashString(const std::string& str, uint64_t hash = 14695981039346656037ull)
+	{
+		for (auto it = str.begin(); it != str.end(); ++it) {
+			hash ^= (uint8_t)*it;
+			hash *= 1099511628211ull;
+		}
+		return hash;
+	}
+
+	std::string glString(GLenum name)
+	{
+		auto str = glGetString(name);
+		return str ? std::string((const char*)str) : std::string();
+	}
+}
+
+void ProgramBinaryCache::init(bool enabled, const std::string& directory)
+{
+	m_enabled = false;
+	m_directory = directory;
+
+	if (!enabled) {
+		return;
+	}
+
+	// Program binaries are core since 4.1, the context is created as 3.3 but drivers usually expose more
+	if (!GLAD_GL_VERSION_4_1) {
+		LOG_DEBUG("ProgramBinaryCache::init: program binaries aren't supported by the driver");
+		return;
+	}
+
+	int nFormats = 0;
+	glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &nFormats);
+	if (nFormats == 0) {
+		LOG_DEBUG("ProgramBinaryCache::init: the driver doesn't support any program binary formats");
+		return;
+	}
+
+	std::error_code err;
+	std::filesystem::create_directories(m_directory, err);
+	if (err) {
+		LOG_DEBUG("ProgramBinaryCache::init: could not create cache directory " + m_directory);
+		return;
+	}
+
+	m_driver = glString(GL_VENDOR) + ";" + glString(GL_RENDERER) + ";" + glString(GL_VERSION);
+	m_enabled = true;
+}
+
+std::string ProgramBinaryCache::key(const std::string& vertexSource, const std::string& fragmentSource, const std::string& geometrySource) const
+{
+	uint64_t hash = hashString(m_driver);
+	hash = hashString(vertexSource, hash);
+	hash = hashString("\n", hash);
+	hash = hashString(fragmentSource, hash);
+	if (!geometrySource.empty()) {
+		hash = hashString("\n", hash);
+		hash = hashString(geometrySource, hash);
+	}
+
+	char str[17];
+	snprintf(str, sizeof(str), "%016llx", (unsigned long long)hash);
+	return str;
+}
+
+uint32_t ProgramBinaryCache::load(const std::string& key)
+{
+	if (!m_enabled) {
+		return 0;
+	}
+
+	std::ifstream in(path(key), std::ios::binary);
+	if (!in) {
+		++m_stats.misses;
+		return 0;
+	}
+
+	CacheFileHeader header;
+	std::vector<char> binary;
+	if (in.read((char*)&header, sizeof(header)) && header.magic == CACHE_FILE_MAGIC) {
+		binary.resize(header.binaryLength);
+		in.read(binary.data(), binary.size());
+	}
+
+	if (!in || binary.empty()) {
+		LOG_DEBUG("ProgramBinaryCache::load: corrupted cache file " + path(key));
+		++m_stats.rejected;
+		return 0;
+	}
+
+	uint32_t program = glCreateProgram();
+	glProgramBinary(program, header.binaryFormat, binary.data(), binary.size());
+
+	int success;
+	glGetProgramiv(program, GL_LINK_STATUS, &success);
+	if (!success) {
+		LOG_DEBUG("ProgramBinaryCache::load: driver rejected program binary " + key);
+		glDeleteProgram(program);
+		++m_stats.rejected;
+		return 0;
+	}
+
+	++m_stats.hits;
+	return program;
+}
+
+void ProgramBinaryCache::store(const std::string& key, uint32_t program)
+{
+	if (!m_enabled) {
+		return;
+	}
+
+	int length = 0;
+	glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+	if (length <= 0) {
+		return;
+	}
+
+	CacheFileHeader header;
+	header.magic = CACHE_FILE_MAGIC;
+	std::vector<char> binary(length);
+	glGetProgramBinary(program, length, nullptr, &header.binaryFormat, binary.data());
+	header.binaryLength = length;
+
+	std::ofstream out(path(key), std::ios::binary);
+	if (!out) {
+		LOG_DEBUG("ProgramBinaryCache::store: could not write " + path(key));
+		return;
+	}
+
+	out.write((const char*)&header, sizeof(header));
+	out.write(binary.data(), binary.size());
+}
+
+std::string ProgramBinaryCache::path(const std::string& key) const
+{
+	return m_directory + "/" + key + ".bin";
+}
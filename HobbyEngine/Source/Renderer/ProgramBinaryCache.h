@@ -0,0 +1,46 @@
+#ifndef PROGRAM_BINARY_CACHE_H
+#define PROGRAM_BINARY_CACHE_H
+
+#include <cstdint>
+#include <string>
+
+// Stores linked shader programs on disk with glGetProgramBinary, so later runs can skip compiling and linking.
+// Binaries are only valid for the driver that produced them, so the cache keys hash the shader sources together
+// with the driver's vendor, renderer and version strings. A driver may still reject a binary after an update
+// without changing its version string, in which case the program is compiled from source and stored again.
+class ProgramBinaryCache
+{
+public:
+	struct Stats
+	{
+		uint32_t hits = 0;
+		uint32_t misses = 0;
+		uint32_t rejected = 0;
+	};
+
+	ProgramBinaryCache() = default;
+
+	// Disables the cache if the driver doesn't support any program binary formats
+	void init(bool enabled, const std::string& directory);
+
+	bool enabled() const { return m_enabled; }
+
+	std::string key(const std::string& vertexSource, const std::string& fragmentSource, const std::string& geometrySource = std::string()) const;
+
+	// Returns a linked program, or 0 if there's no binary for the key or the driver rejected it
+	uint32_t load(const std::string& key);
+	void store(const std::string& key, uint32_t program);
+
+	const Stats& stats() const { return m_stats; }
+
+private:
+	std::string path(const std::string& key) const;
+
+	bool m_enabled = false;
+	std::string m_directory;
+	std::string m_driver;
+
+	Stats m_stats;
+};
+
+#endif // !PROGRAM_BINARY_CACHE_H
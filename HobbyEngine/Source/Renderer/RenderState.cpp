@@ -0,0 +1,117 @@
+#include "RenderState.h"
+
+#include <cmath>
+
+#include "../GameObjects/TransformComponent.h"
+#include "../Utils/Profiler.h"
+
+void RenderState::capture(Scene& scene, uint32_t screenWidth, uint32_t screenHeight)
+{
+	PROFILE_FUNCTION();
+
+	this->screenWidth = screenWidth;
+	this->screenHeight = screenHeight;
+
+	camera.position = scene.camera().position;
+	camera.front = scene.camera().front();
+	camera.view = scene.camera().viewMatrix();
+
+	lighting = scene.lighting();
+
+	skybox = scene.skybox();
+	depthPrepass = scene.depthPrepass();
+	staticBatches = scene.staticBatches();
+	staticVersion = scene.staticVersion();
+
+	objects.clear();
+	gpuInstances.clear();
+	lights.clear();
+	occluders.clear();
+	size_t nParticleSystems = 0;
+
+	for (auto it = scene.gameObjects().begin(); it != scene.gameObjects().end(); ++it) {
+		auto go = *it;
+		auto transformComponent = go->findComponent<TransformComponent>("TransformComponent").lock();
+
+		auto renderComponent = go->findComponent<RenderComponent>("RenderComponent").lock();
+		if (renderComponent && transformComponent && !renderComponent->batched) {
+			RenderObject object;
+			object.id = go->getId();
+			object.model = transformComponent->getTransformMatrix();
+			object.renderComponent = renderComponent;
+			if (renderComponent->gpuCulled()) {
+				gpuInstances.push_back(object);
+			}
+			else {
+				objects.push_back(object);
+			}
+		}
+
+		if (renderComponent && transformComponent && renderComponent->occluderData()) {
+			RenderOccluder occluder;
+			occluder.model = transformComponent->getTransformMatrix();
+			occluder.mesh = renderComponent->occluderData();
+			occluders.push_back(occluder);
+		}
+
+		auto lightComponent = go->findComponent<LightComponent>("LightComponent").lock();
+		if (lightComponent && transformComponent) {
+			glm::mat4 transform = transformComponent->getTransformMatrix();
+
+			RenderLight light;
+			light.position = glm::vec3(transform[3]);
+			light.range = lightComponent->range;
+			light.color = lightComponent->color * lightComponent->intensity;
+			light.direction = glm::normalize(glm::mat3(transform) * lightComponent->direction);
+			if (lightComponent->type == LightComponent::LightType::Spot) {
+				light.cosInnerAngle = std::cos(glm::radians(lightComponent->innerAngle));
+				light.cosOuterAngle = std::cos(glm::radians(lightComponent->outerAngle));
+			}
+			else {
+				light.cosInnerAngle = -1.0f;
+				light.cosOuterAngle = -2.0f;
+			}
+			lights.push_back(light);
+		}
+
+		auto particleSystem = go->findComponent<ParticleSystemComponent>("ParticleSystemComponent").lock();
+		if (particleSystem) {
+			if (nParticleSystems == particleSystems.size()) {
+				particleSystems.push_back(RenderParticleSystem());
+			}
+
+			RenderParticleSystem& particles = particleSystems[nParticleSystems++];
+			particles.id = go->getId();
+			particles.particleSystem = particleSystem;
+
+			uint32_t nParticles = particleSystem->bufferSize();
+			const glm::vec4* positionSize = reinterpret_cast<const glm::vec4*>(particleSystem->positionSizeData());
+			const glm::vec4* colors = reinterpret_cast<const glm::vec4*>(particleSystem->colorData());
+			particles.positionSize.assign(positionSize, positionSize + nParticles);
+			particles.colors.assign(colors, colors + nParticles);
+		}
+	}
+
+	particleSystems.resize(nParticleSystems);
+
+	size_t nTexts = 0;
+	for (auto it = scene.uiElements().begin(); it != scene.uiElements().end(); ++it) {
+		if (std::string((*it)->elementType()) != "TextElement") {
+			continue;
+		}
+
+		if (nTexts == texts.size()) {
+			texts.push_back(RenderText());
+		}
+
+		auto element = std::static_pointer_cast<TextElement>(*it);
+		RenderText& text = texts[nTexts++];
+		text.element = element;
+		text.text = element->text();
+		text.position = element->position();
+		text.color = element->color();
+		text.scale = element->textScale();
+	}
+
+	texts.resize(nTexts);
+}
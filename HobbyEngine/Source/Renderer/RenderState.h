@@ -0,0 +1,100 @@
+#ifndef RENDER_STATE_H
+#define RENDER_STATE_H
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "../Engine/Scene.h"
+#include "../GameObjects/LightComponent.h"
+#include "../GameObjects/ParticleSystemComponent.h"
+#include "../GameObjects/RenderComponent.h"
+#include "Skybox.h"
+#include "StaticBatch.h"
+#include "../UI/TextElement.h"
+
+struct RenderCamera
+{
+	glm::vec3 position;
+	glm::vec3 front;
+	glm::mat4 view;
+};
+
+struct RenderObject
+{
+	uint64_t id;
+	glm::mat4 model;
+
+	// Meshes and materials don't change after loading, so they are shared with the scene instead of copied
+	std::shared_ptr<RenderComponent> renderComponent;
+};
+
+// Point or spot light in world space. Point lights have cone cosines below -1, so the cone never attenuates them.
+struct RenderLight
+{
+	glm::vec3 position;
+	float range;
+	glm::vec3 color;
+	glm::vec3 direction;
+	float cosInnerAngle;
+	float cosOuterAngle;
+};
+
+// Static occluders are merged into batches for drawing, but they are still rasterized one by one for culling
+struct RenderOccluder
+{
+	glm::mat4 model;
+	std::shared_ptr<ModelResProcessedData> mesh;
+};
+
+struct RenderParticleSystem
+{
+	uint64_t id;
+	std::shared_ptr<ParticleSystemComponent> particleSystem;
+
+	// Live particles sorted back to front, uploaded to the particle system's buffers by the renderer
+	std::vector<glm::vec4> positionSize;
+	std::vector<glm::vec4> colors;
+};
+
+struct RenderText
+{
+	std::shared_ptr<TextElement> element;
+	std::string text;
+	glm::vec2 position;
+	glm::vec4 color;
+	float scale;
+};
+
+// Everything the renderer needs to draw a frame, copied from the scene at the end of its update. The renderer
+// only reads the snapshot, so the main thread can update the scene for the next frame while the render thread
+// draws this one. The vectors are reused between frames to avoid reallocating them.
+class RenderState
+{
+public:
+	void capture(Scene& scene, uint32_t screenWidth, uint32_t screenHeight);
+
+	uint32_t screenWidth = 0;
+	uint32_t screenHeight = 0;
+
+	RenderCamera camera;
+	SceneLighting lighting;
+
+	std::shared_ptr<Skybox> skybox;
+	bool depthPrepass = false;
+
+	std::vector<RenderObject> objects;
+
+	// Objects drawn instanced and culled on the GPU, they aren't in objects
+	std::vector<RenderObject> gpuInstances;
+	std::vector<RenderLight> lights;
+	std::vector<RenderOccluder> occluders;
+	std::vector<std::shared_ptr<StaticBatch>> staticBatches;
+	uint64_t staticVersion = 0;
+	std::vector<RenderParticleSystem> particleSystems;
+	std::vector<RenderText> texts;
+};
+
+#endif // !RENDER_STATE_H
@@ -1,21 +1,31 @@
 #include "Renderer.h"
 
 #include <algorithm>
+#include <chrono>
+#include <iterator>
+#include <limits>
 #include <memory>
 #include <string>
+#include <thread>
 
 #include <glm/glm.hpp>
 #include <glm/gtc/type_ptr.hpp>
 #include <tinyxml2/tinyxml2.h>
 
 #include "../Engine/GLApplication.h"
+#include "../Engine/JobSystem.h"
 #include "../GameObjects/ParticleSystemComponent.h"
 #include "../GameObjects/TransformComponent.h"
 #include "../GameObjects/RenderComponent.h"
+#include "Frustum.h"
+#include "GLExtensions.h"
+#include "ShaderVariant.h"
 #include "../ResourceCache/ResourceCache.h"
 #include "../UI/TextElement.h"
 #include "../UI/UIElement.h"
 #include "../Utils/DebugLogger.h"
+#include "../Utils/Profiler.h"
+#include "../Utils/XMLUtils.h"
 
 #ifdef LOG_LEVEL_DEBUG
 #define CHECK_GL_ERR() {\
@@ -28,13 +38,34 @@
 #define CHECK_GL_ERR()
 #endif // LOG_LEVEL_DEBUG
 
-uint32_t createProgram(tinyxml2::XMLElement* vertexShaderElement, tinyxml2::XMLElement* fragmentShaderElement) {
-	auto vertexShaderFile = vertexShaderElement->Attribute("file");
-	auto fragmentShaderFile = fragmentShaderElement->Attribute("file");
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif // !GL_COMPLETION_STATUS_KHR
+
+typedef void (APIENTRY* MaxShaderCompilerThreadsProc)(GLuint count);
+
+// Defines have to come after the #version directive, which the shaders have on their first line
+static std::string insertDefines(const char* source, const std::string& defines)
+{
+	std::string res(source);
+	if (defines.empty()) {
+		return res;
+	}
+
+	size_t lineEnd = res.find('\n');
+	if (res.compare(0, 8, "#version") != 0 || lineEnd == std::string::npos) {
+		return defines + res;
+	}
+	return res.insert(lineEnd + 1, defines);
+}
+
+bool Renderer::createProgram(const char* vertexShaderFile, const char* fragmentShaderFile, uint32_t& program, const std::string& defines, const char* geometryShaderFile,
+	const char* feedbackVarying) {
+	auto startTime = std::chrono::steady_clock::now();
 
 	if (!vertexShaderFile || !fragmentShaderFile) {
 		LOG_DEBUG("Renderer::init: could not get vertex or fragment shader file attribute");
-		return -1;
+		return false;
 	}
 
 	Resource vertexShaderResource(vertexShaderFile);
@@ -45,76 +76,195 @@ uint32_t createProgram(tinyxml2::XMLElement* vertexShaderElement, tinyxml2::XMLE
 
 	if (!vertexShaderHandle || !fragmentShaderHandle) {
 		LOG_DEBUG("Renderer::init: could not get vertex or fragment shader resource handles");
-		return -1;
+		return false;
 	}
 
-	uint32_t vertexShader;
-	vertexShader = glCreateShader(GL_VERTEX_SHADER);
-	const char* vertexSource = (const char*)vertexShaderHandle->buffer;
-	glShaderSource(vertexShader, 1, &vertexSource, nullptr);
-	glCompileShader(vertexShader);
-	int success;
-	glGetShaderiv(vertexShader, GL_COMPILE_STATUS, &success);
-	if (!success) {
-#ifdef LOG_LEVEL_DEBUG
-		char infoLog[512];
-		glGetShaderInfoLog(vertexShader, 512, nullptr, infoLog);
-		DebugLogger::log("Renderer::init: could not compile vertex shader:\n" + std::string(infoLog));
-#endif // LOG_LEVEL_DEBUG
-		return -1;
+	std::string vertexSourceStr = insertDefines((const char*)vertexShaderHandle->buffer, defines);
+	std::string fragmentSourceStr = insertDefines((const char*)fragmentShaderHandle->buffer, defines);
+	const char* vertexSource = vertexSourceStr.c_str();
+	const char* fragmentSource = fragmentSourceStr.c_str();
+
+	std::string geometrySourceStr;
+	if (geometryShaderFile) {
+		Resource geometryShaderResource(geometryShaderFile);
+		auto geometryShaderHandle = Game::instance().resourceCache().getHandle(geometryShaderResource);
+		if (!geometryShaderHandle) {
+			LOG_DEBUG("Renderer::init: could not get geometry shader resource handle");
+			return false;
+		}
+		geometrySourceStr = insertDefines((const char*)geometryShaderHandle->buffer, defines);
 	}
+	const char* geometrySource = geometrySourceStr.c_str();
 
-	uint32_t fragmentShader;
-	fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
-	const char* fragmentSource = (const char*)fragmentShaderHandle->buffer;
-	glShaderSource(fragmentShader, 1, &fragmentSource, nullptr);
-	glCompileShader(fragmentShader);
-	glGetShaderiv(fragmentShader, GL_COMPILE_STATUS, &success);
-	if (!success) {
-#ifdef LOG_LEVEL_DEBUG
-		char infoLog[512];
-		glGetShaderInfoLog(fragmentShader, 512, nullptr, infoLog);
-		DebugLogger::log("Renderer::init: could not compile fragment shader:\n" + std::string(infoLog));
-#endif // LOG_LEVEL_DEBUG
-		return -1;
+	PendingProgram pending;
+	pending.program = &program;
+	pending.cacheKey = m_programCache.key(vertexSource, fragmentSource, geometrySourceStr);
+	pending.name = std::string(vertexShaderFile) + ", " + fragmentShaderFile + (geometryShaderFile ? std::string(", ") + geometryShaderFile : "");
+
+	program = m_programCache.load(pending.cacheKey);
+	if (program != 0) {
+		m_programCreationMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+		return true;
+	}
+
+	// Statuses are only queried in finishPrograms, so the driver doesn't have to finish a program before the
+	// next one is issued
+	pending.vertexShader = glCreateShader(GL_VERTEX_SHADER);
+	glShaderSource(pending.vertexShader, 1, &vertexSource, nullptr);
+	glCompileShader(pending.vertexShader);
+
+	pending.fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
+	glShaderSource(pending.fragmentShader, 1, &fragmentSource, nullptr);
+	glCompileShader(pending.fragmentShader);
+
+	pending.geometryShader = 0;
+	if (geometryShaderFile) {
+		pending.geometryShader = glCreateShader(GL_GEOMETRY_SHADER);
+		glShaderSource(pending.geometryShader, 1, &geometrySource, nullptr);
+		glCompileShader(pending.geometryShader);
 	}
 
-	uint32_t program = glCreateProgram();
-	glAttachShader(program, vertexShader);
-	glAttachShader(program, fragmentShader);
+	program = glCreateProgram();
+	glAttachShader(program, pending.vertexShader);
+	glAttachShader(program, pending.fragmentShader);
+	if (pending.geometryShader != 0) {
+		glAttachShader(program, pending.geometryShader);
+	}
+	if (feedbackVarying) {
+		glTransformFeedbackVaryings(program, 1, &feedbackVarying, GL_INTERLEAVED_ATTRIBS);
+	}
+	if (m_programCache.enabled()) {
+		glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+	}
 	glLinkProgram(program);
+
+	m_pendingPrograms.push_back(pending);
+
+	m_programCreationMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+
+	return true;
+}
+
+bool Renderer::finishPrograms()
+{
+	auto startTime = std::chrono::steady_clock::now();
+
+	bool success = true;
+
+	// With parallel shader compilation the programs are finished in the order the driver completes them,
+	// otherwise the link status query blocks until each program is done
+	while (!m_pendingPrograms.empty()) {
+		for (auto it = m_pendingPrograms.begin(); it != m_pendingPrograms.end();) {
+			if (m_parallelShaderCompile) {
+				int completed;
+				glGetProgramiv(*it->program, GL_COMPLETION_STATUS_KHR, &completed);
+				if (!completed) {
+					++it;
+					continue;
+				}
+			}
+
+			success = finishProgram(*it) && success;
+			it = m_pendingPrograms.erase(it);
+		}
+
+		if (!m_pendingPrograms.empty()) {
+			std::this_thread::yield();
+		}
+	}
+
+	m_programCreationMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+
+	return success;
+}
+
+bool Renderer::finishProgram(PendingProgram& pending)
+{
+	uint32_t program = *pending.program;
+
+	int success;
 	glGetProgramiv(program, GL_LINK_STATUS, &success);
-	if (!success) {
+	if (success) {
+		m_programCache.store(pending.cacheKey, program);
+	}
+	else {
 #ifdef LOG_LEVEL_DEBUG
 		char infoLog[512];
+		glGetShaderiv(pending.vertexShader, GL_COMPILE_STATUS, &success);
+		if (!success) {
+			glGetShaderInfoLog(pending.vertexShader, 512, nullptr, infoLog);
+			DebugLogger::log("Renderer::init: could not compile vertex shader " + pending.name + ":\n" + std::string(infoLog));
+		}
+		glGetShaderiv(pending.fragmentShader, GL_COMPILE_STATUS, &success);
+		if (!success) {
+			glGetShaderInfoLog(pending.fragmentShader, 512, nullptr, infoLog);
+			DebugLogger::log("Renderer::init: could not compile fragment shader " + pending.name + ":\n" + std::string(infoLog));
+		}
+		if (pending.geometryShader != 0) {
+			glGetShaderiv(pending.geometryShader, GL_COMPILE_STATUS, &success);
+			if (!success) {
+				glGetShaderInfoLog(pending.geometryShader, 512, nullptr, infoLog);
+				DebugLogger::log("Renderer::init: could not compile geometry shader " + pending.name + ":\n" + std::string(infoLog));
+			}
+		}
 		glGetProgramInfoLog(program, 512, nullptr, infoLog);
-		DebugLogger::log("Renderer::init: could not link shader program:\n" + std::string(infoLog));
+		DebugLogger::log("Renderer::init: could not link shader program " + pending.name + ":\n" + std::string(infoLog));
 #endif // LOG_LEVEL_DEBUG
-		return -1;
+		glDeleteProgram(program);
+		*pending.program = INVALID_PROGRAM;
+		success = false;
 	}
 
-	glDeleteShader(vertexShader);
-	glDeleteShader(fragmentShader);
+	glDeleteShader(pending.vertexShader);
+	glDeleteShader(pending.fragmentShader);
+	if (pending.geometryShader != 0) {
+		glDeleteShader(pending.geometryShader);
+	}
 
-	return program;
+	return success;
 }
 
 Renderer::~Renderer()
 {
-	glDeleteProgram(m_program);
-	glDeleteProgram(m_skyboxProgram);
-	glDeleteProgram(m_shadowDepthMapProgram);
-	glDeleteProgram(m_particleProgram);
-	glDeleteProgram(m_uiProgram);
-
-	glDeleteFramebuffers(1, &m_shadowDepthMapFBO);
-	glDeleteTextures(1, &m_shadowDepthMap);
+	for (auto it = m_variantPrograms.begin(); it != m_variantPrograms.end(); ++it) {
+		m_glState.deleteProgram(it->second);
+	}
+	m_glState.deleteProgram(m_skyboxProgram);
+	m_glState.deleteProgram(m_shadowDepthMapProgram);
+	m_glState.deleteProgram(m_depthPrepassProgram);
+	m_glState.deleteProgram(m_shadowDepthMapInstancedProgram);
+	m_glState.deleteProgram(m_depthPrepassInstancedProgram);
+	m_glState.deleteProgram(m_gpuCullProgram);
+	m_glState.deleteProgram(m_particleProgram);
+	m_glState.deleteProgram(m_uiProgram);
+	m_glState.deleteProgram(m_upscaleProgram);
+
+	m_glState.deleteFramebuffer(m_shadowLayeredFBO);
+	m_glState.deleteFramebuffer(m_staticShadowLayeredFBO);
+	for (int i = 0; i < m_shadowCascades; ++i) {
+		m_glState.deleteFramebuffer(m_shadowCascadeFBOs[i]);
+		m_glState.deleteFramebuffer(m_staticShadowCascadeFBOs[i]);
+	}
+	m_glState.deleteTexture(m_shadowDepthMap);
+	m_glState.deleteTexture(m_staticShadowDepthMap);
+
+	m_lightClusters.destroy(m_glState);
+	m_textureStreamer.destroy(m_glState);
+	m_gpuCuller.destroy(m_glState);
+	m_streamingBuffer.destroy(m_glState);
+	m_resolutionScaler.destroy(m_glState);
+
+	if (m_offscreenFBO != 0) {
+		m_glState.deleteFramebuffer(m_offscreenFBO);
+		glDeleteRenderbuffers(1, &m_offscreenColorBuffer);
+		glDeleteRenderbuffers(1, &m_offscreenDepthBuffer);
+	}
 
 #ifdef RENDER_DEBUG
-	glDeleteProgram(m_shadowDepthMapDebugProgram);
+	m_glState.deleteProgram(m_shadowDepthMapDebugProgram);
 
-	glDeleteBuffers(1, &m_debugQuadVAO);
-	glDeleteBuffers(1, &m_debugQuadVBO);
+	m_glState.deleteVertexArray(m_debugQuadVAO);
+	m_glState.deleteBuffer(m_debugQuadVBO);
 #endif // RENDER_DEBUG
 
 }
@@ -123,7 +273,7 @@ bool Renderer::init(uint32_t screenWidth, uint32_t screenHeight)
 {
 	m_screenWidth = screenWidth;
 	m_screenHeight = screenHeight;
-	glViewport(0, 0, m_screenWidth, m_screenHeight);
+	m_glState.viewport(0, 0, m_screenWidth, m_screenHeight);
 
 	Resource configResource("RendererConfig.xml");
 	auto configHandle = Game::instance().resourceCache().getHandle(configResource);
@@ -141,6 +291,26 @@ bool Renderer::init(uint32_t screenWidth, uint32_t screenHeight)
 	}
 	auto root = doc.FirstChildElement();
 
+	auto programCacheElement = root->FirstChildElement("ProgramBinaryCache");
+	if (programCacheElement) {
+		auto enabled = programCacheElement->Attribute("enabled");
+		auto directory = programCacheElement->Attribute("directory");
+		m_programCache.init(enabled && std::string(enabled) == std::string("true"), directory ? directory : "ShaderCache");
+	}
+
+	// Drivers supporting parallel shader compilation compile the programs in the background while the rest of
+	// the renderer is initialized
+	bool khrParallelShaderCompile = GLExtensions::supported("GL_KHR_parallel_shader_compile");
+	if (khrParallelShaderCompile || GLExtensions::supported("GL_ARB_parallel_shader_compile")) {
+		auto maxShaderCompilerThreads = (MaxShaderCompilerThreadsProc)GLExtensions::procAddress(
+			khrParallelShaderCompile ? "glMaxShaderCompilerThreadsKHR" : "glMaxShaderCompilerThreadsARB");
+		if (maxShaderCompilerThreads) {
+			maxShaderCompilerThreads(0xFFFFFFFF);
+		}
+		m_parallelShaderCompile = true;
+	}
+
+
 	auto particleVertexShaderElement = root->FirstChildElement("ParticleVertexShader");
 	auto particleFragmentShaderElement = root->FirstChildElement("ParticleFragmentShader");
 
@@ -148,8 +318,7 @@ bool Renderer::init(uint32_t screenWidth, uint32_t screenHeight)
 		LOG_DEBUG("Renderer::init: could not find particle vertex or fragment shader elements");
 		return false;
 	}
-	m_particleProgram = createProgram(particleVertexShaderElement, particleFragmentShaderElement);
-	if (m_particleProgram == -1) {
+	if (!createProgram(particleVertexShaderElement->Attribute("file"), particleFragmentShaderElement->Attribute("file"), m_particleProgram)) {
 		return false;
 	}
 
@@ -165,10 +334,11 @@ bool Renderer::init(uint32_t screenWidth, uint32_t screenHeight)
 		return false;
 	}
 
-	m_program = createProgram(vertexShaderElement, fragmentShaderElement);
-	if (m_program == -1) {
-		return false;
-	}
+	// The game object shader is compiled for each variant the materials request, the default variant with all
+	// features enabled is compiled right away to catch errors in the shaders at startup
+	m_vertexShaderFile = vertexShaderElement->Attribute("file") ? vertexShaderElement->Attribute("file") : "";
+	m_fragmentShaderFile = fragmentShaderElement->Attribute("file") ? fragmentShaderElement->Attribute("file") : "";
+	requestShaderVariant(ShaderVariant());
 
 	// Skybox shader
 
@@ -176,44 +346,154 @@ bool Renderer::init(uint32_t screenWidth, uint32_t screenHeight)
 	auto skyboxFragmentShaderElement = root->FirstChildElement("SkyboxFragmentShader");
 
 	if (skyboxVertexShaderElement && skyboxFragmentShaderElement) {
-		m_skyboxProgram = createProgram(skyboxVertexShaderElement, skyboxFragmentShaderElement);
-		if (m_skyboxProgram == -1) {
+		if (!createProgram(skyboxVertexShaderElement->Attribute("file"), skyboxFragmentShaderElement->Attribute("file"), m_skyboxProgram)) {
 			return false;
 		}
 	}
 
-	// Shadow depth map shader and FBOs
-
-	glGenFramebuffers(1, &m_shadowDepthMapFBO);
-
-	glGenTextures(1, &m_shadowDepthMap);
-	glBindTexture(GL_TEXTURE_2D, m_shadowDepthMap);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT, 2048, 2048, 0, GL_DEPTH_COMPONENT, GL_FLOAT, 0);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
-	float borderColor[] = { 1.0, 1.0, 1.0, 1.0 };
-	glTexParameterfv(GL_TEXTURE_2D, GL_TEXTURE_BORDER_COLOR, borderColor);
+	// Shadow cascades, each cascade is a layer of the depth map array
+
+	auto shadowsElement = root->FirstChildElement("Shadows");
+	if (shadowsElement) {
+		XMLUtils::xmlAttribToInt(shadowsElement, "cascades", m_shadowCascades);
+		XMLUtils::xmlAttribToInt(shadowsElement, "resolution", m_shadowMapResolution);
+		XMLUtils::xmlAttribToFloat(shadowsElement, "distance", m_shadowDistance);
+		XMLUtils::xmlAttribToFloat(shadowsElement, "splitLambda", m_shadowSplitLambda);
+		XMLUtils::xmlAttribToFloat(shadowsElement, "casterDistance", m_shadowCasterDistance);
+		auto layered = shadowsElement->Attribute("layered");
+		m_layeredShadows = layered && std::string(layered) == std::string("true");
+		auto cacheStatic = shadowsElement->Attribute("cacheStatic");
+		m_cacheStaticShadows = cacheStatic && std::string(cacheStatic) == std::string("true");
+	}
+	m_shadowCascades = std::max(1, std::min(m_shadowCascades, MAX_SHADOW_CASCADES));
+
+	// Layered rendering attaches the whole array and picks the layer in the geometry shader. The per-cascade
+	// framebuffers are used for clearing and copying single cascades, and for drawing without layered rendering.
+	auto createShadowDepthArray = [this](uint32_t& texture, uint32_t& layeredFBO, uint32_t* cascadeFBOs) {
+		glGenTextures(1, &texture);
+		m_glState.bindTexture(0, GL_TEXTURE_2D_ARRAY, texture);
+		glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_DEPTH_COMPONENT24, m_shadowMapResolution, m_shadowMapResolution, m_shadowCascades, 0, GL_DEPTH_COMPONENT, GL_FLOAT, 0);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+		float borderColor[] = { 1.0, 1.0, 1.0, 1.0 };
+		glTexParameterfv(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BORDER_COLOR, borderColor);
+
+		glGenFramebuffers(1, &layeredFBO);
+		m_glState.bindFramebuffer(GL_FRAMEBUFFER, layeredFBO);
+		glFramebufferTexture(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, texture, 0);
+		glDrawBuffer(GL_NONE);
+		glReadBuffer(GL_NONE);
+
+		glGenFramebuffers(m_shadowCascades, cascadeFBOs);
+		for (int i = 0; i < m_shadowCascades; ++i) {
+			m_glState.bindFramebuffer(GL_FRAMEBUFFER, cascadeFBOs[i]);
+			glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, texture, 0, i);
+			glDrawBuffer(GL_NONE);
+			glReadBuffer(GL_NONE);
+		}
+		m_glState.bindFramebuffer(GL_FRAMEBUFFER, 0);
+	};
 
-	glBindFramebuffer(GL_FRAMEBUFFER, m_shadowDepthMapFBO);
-	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, m_shadowDepthMap, 0);
-	glDrawBuffer(GL_NONE);
-	glReadBuffer(GL_NONE);
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	createShadowDepthArray(m_shadowDepthMap, m_shadowLayeredFBO, m_shadowCascadeFBOs);
+	if (m_cacheStaticShadows) {
+		createShadowDepthArray(m_staticShadowDepthMap, m_staticShadowLayeredFBO, m_staticShadowCascadeFBOs);
+	}
 
 	auto shadowMapVertexShaderElement = root->FirstChildElement("ShadowMapVertexShader");
 	auto shadowMapFragmentShaderElement = root->FirstChildElement("ShadowMapFragmentShader");
+	auto shadowMapGeometryShaderElement = root->FirstChildElement("ShadowMapGeometryShader");
 
 	if (!shadowMapVertexShaderElement || !shadowMapFragmentShaderElement) {
 		LOG_DEBUG("Renderer::init: could not find shadow map vertex or fragment shader elements");
 		return false;
 	}
-	m_shadowDepthMapProgram = createProgram(shadowMapVertexShaderElement, shadowMapFragmentShaderElement);
-	if (m_shadowDepthMapProgram == -1) {
+	if (m_layeredShadows && !shadowMapGeometryShaderElement) {
+		LOG_DEBUG("Renderer::init: could not find shadow map geometry shader element, required for layered shadows");
+		return false;
+	}
+	if (m_layeredShadows) {
+		if (!createProgram(shadowMapVertexShaderElement->Attribute("file"), shadowMapFragmentShaderElement->Attribute("file"), m_shadowDepthMapProgram,
+			"#define LAYERED\n", shadowMapGeometryShaderElement->Attribute("file"))) {
+			return false;
+		}
+		if (!createProgram(shadowMapVertexShaderElement->Attribute("file"), shadowMapFragmentShaderElement->Attribute("file"), m_shadowDepthMapInstancedProgram,
+			"#define LAYERED\n#define INSTANCED\n", shadowMapGeometryShaderElement->Attribute("file"))) {
+			return false;
+		}
+	}
+	else if (!createProgram(shadowMapVertexShaderElement->Attribute("file"), shadowMapFragmentShaderElement->Attribute("file"), m_shadowDepthMapProgram)
+		|| !createProgram(shadowMapVertexShaderElement->Attribute("file"), shadowMapFragmentShaderElement->Attribute("file"), m_shadowDepthMapInstancedProgram, "#define INSTANCED\n")) {
 		return false;
 	}
 
+	auto depthPrepassVertexShaderElement = root->FirstChildElement("DepthPrepassVertexShader");
+	auto depthPrepassFragmentShaderElement = root->FirstChildElement("DepthPrepassFragmentShader");
+
+	if (!depthPrepassVertexShaderElement || !depthPrepassFragmentShaderElement) {
+		LOG_DEBUG("Renderer::init: could not find depth pre-pass vertex or fragment shader elements");
+		return false;
+	}
+	if (!createProgram(depthPrepassVertexShaderElement->Attribute("file"), depthPrepassFragmentShaderElement->Attribute("file"), m_depthPrepassProgram)
+		|| !createProgram(depthPrepassVertexShaderElement->Attribute("file"), depthPrepassFragmentShaderElement->Attribute("file"), m_depthPrepassInstancedProgram, "#define INSTANCED\n")) {
+		return false;
+	}
+
+	// GPU culling, the culling pass is a transform feedback program. It rasterizes nothing, the empty fragment
+	// shader of the depth pre-pass only completes the program.
+	bool gpuCulling = false;
+	bool gpuCullingHiZ = false;
+	bool gpuCullingIndirect = false;
+	auto gpuCullingElement = root->FirstChildElement("GPUCulling");
+	if (gpuCullingElement) {
+		auto enabled = gpuCullingElement->Attribute("enabled");
+		auto hiZ = gpuCullingElement->Attribute("hiZ");
+		auto indirect = gpuCullingElement->Attribute("indirect");
+		gpuCulling = enabled && std::string(enabled) == std::string("true");
+		gpuCullingHiZ = hiZ && std::string(hiZ) == std::string("true");
+		gpuCullingIndirect = indirect && std::string(indirect) == std::string("true");
+	}
+	if (gpuCulling) {
+		auto gpuCullVertexShaderElement = root->FirstChildElement("GPUCullingVertexShader");
+		auto gpuCullGeometryShaderElement = root->FirstChildElement("GPUCullingGeometryShader");
+
+		if (!gpuCullVertexShaderElement || !gpuCullGeometryShaderElement) {
+			LOG_DEBUG("Renderer::init: could not find GPU culling vertex or geometry shader elements");
+			return false;
+		}
+		if (!createProgram(gpuCullVertexShaderElement->Attribute("file"), depthPrepassFragmentShaderElement->Attribute("file"), m_gpuCullProgram,
+			std::string(), gpuCullGeometryShaderElement->Attribute("file"), "InstanceModel")) {
+			return false;
+		}
+	}
+
+	// Dynamic resolution, the scaled scene is drawn to the window with a fullscreen triangle
+	bool dynamicResolution = false;
+	float dynamicResolutionTargetMs = 16.0f;
+	float dynamicResolutionMinScale = 0.5f;
+	float dynamicResolutionMaxScale = 1.0f;
+	auto dynamicResolutionElement = root->FirstChildElement("DynamicResolution");
+	if (dynamicResolutionElement) {
+		auto enabled = dynamicResolutionElement->Attribute("enabled");
+		dynamicResolution = enabled && std::string(enabled) == std::string("true");
+		XMLUtils::xmlAttribToFloat(dynamicResolutionElement, "targetMs", dynamicResolutionTargetMs);
+		XMLUtils::xmlAttribToFloat(dynamicResolutionElement, "minScale", dynamicResolutionMinScale);
+		XMLUtils::xmlAttribToFloat(dynamicResolutionElement, "maxScale", dynamicResolutionMaxScale);
+	}
+	if (dynamicResolution) {
+		auto upscaleVertexShaderElement = root->FirstChildElement("UpscaleVertexShader");
+		auto upscaleFragmentShaderElement = root->FirstChildElement("UpscaleFragmentShader");
+
+		if (!upscaleVertexShaderElement || !upscaleFragmentShaderElement) {
+			LOG_DEBUG("Renderer::init: could not find upscale vertex or fragment shader elements");
+			return false;
+		}
+		if (!createProgram(upscaleVertexShaderElement->Attribute("file"), upscaleFragmentShaderElement->Attribute("file"), m_upscaleProgram)) {
+			return false;
+		}
+	}
+
 	auto uiVertexShaderElement = root->FirstChildElement("UIVertexShader");
 	auto uiFragmentShaderElement = root->FirstChildElement("UIFragmentShader");
 
@@ -221,8 +501,7 @@ bool Renderer::init(uint32_t screenWidth, uint32_t screenHeight)
 		LOG_DEBUG("Renderer::init: could not find UI vertex or fragment shader elements");
 		return false;
 	}
-	m_uiProgram = createProgram(uiVertexShaderElement, uiFragmentShaderElement);
-	if (m_uiProgram == -1) {
+	if (!createProgram(uiVertexShaderElement->Attribute("file"), uiFragmentShaderElement->Attribute("file"), m_uiProgram)) {
 		return false;
 	}
 
@@ -234,8 +513,7 @@ bool Renderer::init(uint32_t screenWidth, uint32_t screenHeight)
 		LOG_DEBUG("Renderer::init: could not find shadow map vertex or fragment shader elements");
 		return false;
 	}
-	m_shadowDepthMapDebugProgram = createProgram(shadowMapDebugVertexShaderElement, shadowMapDebugFragmentShaderElement);
-	if (m_shadowDepthMapDebugProgram == -1) {
+	if (!createProgram(shadowMapDebugVertexShaderElement->Attribute("file"), shadowMapDebugFragmentShaderElement->Attribute("file"), m_shadowDepthMapDebugProgram)) {
 		return false;
 	}
 
@@ -247,8 +525,8 @@ bool Renderer::init(uint32_t screenWidth, uint32_t screenHeight)
 	};
 	glGenVertexArrays(1, &m_debugQuadVAO);
 	glGenBuffers(1, &m_debugQuadVBO);
-	glBindVertexArray(m_debugQuadVAO);
-	glBindBuffer(GL_ARRAY_BUFFER, m_debugQuadVBO);
+	m_glState.bindVertexArray(m_debugQuadVAO);
+	m_glState.bindBuffer(GL_ARRAY_BUFFER, m_debugQuadVBO);
 	glBufferData(GL_ARRAY_BUFFER, sizeof(quadVertices), &quadVertices, GL_STATIC_DRAW);
 	glEnableVertexAttribArray(0);
 	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)0);
@@ -256,182 +534,726 @@ bool Renderer::init(uint32_t screenWidth, uint32_t screenHeight)
 	glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)(3 * sizeof(float)));
 #endif // RENDER_DEBUG
 
+	if (!finishPrograms()) {
+		return false;
+	}
+
+	auto cacheStats = m_programCache.stats();
+	LOG_DEBUG("Renderer::init: created shader programs in " + std::to_string(m_programCreationMs) + " ms"
+		+ (m_parallelShaderCompile ? ", compiled in parallel" : "") + ", binary cache "
+		+ (m_programCache.enabled() ? "enabled (" + std::to_string(cacheStats.hits) + " hits, " + std::to_string(cacheStats.misses) + " misses, "
+			+ std::to_string(cacheStats.rejected) + " rejected)" : std::string("disabled")));
+
+	auto gpuProfilerElement = root->FirstChildElement("GPUProfiler");
+	if (gpuProfilerElement) {
+		auto enabled = gpuProfilerElement->Attribute("enabled");
+		auto perDraw = gpuProfilerElement->Attribute("perDraw");
+		int historySize;
+		if (!XMLUtils::xmlAttribToInt(gpuProfilerElement, "history", historySize)) {
+			historySize = 120;
+		}
+		m_gpuProfiler.init(enabled && std::string(enabled) == std::string("true"), perDraw && std::string(perDraw) == std::string("true"), historySize);
+	}
+
+	m_lightClusters.init(m_glState);
+
+	int streamingBufferSize = 1024;
+	bool streamingBufferPersistent = true;
+	auto streamingBufferElement = root->FirstChildElement("StreamingBuffer");
+	if (streamingBufferElement) {
+		auto persistent = streamingBufferElement->Attribute("persistent");
+		XMLUtils::xmlAttribToInt(streamingBufferElement, "frameSizeKB", streamingBufferSize);
+		streamingBufferPersistent = persistent && std::string(persistent) == std::string("true");
+	}
+	m_streamingBuffer.init(m_glState, streamingBufferSize * 1024, streamingBufferPersistent);
+
+	bool textureStreaming = true;
+	int textureUploadBudget = 2048;
+	float textureUploadBudgetMs = 2.0f;
+	int textureEvictFrames = 300;
+	bool texturePackMaterials = true;
+	bool textureArrays = true;
+	int textureLayersPerPage = 16;
+	auto textureStreamingElement = root->FirstChildElement("TextureStreaming");
+	if (textureStreamingElement) {
+		auto enabled = textureStreamingElement->Attribute("enabled");
+		textureStreaming = enabled && std::string(enabled) == std::string("true");
+		XMLUtils::xmlAttribToInt(textureStreamingElement, "uploadBudgetKB", textureUploadBudget);
+		XMLUtils::xmlAttribToFloat(textureStreamingElement, "uploadBudgetMs", textureUploadBudgetMs);
+		XMLUtils::xmlAttribToInt(textureStreamingElement, "evictFrames", textureEvictFrames);
+
+		auto packMaterials = textureStreamingElement->Attribute("packMaterials");
+		texturePackMaterials = packMaterials && std::string(packMaterials) == std::string("true");
+
+		auto arrays = textureStreamingElement->Attribute("textureArrays");
+		textureArrays = arrays && std::string(arrays) == std::string("true");
+		XMLUtils::xmlAttribToInt(textureStreamingElement, "layersPerPage", textureLayersPerPage);
+	}
+	m_textureStreamer.init(m_glState, textureStreaming, (size_t)textureUploadBudget * 1024, textureUploadBudgetMs, textureEvictFrames, texturePackMaterials,
+		textureArrays, textureLayersPerPage);
+	m_gpuCuller.init(m_glState, gpuCulling, gpuCullingHiZ, gpuCullingIndirect, m_gpuCullProgram);
+
+	// The scene framebuffer takes the sample count of the window's, so MSAA is kept below the window resolution
+	GLint samples = 0;
+	m_glState.bindFramebuffer(GL_FRAMEBUFFER, 0);
+	glGetIntegerv(GL_SAMPLES, &samples);
+	m_resolutionScaler.init(m_glState, dynamicResolution, dynamicResolutionTargetMs, dynamicResolutionMinScale, dynamicResolutionMaxScale,
+		samples, m_upscaleProgram, m_screenWidth, m_screenHeight);
+
+
+	auto lodElement = root->FirstChildElement("LOD");
+	if (lodElement) {
+		XMLUtils::xmlAttribToFloat(lodElement, "bias", m_lodBias);
+		XMLUtils::xmlAttribToFloat(lodElement, "hysteresis", m_lodHysteresis);
+	}
+
+	auto occlusionCullingElement = root->FirstChildElement("OcclusionCulling");
+	if (occlusionCullingElement) {
+		auto enabled = occlusionCullingElement->Attribute("enabled");
+		int width = 256;
+		int height = 128;
+		XMLUtils::xmlAttribToInt(occlusionCullingElement, "width", width);
+		XMLUtils::xmlAttribToInt(occlusionCullingElement, "height", height);
+		m_occlusionCuller.init(enabled && std::string(enabled) == std::string("true"), width, height);
+	}
+
 	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
 
-	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-	glEnable(GL_BLEND);
-	glEnable(GL_DEPTH_TEST);
-	glEnable(GL_MULTISAMPLE);
+	m_glState.blendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+	m_glState.setEnabled(GL_BLEND, true);
+	m_glState.setEnabled(GL_DEPTH_TEST, true);
+	m_glState.setEnabled(GL_MULTISAMPLE, true);
 	//glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
 
 	return true;
 }
 
-bool Renderer::renderScene(Scene& scene)
+bool Renderer::renderScene(RenderState& state)
 {
+	PROFILE_FUNCTION();
+
+	m_glState.beginFrame();
+	m_streamingBuffer.beginFrame();
+
+	if (state.screenWidth != m_screenWidth || state.screenHeight != m_screenHeight) {
+		updateScreenSize(state.screenWidth, state.screenHeight);
+	}
+
 	glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
 
-	Camera camera = scene.camera();
+	prepareDrawPackets(state);
 
-	// First pass: shadow depth map
-	// Switch to correct framebuffer
-	glViewport(0, 0, 2048, 2048);
-	glBindFramebuffer(GL_FRAMEBUFFER, m_shadowDepthMapFBO);
-	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-	glCullFace(GL_FRONT);
-	
-	renderShadowDepthMap(camera, scene);
-
-	// Switch back to default rendering config
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
-	glCullFace(GL_BACK);
-	glViewport(0, 0, m_screenWidth, m_screenHeight);
+	// The levels the packets need are uploaded before they are drawn, the rest of them in later frames
+	m_textureStreamer.update(m_glState);
+
+	m_gpuProfiler.beginFrame();
+	m_gpuProfiler.beginZone("Frame");
+	m_resolutionScaler.beginFrame();
+
+	// Culling of the instances, issued first so the GPU has finished it by the time the camera passes draw them
+	{
+		GPUTimerScope timer(m_gpuProfiler, "GPU culling");
+
+		glm::mat4 projection = glm::perspective(glm::radians(45.0f), (float)m_screenWidth / (float)m_screenHeight, 0.1f, 100.0f);
+		bool occlusionCulling = m_occlusionCuller.enabled() && !state.occluders.empty();
+		m_gpuCuller.cull(m_glState, state.gpuInstances, projection * state.camera.view, occlusionCulling ? &m_occlusionCuller : nullptr);
+	}
+
+	// First pass: shadow depth map cascades
+	{
+		GPUTimerScope timer(m_gpuProfiler, "Shadow map");
+
+		m_glState.viewport(0, 0, m_shadowMapResolution, m_shadowMapResolution);
+		m_glState.cullFace(GL_FRONT);
+
+		// Casters between the light and the near plane of a cascade are clamped to the near plane instead of
+		// being clipped away
+		m_glState.setEnabled(GL_DEPTH_CLAMP, true);
+
+		renderShadowDepthMap(state);
+
+		m_glState.setEnabled(GL_DEPTH_CLAMP, false);
+	}
+
+	// Switch back to default rendering config, at the scaled resolution until the UI pass
+	m_glState.bindFramebuffer(GL_FRAMEBUFFER, m_resolutionScaler.scaled() ? m_resolutionScaler.framebuffer() : m_targetFramebuffer);
+	m_glState.cullFace(GL_BACK);
+	m_glState.viewport(0, 0, m_resolutionScaler.width(), m_resolutionScaler.height());
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
 	// Second pass: skybox
-	if (scene.skybox() && m_skyboxProgram != -1) {
-		renderSkybox(scene);
+	if (state.skybox && m_skyboxProgram != INVALID_PROGRAM) {
+		GPUTimerScope timer(m_gpuProfiler, "Skybox");
+		renderSkybox(state);
 	}
 
-	// Third pass: game objects
-	renderGameObjects(scene);
+	// Third pass: game objects, optionally after laying down their depth in a pre-pass. With the pre-pass the
+	// expensive fragment shader runs only once per pixel, for the fragments that pass the GL_EQUAL depth test.
+	if (state.depthPrepass) {
+		GPUTimerScope timer(m_gpuProfiler, "Depth pre-pass");
+		renderDepthPrepass(state);
+	}
+
+	{
+		GPUTimerScope timer(m_gpuProfiler, "Game objects");
+		if (state.depthPrepass) {
+			m_glState.depthFunc(GL_EQUAL);
+			m_glState.depthMask(false);
+		}
+
+		renderGameObjects(state);
+
+		m_glState.depthFunc(GL_LESS);
+		m_glState.depthMask(true);
+	}
 
 	// Fourth pass: particle systems
-	renderParticleSystems(scene);
+	{
+		GPUTimerScope timer(m_gpuProfiler, "Particles");
+		renderParticleSystems(state);
+	}
+
+	// The scene is upscaled to the window, and the UI drawn over it with a cleared depth buffer
+	if (m_resolutionScaler.scaled()) {
+		GPUTimerScope timer(m_gpuProfiler, "Upscale");
+		m_glState.setEnabled(GL_DEPTH_TEST, false);
+		m_glState.setEnabled(GL_BLEND, false);
+		m_resolutionScaler.upscale(m_glState, m_targetFramebuffer);
+		m_glState.setEnabled(GL_DEPTH_TEST, true);
+		m_glState.setEnabled(GL_BLEND, true);
+		glClear(GL_DEPTH_BUFFER_BIT);
+	}
 
 	// Fifth pass: UI elements
-	renderUIElements(scene);
+	{
+		GPUTimerScope timer(m_gpuProfiler, "UI");
+		renderUIElements(state);
+	}
+
+	m_streamingBuffer.endFrame();
 
 #ifdef RENDER_DEBUG
 	// Debug pass: shadow map
-	renderShadowMapDebug();
+	{
+		GPUTimerScope timer(m_gpuProfiler, "Debug");
+		renderShadowMapDebug();
+	}
+
+	if (++m_frameCounter % 600 == 0) {
+		auto stats = m_glState.lastFrameStats();
+		DebugLogger::log("Renderer: GL state changes last frame - issued: " + std::to_string(stats.issued) + ", filtered: " + std::to_string(stats.filtered));
+		if (m_occlusionCuller.enabled()) {
+			DebugLogger::log("Renderer: occlusion culled " + std::to_string(m_occlusionCuller.nCulled()) + " objects behind "
+				+ std::to_string(m_occlusionCuller.nOccluderTriangles()) + " occluder triangles last frame");
+		}
+		DebugLogger::log("Renderer: streamed " + std::to_string(m_streamingBuffer.lastFrameBytes()) + " bytes last frame, waited for the GPU in "
+			+ std::to_string(m_streamingBuffer.nWaits()) + " frames" + (m_streamingBuffer.persistent() ? " (persistent mapping)" : ""));
+		DebugLogger::log("Renderer: " + std::to_string(m_textureStreamer.residentBytes()) + " bytes of streamed textures resident, "
+			+ std::to_string(m_textureStreamer.nStreaming()) + " textures streaming, " + std::to_string(m_textureStreamer.lastFrameBytes())
+			+ " bytes uploaded last frame, " + std::to_string(m_textureStreamer.nDirectUploads()) + " levels too large for the pixel buffer, "
+			+ std::to_string(m_textureStreamer.nPages()) + " texture array pages");
+		if (m_gpuCuller.nInstances() > 0) {
+			DebugLogger::log("Renderer: " + std::to_string(m_gpuCuller.nInstances()) + " instances in " + std::to_string(m_gpuCuller.groups().size())
+				+ " groups" + (m_gpuCuller.enabled() ? std::string(", culled on the GPU") + (m_gpuCuller.indirect() ? " with indirect draws" : "") : std::string()));
+		}
+		if (m_resolutionScaler.enabled()) {
+			DebugLogger::log("Renderer: rendering at " + std::to_string(m_resolutionScaler.width()) + "x" + std::to_string(m_resolutionScaler.height())
+				+ " (scale " + std::to_string(m_resolutionScaler.scale()) + "), GPU frame time " + std::to_string(m_resolutionScaler.gpuMs()) + " ms");
+		}
+	}
 #endif // RENDER_DEBUG
 
-	Game::instance().swapBuffers();
+	m_resolutionScaler.endFrame();
+	m_gpuProfiler.endZone();
+	m_gpuProfiler.endFrame();
+
+	{
+		PROFILE_SCOPE("Swap buffers");
+		Game::instance().swapBuffers();
+	}
 	return true;
 }
 
+uint32_t Renderer::requestShaderVariant(const ShaderVariant& variant)
+{
+	uint32_t key = variant.key();
+	if (m_variantPrograms.find(key) != m_variantPrograms.end()) {
+		return key;
+	}
+
+	uint32_t& program = m_variantPrograms[key];
+	if (!createProgram(m_vertexShaderFile.c_str(), m_fragmentShaderFile.c_str(), program, variant.defines())) {
+		LOG_DEBUG("Renderer::requestShaderVariant: could not create program for shader variant " + std::to_string(key));
+		program = INVALID_PROGRAM;
+	}
+	return key;
+}
+
 void Renderer::updateScreenSize(uint32_t screenWidth, uint32_t screenHeight)
 {
 	m_screenHeight = screenHeight;
 	m_screenWidth = screenWidth;
-	glViewport(0, 0, m_screenWidth, m_screenHeight);
+	m_glState.viewport(0, 0, m_screenWidth, m_screenHeight);
+
+	if (m_offscreenFBO != 0) {
+		glBindRenderbuffer(GL_RENDERBUFFER, m_offscreenColorBuffer);
+		glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, m_screenWidth, m_screenHeight);
+		glBindRenderbuffer(GL_RENDERBUFFER, m_offscreenDepthBuffer);
+		glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, m_screenWidth, m_screenHeight);
+		glBindRenderbuffer(GL_RENDERBUFFER, 0);
+	}
+
+	m_resolutionScaler.resize(m_glState, m_screenWidth, m_screenHeight);
+}
+
+bool Renderer::createOffscreenTarget()
+{
+	glGenRenderbuffers(1, &m_offscreenColorBuffer);
+	glBindRenderbuffer(GL_RENDERBUFFER, m_offscreenColorBuffer);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, m_screenWidth, m_screenHeight);
+
+	glGenRenderbuffers(1, &m_offscreenDepthBuffer);
+	glBindRenderbuffer(GL_RENDERBUFFER, m_offscreenDepthBuffer);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, m_screenWidth, m_screenHeight);
+	glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+	glGenFramebuffers(1, &m_offscreenFBO);
+	m_glState.bindFramebuffer(GL_FRAMEBUFFER, m_offscreenFBO);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, m_offscreenColorBuffer);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, m_offscreenDepthBuffer);
+
+	bool complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+	m_glState.bindFramebuffer(GL_FRAMEBUFFER, 0);
+
+	if (!complete) {
+		LOG_DEBUG("Renderer::createOffscreenTarget: offscreen framebuffer is incomplete");
+		return false;
+	}
+
+	m_targetFramebuffer = m_offscreenFBO;
+
+	return true;
 }
 
-bool Renderer::renderGameObjects(Scene& scene)
+void Renderer::prepareDrawPackets(RenderState& state)
 {
-	glUseProgram(m_program);
+	PROFILE_FUNCTION();
+
+	JobSystem& jobSystem = Game::instance().jobSystem();
 
-	glm::mat4 view = scene.camera().viewMatrix();
-	glUniformMatrix4fv(glGetUniformLocation(m_program, "view"), 1, GL_FALSE, glm::value_ptr(view));
+	m_threadPackets.resize(jobSystem.nThreads());
+	m_threadShadowPackets.resize(jobSystem.nThreads());
+	for (size_t i = 0; i < m_threadPackets.size(); ++i) {
+		m_threadPackets[i].clear();
+		m_threadShadowPackets[i].clear();
+	}
 
 	glm::mat4 projection = glm::perspective(glm::radians(45.0f), (float)m_screenWidth / (float)m_screenHeight, 0.1f, 100.0f);
-	glUniformMatrix4fv(glGetUniformLocation(m_program, "projection"), 1, GL_FALSE, glm::value_ptr(projection));
+	Frustum frustum(projection * state.camera.view);
 
-	glUniform3fv(glGetUniformLocation(m_program, "viewPos"), 1, glm::value_ptr(scene.camera().position));
-	glUniformMatrix4fv(glGetUniformLocation(m_program, "lightSpaceMatrix"), 1, GL_FALSE, glm::value_ptr(scene.lightSpaceMatrix()));
+	computeShadowCascades(state);
+	Frustum cascadeFrustums[MAX_SHADOW_CASCADES];
+	for (int i = 0; i < m_shadowCascades; ++i) {
+		cascadeFrustums[i].update(m_cascadeMatrices[i]);
+	}
 
-	glUniform1i(glGetUniformLocation(m_program, "skybox"), 4);
-	glActiveTexture(GL_TEXTURE4);
-	glBindTexture(GL_TEXTURE_CUBE_MAP, scene.skybox()->texture());
+	// The occluders are rasterized before the packets are culled against them. Like the rest of the preparation
+	// this runs on the render thread and the workers while the main thread updates the next frame.
+	bool occlusionCulling = m_occlusionCuller.enabled() && !state.occluders.empty();
+	if (occlusionCulling) {
+		m_occlusionCuller.build(state.occluders, projection * state.camera.view, jobSystem);
+	}
 
-	for (auto it = scene.gameObjects().begin(); it != scene.gameObjects().end(); ++it) {
-		auto go = *it;
-		if (go->findComponent<RenderComponent>("RenderComponent").lock()) {
-			renderGameObject(*go, scene);
+	jobSystem.parallelFor(state.objects.size(), 64, [&](size_t begin, size_t end, int threadIndex) {
+		PROFILE_SCOPE("Prepare draw packets");
+
+		auto& packets = m_threadPackets[threadIndex];
+		auto& shadowPackets = m_threadShadowPackets[threadIndex];
+
+		for (size_t i = begin; i < end; ++i) {
+			RenderObject& object = state.objects[i];
+			RenderComponent* renderComponent = object.renderComponent.get();
+
+			// Components without bounds are never culled
+			bool hasBounds = renderComponent->localBounds().isValid();
+			AABB bounds = hasBounds ? renderComponent->localBounds().transformed(object.model) : AABB();
+
+			DrawPacket packet;
+			packet.id = object.id;
+			packet.model = object.model;
+			packet.renderComponent = renderComponent;
+			packet.depth = hasBounds ? glm::dot(bounds.center() - state.camera.position, state.camera.front) : 0.0f;
+			packet.screenSize = hasBounds ? projectedSize(bounds, state.camera.position) : std::numeric_limits<float>::max();
+			packet.lod = hasBounds ? selectLod(*renderComponent, packet.screenSize) : 0;
+
+			// Casters are drawn only into the cascades they intersect
+			packet.cascadeMask = 0;
+			for (int cascade = 0; cascade < m_shadowCascades; ++cascade) {
+				if (!hasBounds || cascadeFrustums[cascade].intersects(bounds)) {
+					packet.cascadeMask |= 1 << cascade;
+				}
+			}
+
+			if (packet.cascadeMask != 0) {
+				packet.sortKey = renderComponent->lod(packet.lod).vao;
+				shadowPackets.push_back(packet);
+			}
+
+			// Occluded objects still cast shadows, so only the camera packets are culled by occlusion
+			if (!hasBounds || (frustum.intersects(bounds) && (!occlusionCulling || m_occlusionCuller.isVisible(bounds)))) {
+				packet.sortKey = ((uint64_t)renderComponent->shaderVariantKey() << 52) | ((uint64_t)(renderComponent->materialId() & 0xFFFFF) << 32) | renderComponent->lod(packet.lod).vao;
+				packet.normalMatrix = glm::transpose(glm::inverse(glm::mat3(object.model)));
+				packets.push_back(packet);
+			}
 		}
+	});
+
+	m_packets.clear();
+	m_shadowPackets.clear();
+	for (size_t i = 0; i < m_threadPackets.size(); ++i) {
+		m_packets.insert(m_packets.end(), m_threadPackets[i].begin(), m_threadPackets[i].end());
+		m_shadowPackets.insert(m_shadowPackets.end(), m_threadShadowPackets[i].begin(), m_threadShadowPackets[i].end());
 	}
-	return true;
+
+	// Which thread prepared which range varies, the id keeps the order the same from frame to frame
+	auto packetOrder = [](const DrawPacket& a, const DrawPacket& b) {
+		if (a.sortKey != b.sortKey) {
+			return a.sortKey < b.sortKey;
+		}
+		if (a.depth != b.depth) {
+			return a.depth < b.depth;
+		}
+		return a.id < b.id;
+	};
+	std::sort(m_packets.begin(), m_packets.end(), packetOrder);
+	std::sort(m_shadowPackets.begin(), m_shadowPackets.end(), packetOrder);
+
+	m_visibleBatches.clear();
+	for (auto it = state.staticBatches.begin(); it != state.staticBatches.end(); ++it) {
+		if (frustum.intersects((*it)->bounds()) && (!occlusionCulling || m_occlusionCuller.isVisible((*it)->bounds()))) {
+			m_visibleBatches.push_back(it->get());
+		}
+	}
+
+	for (auto it = m_packets.begin(); it != m_packets.end(); ++it) {
+		touchTextures(*it->renderComponent, it->screenSize);
+	}
+	for (auto it = m_visibleBatches.begin(); it != m_visibleBatches.end(); ++it) {
+		touchTextures(*(*it)->renderComponent(), projectedSize((*it)->bounds(), state.camera.position));
+	}
+
+	// Instances are culled on the GPU, so their sizes on screen aren't known and they are treated as filling it
+	for (auto it = state.gpuInstances.begin(); it != state.gpuInstances.end(); ++it) {
+		touchTextures(*it->renderComponent, std::numeric_limits<float>::max());
+	}
+
+	m_lightClusters.build(state.lights, state.camera.view, glm::radians(45.0f), (float)m_screenWidth / (float)m_screenHeight, 0.1f, 100.0f, jobSystem);
 }
 
-bool Renderer::renderGameObject(GameObject& gameObject, Scene& scene)
+float Renderer::projectedSize(const AABB& bounds, const glm::vec3& cameraPosition)
 {
-	auto transformComponent = gameObject.findComponent<TransformComponent>("TransformComponent").lock();
-	auto renderComponent = gameObject.findComponent<RenderComponent>("RenderComponent").lock();
+	float radius = glm::length(bounds.max - bounds.min) * 0.5f;
+	float distance = glm::length(bounds.center() - cameraPosition);
+	if (distance <= radius) {
+		return std::numeric_limits<float>::max();
+	}
+	return radius / (distance * std::tan(glm::radians(45.0f) * 0.5f));
+}
 
-	glm::mat4 model = transformComponent->getTransformMatrix();
-	glUniformMatrix4fv(glGetUniformLocation(m_program, "model"), 1, GL_FALSE, glm::value_ptr(model));
+int Renderer::selectLod(RenderComponent& renderComponent, float screenSize)
+{
+	if (renderComponent.nLods() == 1) {
+		return 0;
+	}
 
-	glm::mat3 normalMatrix = glm::transpose(glm::inverse(glm::mat3(model)));
-	glUniformMatrix3fv(glGetUniformLocation(m_program, "normalMatrix"), 1, GL_FALSE, glm::value_ptr(normalMatrix));
+	if (screenSize == std::numeric_limits<float>::max()) {
+		renderComponent.lastLod = 0;
+		return 0;
+	}
+	screenSize *= m_lodBias;
 
-	// Setup material
-	glUniform1i(glGetUniformLocation(m_program, "material.diffuse"), 0);
-	glUniform1i(glGetUniformLocation(m_program, "material.specular"), 1);
-	glUniform1i(glGetUniformLocation(m_program, "material.reflectionMap"), 5);
-	glUniform1f(glGetUniformLocation(m_program, "material.shininess"), renderComponent->material().shininess);
+	// A LOD is only switched once the size is clearly past the threshold, so objects near it don't alternate
+	// between two LODs every frame
+	int lod = std::min(renderComponent.lastLod, renderComponent.nLods() - 1);
+	while (lod + 1 < renderComponent.nLods() && screenSize < renderComponent.lod(lod + 1).screenSize * (1.0f - m_lodHysteresis)) {
+		++lod;
+	}
+	while (lod > 0 && screenSize > renderComponent.lod(lod).screenSize * (1.0f + m_lodHysteresis)) {
+		--lod;
+	}
 
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, renderComponent->material().diffuseMap);
+	renderComponent.lastLod = lod;
+	return lod;
+}
 
-	glActiveTexture(GL_TEXTURE1);
-	glBindTexture(GL_TEXTURE_2D, renderComponent->material().specularMap);
+bool Renderer::renderGameObjects(RenderState& state)
+{
+	PROFILE_FUNCTION();
+
+	m_glState.bindTexture(3, GL_TEXTURE_2D_ARRAY, m_shadowDepthMap);
+	m_glState.bindTexture(4, GL_TEXTURE_CUBE_MAP, m_textureStreamer.binding(state.skybox->texture()).texture);
+
+	m_lightClusters.upload(m_glState);
+	m_lightClusters.bindTextures(m_glState, 6);
+
+	// Packets are sorted by shader variant and then by material, so the program and the material only have to
+	// be set up when they change
+	bool variantSet = false;
+	uint32_t variantKey = 0;
+	bool materialSet = false;
+	uint32_t materialId = 0;
+	for (auto it = m_packets.begin(); it != m_packets.end(); ++it) {
+		RenderComponent& renderComponent = *it->renderComponent;
+		if (!variantSet || renderComponent.shaderVariantKey() != variantKey) {
+			variantKey = renderComponent.shaderVariantKey();
+			variantSet = true;
+			materialSet = false;
+			useShaderVariant(variantKey, state);
+		}
+		if (!materialSet || renderComponent.materialId() != materialId) {
+			materialId = renderComponent.materialId();
+			materialSet = true;
+			setupMaterial(renderComponent);
+		}
+		renderGameObject(*it);
+	}
 
-	glActiveTexture(GL_TEXTURE5);
-	glBindTexture(GL_TEXTURE_2D, renderComponent->material().reflectionMap);
+	for (auto it = m_visibleBatches.begin(); it != m_visibleBatches.end(); ++it) {
+		uint32_t batchVariantKey = (*it)->renderComponent()->shaderVariantKey();
+		if (!variantSet || batchVariantKey != variantKey) {
+			variantKey = batchVariantKey;
+			variantSet = true;
+			useShaderVariant(variantKey, state);
+		}
+		renderStaticBatch(**it);
+	}
 
-	// Setup normal map
+	auto& groups = m_gpuCuller.groups();
+	for (size_t i = 0; i < groups.size(); ++i) {
+		if (!variantSet || groups[i].renderComponent->shaderVariantKey() != variantKey) {
+			variantKey = groups[i].renderComponent->shaderVariantKey();
+			variantSet = true;
+			useShaderVariant(variantKey, state);
+		}
+		setupMaterial(*groups[i].renderComponent);
+		renderInstances(i);
+	}
+	return true;
+}
 
-	glUniform1i(glGetUniformLocation(m_program, "normalMap"), 2);
-	glActiveTexture(GL_TEXTURE2);
-	glBindTexture(GL_TEXTURE_2D, renderComponent->normalMap());
+void Renderer::useShaderVariant(uint32_t variantKey, RenderState& state)
+{
+	auto it = m_variantPrograms.find(variantKey);
+	m_program = it != m_variantPrograms.end() ? it->second : -1;
+	m_glState.useProgram(m_program);
 
-	// Setup shadow map
+	glUniformMatrix4fv(glGetUniformLocation(m_program, "view"), 1, GL_FALSE, glm::value_ptr(state.camera.view));
 
-	glUniform1i(glGetUniformLocation(m_program, "shadowMap"), 3);
-	glActiveTexture(GL_TEXTURE3);
-	glBindTexture(GL_TEXTURE_2D, m_shadowDepthMap);
+	glm::mat4 projection = glm::perspective(glm::radians(45.0f), (float)m_screenWidth / (float)m_screenHeight, 0.1f, 100.0f);
+	glUniformMatrix4fv(glGetUniformLocation(m_program, "projection"), 1, GL_FALSE, glm::value_ptr(projection));
 
-	// Setup reflection map
+	glUniform3fv(glGetUniformLocation(m_program, "viewPos"), 1, glm::value_ptr(state.camera.position));
+	glUniformMatrix4fv(glGetUniformLocation(m_program, "lightSpaceMatrices"), m_shadowCascades, GL_FALSE, glm::value_ptr(m_cascadeMatrices[0]));
+	glUniform1fv(glGetUniformLocation(m_program, "cascadeSplits"), m_shadowCascades, m_cascadeSplits);
+	glUniform1i(glGetUniformLocation(m_program, "cascadeCount"), m_shadowCascades);
+
+	// Texture units
+	glUniform1i(glGetUniformLocation(m_program, "material.diffuse"), 0);
+	glUniform1i(glGetUniformLocation(m_program, "material.specular"), 1);
+	glUniform1i(glGetUniformLocation(m_program, "material.packedMap"), 1);
+	glUniform1i(glGetUniformLocation(m_program, "normalMap"), 2);
+	glUniform1i(glGetUniformLocation(m_program, "shadowMap"), 3);
+	glUniform1i(glGetUniformLocation(m_program, "skybox"), 4);
+	glUniform1i(glGetUniformLocation(m_program, "material.reflectionMap"), 5);
+	m_lightClusters.setUniforms(m_program, 6, m_resolutionScaler.width(), m_resolutionScaler.height());
 
 	// Setup lighting
-	auto lighting = scene.lighting();
+	auto& lighting = state.lighting;
 	glUniform3fv(glGetUniformLocation(m_program, "light.direction"), 1, glm::value_ptr(lighting.direction));
 	glUniform3fv(glGetUniformLocation(m_program, "light.ambient"), 1, glm::value_ptr(lighting.ambient));
 	glUniform3fv(glGetUniformLocation(m_program, "light.diffuse"), 1, glm::value_ptr(lighting.diffuse));
 	glUniform3fv(glGetUniformLocation(m_program, "light.specular"), 1, glm::value_ptr(lighting.specular));
-	
+}
+
+bool Renderer::renderGameObject(DrawPacket& packet)
+{
+	GPUTimerScope timer(m_gpuProfiler, "Game object", packet.id);
+
+	auto renderComponent = packet.renderComponent;
+
+	glUniformMatrix4fv(glGetUniformLocation(m_program, "model"), 1, GL_FALSE, glm::value_ptr(packet.model));
+	glUniformMatrix3fv(glGetUniformLocation(m_program, "normalMatrix"), 1, GL_FALSE, glm::value_ptr(packet.normalMatrix));
+
 	// Setup VAO and model data
-	glBindVertexArray(renderComponent->vao());
+	MeshLOD& mesh = renderComponent->lod(packet.lod);
+	m_glState.bindVertexArray(mesh.vao);
 
-	glBindBuffer(GL_ARRAY_BUFFER, renderComponent->vbo());
+	m_glState.bindBuffer(GL_ARRAY_BUFFER, mesh.vbo);
 	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
 	glEnableVertexAttribArray(0);
 
-	glBindBuffer(GL_ARRAY_BUFFER, renderComponent->uvs());
+	m_glState.bindBuffer(GL_ARRAY_BUFFER, mesh.uvs);
 	glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 0, (void*)0);
 	glEnableVertexAttribArray(1);
 
-	glBindBuffer(GL_ARRAY_BUFFER, renderComponent->normals());
+	m_glState.bindBuffer(GL_ARRAY_BUFFER, mesh.normals);
 	glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
 	glEnableVertexAttribArray(2);
 
-	glBindBuffer(GL_ARRAY_BUFFER, renderComponent->tangents());
+	m_glState.bindBuffer(GL_ARRAY_BUFFER, mesh.tangents);
 	glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
 	glEnableVertexAttribArray(3);
 
-	glBindBuffer(GL_ARRAY_BUFFER, renderComponent->bitangents());
+	m_glState.bindBuffer(GL_ARRAY_BUFFER, mesh.bitangents);
 	glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
 	glEnableVertexAttribArray(4);
 
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, renderComponent->ebo());
+	m_glState.bindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.ebo);
 
 	// Render
-	glDrawElements(GL_TRIANGLES, renderComponent->nIndices(), GL_UNSIGNED_SHORT, (void*)0);
+	glDrawElements(GL_TRIANGLES, mesh.nIndices, GL_UNSIGNED_SHORT, (void*)mesh.indexOffset);
 
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+	m_glState.bindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
 	glDisableVertexAttribArray(renderComponent->vao());
 
 	return true;
 }
 
-bool Renderer::renderSkybox(Scene& scene)
+bool Renderer::renderStaticBatch(StaticBatch& batch)
+{
+	GPUTimerScope timer(m_gpuProfiler, "Static batch", batch.vao());
+
+	// Batch vertices are already in world space
+	glm::mat4 model = glm::mat4(1.0f);
+	glUniformMatrix4fv(glGetUniformLocation(m_program, "model"), 1, GL_FALSE, glm::value_ptr(model));
+
+	glm::mat3 normalMatrix = glm::mat3(1.0f);
+	glUniformMatrix3fv(glGetUniformLocation(m_program, "normalMatrix"), 1, GL_FALSE, glm::value_ptr(normalMatrix));
+
+	setupMaterial(*batch.renderComponent());
+
+	m_glState.bindVertexArray(batch.vao());
+
+	m_glState.bindBuffer(GL_ARRAY_BUFFER, batch.vbo());
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
+	glEnableVertexAttribArray(0);
+
+	m_glState.bindBuffer(GL_ARRAY_BUFFER, batch.uvs());
+	glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 0, (void*)0);
+	glEnableVertexAttribArray(1);
+
+	m_glState.bindBuffer(GL_ARRAY_BUFFER, batch.normals());
+	glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
+	glEnableVertexAttribArray(2);
+
+	m_glState.bindBuffer(GL_ARRAY_BUFFER, batch.tangents());
+	glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
+	glEnableVertexAttribArray(3);
+
+	m_glState.bindBuffer(GL_ARRAY_BUFFER, batch.bitangents());
+	glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
+	glEnableVertexAttribArray(4);
+
+	m_glState.bindBuffer(GL_ELEMENT_ARRAY_BUFFER, batch.ebo());
+
+	glDrawElements(GL_TRIANGLES, batch.nIndices(), GL_UNSIGNED_INT, (void*)0);
+
+	m_glState.bindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+
+	return true;
+}
+
+bool Renderer::renderInstances(size_t group)
+{
+	GPUTimerScope timer(m_gpuProfiler, "Instances", group);
+
+	auto renderComponent = m_gpuCuller.groups()[group].renderComponent;
+
+	// The representative component's buffers are drawn for every instance of the group
+	m_glState.bindVertexArray(renderComponent->vao());
+
+	m_glState.bindBuffer(GL_ARRAY_BUFFER, renderComponent->vbo());
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
+	glEnableVertexAttribArray(0);
+
+	m_glState.bindBuffer(GL_ARRAY_BUFFER, renderComponent->uvs());
+	glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 0, (void*)0);
+	glEnableVertexAttribArray(1);
+
+	m_glState.bindBuffer(GL_ARRAY_BUFFER, renderComponent->normals());
+	glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
+	glEnableVertexAttribArray(2);
+
+	m_glState.bindBuffer(GL_ARRAY_BUFFER, renderComponent->tangents());
+	glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
+	glEnableVertexAttribArray(3);
+
+	m_glState.bindBuffer(GL_ARRAY_BUFFER, renderComponent->bitangents());
+	glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
+	glEnableVertexAttribArray(4);
+
+	m_gpuCuller.bindInstances(m_glState, group, false);
+
+	m_glState.bindBuffer(GL_ELEMENT_ARRAY_BUFFER, renderComponent->ebo());
+
+	m_gpuCuller.draw(m_glState, group, false);
+
+	m_glState.bindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+
+	return true;
+}
+
+void Renderer::touchTextures(RenderComponent& renderComponent, float screenSize)
+{
+	// The height is clamped first, as the size of objects around the camera would overflow
+	float pixels = std::min(screenSize, 1.0f) * m_resolutionScaler.height();
+
+	m_textureStreamer.touch(renderComponent.material().diffuseMap, pixels);
+	m_textureStreamer.touch(renderComponent.material().specularMap, pixels);
+	m_textureStreamer.touch(renderComponent.material().reflectionMap, pixels);
+	m_textureStreamer.touch(renderComponent.material().packedMap, pixels);
+	m_textureStreamer.touch(renderComponent.normalMap(), pixels);
+}
+
+void Renderer::setupMaterial(RenderComponent& renderComponent)
+{
+	// Texture units are set up in useShaderVariant, samplers of features the variant doesn't have are unused
+	glUniform1f(glGetUniformLocation(m_program, "material.shininess"), renderComponent.material().shininess);
+
+	// Materials with their textures in the same texture array pages only change the layers
+	const Material& material = renderComponent.material();
+	const ShaderVariant& variant = renderComponent.shaderVariant();
+	auto diffuse = m_textureStreamer.binding(material.diffuseMap);
+	auto specular = m_textureStreamer.binding(variant.packedMaterial ? material.packedMap : material.specularMap);
+	auto reflection = m_textureStreamer.binding(material.reflectionMap);
+	auto normal = m_textureStreamer.binding(renderComponent.normalMap());
+
+	m_glState.bindTexture(0, diffuse.target, diffuse.texture);
+
+	// A packed material takes the specular map's unit and needs no reflection map
+	m_glState.bindTexture(1, specular.target, specular.texture);
+	if (variant.reflection && !variant.packedMaterial) {
+		m_glState.bindTexture(5, reflection.target, reflection.texture);
+	}
+
+	if (variant.normalMapping) {
+		m_glState.bindTexture(2, normal.target, normal.texture);
+	}
+
+	if (variant.textureArrays) {
+		glUniform4f(glGetUniformLocation(m_program, "materialLayers"), (float)diffuse.layer, (float)specular.layer, (float)reflection.layer, (float)normal.layer);
+	}
+}
+
+bool Renderer::renderSkybox(RenderState& state)
 {
-	glUseProgram(m_skyboxProgram);
+	PROFILE_FUNCTION();
+
+	m_glState.useProgram(m_skyboxProgram);
 
-	glDepthMask(GL_FALSE);
+	m_glState.depthMask(false);
 
-	glm::mat4 view = glm::mat4(glm::mat3(scene.camera().viewMatrix()));
+	glm::mat4 view = glm::mat4(glm::mat3(state.camera.view));
 	glUniformMatrix4fv(glGetUniformLocation(m_skyboxProgram, "view"), 1, GL_FALSE, glm::value_ptr(view));
 
 	glm::mat4 projection = glm::perspective(glm::radians(45.0f), (float)m_screenWidth / (float)m_screenHeight, 0.1f, 100.0f);
@@ -439,60 +1261,352 @@ bool Renderer::renderSkybox(Scene& scene)
 
 	glUniform1i(glGetUniformLocation(m_skyboxProgram, "skybox"), 0);
 
-	glBindVertexArray(scene.skybox()->vao());
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_CUBE_MAP, scene.skybox()->texture());
+	m_glState.bindVertexArray(state.skybox->vao());
+	m_glState.bindTexture(0, GL_TEXTURE_CUBE_MAP, m_textureStreamer.binding(state.skybox->texture()).texture);
 
 	glDrawArrays(GL_TRIANGLES, 0, 36);
-	glBindVertexArray(0);
+	m_glState.bindVertexArray(0);
+
+	m_glState.depthMask(true);
+	return true;
+}
+
+void Renderer::computeShadowCascades(RenderState& state)
+{
+	const float nearPlane = 0.1f;
+	float shadowDistance = std::min(m_shadowDistance, 100.0f);
+	float aspect = (float)m_screenWidth / (float)m_screenHeight;
+	glm::mat4 inverseView = glm::inverse(state.camera.view);
+
+	glm::vec3 lightDirection = glm::normalize(state.lighting.direction);
+	glm::vec3 up = std::abs(lightDirection.y) > 0.99f ? glm::vec3(0.0f, 0.0f, 1.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+
+	float splitNear = nearPlane;
+	for (int i = 0; i < m_shadowCascades; ++i) {
+		// Practical split scheme, a blend of logarithmic and uniform splits
+		float t = (float)(i + 1) / m_shadowCascades;
+		float logSplit = nearPlane * std::pow(shadowDistance / nearPlane, t);
+		float uniformSplit = nearPlane + (shadowDistance - nearPlane) * t;
+		float splitFar = m_shadowSplitLambda * logSplit + (1.0f - m_shadowSplitLambda) * uniformSplit;
+
+		// The cascade is fitted to the bounding sphere of the slice, so its size doesn't change when the camera
+		// rotates. The radius is rounded to keep it constant despite floating point errors.
+		glm::mat4 inverseSlice = inverseView * glm::inverse(glm::perspective(glm::radians(45.0f), aspect, splitNear, splitFar));
+		glm::vec3 corners[8];
+		glm::vec3 center(0.0f);
+		for (int c = 0; c < 8; ++c) {
+			glm::vec4 corner = inverseSlice * glm::vec4((c & 1) ? 1.0f : -1.0f, (c & 2) ? 1.0f : -1.0f, (c & 4) ? 1.0f : -1.0f, 1.0f);
+			corners[c] = glm::vec3(corner) / corner.w;
+			center += corners[c] / 8.0f;
+		}
+		float radius = 0.0f;
+		for (int c = 0; c < 8; ++c) {
+			radius = std::max(radius, glm::length(corners[c] - center));
+		}
+		radius = std::ceil(radius * 16.0f) / 16.0f;
+
+		if (m_cacheStaticShadows) {
+			// Move the cascade in steps of an eighth of its radius, so it stays in place and its cached static
+			// shadows stay valid while the camera moves within a step. The cascade is enlarged by a step to still
+			// cover the whole slice.
+			float step = radius / 8.0f;
+			glm::mat3 lightRotation = glm::mat3(glm::lookAt(glm::vec3(0.0f), lightDirection, up));
+			glm::vec3 lightSpaceCenter = glm::round(lightRotation * center / step) * step;
+			center = glm::transpose(lightRotation) * lightSpaceCenter;
+			radius += step;
+		}
+
+		// Casters up to casterDistance towards the light from the sphere are included in the cascade
+		glm::mat4 lightView = glm::lookAt(center - lightDirection * (radius + m_shadowCasterDistance), center, up);
+		glm::mat4 lightProjection = glm::ortho(-radius, radius, -radius, radius, 0.0f, 2.0f * radius + m_shadowCasterDistance);
+
+		// Snap the cascade to whole texels, otherwise shadow edges shimmer when the camera moves
+		glm::vec4 origin = lightProjection * lightView * glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+		glm::vec2 originTexels = glm::vec2(origin.x, origin.y) * (m_shadowMapResolution / 2.0f);
+		glm::vec2 offset = (glm::round(originTexels) - originTexels) * (2.0f / m_shadowMapResolution);
+		lightProjection[3][0] += offset.x;
+		lightProjection[3][1] += offset.y;
+
+		m_cascadeMatrices[i] = lightProjection * lightView;
+		m_cascadeSplits[i] = splitFar;
+		splitNear = splitFar;
+	}
+}
+
+bool Renderer::renderShadowDepthMap(RenderState& state)
+{
+	PROFILE_FUNCTION();
+
+	m_glState.useProgram(m_shadowDepthMapProgram);
+
+	Frustum cascadeFrustums[MAX_SHADOW_CASCADES];
+	for (int i = 0; i < m_shadowCascades; ++i) {
+		cascadeFrustums[i].update(m_cascadeMatrices[i]);
+	}
+
+	// Static batches are culled here, they are few enough not to need the preparation jobs
+	m_shadowBatchMasks.resize(state.staticBatches.size());
+	for (size_t i = 0; i < state.staticBatches.size(); ++i) {
+		m_shadowBatchMasks[i] = 0;
+		for (int cascade = 0; cascade < m_shadowCascades; ++cascade) {
+			if (cascadeFrustums[cascade].intersects(state.staticBatches[i]->bounds())) {
+				m_shadowBatchMasks[i] |= 1 << cascade;
+			}
+		}
+	}
+
+	uint32_t allCascades = (1 << m_shadowCascades) - 1;
+
+	if (!m_cacheStaticShadows) {
+		clearShadowCascades(m_shadowCascadeFBOs, allCascades);
+		renderShadowCasters(state, allCascades, false);
+		renderShadowInstances(allCascades);
+		return true;
+	}
+
+	// Static casters are drawn again only into the cascades that moved, or into all of them after the light
+	// direction or the static batches changed
+	uint32_t staleCascades = 0;
+	if (state.lighting.direction != m_staticShadowLightDirection || state.staticVersion != m_staticShadowVersion) {
+		staleCascades = allCascades;
+	}
+	for (int i = 0; i < m_shadowCascades; ++i) {
+		if (m_cascadeMatrices[i] != m_staticShadowMatrices[i]) {
+			staleCascades |= 1 << i;
+		}
+	}
+
+	if (staleCascades != 0) {
+		clearShadowCascades(m_staticShadowCascadeFBOs, staleCascades);
+		renderShadowCasters(state, staleCascades, true);
+
+		m_staticShadowLightDirection = state.lighting.direction;
+		m_staticShadowVersion = state.staticVersion;
+		for (int i = 0; i < m_shadowCascades; ++i) {
+			m_staticShadowMatrices[i] = m_cascadeMatrices[i];
+		}
+	}
+
+	// Each cascade starts from its cached static depth, and the dynamic casters are drawn on top
+	for (int i = 0; i < m_shadowCascades; ++i) {
+		m_glState.bindFramebuffer(GL_READ_FRAMEBUFFER, m_staticShadowCascadeFBOs[i]);
+		m_glState.bindFramebuffer(GL_DRAW_FRAMEBUFFER, m_shadowCascadeFBOs[i]);
+		glBlitFramebuffer(0, 0, m_shadowMapResolution, m_shadowMapResolution, 0, 0, m_shadowMapResolution, m_shadowMapResolution, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+	}
+	renderShadowCasters(state, allCascades, false);
+	renderShadowInstances(allCascades);
 
-	glDepthMask(GL_TRUE);
 	return true;
 }
 
-bool Renderer::renderShadowDepthMap(Camera& camera, Scene& scene)
+void Renderer::clearShadowCascades(uint32_t* cascadeFBOs, uint32_t cascadeMask)
+{
+	for (int i = 0; i < m_shadowCascades; ++i) {
+		if (cascadeMask & (1 << i)) {
+			m_glState.bindFramebuffer(GL_FRAMEBUFFER, cascadeFBOs[i]);
+			glClear(GL_DEPTH_BUFFER_BIT);
+		}
+	}
+}
+
+void Renderer::renderShadowCasters(RenderState& state, uint32_t cascadeMask, bool staticCache)
 {
-	glUseProgram(m_shadowDepthMapProgram);
+	// The static cache only holds the static batches, which are then left out of the shadow map's own pass
+	bool drawPackets = !staticCache;
+	bool drawBatches = staticCache || !m_cacheStaticShadows;
+
+	if (m_layeredShadows) {
+		// Single pass, the geometry shader emits each triangle to the cascades in the caster's mask
+		m_glState.bindFramebuffer(GL_FRAMEBUFFER, staticCache ? m_staticShadowLayeredFBO : m_shadowLayeredFBO);
+
+		glUniformMatrix4fv(glGetUniformLocation(m_shadowDepthMapProgram, "lightSpaceMatrices"), m_shadowCascades, GL_FALSE, glm::value_ptr(m_cascadeMatrices[0]));
+		int cascadeMaskLocation = glGetUniformLocation(m_shadowDepthMapProgram, "cascadeMask");
+
+		for (auto it = m_shadowPackets.begin(); drawPackets && it != m_shadowPackets.end(); ++it) {
+			uint32_t mask = it->cascadeMask & cascadeMask;
+			if (mask != 0) {
+				glUniform1i(cascadeMaskLocation, mask);
+				renderDepthOnlyObject(*it, m_shadowDepthMapProgram);
+			}
+		}
+
+		for (size_t i = 0; drawBatches && i < state.staticBatches.size(); ++i) {
+			uint32_t mask = m_shadowBatchMasks[i] & cascadeMask;
+			if (mask != 0) {
+				glUniform1i(cascadeMaskLocation, mask);
+				renderDepthOnlyBatch(*state.staticBatches[i], m_shadowDepthMapProgram);
+			}
+		}
+		return;
+	}
+
+	for (int cascade = 0; cascade < m_shadowCascades; ++cascade) {
+		if (!(cascadeMask & (1 << cascade))) {
+			continue;
+		}
+
+		m_glState.bindFramebuffer(GL_FRAMEBUFFER, staticCache ? m_staticShadowCascadeFBOs[cascade] : m_shadowCascadeFBOs[cascade]);
+
+		glUniformMatrix4fv(glGetUniformLocation(m_shadowDepthMapProgram, "lightSpaceMatrix"), 1, GL_FALSE, glm::value_ptr(m_cascadeMatrices[cascade]));
+
+		for (auto it = m_shadowPackets.begin(); drawPackets && it != m_shadowPackets.end(); ++it) {
+			if (it->cascadeMask & (1 << cascade)) {
+				renderDepthOnlyObject(*it, m_shadowDepthMapProgram);
+			}
+		}
+
+		for (size_t i = 0; drawBatches && i < state.staticBatches.size(); ++i) {
+			if (m_shadowBatchMasks[i] & (1 << cascade)) {
+				renderDepthOnlyBatch(*state.staticBatches[i], m_shadowDepthMapProgram);
+			}
+		}
+	}
+}
+
+void Renderer::renderShadowInstances(uint32_t cascadeMask)
+{
+	auto& groups = m_gpuCuller.groups();
+	if (groups.empty()) {
+		return;
+	}
+
+	// The instances aren't culled against the cascades, each group is drawn into all of them
+	m_glState.useProgram(m_shadowDepthMapInstancedProgram);
+
+	if (m_layeredShadows) {
+		m_glState.bindFramebuffer(GL_FRAMEBUFFER, m_shadowLayeredFBO);
+
+		glUniformMatrix4fv(glGetUniformLocation(m_shadowDepthMapInstancedProgram, "lightSpaceMatrices"), m_shadowCascades, GL_FALSE, glm::value_ptr(m_cascadeMatrices[0]));
+		glUniform1i(glGetUniformLocation(m_shadowDepthMapInstancedProgram, "cascadeMask"), cascadeMask);
+
+		for (size_t i = 0; i < groups.size(); ++i) {
+			renderDepthOnlyInstances(i, true);
+		}
+	}
+	else {
+		for (int cascade = 0; cascade < m_shadowCascades; ++cascade) {
+			if (!(cascadeMask & (1 << cascade))) {
+				continue;
+			}
+
+			m_glState.bindFramebuffer(GL_FRAMEBUFFER, m_shadowCascadeFBOs[cascade]);
+
+			glUniformMatrix4fv(glGetUniformLocation(m_shadowDepthMapInstancedProgram, "lightSpaceMatrix"), 1, GL_FALSE, glm::value_ptr(m_cascadeMatrices[cascade]));
+
+			for (size_t i = 0; i < groups.size(); ++i) {
+				renderDepthOnlyInstances(i, true);
+			}
+		}
+	}
+
+	m_glState.useProgram(m_shadowDepthMapProgram);
+}
+
+void Renderer::renderDepthPrepass(RenderState& state)
+{
+	PROFILE_FUNCTION();
+
+	m_glState.useProgram(m_depthPrepassProgram);
+	m_glState.colorMask(false);
+
+	glUniformMatrix4fv(glGetUniformLocation(m_depthPrepassProgram, "view"), 1, GL_FALSE, glm::value_ptr(state.camera.view));
+
+	glm::mat4 projection = glm::perspective(glm::radians(45.0f), (float)m_screenWidth / (float)m_screenHeight, 0.1f, 100.0f);
+	glUniformMatrix4fv(glGetUniformLocation(m_depthPrepassProgram, "projection"), 1, GL_FALSE, glm::value_ptr(projection));
+
+	// Same packets and batches as the colour pass, drawn with positions only
+	for (auto it = m_packets.begin(); it != m_packets.end(); ++it) {
+		renderDepthOnlyObject(*it, m_depthPrepassProgram);
+	}
 
-	glUniformMatrix4fv(glGetUniformLocation(m_shadowDepthMapProgram, "lightSpaceMatrix"), 1, GL_FALSE, glm::value_ptr(scene.lightSpaceMatrix()));
+	for (auto it = m_visibleBatches.begin(); it != m_visibleBatches.end(); ++it) {
+		renderDepthOnlyBatch(**it, m_depthPrepassProgram);
+	}
+
+	// The visible instances are drawn from the same buffer as in the colour pass, so their depth matches exactly
+	if (!m_gpuCuller.groups().empty()) {
+		m_glState.useProgram(m_depthPrepassInstancedProgram);
+		glUniformMatrix4fv(glGetUniformLocation(m_depthPrepassInstancedProgram, "view"), 1, GL_FALSE, glm::value_ptr(state.camera.view));
+		glUniformMatrix4fv(glGetUniformLocation(m_depthPrepassInstancedProgram, "projection"), 1, GL_FALSE, glm::value_ptr(projection));
 
-	for (auto it = scene.gameObjects().begin(); it != scene.gameObjects().end(); ++it) {
-		auto go = *it;
-		if (go->findComponent<RenderComponent>("RenderComponent").lock()) {
-			renderShadowDepthMapGO(*go);
+		for (size_t i = 0; i < m_gpuCuller.groups().size(); ++i) {
+			renderDepthOnlyInstances(i, false);
 		}
 	}
+
+	m_glState.colorMask(true);
+}
+
+bool Renderer::renderDepthOnlyObject(DrawPacket& packet, uint32_t program)
+{
+	auto renderComponent = packet.renderComponent;
+
+	glUniformMatrix4fv(glGetUniformLocation(program, "model"), 1, GL_FALSE, glm::value_ptr(packet.model));
+
+	MeshLOD& mesh = renderComponent->lod(packet.lod);
+	m_glState.bindVertexArray(mesh.vao);
+
+	m_glState.bindBuffer(GL_ARRAY_BUFFER, mesh.vbo);
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
+	glEnableVertexAttribArray(0);
+
+	m_glState.bindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.ebo);
+
+	glDrawElements(GL_TRIANGLES, mesh.nIndices, GL_UNSIGNED_SHORT, (void*)mesh.indexOffset);
+
+	glDisableVertexAttribArray(0);
+
 	return true;
 }
 
-bool Renderer::renderShadowDepthMapGO(GameObject& gameObject)
+bool Renderer::renderDepthOnlyBatch(StaticBatch& batch, uint32_t program)
 {
-	auto transformComponent = gameObject.findComponent<TransformComponent>("TransformComponent").lock();
-	auto renderComponent = gameObject.findComponent<RenderComponent>("RenderComponent").lock();
+	glm::mat4 model = glm::mat4(1.0f);
+	glUniformMatrix4fv(glGetUniformLocation(program, "model"), 1, GL_FALSE, glm::value_ptr(model));
+
+	m_glState.bindVertexArray(batch.vao());
+
+	m_glState.bindBuffer(GL_ARRAY_BUFFER, batch.vbo());
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
+	glEnableVertexAttribArray(0);
+
+	m_glState.bindBuffer(GL_ELEMENT_ARRAY_BUFFER, batch.ebo());
 
-	glm::mat4 model = transformComponent->getTransformMatrix();
-	glUniformMatrix4fv(glGetUniformLocation(m_shadowDepthMapProgram, "model"), 1, GL_FALSE, glm::value_ptr(model));
+	glDrawElements(GL_TRIANGLES, batch.nIndices(), GL_UNSIGNED_INT, (void*)0);
+
+	glDisableVertexAttribArray(0);
+
+	return true;
+}
+
+bool Renderer::renderDepthOnlyInstances(size_t group, bool allInstances)
+{
+	auto renderComponent = m_gpuCuller.groups()[group].renderComponent;
 
-	glBindVertexArray(renderComponent->vao());
+	m_glState.bindVertexArray(renderComponent->vao());
 
-	glBindBuffer(GL_ARRAY_BUFFER, renderComponent->vbo());
+	m_glState.bindBuffer(GL_ARRAY_BUFFER, renderComponent->vbo());
 	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
 	glEnableVertexAttribArray(0);
 
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, renderComponent->ebo());
+	m_gpuCuller.bindInstances(m_glState, group, allInstances);
 
-	glDrawElements(GL_TRIANGLES, renderComponent->nIndices(), GL_UNSIGNED_SHORT, (void*)0);
+	m_glState.bindBuffer(GL_ELEMENT_ARRAY_BUFFER, renderComponent->ebo());
+
+	m_gpuCuller.draw(m_glState, group, allInstances);
 
 	glDisableVertexAttribArray(0);
 
 	return true;
 }
 
-bool Renderer::renderParticleSystems(Scene& scene)
+bool Renderer::renderParticleSystems(RenderState& state)
 {
-	glUseProgram(m_particleProgram);
+	PROFILE_FUNCTION();
+
+	m_glState.useProgram(m_particleProgram);
 
-	glm::mat4 view = scene.camera().viewMatrix();
+	glm::mat4 view = state.camera.view;
 	glUniformMatrix4fv(glGetUniformLocation(m_particleProgram, "view"), 1, GL_FALSE, glm::value_ptr(view));
 
 	glm::mat4 projection = glm::perspective(glm::radians(45.0f), (float)m_screenWidth / (float)m_screenHeight, 0.1f, 100.0f);
@@ -501,108 +1615,119 @@ bool Renderer::renderParticleSystems(Scene& scene)
 	glm::vec3 cameraUp = glm::vec3(0.0f, 1.0f, 0.0f);
 	glUniform3fv(glGetUniformLocation(m_particleProgram, "cameraUp"), 1, glm::value_ptr(cameraUp));
 
-	glm::vec3 cameraRight = glm::normalize(glm::cross(scene.camera().front(), cameraUp));
+	glm::vec3 cameraRight = glm::normalize(glm::cross(state.camera.front, cameraUp));
 	glUniform3fv(glGetUniformLocation(m_particleProgram, "cameraRight"), 1, glm::value_ptr(cameraUp));
 
-	for (auto it = scene.gameObjects().begin(); it != scene.gameObjects().end(); ++it) {
-		auto go = *it;
-		if (go->findComponent<ParticleSystemComponent>("ParticleSystemComponent").lock()) {
-			renderParticleSystem(*go, scene.camera());
-		}
+	for (auto it = state.particleSystems.begin(); it != state.particleSystems.end(); ++it) {
+		renderParticleSystem(*it);
 	}
 	return true;
 }
 
-bool Renderer::renderParticleSystem(GameObject& gameObject, Camera& camera)
+bool Renderer::renderParticleSystem(RenderParticleSystem& particles)
 {
-	auto particleSystem = gameObject.findComponent<ParticleSystemComponent>("ParticleSystemComponent").lock();
+	GPUTimerScope timer(m_gpuProfiler, "Particle system", particles.id);
+
+	auto particleSystem = particles.particleSystem;
+	size_t nParticles = particles.positionSize.size();
+	if (nParticles == 0) {
+		return true;
+	}
 
 	glUniform1i(glGetUniformLocation(m_particleProgram, "particleTexture"), 0);
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, particleSystem->texture());
+	m_glState.bindTexture(0, GL_TEXTURE_2D, particleSystem->texture());
 
 	if (m_particlesInstanced) {
-		glBindVertexArray(particleSystem->vao());
+		m_glState.bindVertexArray(particleSystem->vao());
 
-		glBindBuffer(GL_ARRAY_BUFFER, particleSystem->vbo());
+		m_glState.bindBuffer(GL_ARRAY_BUFFER, particleSystem->vbo());
 		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
 		glEnableVertexAttribArray(0);
 
-		glBindBuffer(GL_ARRAY_BUFFER, particleSystem->positionSizeBuffer());
-		glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, 0, (void*)0);
+		size_t positionSizeOffset = m_streamingBuffer.write(m_glState, &particles.positionSize[0], nParticles * sizeof(glm::vec4));
+		size_t colorOffset = m_streamingBuffer.write(m_glState, &particles.colors[0], nParticles * sizeof(glm::vec4));
+		if (positionSizeOffset == (size_t)-1 || colorOffset == (size_t)-1) {
+			return false;
+		}
+
+		m_glState.bindBuffer(GL_ARRAY_BUFFER, m_streamingBuffer.buffer());
+		glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, 0, (void*)positionSizeOffset);
 		glEnableVertexAttribArray(1);
 
-		glBindBuffer(GL_ARRAY_BUFFER, particleSystem->colorBuffer());
-		glVertexAttribPointer(2, 4, GL_FLOAT, GL_FALSE, 0, (void*)0);
+		glVertexAttribPointer(2, 4, GL_FLOAT, GL_FALSE, 0, (void*)colorOffset);
 		glEnableVertexAttribArray(2);
 
 		glVertexAttribDivisor(0, 0);
 		glVertexAttribDivisor(1, 1);
 		glVertexAttribDivisor(2, 1);
 
-		glDrawArraysInstanced(GL_TRIANGLES, 0, 6, particleSystem->bufferSize());
+		glDrawArraysInstanced(GL_TRIANGLES, 0, 6, nParticles);
 	}
 	else {
-		Particle* particles = particleSystem->particles();
-
-		for (int i = 0; i < particleSystem->maxParticles(); ++i) {
-			Particle& p = particles[i];
+		for (size_t i = 0; i < nParticles; ++i) {
+			glm::vec3 position = glm::vec3(particles.positionSize[i]);
+			glUniform3fv(glGetUniformLocation(m_particleProgram, "position"), 1, glm::value_ptr(position));
+			glUniform1f(glGetUniformLocation(m_particleProgram, "size"), particles.positionSize[i].w);
+			glUniform4fv(glGetUniformLocation(m_particleProgram, "color"), 1, glm::value_ptr(particles.colors[i]));
 
-			if (p.life > 0) {
-				glUniform3fv(glGetUniformLocation(m_particleProgram, "position"), 1, glm::value_ptr(p.position));
-				glUniform1f(glGetUniformLocation(m_particleProgram, "size"), p.size);
-				glUniform4fv(glGetUniformLocation(m_particleProgram, "color"), 1, glm::value_ptr(p.color));
+			m_glState.bindVertexArray(particleSystem->vao());
 
-				glBindVertexArray(particleSystem->vao());
+			m_glState.bindBuffer(GL_ARRAY_BUFFER, particleSystem->vbo());
+			glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
+			glEnableVertexAttribArray(0);
 
-				glBindBuffer(GL_ARRAY_BUFFER, particleSystem->vbo());
-				glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
-				glEnableVertexAttribArray(0);
-
-				glDrawArrays(GL_TRIANGLES, 0, 6);
-			}
+			glDrawArrays(GL_TRIANGLES, 0, 6);
 		}
 	}
 
 	return true;
 }
 
-bool Renderer::renderUIElements(Scene& scene)
+bool Renderer::renderUIElements(RenderState& state)
 {
-	glUseProgram(m_uiProgram);
+	PROFILE_FUNCTION();
+
+	m_glState.useProgram(m_uiProgram);
 
 	glm::mat4 projection = glm::ortho(0.0f, (float)m_screenWidth, 0.0f, (float)m_screenHeight);
 	glUniformMatrix4fv(glGetUniformLocation(m_uiProgram, "projection"), 1, GL_FALSE, glm::value_ptr(projection));
 
-	auto uiElements = scene.uiElements();
-	for (auto it = uiElements.begin(); it != uiElements.end(); ++it) {
-		std::shared_ptr<UIElement> pElement = *it;
-		if (std::string(pElement->elementType()) == "TextElement") {
-			std::shared_ptr<TextElement> pTextElem = std::static_pointer_cast<TextElement>(pElement);
-			renderTextElement(pTextElem);
-		}
-		else {
-			LOG_DEBUG("Renderer::renderUIElements: couldn't render UI element - couldn't recognize element type.");
-		}
+	for (auto it = state.texts.begin(); it != state.texts.end(); ++it) {
+		renderTextElement(*it);
 	}
 
 	return true;
 }
 
-bool Renderer::renderTextElement(std::shared_ptr<TextElement> elem)
+bool Renderer::renderTextElement(RenderText& text)
 {
-	glUniform4fv(glGetUniformLocation(m_uiProgram, "textColor"), 1, glm::value_ptr(elem->color()));
-	glActiveTexture(GL_TEXTURE0);
+	auto elem = text.element;
+
+	glUniform4fv(glGetUniformLocation(m_uiProgram, "textColor"), 1, glm::value_ptr(text.color));
 	glUniform1i(glGetUniformLocation(m_uiProgram, "glyphTexture"), 0);
-	glBindVertexArray(elem->vao());
+	m_glState.bindVertexArray(elem->vao());
 
 	auto font = elem->font();
-	float x = elem->position().x;
-	float y = elem->position().y;
-	float scale = elem->textScale();
+	float x = text.position.x;
+	float y = text.position.y;
+	float scale = text.scale;
+
+	// Lines are spaced by the height of a capital letter
+	float lineHeight = font->glyphs()['H']->size.y * 1.6f * scale;
+
+	// The quads of all glyphs are written with one upload, and drawn one glyph texture at a time
+	std::vector<float> vertices;
+	std::vector<uint32_t> textures;
+	vertices.reserve(text.text.size() * 6 * 4);
+	textures.reserve(text.text.size());
+
+	for (auto c = text.text.begin(); c != text.text.end(); ++c) {
+		if (*c == '\n') {
+			x = text.position.x;
+			y -= lineHeight;
+			continue;
+		}
 
-	std::string text = elem->text();
-	for (auto c = text.begin(); c != text.end(); ++c) {
 		std::shared_ptr<Character> ch = font->glyphs()[*c];
 
 		float xpos = x + ch->bearing.x * scale;
@@ -610,7 +1735,7 @@ bool Renderer::renderTextElement(std::shared_ptr<TextElement> elem)
 		float w = ch->size.x * scale;
 		float h = ch->size.y * scale;
 
-		float vertices[] = {
+		float quad[] = {
 			xpos, ypos + h, 0.0, 0.0,
 			xpos, ypos, 0.0, 1.0,
 			xpos + w, ypos, 1.0, 1.0,
@@ -618,21 +1743,31 @@ bool Renderer::renderTextElement(std::shared_ptr<TextElement> elem)
 			xpos + w, ypos, 1.0, 1.0,
 			xpos + w, ypos + h, 1.0, 0.0
 		};
+		vertices.insert(vertices.end(), std::begin(quad), std::end(quad));
+		textures.push_back(ch->textureID);
 
-		glBindTexture(GL_TEXTURE_2D, ch->textureID);
-		glBindBuffer(GL_ARRAY_BUFFER, elem->vbo());
-		glBufferSubData(GL_ARRAY_BUFFER, 0, 6 * 4 * sizeof(float), vertices);
+		x += (ch->advance >> 6) * scale;
+	}
 
-		glEnableVertexAttribArray(0);
-		glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, 4 * sizeof(float), (void*)0);
+	if (textures.empty()) {
+		return true;
+	}
 
-		glDrawArrays(GL_TRIANGLES, 0, 6);
+	size_t offset = m_streamingBuffer.write(m_glState, vertices.data(), vertices.size() * sizeof(float));
+	if (offset == (size_t)-1) {
+		return false;
+	}
 
-		x += (ch->advance >> 6) * scale;
+	m_glState.bindBuffer(GL_ARRAY_BUFFER, m_streamingBuffer.buffer());
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, 4 * sizeof(float), (void*)offset);
+
+	for (size_t i = 0; i < textures.size(); ++i) {
+		m_glState.bindTexture(0, GL_TEXTURE_2D, textures[i]);
+		glDrawArrays(GL_TRIANGLES, i * 6, 6);
 	}
 
-	glBindVertexArray(0);
-	glBindTexture(GL_TEXTURE_2D, 0);
+	m_glState.bindVertexArray(0);
 
 	return true;
 }
@@ -640,19 +1775,19 @@ bool Renderer::renderTextElement(std::shared_ptr<TextElement> elem)
 #ifdef RENDER_DEBUG
 bool Renderer::renderShadowMapDebug()
 {
-	glViewport(0, 0, 400, 300);
-	glUseProgram(m_shadowDepthMapDebugProgram);
-
-	glUniform1i(glGetUniformLocation(m_shadowDepthMapDebugProgram, "shadowMap"), 0);
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, m_shadowDepthMap);
+	m_glState.useProgram(m_shadowDepthMapDebugProgram);
 
-	glUniform1f(glGetUniformLocation(m_shadowDepthMapDebugProgram, "near_plane"), -10.0f);
-	glUniform1f(glGetUniformLocation(m_shadowDepthMapDebugProgram, "far_plane"), 20.0f);
+	glUniform1i(glGetUniformLocation(m_shadowDepthMapDebugProgram, "depthMap"), 0);
+	m_glState.bindTexture(0, GL_TEXTURE_2D_ARRAY, m_shadowDepthMap);
 
-	glBindVertexArray(m_debugQuadVAO);
-	glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
-	glBindVertexArray(0);
+	// Cascades side by side, nearest on the left
+	m_glState.bindVertexArray(m_debugQuadVAO);
+	for (int i = 0; i < m_shadowCascades; ++i) {
+		m_glState.viewport(i * 300, 0, 300, 300);
+		glUniform1i(glGetUniformLocation(m_shadowDepthMapDebugProgram, "layer"), i);
+		glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+	}
+	m_glState.bindVertexArray(0);
 
 	return true;
 }
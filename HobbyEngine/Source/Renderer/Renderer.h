@@ -1,13 +1,27 @@
 #ifndef RENDERER_H
 #define RENDERER_H
 
+#include <map>
 #include <memory>
+#include <string>
+#include <vector>
+
+#include <tinyxml2/tinyxml2.h>
 
 #include "Camera.h"
-#include "../Engine/Scene.h"
-#include "../GameObjects/GameObject.h"
-#include "Skybox.h"
-#include "../UI/TextElement.h"
+#include "DrawPacket.h"
+#include "GLStateCache.h"
+#include "GPUCuller.h"
+#include "GPUProfiler.h"
+#include "LightClusters.h"
+#include "OcclusionCuller.h"
+#include "ProgramBinaryCache.h"
+#include "RenderState.h"
+#include "ResolutionScaler.h"
+#include "ShaderVariant.h"
+#include "StaticBatch.h"
+#include "StreamingBuffer.h"
+#include "TextureStreamer.h"
 
 class Renderer
 {
@@ -17,35 +31,193 @@ public:
 
 	bool init(uint32_t screenWidth, uint32_t screenHeight);
 
-	bool renderScene(Scene& scene);
+	// Draws a snapshot of the scene, the snapshot isn't modified so it can be captured on another thread
+	bool renderScene(RenderState& state);
 
 	void updateScreenSize(uint32_t screenWidth, uint32_t screenHeight);
 
+	// Renders into an offscreen framebuffer of the screen size instead of the default framebuffer, which
+	// doesn't exist when running headless
+	bool createOffscreenTarget();
+	uint32_t targetFramebuffer() { return m_targetFramebuffer; }
+
+	// Every bind of the renderer and the GL resources it draws should go through the state cache
+	GLStateCache& glState() { return m_glState; }
+
+	GPUProfiler& gpuProfiler() { return m_gpuProfiler; }
+
+	// Textures of the render components are requested from the streamer, which keeps the levels they need
+	TextureStreamer& textureStreamer() { return m_textureStreamer; }
+
+	ResolutionScaler& resolutionScaler() { return m_resolutionScaler; }
+
+	// Issues the compile of the game object shader with the variant's features unless it has been requested
+	// before, and returns the key the variant is drawn with. Has to be called on the thread owning the context,
+	// the program is usable after finishPrograms.
+	uint32_t requestShaderVariant(const ShaderVariant& variant);
+
+	// Waits for the pending programs, returns false if any of them failed to compile or link
+	bool finishPrograms();
+
+	// Time spent creating the shader programs at init, compiled or loaded from the program binary cache
+	double programCreationMs() { return m_programCreationMs; }
+	const ProgramBinaryCache& programCache() { return m_programCache; }
+
 private:
-	bool renderGameObjects(Scene& scene);
-	bool renderGameObject(GameObject& gameObject, Scene& scene);
-	bool renderSkybox(Scene& scene);
-	bool renderShadowDepthMap(Camera& camera, Scene& scene);
-	bool renderShadowDepthMapGO(GameObject& gameObject);
-	bool renderParticleSystems(Scene& scene);
-	bool renderParticleSystem(GameObject& gameObject, Camera& camera);
-	bool renderUIElements(Scene& scene);
-	bool renderTextElement(std::shared_ptr<TextElement> elem);
+	struct PendingProgram
+	{
+		uint32_t* program;
+		std::string cacheKey;
+		std::string name;
+		uint32_t vertexShader;
+		uint32_t fragmentShader;
+		uint32_t geometryShader;
+	};
+
+	// Loads the program from the binary cache if possible, otherwise issues the compile and link and leaves the
+	// program pending. The program is usable only after finishPrograms has succeeded. The feedback varying is
+	// captured by transform feedback.
+	bool createProgram(const char* vertexShaderFile, const char* fragmentShaderFile, uint32_t& program, const std::string& defines = std::string(),
+		const char* geometryShaderFile = nullptr, const char* feedbackVarying = nullptr);
+	bool finishProgram(PendingProgram& pending);
 
+	// Culls the objects against the camera and the light and builds the sorted draw packets for both passes.
+	// The objects are split into contiguous ranges on the job system, only the GL submission stays on the
+	// thread owning the context.
+	void prepareDrawPackets(RenderState& state);
+
+	bool renderGameObjects(RenderState& state);
+	void useShaderVariant(uint32_t variantKey, RenderState& state);
+	bool renderGameObject(DrawPacket& packet);
+	bool renderStaticBatch(StaticBatch& batch);
+	bool renderInstances(size_t group);
+	void setupMaterial(RenderComponent& renderComponent);
+	bool renderSkybox(RenderState& state);
+	// Fits the cascades to slices of the camera frustum, called before the casters are culled
+	void computeShadowCascades(RenderState& state);
+	bool renderShadowDepthMap(RenderState& state);
+	void clearShadowCascades(uint32_t* cascadeFBOs, uint32_t cascadeMask);
+
+	// Draws the casters into the cascades in cascadeMask, either the static batches into the static shadow cache
+	// or the rest into the shadow map
+	void renderShadowCasters(RenderState& state, uint32_t cascadeMask, bool staticCache);
+
+	// Draws all GPU culled instances into the shadow map, they are never in the static cache
+	void renderShadowInstances(uint32_t cascadeMask);
+	void renderDepthPrepass(RenderState& state);
+
+	// Height of the bounding sphere of the bounds relative to the screen height, or the largest float if the
+	// camera is inside it
+	float projectedSize(const AABB& bounds, const glm::vec3& cameraPosition);
+
+	// Picks the LOD from the projected height of the bounds, called from the preparation jobs
+	int selectLod(RenderComponent& renderComponent, float screenSize);
+
+	// Reports the size on screen of the component's textures to the texture streamer
+	void touchTextures(RenderComponent& renderComponent, float screenSize);
+
+	// Draw with positions only, for the shadow maps and the depth pre-pass
+	bool renderDepthOnlyObject(DrawPacket& packet, uint32_t program);
+	bool renderDepthOnlyBatch(StaticBatch& batch, uint32_t program);
+	bool renderDepthOnlyInstances(size_t group, bool allInstances);
+	bool renderParticleSystems(RenderState& state);
+	bool renderParticleSystem(RenderParticleSystem& particles);
+	bool renderUIElements(RenderState& state);
+	bool renderTextElement(RenderText& text);
+
+	// Program of the shader variant being drawn
 	uint32_t m_program;
-	uint32_t m_skyboxProgram;
+
+	std::string m_vertexShaderFile;
+	std::string m_fragmentShaderFile;
+	std::map<uint32_t, uint32_t> m_variantPrograms;
+
+	// Program name of a shader that failed to compile or isn't configured
+	static const uint32_t INVALID_PROGRAM = (uint32_t)-1;
+
+	uint32_t m_skyboxProgram = INVALID_PROGRAM;
 	uint32_t m_shadowDepthMapProgram;
+	uint32_t m_depthPrepassProgram;
+	uint32_t m_shadowDepthMapInstancedProgram;
+	uint32_t m_depthPrepassInstancedProgram;
+	uint32_t m_gpuCullProgram = 0;
 	uint32_t m_particleProgram;
 	uint32_t m_uiProgram;
+	uint32_t m_upscaleProgram = 0;
+
+	static const int MAX_SHADOW_CASCADES = 4;
 
-	uint32_t m_shadowDepthMapFBO;
+	int m_shadowCascades = 3;
+	int m_shadowMapResolution = 2048;
+	float m_shadowDistance = 50.0f;
+	float m_shadowSplitLambda = 0.75f;
+	float m_shadowCasterDistance = 20.0f;
+	bool m_layeredShadows = false;
+
+	uint32_t m_shadowLayeredFBO = 0;
+	uint32_t m_shadowCascadeFBOs[MAX_SHADOW_CASCADES] = {};
 	uint32_t m_shadowDepthMap;
 
+	// Cascade masks of the static batches for the current frame
+	std::vector<uint32_t> m_shadowBatchMasks;
+
+	// Depth of the static batches, rendered only when the light, the static batches or a cascade's placement
+	// changes and copied into the shadow map each frame before the dynamic casters are drawn
+	bool m_cacheStaticShadows = false;
+	uint32_t m_staticShadowLayeredFBO = 0;
+	uint32_t m_staticShadowCascadeFBOs[MAX_SHADOW_CASCADES] = {};
+	uint32_t m_staticShadowDepthMap = 0;
+	glm::mat4 m_staticShadowMatrices[MAX_SHADOW_CASCADES];
+	glm::vec3 m_staticShadowLightDirection = glm::vec3(0.0f);
+	uint64_t m_staticShadowVersion = 0;
+
+	glm::mat4 m_cascadeMatrices[MAX_SHADOW_CASCADES];
+	float m_cascadeSplits[MAX_SHADOW_CASCADES];
+
 	uint32_t m_screenWidth;
 	uint32_t m_screenHeight;
 
+	uint32_t m_targetFramebuffer = 0;
+	uint32_t m_offscreenFBO = 0;
+	uint32_t m_offscreenColorBuffer = 0;
+	uint32_t m_offscreenDepthBuffer = 0;
+
 	bool m_particlesInstanced = false;
 
+	// Scales the projected sizes LODs are picked by, and the fraction by which the size has to pass a LOD's
+	// threshold before the LOD changes
+	float m_lodBias = 1.0f;
+	float m_lodHysteresis = 0.1f;
+
+	// Packets are written to per thread arrays by the preparation jobs and merged for sorting
+	std::vector<std::vector<DrawPacket>> m_threadPackets;
+	std::vector<std::vector<DrawPacket>> m_threadShadowPackets;
+	std::vector<DrawPacket> m_packets;
+	std::vector<DrawPacket> m_shadowPackets;
+
+	// Static batches passing the frustum and occlusion culling, for the depth pre-pass and the colour pass
+	std::vector<StaticBatch*> m_visibleBatches;
+
+	GLStateCache m_glState;
+	GPUProfiler m_gpuProfiler;
+	LightClusters m_lightClusters;
+	OcclusionCuller m_occlusionCuller;
+	GPUCuller m_gpuCuller;
+
+	// Particle instances and text vertices written each frame
+	StreamingBuffer m_streamingBuffer;
+
+	TextureStreamer m_textureStreamer;
+
+	// Size of the 3D passes, which are upscaled to the window before the UI
+	ResolutionScaler m_resolutionScaler;
+
+	ProgramBinaryCache m_programCache;
+	double m_programCreationMs = 0.0;
+
+	std::vector<PendingProgram> m_pendingPrograms;
+	bool m_parallelShaderCompile = false;
+
 #ifdef RENDER_DEBUG
 	bool renderShadowMapDebug();
 
@@ -53,6 +225,8 @@ private:
 
 	uint32_t m_debugQuadVAO;
 	uint32_t m_debugQuadVBO;
+
+	uint64_t m_frameCounter = 0;
 #endif // RENDERER_DEBUG
 };
 
@@ -0,0 +1,218 @@
+#include "ResolutionScaler.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "../Utils/DebugLogger.h"
+
+void ResolutionScaler::init(GLStateCache& glState, bool enabled, float targetMs, float minScale, float maxScale, int samples, uint32_t program,
+	uint32_t screenWidth, uint32_t screenHeight)
+{
+	m_enabled = enabled;
+	m_targetMs = std::max(targetMs, 1.0f);
+	m_minScale = std::min(std::max(minScale, 0.1f), 1.0f);
+	m_maxScale = std::min(std::max(maxScale, m_minScale), 1.0f);
+	m_scale = m_maxScale;
+	m_program = program;
+	m_screenWidth = screenWidth;
+	m_screenHeight = screenHeight;
+
+	if (!m_enabled) {
+		updateSize();
+		return;
+	}
+
+	GLint maxSamples = 0;
+	glGetIntegerv(GL_MAX_SAMPLES, &maxSamples);
+	m_samples = std::max(std::min(samples, (int)maxSamples), 0);
+
+	glGenTextures(1, &m_colorTexture);
+	glState.bindTexture(0, GL_TEXTURE_2D, m_colorTexture);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+	glState.bindTexture(0, GL_TEXTURE_2D, 0);
+
+	if (m_samples > 0) {
+		glGenRenderbuffers(1, &m_colorBuffer);
+	}
+	glGenRenderbuffers(1, &m_depthBuffer);
+	glGenVertexArrays(1, &m_vao);
+	for (int i = 0; i < FRAME_LATENCY; ++i) {
+		glGenQueries(2, m_frames[i].queries);
+	}
+
+	resize(glState, screenWidth, screenHeight);
+
+	glGenFramebuffers(1, &m_framebuffer);
+	glState.bindFramebuffer(GL_FRAMEBUFFER, m_framebuffer);
+	if (m_samples > 0) {
+		glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, m_colorBuffer);
+	}
+	else {
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, m_colorTexture, 0);
+	}
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, m_depthBuffer);
+	bool complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+
+	if (m_samples > 0) {
+		glGenFramebuffers(1, &m_resolveFramebuffer);
+		glState.bindFramebuffer(GL_FRAMEBUFFER, m_resolveFramebuffer);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, m_colorTexture, 0);
+		complete = complete && glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+	}
+	glState.bindFramebuffer(GL_FRAMEBUFFER, 0);
+
+	if (!complete) {
+		LOG_DEBUG("ResolutionScaler::init: scene framebuffer is incomplete, rendering at the window resolution");
+		m_enabled = false;
+		m_scale = 1.0f;
+		updateSize();
+	}
+}
+
+void ResolutionScaler::resize(GLStateCache& glState, uint32_t screenWidth, uint32_t screenHeight)
+{
+	m_screenWidth = screenWidth;
+	m_screenHeight = screenHeight;
+	updateSize();
+
+	if (m_colorTexture == 0) {
+		return;
+	}
+
+	// The buffers are allocated for the largest scale, smaller ones only use a part of them
+	GLsizei width = std::max(m_screenWidth, 1u);
+	GLsizei height = std::max(m_screenHeight, 1u);
+	glState.bindTexture(0, GL_TEXTURE_2D, m_colorTexture);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+	glState.bindTexture(0, GL_TEXTURE_2D, 0);
+
+	if (m_colorBuffer != 0) {
+		glBindRenderbuffer(GL_RENDERBUFFER, m_colorBuffer);
+		glRenderbufferStorageMultisample(GL_RENDERBUFFER, m_samples, GL_RGBA8, width, height);
+	}
+	glBindRenderbuffer(GL_RENDERBUFFER, m_depthBuffer);
+	glRenderbufferStorageMultisample(GL_RENDERBUFFER, m_samples, GL_DEPTH24_STENCIL8, width, height);
+	glBindRenderbuffer(GL_RENDERBUFFER, 0);
+}
+
+void ResolutionScaler::destroy(GLStateCache& glState)
+{
+	if (m_colorTexture == 0) {
+		return;
+	}
+
+	glState.deleteFramebuffer(m_framebuffer);
+	if (m_resolveFramebuffer != 0) {
+		glState.deleteFramebuffer(m_resolveFramebuffer);
+		glDeleteRenderbuffers(1, &m_colorBuffer);
+	}
+	glDeleteRenderbuffers(1, &m_depthBuffer);
+	glState.deleteTexture(m_colorTexture);
+	glState.deleteVertexArray(m_vao);
+	for (int i = 0; i < FRAME_LATENCY; ++i) {
+		glDeleteQueries(2, m_frames[i].queries);
+	}
+
+	m_enabled = false;
+	m_colorTexture = 0;
+}
+
+void ResolutionScaler::beginFrame()
+{
+	if (!m_enabled) {
+		return;
+	}
+
+	// The frame in this slot was issued FRAME_LATENCY frames ago, its results are skipped if they're still not
+	// available rather than stalling
+	Frame& frame = m_frames[m_currentFrame];
+	if (frame.pending) {
+		GLint available = 0;
+		glGetQueryObjectiv(frame.queries[1], GL_QUERY_RESULT_AVAILABLE, &available);
+		if (available) {
+			GLuint64 start = 0;
+			GLuint64 end = 0;
+			glGetQueryObjectui64v(frame.queries[0], GL_QUERY_RESULT, &start);
+			glGetQueryObjectui64v(frame.queries[1], GL_QUERY_RESULT, &end);
+			updateScale((float)((double)(end - start) / 1000000.0), frame.scale);
+		}
+		frame.pending = false;
+	}
+
+	glQueryCounter(frame.queries[0], GL_TIMESTAMP);
+	frame.scale = m_scale;
+}
+
+void ResolutionScaler::endFrame()
+{
+	if (!m_enabled) {
+		return;
+	}
+
+	Frame& frame = m_frames[m_currentFrame];
+	glQueryCounter(frame.queries[1], GL_TIMESTAMP);
+	frame.pending = true;
+	m_currentFrame = (m_currentFrame + 1) % FRAME_LATENCY;
+}
+
+void ResolutionScaler::upscale(GLStateCache& glState, uint32_t targetFramebuffer)
+{
+	// Resolving blits can't scale, so only the corner is resolved
+	if (m_samples > 0) {
+		glState.bindFramebuffer(GL_READ_FRAMEBUFFER, m_framebuffer);
+		glState.bindFramebuffer(GL_DRAW_FRAMEBUFFER, m_resolveFramebuffer);
+		glBlitFramebuffer(0, 0, m_width, m_height, 0, 0, m_width, m_height, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+	}
+
+	glState.bindFramebuffer(GL_FRAMEBUFFER, targetFramebuffer);
+	glState.viewport(0, 0, m_screenWidth, m_screenHeight);
+	glState.useProgram(m_program);
+
+	// The texture has the size of the window. Samples are clamped to the texel centres of the corner's last row and
+	// column, so the filter never reads the texels outside it.
+	glUniform1i(glGetUniformLocation(m_program, "scene"), 0);
+	glUniform2f(glGetUniformLocation(m_program, "cornerSize"), (float)m_width / m_screenWidth, (float)m_height / m_screenHeight);
+	glUniform2f(glGetUniformLocation(m_program, "cornerMax"), (m_width - 0.5f) / m_screenWidth, (m_height - 0.5f) / m_screenHeight);
+	glState.bindTexture(0, GL_TEXTURE_2D, m_colorTexture);
+
+	glState.bindVertexArray(m_vao);
+	glDrawArrays(GL_TRIANGLES, 0, 3);
+	glState.bindVertexArray(0);
+}
+
+void ResolutionScaler::updateScale(float frameMs, float frameScale)
+{
+	// The time is scaled to the current scale, as the frames in flight were rendered at older ones
+	float ms = frameMs * (m_scale * m_scale) / (frameScale * frameScale);
+	m_gpuMs = m_gpuMs > 0.0f ? m_gpuMs + (ms - m_gpuMs) * SMOOTHING : ms;
+
+	// Aims at the middle of the band the scale is held in, between the target and HEADROOM below it
+	float goalMs = m_targetMs * (1.0f - HEADROOM * 0.5f);
+	float idealScale = m_scale * std::sqrt(goalMs / std::max(m_gpuMs, 0.01f));
+	idealScale = std::min(std::max(idealScale, m_minScale), m_maxScale);
+
+	if (m_gpuMs > m_targetMs && idealScale < m_scale) {
+		m_scale += (idealScale - m_scale) * RATE_DOWN;
+	}
+	else if (m_gpuMs < m_targetMs * (1.0f - HEADROOM) && idealScale > m_scale) {
+		m_scale += (idealScale - m_scale) * RATE_UP;
+	}
+	else {
+		return;
+	}
+
+	if (std::abs(idealScale - m_scale) < 0.01f) {
+		m_scale = idealScale;
+	}
+	updateSize();
+}
+
+void ResolutionScaler::updateSize()
+{
+	m_width = std::max((uint32_t)std::lround(m_screenWidth * m_scale), 1u);
+	m_height = std::max((uint32_t)std::lround(m_screenHeight * m_scale), 1u);
+}
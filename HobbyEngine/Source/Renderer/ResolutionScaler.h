@@ -0,0 +1,110 @@
+#ifndef RESOLUTION_SCALER_H
+#define RESOLUTION_SCALER_H
+
+#include <cstdint>
+
+#include <glad/glad.h>
+
+#include "GLStateCache.h"
+
+// Renders the 3D passes at a fraction of the window resolution, picked to hold the GPU frame time at a target.
+// The scene framebuffer has the size of the window and the passes draw into its lower left corner, so a new
+// scale needs no reallocation. Its buffers have the sample count of the target framebuffer, so MSAA is kept at
+// every scale. Before the UI is drawn at the full resolution, a multisampled corner is resolved into a texture,
+// and the texture is upscaled into the target framebuffer with a fullscreen triangle. A blit can't be used,
+// as the window's framebuffer may be multisampled too. At full scale the passes render straight into the target
+// framebuffer, as without scaling.
+//
+// Each frame's GPU time is measured with a pair of timestamp queries, read back FRAME_LATENCY frames later so
+// the CPU never waits for them. The time is assumed to grow with the number of pixels, so the controller moves
+// the scale towards the one that would have taken the target time. The scale is lowered when a frame takes
+// longer than the target and raised when it's faster by more than HEADROOM, so in between the image doesn't keep
+// shifting between sizes. Lower scales are taken faster than higher ones.
+//
+// The timestamps also count the time the GPU waits for the CPU to submit the frame's commands, so the controller
+// assumes GPU bound frames. When the CPU is the bottleneck, the scale drops without making the frames faster.
+class ResolutionScaler
+{
+public:
+	ResolutionScaler() = default;
+
+	// samples is the sample count of the target framebuffer, program draws the upscaling triangle
+	void init(GLStateCache& glState, bool enabled, float targetMs, float minScale, float maxScale, int samples, uint32_t program,
+		uint32_t screenWidth, uint32_t screenHeight);
+	void resize(GLStateCache& glState, uint32_t screenWidth, uint32_t screenHeight);
+
+	// Deletes the framebuffers and the texture through the state cache, called by the renderer before the cache
+	// goes away
+	void destroy(GLStateCache& glState);
+
+	bool enabled() const { return m_enabled; }
+
+	// Whether the 3D passes are rendered below the window resolution this frame, into the scene framebuffer
+	bool scaled() const { return m_enabled && (m_width != m_screenWidth || m_height != m_screenHeight); }
+
+	// Size the 3D passes are rendered at, the window size when disabled
+	uint32_t width() const { return m_width; }
+	uint32_t height() const { return m_height; }
+	float scale() const { return m_scale; }
+
+	// Smoothed GPU time of a frame in milliseconds, zero until the first frame has been read back
+	float gpuMs() const { return m_gpuMs; }
+
+	uint32_t framebuffer() const { return m_framebuffer; }
+
+	// Reads back the oldest frame's time, updates the scale and starts timing a new frame. The size is only
+	// changed here, so it stays the same for all the passes of a frame.
+	void beginFrame();
+	void endFrame();
+
+	// Upscales the rendered corner into the target framebuffer, which is left bound with a window-sized viewport.
+	// Depth testing and blending have to be disabled.
+	void upscale(GLStateCache& glState, uint32_t targetFramebuffer);
+
+private:
+	static const int FRAME_LATENCY = 4;
+	static constexpr float HEADROOM = 0.15f;
+	static constexpr float SMOOTHING = 0.1f;
+	static constexpr float RATE_DOWN = 0.5f;
+	static constexpr float RATE_UP = 0.1f;
+
+	struct Frame
+	{
+		uint32_t queries[2] = {};
+		float scale = 1.0f;
+		bool pending = false;
+	};
+
+	void updateScale(float frameMs, float frameScale);
+	void updateSize();
+
+	bool m_enabled = false;
+	float m_targetMs = 16.0f;
+	float m_minScale = 0.5f;
+	float m_maxScale = 1.0f;
+	int m_samples = 0;
+	uint32_t m_program = 0;
+
+	uint32_t m_screenWidth = 0;
+	uint32_t m_screenHeight = 0;
+	uint32_t m_width = 0;
+	uint32_t m_height = 0;
+	float m_scale = 1.0f;
+	float m_gpuMs = 0.0f;
+
+	// The colour texture is the scene framebuffer's colour attachment without multisampling, and the resolve
+	// framebuffer's with it
+	uint32_t m_framebuffer = 0;
+	uint32_t m_colorBuffer = 0;
+	uint32_t m_depthBuffer = 0;
+	uint32_t m_resolveFramebuffer = 0;
+	uint32_t m_colorTexture = 0;
+
+	// The triangle's vertices come from gl_VertexID, but core profile draws need a vertex array bound
+	uint32_t m_vao = 0;
+
+	Frame m_frames[FRAME_LATENCY];
+	int m_currentFrame = 0;
+};
+
+#endif // !RESOLUTION_SCALER_H
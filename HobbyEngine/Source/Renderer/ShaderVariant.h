@@ -0,0 +1,62 @@
+#ifndef SHADER_VARIANT_H
+#define SHADER_VARIANT_H
+
+#include <cstdint>
+#include <string>
+
+// Feature flags of the game object shader. Each flag is compiled in with a #define, so a material only pays for
+// the texture samples and shadow taps it actually uses.
+struct ShaderVariant
+{
+	bool normalMapping = true;
+	bool reflection = true;
+	bool receiveShadows = true;
+
+	// Width of the square PCF kernel in shadow map texels, 1 takes a single tap
+	int pcfKernelSize = 3;
+
+	// The model matrix comes from a per-instance attribute instead of a uniform, for the GPU culled instances
+	bool instanced = false;
+
+	// Specular intensity, reflection mask and shininess come from a single channel-packed texture
+	bool packedMaterial = false;
+
+	// The material textures are layers of texture arrays, picked with the materialLayers uniform
+	bool textureArrays = false;
+
+	// Packs the flags into 10 bits, variants with equal keys share a program. The kernel size has no define
+	// without shadows, so it's left out of the key then.
+	uint32_t key() const
+	{
+		uint32_t pcfBits = receiveShadows ? (uint32_t)pcfKernelSize << 3 : 0;
+		return (normalMapping ? 1 : 0) | (reflection ? 2 : 0) | (receiveShadows ? 4 : 0) | pcfBits | (instanced ? 128 : 0) |
+			(packedMaterial ? 256 : 0) | (textureArrays ? 512 : 0);
+	}
+
+	std::string defines() const
+	{
+		std::string defines;
+		if (normalMapping) {
+			defines += "#define NORMAL_MAP\n";
+		}
+		if (reflection) {
+			defines += "#define REFLECTION\n";
+		}
+		if (receiveShadows) {
+			defines += "#define RECEIVE_SHADOWS\n";
+			defines += "#define PCF_KERNEL_SIZE " + std::to_string(pcfKernelSize) + "\n";
+		}
+		if (instanced) {
+			defines += "#define INSTANCED\n";
+		}
+		if (packedMaterial) {
+			defines += "#define PACKED_MATERIAL\n";
+		}
+		if (textureArrays) {
+			defines += "#define TEXTURE_ARRAYS\n";
+		}
+		return defines;
+	}
+};
+
+#endif // !SHADER_VARIANT_H
@@ -11,12 +11,13 @@ public:
 
 	bool init(tinyxml2::XMLElement* root);
 
+	// Handle of the cube map in the renderer's texture streamer
 	uint32_t texture() { return m_texture; }
 	uint32_t vao() { return m_VAO; }
 	uint32_t vbo() { return m_VBO; }
 
 private:
-	uint32_t m_texture;
+	uint32_t m_texture = 0;
 	uint32_t m_VAO;
 	uint32_t m_VBO;
 };
@@ -0,0 +1,146 @@
+#include "StaticBatch.h"
+
+#include <map>
+#include <string>
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "../Engine/GLApplication.h"
+#include "../GameObjects/TransformComponent.h"
+#include "../ResourceCache/ModelLoader.h"
+#include "../Utils/DebugLogger.h"
+
+StaticBatch::~StaticBatch()
+{
+	GLStateCache& glState = Game::instance().renderer().glState();
+
+	glState.deleteBuffer(m_VBO);
+	glState.deleteBuffer(m_uvBuffer);
+	glState.deleteBuffer(m_normalBuffer);
+	glState.deleteBuffer(m_tangentBuffer);
+	glState.deleteBuffer(m_bitangentBuffer);
+	glState.deleteBuffer(m_EBO);
+	glState.deleteVertexArray(m_VAO);
+}
+
+std::vector<std::shared_ptr<StaticBatch>> StaticBatch::buildBatches(std::vector<std::shared_ptr<GameObject>>& gameObjects)
+{
+	std::map<std::string, std::vector<std::shared_ptr<GameObject>>> groups;
+
+	for (auto it = gameObjects.begin(); it != gameObjects.end(); ++it) {
+		auto go = *it;
+		if (!go->isStatic()) {
+			continue;
+		}
+
+		auto renderComponent = go->findComponent<RenderComponent>("RenderComponent").lock();
+		auto transformComponent = go->findComponent<TransformComponent>("TransformComponent").lock();
+		// GPU culled components are drawn instanced instead
+		if (!renderComponent || !transformComponent || !renderComponent->modelData() || renderComponent->gpuCulled()) {
+			continue;
+		}
+
+		groups[renderComponent->materialKey()].push_back(go);
+	}
+
+	std::vector<std::shared_ptr<StaticBatch>> batches;
+
+	for (auto it = groups.begin(); it != groups.end(); ++it) {
+		std::shared_ptr<StaticBatch> batch(new StaticBatch);
+		if (!batch->init(it->second)) {
+			LOG_DEBUG("StaticBatch::buildBatches: could not create batch for material " + it->first);
+			continue;
+		}
+		batches.push_back(batch);
+	}
+
+	return batches;
+}
+
+bool StaticBatch::init(std::vector<std::shared_ptr<GameObject>>& members)
+{
+	GLStateCache& glState = Game::instance().renderer().glState();
+
+	std::vector<glm::vec3> vertices;
+	std::vector<glm::vec2> uvs;
+	std::vector<glm::vec3> normals;
+	std::vector<glm::vec3> tangents;
+	std::vector<glm::vec3> bitangents;
+	std::vector<uint32_t> indices;
+
+	for (auto it = members.begin(); it != members.end(); ++it) {
+		auto renderComponent = (*it)->findComponent<RenderComponent>("RenderComponent").lock();
+		auto transformComponent = (*it)->findComponent<TransformComponent>("TransformComponent").lock();
+		auto model = renderComponent->modelData();
+
+		glm::mat4 transform = transformComponent->getTransformMatrix();
+		glm::mat3 normalMatrix = glm::transpose(glm::inverse(glm::mat3(transform)));
+
+		uint32_t baseVertex = vertices.size();
+
+		for (size_t i = 0; i < model->vertices().size(); ++i) {
+			glm::vec3 vertex = glm::vec3(transform * glm::vec4(model->vertices()[i], 1.0f));
+			vertices.push_back(vertex);
+			uvs.push_back(model->uvs()[i]);
+			normals.push_back(normalMatrix * model->normals()[i]);
+			tangents.push_back(normalMatrix * model->tangents()[i]);
+			bitangents.push_back(normalMatrix * model->bitangents()[i]);
+			m_bounds.expand(vertex);
+		}
+
+		for (auto idx = model->indices().begin(); idx != model->indices().end(); ++idx) {
+			indices.push_back(baseVertex + *idx);
+		}
+
+		if (!m_renderComponent) {
+			m_renderComponent = renderComponent;
+		}
+	}
+
+	m_nMembers = members.size();
+	m_nIndices = indices.size();
+
+	if (m_nIndices == 0) {
+		LOG_DEBUG("StaticBatch::init: could not create batch - no indices");
+		return false;
+	}
+
+	// The index buffer binding is stored in the VAO, so the batch's own has to be bound before it
+	glGenVertexArrays(1, &m_VAO);
+	glState.bindVertexArray(m_VAO);
+
+	glGenBuffers(1, &m_VBO);
+	glState.bindBuffer(GL_ARRAY_BUFFER, m_VBO);
+	glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(glm::vec3), &vertices[0], GL_STATIC_DRAW);
+
+	glGenBuffers(1, &m_uvBuffer);
+	glState.bindBuffer(GL_ARRAY_BUFFER, m_uvBuffer);
+	glBufferData(GL_ARRAY_BUFFER, uvs.size() * sizeof(glm::vec2), &uvs[0], GL_STATIC_DRAW);
+
+	glGenBuffers(1, &m_normalBuffer);
+	glState.bindBuffer(GL_ARRAY_BUFFER, m_normalBuffer);
+	glBufferData(GL_ARRAY_BUFFER, normals.size() * sizeof(glm::vec3), &normals[0], GL_STATIC_DRAW);
+
+	glGenBuffers(1, &m_tangentBuffer);
+	glState.bindBuffer(GL_ARRAY_BUFFER, m_tangentBuffer);
+	glBufferData(GL_ARRAY_BUFFER, tangents.size() * sizeof(glm::vec3), &tangents[0], GL_STATIC_DRAW);
+
+	glGenBuffers(1, &m_bitangentBuffer);
+	glState.bindBuffer(GL_ARRAY_BUFFER, m_bitangentBuffer);
+	glBufferData(GL_ARRAY_BUFFER, bitangents.size() * sizeof(glm::vec3), &bitangents[0], GL_STATIC_DRAW);
+
+	glGenBuffers(1, &m_EBO);
+	glState.bindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_EBO);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(uint32_t), &indices[0], GL_STATIC_DRAW);
+	glState.bindVertexArray(0);
+
+	// Members are only skipped by the per-object draws once the batch drawing them exists
+	for (auto it = members.begin(); it != members.end(); ++it) {
+		(*it)->findComponent<RenderComponent>("RenderComponent").lock()->batched = true;
+	}
+
+	LOG_DEBUG("StaticBatch::init: batched " + std::to_string(m_nMembers) + " game objects, " + std::to_string(m_nIndices / 3) + " triangles");
+
+	return true;
+}
@@ -0,0 +1,58 @@
+#ifndef STATIC_BATCH_H
+#define STATIC_BATCH_H
+
+#include <memory>
+#include <vector>
+
+#include "AABB.h"
+#include "../GameObjects/GameObject.h"
+#include "../GameObjects/RenderComponent.h"
+
+// A static batch merges the meshes of static game objects sharing a material into a single set of vertex and
+// index buffers. The vertices are pre-transformed into world space, so a batch is drawn with an identity model
+// matrix using the material of its first member.
+class StaticBatch
+{
+public:
+	StaticBatch() = default;
+	~StaticBatch();
+
+	// Groups the static game objects of a scene by material and creates a batch for each group
+	static std::vector<std::shared_ptr<StaticBatch>> buildBatches(std::vector<std::shared_ptr<GameObject>>& gameObjects);
+
+	bool init(std::vector<std::shared_ptr<GameObject>>& members);
+
+	uint32_t vao() { return m_VAO; }
+	uint32_t vbo() { return m_VBO; }
+	uint32_t uvs() { return m_uvBuffer; }
+	uint32_t normals() { return m_normalBuffer; }
+	uint32_t tangents() { return m_tangentBuffer; }
+	uint32_t bitangents() { return m_bitangentBuffer; }
+	uint32_t ebo() { return m_EBO; }
+
+	int nIndices() { return m_nIndices; }
+	size_t nMembers() { return m_nMembers; }
+
+	// Render component of the first member, used for the material and normal map of the whole batch
+	std::shared_ptr<RenderComponent> renderComponent() { return m_renderComponent; }
+
+	const AABB& bounds() { return m_bounds; }
+
+private:
+	uint32_t m_VAO = 0;
+	uint32_t m_VBO = 0;
+	uint32_t m_uvBuffer = 0;
+	uint32_t m_normalBuffer = 0;
+	uint32_t m_tangentBuffer = 0;
+	uint32_t m_bitangentBuffer = 0;
+	uint32_t m_EBO = 0;
+
+	int m_nIndices = 0;
+	size_t m_nMembers = 0;
+
+	std::shared_ptr<RenderComponent> m_renderComponent;
+
+	AABB m_bounds;
+};
+
+#endif // !STATIC_BATCH_H
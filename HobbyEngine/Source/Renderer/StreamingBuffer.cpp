@@ -0,0 +1,134 @@
+#include "StreamingBuffer.h"
+
+#include <cstring>
+#include <string>
+
+#include "GLExtensions.h"
+#include "../Utils/DebugLogger.h"
+#include "../Utils/Profiler.h"
+
+typedef void (APIENTRY* BufferStorageProc)(GLenum target, GLsizeiptr size, const void* data, GLbitfield flags);
+
+void StreamingBuffer::init(GLStateCache& glState, size_t frameSize, bool persistent, GLenum target)
+{
+	m_frameSize = frameSize;
+	m_target = target;
+
+	glGenBuffers(1, &m_buffer);
+	glState.bindBuffer(m_target, m_buffer);
+
+	// Immutable storage is core since 4.4, older drivers may expose it as an extension
+	BufferStorageProc bufferStorage = nullptr;
+	if (persistent) {
+		if (GLAD_GL_VERSION_4_4) {
+			bufferStorage = glBufferStorage;
+		}
+		else if (GLExtensions::supported("GL_ARB_buffer_storage")) {
+			bufferStorage = (BufferStorageProc)GLExtensions::procAddress("glBufferStorage");
+		}
+	}
+
+	if (bufferStorage) {
+		GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		bufferStorage(m_target, FRAME_COUNT * m_frameSize, nullptr, flags);
+		m_mapping = (uint8_t*)glMapBufferRange(m_target, 0, FRAME_COUNT * m_frameSize, flags);
+		if (!m_mapping) {
+			LOG_DEBUG("StreamingBuffer::init: could not map buffer persistently, mapping each write instead");
+
+			// Immutable storage can't be respecified, so the fallback needs a new buffer
+			glState.deleteBuffer(m_buffer);
+			glGenBuffers(1, &m_buffer);
+			glState.bindBuffer(m_target, m_buffer);
+		}
+	}
+	else if (persistent) {
+		LOG_DEBUG("StreamingBuffer::init: buffer storage isn't supported by the driver, mapping each write instead");
+	}
+
+	if (!m_mapping) {
+		glBufferData(m_target, FRAME_COUNT * m_frameSize, nullptr, GL_STREAM_DRAW);
+	}
+
+	glState.bindBuffer(m_target, 0);
+}
+
+void StreamingBuffer::destroy(GLStateCache& glState)
+{
+	for (int i = 0; i < FRAME_COUNT; ++i) {
+		if (m_fences[i]) {
+			glDeleteSync(m_fences[i]);
+			m_fences[i] = nullptr;
+		}
+	}
+
+	// Deleting the buffer also unmaps it
+	if (m_buffer != 0) {
+		glState.deleteBuffer(m_buffer);
+		m_buffer = 0;
+		m_mapping = nullptr;
+	}
+}
+
+void StreamingBuffer::beginFrame()
+{
+	m_frame = (m_frame + 1) % FRAME_COUNT;
+	m_frameOffset = 0;
+
+	GLsync& fence = m_fences[m_frame];
+	if (!fence) {
+		return;
+	}
+
+	// Usually signaled already, in which case this doesn't wait at all
+	GLenum status = glClientWaitSync(fence, 0, 0);
+	if (status == GL_TIMEOUT_EXPIRED) {
+		PROFILE_SCOPE("Wait for streaming buffer");
+		++m_nWaits;
+		while (status == GL_TIMEOUT_EXPIRED) {
+			status = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+		}
+	}
+	glDeleteSync(fence);
+	fence = nullptr;
+}
+
+void StreamingBuffer::endFrame()
+{
+	m_lastFrameBytes = m_frameOffset;
+	if (m_frameOffset > 0) {
+		m_fences[m_frame] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	}
+}
+
+size_t StreamingBuffer::available(size_t alignment) const
+{
+	size_t offset = (m_frameOffset + alignment - 1) / alignment * alignment;
+	return offset < m_frameSize ? m_frameSize - offset : 0;
+}
+
+size_t StreamingBuffer::write(GLStateCache& glState, const void* data, size_t size, size_t alignment)
+{
+	size_t offset = (m_frameOffset + alignment - 1) / alignment * alignment;
+	if (offset + size > m_frameSize) {
+		LOG_DEBUG("StreamingBuffer::write: frame region of " + std::to_string(m_frameSize) + " bytes is full");
+		return (size_t)-1;
+	}
+	m_frameOffset = offset + size;
+	offset += m_frame * m_frameSize;
+
+	if (m_mapping) {
+		memcpy(m_mapping + offset, data, size);
+		return offset;
+	}
+
+	glState.bindBuffer(m_target, m_buffer);
+	void* mapping = glMapBufferRange(m_target, offset, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+	if (!mapping) {
+		LOG_DEBUG("StreamingBuffer::write: could not map buffer range");
+		return (size_t)-1;
+	}
+	memcpy(mapping, data, size);
+	glUnmapBuffer(m_target);
+
+	return offset;
+}
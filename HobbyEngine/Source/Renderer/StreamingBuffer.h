@@ -0,0 +1,65 @@
+#ifndef STREAMING_BUFFER_H
+#define STREAMING_BUFFER_H
+
+#include <cstddef>
+#include <cstdint>
+
+#include <glad/glad.h>
+
+#include "GLStateCache.h"
+
+// Ring buffer for data the CPU writes every frame, such as particle instances, UI text and texture uploads. The
+// buffer is split into FRAME_COUNT regions and each frame sub-allocates from the next one, so the GPU can still be
+// reading the data of the previous frames while the current one is written. A fence is inserted after each frame
+// and waited on before its region is reused, which only blocks if the GPU is more than two frames behind.
+//
+// With GL 4.4 or ARB_buffer_storage the buffer is mapped once, persistently and coherently, and writes are plain
+// copies into the mapping. Otherwise each write maps its range unsynchronized, which skips the driver's
+// implicit synchronization since the fences already guarantee the range isn't in use.
+class StreamingBuffer
+{
+public:
+	StreamingBuffer() = default;
+
+	// frameSize is the number of bytes available to each frame, target is the binding the buffer is used through
+	void init(GLStateCache& glState, size_t frameSize, bool persistent, GLenum target = GL_ARRAY_BUFFER);
+
+	// Deletes the fences and the buffer through the state cache, called by the owner before the cache goes away
+	void destroy(GLStateCache& glState);
+
+	bool persistent() const { return m_mapping != nullptr; }
+	uint32_t buffer() const { return m_buffer; }
+	size_t frameSize() const { return m_frameSize; }
+
+	// Bytes that can still be written into the current frame's region at the alignment
+	size_t available(size_t alignment = 16) const;
+
+	// Waits for the GPU to finish with the region of FRAME_COUNT frames ago and starts writing into it
+	void beginFrame();
+	void endFrame();
+
+	// Copies the data into the current frame's region and returns its offset in the buffer, which has to be bound
+	// with glState, or -1 if the region is full. The offset is a multiple of alignment.
+	size_t write(GLStateCache& glState, const void* data, size_t size, size_t alignment = 16);
+
+	// Bytes written and frames that had to wait for their region during the last frame
+	size_t lastFrameBytes() const { return m_lastFrameBytes; }
+	uint32_t nWaits() const { return m_nWaits; }
+
+private:
+	static const int FRAME_COUNT = 3;
+
+	uint32_t m_buffer = 0;
+	GLenum m_target = GL_ARRAY_BUFFER;
+	size_t m_frameSize = 0;
+	uint8_t* m_mapping = nullptr;
+
+	GLsync m_fences[FRAME_COUNT] = {};
+	int m_frame = 0;
+	size_t m_frameOffset = 0;
+
+	size_t m_lastFrameBytes = 0;
+	uint32_t m_nWaits = 0;
+};
+
+#endif // !STREAMING_BUFFER_H
@@ -0,0 +1,968 @@
+#include "TextureStreamer.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <filesystem>
+#include <regex>
+
+#include "TextureUtils.h"
+#include "../Engine/GLApplication.h"
+#include "../ResourceCache/CompressedTextureLoader.h"
+#include "../ResourceCache/ImageLoader.h"
+#include "../Utils/DebugLogger.h"
+#include "../Utils/Profiler.h"
+
+namespace
+{
+	// Next mip level with a 2x2 box filter, odd sizes repeat their last row or column
+	std::vector<uint8_t> downsample(const std::vector<uint8_t>& pixels, int width, int height, int nChannels, int& outWidth, int& outHeight)
+	{
+		outWidth = std::max(width / 2, 1);
+		outHeight = std::max(height / 2, 1);
+		std::vector<uint8_t> res((size_t)outWidth * outHeight * nChannels);
+		for (int y = 0; y < outHeight; ++y) {
+			int y0 = std::min(y * 2, height - 1);
+			int y1 = std::min(y * 2 + 1, height - 1);
+			for (int x = 0; x < outWidth; ++x) {
+				int x0 = std::min(x * 2, width - 1);
+				int x1 = std::min(x * 2 + 1, width - 1);
+				for (int c = 0; c < nChannels; ++c) {
+					int sum = pixels[((size_t)y0 * width + x0) * nChannels + c] + pixels[((size_t)y0 * width + x1) * nChannels + c]
+						+ pixels[((size_t)y1 * width + x0) * nChannels + c] + pixels[((size_t)y1 * width + x1) * nChannels + c];
+					res[((size_t)y * outWidth + x) * nChannels + c] = (uint8_t)((sum + 2) / 4);
+				}
+			}
+		}
+		return res;
+	}
+
+	int faceCount(GLenum target)
+	{
+		return target == GL_TEXTURE_CUBE_MAP ? 6 : 1;
+	}
+
+	GLenum faceTarget(GLenum target, int face)
+	{
+		return target == GL_TEXTURE_CUBE_MAP ? GL_TEXTURE_CUBE_MAP_POSITIVE_X + face : target;
+	}
+
+	void colorBytes(const glm::vec4& color, uint8_t* bytes)
+	{
+		for (int i = 0; i < 4; ++i) {
+			bytes[i] = (uint8_t)std::lround(std::min(std::max(color[i], 0.0f), 1.0f) * 255.0f);
+		}
+	}
+
+	int channelCount(GLenum format)
+	{
+		switch (format) {
+		case GL_RED:
+			return 1;
+		case GL_RG:
+			return 2;
+		case GL_RGBA:
+			return 4;
+		default:
+			return 3;
+		}
+	}
+
+	// Rec. 709 weights scaled to sum to 256, one and two channel images are already greyscale
+	uint8_t luminance(const char* pixel, int nChannels)
+	{
+		auto p = (const uint8_t*)pixel;
+		return nChannels < 3 ? p[0] : (uint8_t)((54 * p[0] + 183 * p[1] + 19 * p[2] + 128) >> 8);
+	}
+
+	bool isImage(const std::string& file)
+	{
+		ImageLoader imageLoader;
+		return std::regex_match(file, std::regex(imageLoader.getWildcard()));
+	}
+}
+
+TextureStreamer::~TextureStreamer()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stop = true;
+	}
+	m_condition.notify_all();
+
+	if (m_worker.joinable()) {
+		m_worker.join();
+	}
+}
+
+void TextureStreamer::init(GLStateCache& glState, bool enabled, size_t uploadBudget, float uploadBudgetMs, int evictFrames, bool packMaterials,
+	bool textureArrays, int layersPerPage)
+{
+	m_enabled = enabled;
+	m_uploadBudget = uploadBudget;
+	m_uploadBudgetMs = uploadBudgetMs;
+	m_evictFrames = evictFrames;
+	m_packMaterials = packMaterials;
+	m_textureArrays = enabled && textureArrays;
+
+	GLint maxLayers = 256;
+	glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &maxLayers);
+	m_layersPerPage = std::max(1, std::min(layersPerPage, (int)maxLayers));
+
+	if (!m_enabled || m_worker.joinable()) {
+		return;
+	}
+
+	m_stagingBuffer.init(glState, m_uploadBudget, true, GL_PIXEL_UNPACK_BUFFER);
+	m_worker = std::thread(&TextureStreamer::workerMain, this);
+}
+
+void TextureStreamer::destroy(GLStateCache& glState)
+{
+	for (auto it = m_textures.begin(); it != m_textures.end(); ++it) {
+		if (it->second.texture != 0) {
+			glState.deleteTexture(it->second.texture);
+		}
+	}
+	m_textures.clear();
+	m_keyTextures.clear();
+
+	for (auto it = m_pages.begin(); it != m_pages.end(); ++it) {
+		if (it->texture != 0) {
+			glState.deleteTexture(it->texture);
+		}
+	}
+	m_pages.clear();
+
+	if (m_fallbackPage != 0) {
+		glState.deleteTexture(m_fallbackPage);
+		m_fallbackPage = 0;
+	}
+	m_fallbackColors.clear();
+	m_residentBytes = 0;
+
+	m_stagingBuffer.destroy(glState);
+}
+
+uint32_t TextureStreamer::request(GLStateCache& glState, const std::string& file, const glm::vec4& fallback)
+{
+	StreamedTexture prototype;
+	prototype.key = file;
+	prototype.files.push_back(file);
+	return create(glState, prototype, fallback);
+}
+
+uint32_t TextureStreamer::requestCubeMap(GLStateCache& glState, const std::vector<std::string>& faces, const glm::vec4& fallback)
+{
+	if (faces.size() != 6) {
+		LOG_DEBUG("TextureStreamer::requestCubeMap: a cube map needs 6 faces, got " + std::to_string(faces.size()));
+		return 0;
+	}
+
+	StreamedTexture prototype;
+	prototype.key = faces[0];
+	for (size_t i = 1; i < faces.size(); ++i) {
+		prototype.key += ";" + faces[i];
+	}
+	prototype.files = faces;
+	prototype.target = GL_TEXTURE_CUBE_MAP;
+	return create(glState, prototype, fallback);
+}
+
+bool TextureStreamer::canPackMaterial(const std::string& specularFile, const std::string& reflectionFile) const
+{
+	return m_enabled && m_packMaterials && isImage(specularFile) && (reflectionFile.empty() || isImage(reflectionFile));
+}
+
+uint32_t TextureStreamer::requestPackedMaterial(GLStateCache& glState, const std::string& specularFile, const std::string& reflectionFile, float shininess)
+{
+	if (!canPackMaterial(specularFile, reflectionFile)) {
+		LOG_DEBUG("TextureStreamer::requestPackedMaterial: could not pack " + specularFile + " and " + reflectionFile);
+		return 0;
+	}
+
+	StreamedTexture prototype;
+	prototype.key = "packed;" + specularFile + ";" + reflectionFile + ";" + std::to_string(shininess);
+	prototype.files = { specularFile, reflectionFile };
+	prototype.packed = true;
+	prototype.shininess = std::min(std::max(shininess, 0.0f), 255.0f);
+
+	// Shown without specular and reflection until the packed levels arrive
+	return create(glState, prototype, glm::vec4(0.0f, 0.0f, prototype.shininess / 255.0f, 1.0f));
+}
+
+uint32_t TextureStreamer::create(GLStateCache& glState, const StreamedTexture& prototype, const glm::vec4& fallback)
+{
+	auto keyIt = m_keyTextures.find(prototype.key);
+	if (keyIt != m_keyTextures.end()) {
+		++m_textures[keyIt->second].refs;
+		return keyIt->second;
+	}
+
+	// Missing files are still noticed while the component is initialized, only the decoding is deferred
+	for (auto it = prototype.files.begin(); m_enabled && it != prototype.files.end(); ++it) {
+		if (!it->empty() && !std::filesystem::exists(path(prototype, *it))) {
+			LOG_DEBUG("TextureStreamer::request: could not find texture " + *it);
+			return 0;
+		}
+	}
+
+	// Layers get their page when the first load has finished
+	bool layer = m_textureArrays && prototype.target == GL_TEXTURE_2D;
+	uint32_t texture = layer ? 0 : createTexture(glState, prototype, fallback);
+	if (!layer && texture == 0) {
+		return 0;
+	}
+
+	uint32_t handle = m_nextHandle++;
+	StreamedTexture& streamed = m_textures[handle];
+	streamed = prototype;
+	streamed.refs = 1;
+	streamed.texture = texture;
+	if (layer) {
+		streamed.fallbackLayer = fallbackLayer(glState, fallback);
+	}
+	m_keyTextures[prototype.key] = handle;
+
+	if (m_enabled) {
+		queueLoad(handle, streamed);
+	}
+	return handle;
+}
+
+uint32_t TextureStreamer::createTexture(GLStateCache& glState, const StreamedTexture& prototype, const glm::vec4& fallback)
+{
+	const std::vector<std::string>& files = prototype.files;
+	GLenum target = prototype.target;
+
+	uint32_t texture;
+	glGenTextures(1, &texture);
+	glState.bindTexture(0, target, texture);
+
+	if (target == GL_TEXTURE_CUBE_MAP) {
+		glTexParameteri(target, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(target, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glTexParameteri(target, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+	}
+	else {
+		glTexParameteri(target, GL_TEXTURE_WRAP_S, GL_REPEAT);
+		glTexParameteri(target, GL_TEXTURE_WRAP_T, GL_REPEAT);
+	}
+	glTexParameteri(target, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+	bool success = true;
+	if (m_enabled) {
+		// The streamed levels of 2D textures are sampled with trilinear filtering, until the first of them arrives
+		// the fallback colour is the only level
+		glTexParameteri(target, GL_TEXTURE_MIN_FILTER, target == GL_TEXTURE_2D ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+		glTexParameteri(target, GL_TEXTURE_BASE_LEVEL, 0);
+		glTexParameteri(target, GL_TEXTURE_MAX_LEVEL, 0);
+
+		uint8_t color[4];
+		colorBytes(fallback, color);
+		for (int face = 0; face < faceCount(target); ++face) {
+			glTexImage2D(faceTarget(target, face), 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, color);
+		}
+	}
+	else {
+		glTexParameteri(target, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+
+		for (int face = 0; success && face < faceCount(target); ++face) {
+			Resource textureResource(files[face]);
+			auto textureHandle = Game::instance().resourceCache().getHandle(textureResource);
+			success = textureHandle && TextureUtils::uploadTexture(faceTarget(target, face), textureHandle, target == GL_TEXTURE_2D);
+		}
+	}
+
+	glState.bindTexture(0, target, 0);
+
+	if (!success) {
+		LOG_DEBUG("TextureStreamer::request: could not load texture " + prototype.key);
+		glState.deleteTexture(texture);
+		return 0;
+	}
+	return texture;
+}
+
+int TextureStreamer::fallbackLayer(GLStateCache& glState, const glm::vec4& fallback)
+{
+	uint8_t color[4];
+	colorBytes(fallback, color);
+	for (size_t i = 0; i < m_fallbackColors.size(); i += 4) {
+		if (std::equal(color, color + 4, m_fallbackColors.begin() + i)) {
+			return (int)(i / 4);
+		}
+	}
+	m_fallbackColors.insert(m_fallbackColors.end(), color, color + 4);
+
+	if (m_fallbackPage == 0) {
+		glGenTextures(1, &m_fallbackPage);
+		glState.bindTexture(0, GL_TEXTURE_2D_ARRAY, m_fallbackPage);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, 0);
+	}
+
+	// The page is respecified with all the colours, it only has a texel per layer
+	int nColors = (int)m_fallbackColors.size() / 4;
+	glState.bindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	glState.bindTexture(0, GL_TEXTURE_2D_ARRAY, m_fallbackPage);
+	glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA, 1, 1, nColors, 0, GL_RGBA, GL_UNSIGNED_BYTE, m_fallbackColors.data());
+	glState.bindTexture(0, GL_TEXTURE_2D_ARRAY, 0);
+	return nColors - 1;
+}
+
+void TextureStreamer::release(GLStateCache& glState, uint32_t handle)
+{
+	auto it = m_textures.find(handle);
+	if (it == m_textures.end() || --it->second.refs > 0) {
+		return;
+	}
+
+	// A load still in progress finds no texture when it finishes and is thrown away
+	StreamedTexture& streamed = it->second;
+	m_keyTextures.erase(streamed.key);
+
+	if (streamed.texture != 0) {
+		for (int level = streamed.residentLevel; level < streamed.nLevels; ++level) {
+			m_residentBytes -= streamed.levelSizes[level];
+		}
+		glState.deleteTexture(streamed.texture);
+	}
+	else if (streamed.page >= 0) {
+		// The layer is left for the next texture of the same size and format, the page is deleted with its last layer
+		Page& page = m_pages[streamed.page];
+		page.layers[streamed.layer] = 0;
+		if (std::find_if(page.layers.begin(), page.layers.end(), [](uint32_t layer) { return layer != 0; }) == page.layers.end()) {
+			for (int level = page.allocatedLevel; level < (int)page.levels.size(); ++level) {
+				m_residentBytes -= page.levels[level].size * page.layers.size();
+			}
+			glState.deleteTexture(page.texture);
+			page = Page();
+		}
+	}
+	m_textures.erase(it);
+}
+
+TextureStreamer::Binding TextureStreamer::binding(uint32_t handle) const
+{
+	auto it = m_textures.find(handle);
+	if (it == m_textures.end()) {
+		return { GL_TEXTURE_2D, 0, 0 };
+	}
+
+	const StreamedTexture& streamed = it->second;
+	if (streamed.texture != 0) {
+		return { streamed.target, streamed.texture, 0 };
+	}
+	if (streamed.visible) {
+		return { GL_TEXTURE_2D_ARRAY, m_pages[streamed.page].texture, streamed.layer };
+	}
+	return { GL_TEXTURE_2D_ARRAY, m_fallbackPage, streamed.fallbackLayer };
+}
+
+std::string TextureStreamer::path(const StreamedTexture& streamed, const std::string& file)
+{
+	return "Resources/" + (streamed.packed ? file : Game::instance().resourceCache().fileName(file));
+}
+
+void TextureStreamer::touch(uint32_t handle, float pixels)
+{
+	auto it = m_textures.find(handle);
+	if (it != m_textures.end()) {
+		it->second.pixels = std::max(it->second.pixels, pixels);
+	}
+}
+
+void TextureStreamer::update(GLStateCache& glState)
+{
+	PROFILE_FUNCTION();
+
+	++m_frame;
+	m_lastFrameBytes = 0;
+
+	if (!m_enabled) {
+		return;
+	}
+
+	// Waits for the uploads from the frame that last used this region of the pixel buffer
+	m_stagingBuffer.beginFrame();
+
+	std::vector<std::shared_ptr<LoadedTexture>> finished;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		finished.swap(m_finished);
+	}
+	for (auto it = finished.begin(); it != finished.end(); ++it) {
+		finishLoad(glState, *it);
+	}
+
+	struct Upload
+	{
+		StreamedTexture* streamed;
+		int wantedLevel;
+	};
+	std::vector<Upload> uploads;
+
+	// The layers of a page are streamed to the finest level any of them needs
+	for (auto it = m_pages.begin(); it != m_pages.end(); ++it) {
+		it->wantedLevel = (int)it->levels.size();
+	}
+	for (auto it = m_textures.begin(); it != m_textures.end(); ++it) {
+		if (it->second.page >= 0) {
+			Page& page = m_pages[it->second.page];
+			page.wantedLevel = std::min(page.wantedLevel, wantedLevel(it->second));
+		}
+	}
+
+	for (auto it = m_textures.begin(); it != m_textures.end(); ++it) {
+		StreamedTexture& streamed = it->second;
+		if (streamed.nLevels == 0) {
+			continue;
+		}
+
+		int wanted = wantedLevel(streamed);
+		if (streamed.page >= 0) {
+			// A layer that isn't visible yet needs the level the page is sampled from, even if it's finer than needed
+			const Page& page = m_pages[streamed.page];
+			wanted = streamed.visible ? page.wantedLevel : std::min(page.wantedLevel, page.baseLevel);
+		}
+		streamed.pixels = 0.0f;
+
+		if (wanted >= streamed.residentLevel) {
+			// Finer levels than needed are kept for a while, so textures of objects moving back and forth at the
+			// threshold aren't loaded over and over
+			if (wanted == streamed.residentLevel) {
+				streamed.lastNeededFrame = m_frame;
+			}
+			else if (m_frame - streamed.lastNeededFrame > (uint64_t)m_evictFrames) {
+				evictLevels(glState, streamed, wanted);
+			}
+			streamed.loaded.reset();
+			continue;
+		}
+
+		streamed.lastNeededFrame = m_frame;
+		if (streamed.loaded) {
+			uploads.push_back({ &streamed, wanted });
+		}
+		else if (!streamed.loading) {
+			queueLoad(it->first, streamed);
+		}
+	}
+
+	// The smallest missing level of any texture goes first, so every texture gets its coarse levels before any
+	// texture gets its finest. The first upload of a frame is issued even if it's over the budgets, later levels that
+	// don't fit into what's left of the frame's pixel buffer region wait for the next frame.
+	auto start = std::chrono::steady_clock::now();
+	while (true) {
+		Upload* next = nullptr;
+		for (auto it = uploads.begin(); it != uploads.end(); ++it) {
+			StreamedTexture& streamed = *it->streamed;
+			if (streamed.residentLevel > it->wantedLevel && (!next
+				|| streamed.levelSizes[streamed.residentLevel - 1] < next->streamed->levelSizes[next->streamed->residentLevel - 1])) {
+				next = &*it;
+			}
+		}
+		if (!next) {
+			break;
+		}
+
+		StreamedTexture& streamed = *next->streamed;
+		size_t size = streamed.levelSizes[streamed.residentLevel - 1];
+		if (m_lastFrameBytes > 0) {
+			std::chrono::duration<float, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+			if (size > m_stagingBuffer.available() || elapsed.count() >= m_uploadBudgetMs) {
+				break;
+			}
+		}
+
+		uploadLevel(glState, streamed, streamed.residentLevel - 1);
+		m_lastFrameBytes += size;
+
+		// The decoded levels are only kept until the texture has all the levels it needs
+		if (streamed.residentLevel == next->wantedLevel) {
+			streamed.loaded.reset();
+		}
+	}
+
+	for (auto it = m_pages.begin(); it != m_pages.end(); ++it) {
+		if (it->texture != 0) {
+			updatePage(glState, *it);
+		}
+	}
+
+	// Other texture uploads would read from the pixel buffer while it's bound
+	glState.bindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	m_stagingBuffer.endFrame();
+}
+
+size_t TextureStreamer::nStreaming() const
+{
+	size_t n = 0;
+	for (auto it = m_textures.begin(); it != m_textures.end(); ++it) {
+		if (it->second.loading || it->second.loaded) {
+			++n;
+		}
+	}
+	return n;
+}
+
+size_t TextureStreamer::nPages() const
+{
+	return std::count_if(m_pages.begin(), m_pages.end(), [](const Page& page) { return page.texture != 0; });
+}
+
+void TextureStreamer::workerMain()
+{
+	PROFILE_THREAD_NAME("Texture streaming");
+
+	while (true) {
+		LoadRequest request;
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_condition.wait(lock, [this]() { return m_stop || !m_requests.empty(); });
+			if (m_stop) {
+				break;
+			}
+			request = m_requests.front();
+			m_requests.pop_front();
+		}
+
+		auto loaded = std::make_shared<LoadedTexture>();
+		load(request, *loaded);
+
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_finished.push_back(loaded);
+	}
+}
+
+void TextureStreamer::load(const LoadRequest& request, LoadedTexture& loaded)
+{
+	PROFILE_FUNCTION();
+
+	loaded.handle = request.handle;
+	loaded.key = request.key;
+
+	if (request.packed) {
+		loaded.success = loadPacked(request, loaded);
+		return;
+	}
+
+	// The faces of a cube map are appended to the first one's base level, and have to match it
+	bool cubeMap = request.paths.size() > 1;
+	for (size_t face = 0; face < request.paths.size(); ++face) {
+		LoadedTexture faceTexture;
+		if (!loadFile(request.files[face], request.paths[face], !cubeMap, faceTexture)) {
+			return;
+		}
+
+		if (face == 0) {
+			loaded.compressed = faceTexture.compressed;
+			loaded.internalFormat = faceTexture.internalFormat;
+			loaded.format = faceTexture.format;
+			loaded.levels = faceTexture.levels;
+			loaded.data.swap(faceTexture.data);
+			continue;
+		}
+
+		if (faceTexture.internalFormat != loaded.internalFormat || faceTexture.levels[0].width != loaded.levels[0].width
+			|| faceTexture.levels[0].height != loaded.levels[0].height) {
+			return;
+		}
+		loaded.data.insert(loaded.data.end(), faceTexture.data.begin(), faceTexture.data.end());
+	}
+
+	loaded.success = true;
+}
+
+bool TextureStreamer::loadFile(const std::string& file, const std::string& path, bool mipmaps, LoadedTexture& loaded)
+{
+	// The loaders keep state between reading the size and loading, so the worker uses instances of its own
+	Resource resource(file);
+	CompressedTextureLoader compressedLoader;
+	if (std::regex_match(path, std::regex(compressedLoader.getWildcard()))) {
+		auto handle = ResCache::loadFile(compressedLoader, resource, path);
+		auto compressedData = handle ? std::dynamic_pointer_cast<CompressedTextureResProcessedData>(handle->processedData) : nullptr;
+		if (!compressedData || compressedData->levels().empty()) {
+			return false;
+		}
+
+		loaded.compressed = true;
+		loaded.internalFormat = compressedData->internalFormat();
+		auto& levels = compressedData->levels();
+		size_t nLevels = mipmaps ? levels.size() : 1;
+		for (size_t i = 0; i < nLevels; ++i) {
+			loaded.levels.push_back({ levels[i].width, levels[i].height, loaded.data.size(), levels[i].size });
+			loaded.data.insert(loaded.data.end(), handle->buffer + levels[i].offset, handle->buffer + levels[i].offset + levels[i].size);
+		}
+		return true;
+	}
+
+	ImageLoader imageLoader;
+	auto handle = ResCache::loadFile(imageLoader, resource, path);
+	auto imageData = handle ? std::dynamic_pointer_cast<ImageResProcessedData>(handle->processedData) : nullptr;
+	if (!imageData) {
+		return false;
+	}
+
+	std::vector<uint8_t> pixels(handle->buffer, handle->buffer + handle->size);
+	appendMipChain(pixels, imageData->width(), imageData->height(), imageData->nChannels(), mipmaps, loaded);
+	return true;
+}
+
+bool TextureStreamer::loadPacked(const LoadRequest& request, LoadedTexture& loaded)
+{
+	LoadedTexture specular;
+	LoadedTexture reflection;
+	bool hasReflection = !request.files[1].empty();
+	if (!loadFile(request.files[0], request.paths[0], false, specular) || specular.compressed
+		|| (hasReflection && (!loadFile(request.files[1], request.paths[1], false, reflection) || reflection.compressed))) {
+		return false;
+	}
+
+	int width = specular.levels[0].width;
+	int height = specular.levels[0].height;
+	int specularChannels = channelCount(specular.format);
+	int reflectionChannels = channelCount(reflection.format);
+	uint8_t shininess = (uint8_t)std::lround(request.shininess);
+
+	std::vector<uint8_t> pixels((size_t)width * height * 4);
+	for (int y = 0; y < height; ++y) {
+		for (int x = 0; x < width; ++x) {
+			uint8_t* packed = &pixels[((size_t)y * width + x) * 4];
+			packed[0] = luminance(&specular.data[((size_t)y * width + x) * specularChannels], specularChannels);
+			packed[1] = 0;
+			if (hasReflection) {
+				// Nearest texel of the reflection map, which usually has the same size anyway
+				int reflectionX = (int)((int64_t)x * reflection.levels[0].width / width);
+				int reflectionY = (int)((int64_t)y * reflection.levels[0].height / height);
+				size_t index = ((size_t)reflectionY * reflection.levels[0].width + reflectionX) * reflectionChannels;
+				packed[1] = luminance(&reflection.data[index], reflectionChannels);
+			}
+			packed[2] = shininess;
+			packed[3] = 255;
+		}
+	}
+
+	appendMipChain(pixels, width, height, 4, true, loaded);
+	return true;
+}
+
+void TextureStreamer::appendMipChain(std::vector<uint8_t> pixels, int width, int height, int nChannels, bool mipmaps, LoadedTexture& loaded)
+{
+	// The whole chain down to 1x1 is built here, as glGenerateMipmap would need the full resolution level on
+	// the GPU first
+	while (true) {
+		loaded.levels.push_back({ width, height, loaded.data.size(), pixels.size() });
+		loaded.data.insert(loaded.data.end(), pixels.begin(), pixels.end());
+		if (!mipmaps || (width == 1 && height == 1)) {
+			break;
+		}
+		pixels = downsample(pixels, width, height, nChannels, width, height);
+	}
+
+	loaded.format = TextureUtils::imageFormat(nChannels);
+	loaded.internalFormat = loaded.format;
+}
+
+void TextureStreamer::queueLoad(uint32_t handle, StreamedTexture& streamed)
+{
+	streamed.loading = true;
+
+	LoadRequest request;
+	request.handle = handle;
+	request.key = streamed.key;
+	request.files = streamed.files;
+	for (auto it = streamed.files.begin(); it != streamed.files.end(); ++it) {
+		request.paths.push_back(it->empty() ? std::string() : path(streamed, *it));
+	}
+	request.packed = streamed.packed;
+	request.shininess = streamed.shininess;
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_requests.push_back(request);
+	}
+	m_condition.notify_one();
+}
+
+void TextureStreamer::finishLoad(GLStateCache& glState, std::shared_ptr<LoadedTexture> loaded)
+{
+	// The texture may have been released while the file was loading
+	auto it = m_textures.find(loaded->handle);
+	if (it == m_textures.end() || it->second.key != loaded->key || !it->second.loading) {
+		return;
+	}
+
+	StreamedTexture& streamed = it->second;
+	streamed.loading = false;
+
+	if (!loaded->success) {
+		LOG_DEBUG("TextureStreamer::update: could not load texture " + streamed.key);
+		return;
+	}
+
+	if (loaded->compressed && !TextureUtils::compressedFormatSupported(loaded->internalFormat)) {
+		LOG_DEBUG("TextureStreamer::update: compressed format of " + streamed.key + " isn't supported by the driver");
+		return;
+	}
+
+	if (streamed.nLevels == 0) {
+		streamed.nLevels = (int)loaded->levels.size();
+		streamed.width = loaded->levels[0].width;
+		streamed.height = loaded->levels[0].height;
+		streamed.compressed = loaded->compressed;
+		streamed.internalFormat = loaded->internalFormat;
+		streamed.format = loaded->format;
+		for (auto level = loaded->levels.begin(); level != loaded->levels.end(); ++level) {
+			streamed.levelSizes.push_back(level->size * faceCount(streamed.target));
+		}
+		streamed.residentLevel = streamed.nLevels;
+
+		if (streamed.texture == 0) {
+			assignPage(glState, it->first, streamed, *loaded);
+		}
+	}
+	else if ((int)loaded->levels.size() != streamed.nLevels || loaded->internalFormat != streamed.internalFormat) {
+		LOG_DEBUG("TextureStreamer::update: " + streamed.key + " has changed since it was first loaded");
+		return;
+	}
+
+	streamed.loaded = loaded;
+}
+
+void TextureStreamer::assignPage(GLStateCache& glState, uint32_t handle, StreamedTexture& streamed, const LoadedTexture& loaded)
+{
+	int pageIndex = -1;
+	int freePage = -1;
+	for (size_t i = 0; pageIndex < 0 && i < m_pages.size(); ++i) {
+		Page& page = m_pages[i];
+		if (page.texture == 0) {
+			freePage = freePage < 0 ? (int)i : freePage;
+			continue;
+		}
+
+		if (page.width == streamed.width && page.height == streamed.height && page.internalFormat == streamed.internalFormat
+			&& page.levels.size() == loaded.levels.size() && std::find(page.layers.begin(), page.layers.end(), 0) != page.layers.end()) {
+			pageIndex = (int)i;
+		}
+	}
+
+	if (pageIndex < 0) {
+		pageIndex = freePage >= 0 ? freePage : (int)m_pages.size();
+		if (pageIndex == (int)m_pages.size()) {
+			m_pages.emplace_back();
+		}
+
+		Page& page = m_pages[pageIndex];
+		page.width = streamed.width;
+		page.height = streamed.height;
+		page.compressed = streamed.compressed;
+		page.internalFormat = streamed.internalFormat;
+		page.format = streamed.format;
+		page.levels = loaded.levels;
+		page.layers.assign(m_layersPerPage, 0);
+		page.allocatedLevel = (int)page.levels.size();
+		page.baseLevel = (int)page.levels.size() - 1;
+
+		// The levels are allocated as the layers need them, so the base level only has to stay within the chain
+		glGenTextures(1, &page.texture);
+		glState.bindTexture(0, GL_TEXTURE_2D_ARRAY, page.texture);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BASE_LEVEL, page.baseLevel);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, page.baseLevel);
+		glState.bindTexture(0, GL_TEXTURE_2D_ARRAY, 0);
+	}
+
+	Page& page = m_pages[pageIndex];
+	auto layer = std::find(page.layers.begin(), page.layers.end(), 0);
+	*layer = handle;
+	streamed.page = pageIndex;
+	streamed.layer = (int)(layer - page.layers.begin());
+}
+
+int TextureStreamer::wantedLevel(const StreamedTexture& streamed) const
+{
+	int tailLevel = 0;
+	while (tailLevel + 1 < streamed.nLevels && std::max(streamed.width >> tailLevel, streamed.height >> tailLevel) > TAIL_SIZE) {
+		++tailLevel;
+	}
+
+	// One texel per pixel, anything finer would only be filtered away
+	float size = (float)std::max(streamed.width, streamed.height);
+	float level = std::floor(std::log2(size / std::max(streamed.pixels, 1.0f)));
+	return (int)std::min(std::max(level, 0.0f), (float)tailLevel);
+}
+
+void TextureStreamer::uploadLevel(GLStateCache& glState, StreamedTexture& streamed, int level)
+{
+	auto& mip = streamed.loaded->levels[level];
+	const char* data = streamed.loaded->data.data() + mip.offset;
+	size_t size = streamed.levelSizes[level];
+
+	// The level of the page is allocated for all the layers before the pixel buffer is bound
+	Page* page = streamed.page >= 0 ? &m_pages[streamed.page] : nullptr;
+	if (page) {
+		allocatePageLevels(glState, *page, level);
+	}
+
+	// The pixels are read from the staging region at the offset instead of from client memory, unless the level
+	// doesn't fit into a frame's region at all. Smaller levels always fit, as update defers them to the next frame
+	// when what's left of the region is too small.
+	const char* pixels = data;
+	size_t offset = size <= m_stagingBuffer.frameSize() ? m_stagingBuffer.write(glState, data, size) : (size_t)-1;
+	if (offset != (size_t)-1) {
+		glState.bindBuffer(GL_PIXEL_UNPACK_BUFFER, m_stagingBuffer.buffer());
+		pixels = (const char*)offset;
+	}
+	else {
+		glState.bindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		++m_nDirectUploads;
+	}
+
+	if (page) {
+		glState.bindTexture(0, GL_TEXTURE_2D_ARRAY, page->texture);
+		if (streamed.compressed) {
+			glCompressedTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, 0, streamed.layer, mip.width, mip.height, 1, streamed.internalFormat, (GLsizei)mip.size, pixels);
+		}
+		else {
+			glTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, 0, streamed.layer, mip.width, mip.height, 1, streamed.format, GL_UNSIGNED_BYTE, pixels);
+		}
+		glState.bindTexture(0, GL_TEXTURE_2D_ARRAY, 0);
+
+		// The page's memory is counted when its levels are allocated
+		streamed.residentLevel = level;
+		return;
+	}
+
+	glState.bindTexture(0, streamed.target, streamed.texture);
+	for (int face = 0; face < faceCount(streamed.target); ++face) {
+		const char* facePixels = pixels + face * mip.size;
+		if (streamed.compressed) {
+			glCompressedTexImage2D(faceTarget(streamed.target, face), level, streamed.internalFormat, mip.width, mip.height, 0, (GLsizei)mip.size, facePixels);
+		}
+		else {
+			glTexImage2D(faceTarget(streamed.target, face), level, streamed.internalFormat, mip.width, mip.height, 0, streamed.format, GL_UNSIGNED_BYTE, facePixels);
+		}
+	}
+
+	// Levels below the base level, including the fallback colour, are ignored by sampling and completeness
+	glTexParameteri(streamed.target, GL_TEXTURE_BASE_LEVEL, level);
+	glTexParameteri(streamed.target, GL_TEXTURE_MAX_LEVEL, streamed.nLevels - 1);
+	glState.bindTexture(0, streamed.target, 0);
+
+	streamed.residentLevel = level;
+	m_residentBytes += size;
+}
+
+void TextureStreamer::evictLevels(GLStateCache& glState, StreamedTexture& streamed, int level)
+{
+	if (streamed.texture == 0) {
+		streamed.residentLevel = level;
+		streamed.lastNeededFrame = m_frame;
+		return;
+	}
+
+	glState.bindTexture(0, streamed.target, streamed.texture);
+	glTexParameteri(streamed.target, GL_TEXTURE_BASE_LEVEL, level);
+
+	// Respecifying the levels as empty images lets the driver free their memory
+	for (int i = streamed.residentLevel; i < level; ++i) {
+		for (int face = 0; face < faceCount(streamed.target); ++face) {
+			if (streamed.compressed) {
+				glCompressedTexImage2D(faceTarget(streamed.target, face), i, streamed.internalFormat, 0, 0, 0, 0, nullptr);
+			}
+			else {
+				glTexImage2D(faceTarget(streamed.target, face), i, streamed.internalFormat, 0, 0, 0, streamed.format, GL_UNSIGNED_BYTE, nullptr);
+			}
+		}
+		m_residentBytes -= streamed.levelSizes[i];
+	}
+	glState.bindTexture(0, streamed.target, 0);
+
+	streamed.residentLevel = level;
+	streamed.lastNeededFrame = m_frame;
+}
+
+void TextureStreamer::allocatePageLevels(GLStateCache& glState, Page& page, int level)
+{
+	if (level >= page.allocatedLevel) {
+		return;
+	}
+
+	// Without a pixel buffer bound, the null pointer leaves the levels uninitialized instead of reading from it
+	glState.bindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	glState.bindTexture(0, GL_TEXTURE_2D_ARRAY, page.texture);
+	GLsizei nLayers = (GLsizei)page.layers.size();
+	for (int i = level; i < page.allocatedLevel; ++i) {
+		const MipLevel& mip = page.levels[i];
+		if (page.compressed) {
+			glCompressedTexImage3D(GL_TEXTURE_2D_ARRAY, i, page.internalFormat, mip.width, mip.height, nLayers, 0, (GLsizei)(mip.size * nLayers), nullptr);
+		}
+		else {
+			glTexImage3D(GL_TEXTURE_2D_ARRAY, i, page.internalFormat, mip.width, mip.height, nLayers, 0, page.format, GL_UNSIGNED_BYTE, nullptr);
+		}
+		m_residentBytes += mip.size * nLayers;
+	}
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, (GLint)page.levels.size() - 1);
+	glState.bindTexture(0, GL_TEXTURE_2D_ARRAY, 0);
+
+	page.allocatedLevel = level;
+}
+
+void TextureStreamer::updatePage(GLStateCache& glState, Page& page)
+{
+	int nLevels = (int)page.levels.size();
+	int baseLevel = -1;
+	int minResidentLevel = nLevels;
+	for (auto it = page.layers.begin(); it != page.layers.end(); ++it) {
+		if (*it == 0) {
+			continue;
+		}
+		const StreamedTexture& streamed = m_textures[*it];
+		minResidentLevel = std::min(minResidentLevel, streamed.residentLevel);
+		if (streamed.visible) {
+			baseLevel = std::max(baseLevel, streamed.residentLevel);
+		}
+	}
+
+	// Until a layer is visible the page waits for the coarsest level, which the first uploads fill
+	if (baseLevel < 0) {
+		baseLevel = nLevels - 1;
+	}
+	for (auto it = page.layers.begin(); it != page.layers.end(); ++it) {
+		if (*it != 0 && m_textures[*it].residentLevel <= baseLevel) {
+			m_textures[*it].visible = true;
+		}
+	}
+
+	bool freeLevels = minResidentLevel > page.allocatedLevel;
+	if (baseLevel == page.baseLevel && !freeLevels) {
+		return;
+	}
+
+	glState.bindTexture(0, GL_TEXTURE_2D_ARRAY, page.texture);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BASE_LEVEL, baseLevel);
+	page.baseLevel = baseLevel;
+
+	// Respecifying the levels no layer has as empty images lets the driver free their memory
+	GLsizei nLayers = (GLsizei)page.layers.size();
+	for (int i = page.allocatedLevel; freeLevels && i < minResidentLevel; ++i) {
+		if (page.compressed) {
+			glCompressedTexImage3D(GL_TEXTURE_2D_ARRAY, i, page.internalFormat, 0, 0, 0, 0, 0, nullptr);
+		}
+		else {
+			glTexImage3D(GL_TEXTURE_2D_ARRAY, i, page.internalFormat, 0, 0, 0, 0, page.format, GL_UNSIGNED_BYTE, nullptr);
+		}
+		m_residentBytes -= page.levels[i].size * nLayers;
+	}
+	glState.bindTexture(0, GL_TEXTURE_2D_ARRAY, 0);
+
+	if (freeLevels) {
+		page.allocatedLevel = minResidentLevel;
+	}
+}
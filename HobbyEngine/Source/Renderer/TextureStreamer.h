@@ -0,0 +1,271 @@
+#ifndef TEXTURE_STREAMER_H
+#define TEXTURE_STREAMER_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "GLStateCache.h"
+#include "StreamingBuffer.h"
+
+// Loads the textures of the render components and the skybox in the background and keeps only the mip levels
+// their size on screen needs on the GPU. A requested texture is usable at once with a 1x1 fallback colour, while
+// a worker thread reads and decodes the file and builds the mip chain of images. The levels are then uploaded from
+// the coarsest up, so a texture first appears blurry and sharpens over the following frames instead of stalling
+// the load.
+//
+// The levels are copied into a persistently mapped pixel buffer, a StreamingBuffer bound as the pixel unpack
+// buffer, and uploaded from there, so the driver's copy of the pixels doesn't block the render thread. At most
+// uploadBudget bytes are staged per frame, which is also the size of a frame's region of the buffer, and uploads
+// stop for the frame once uploadBudgetMs has passed.
+//
+// Each frame the renderer reports how many pixels each drawn texture covers, which decides the finest level
+// worth having. Levels finer than that are dropped once they haven't been needed for evictFrames frames, and
+// loaded from the file again if they are. The levels of TAIL_SIZE texels and less are always resident.
+//
+// Materials can also be channel-packed on the worker thread: the luminance of the specular map, the luminance of
+// the reflection map and the shininess are combined into the RGB channels of one texture, which takes the place
+// of two textures and two binds.
+//
+// Requests return handles of the streamer rather than texture names, as with texture arrays enabled a 2D texture
+// becomes a layer of a GL_TEXTURE_2D_ARRAY page once its first load tells its size and format. Textures of the
+// same size, format and mip count share pages, so objects with different materials draw without rebinding
+// textures, only the layer indices change.
+class TextureStreamer
+{
+public:
+	// Where a handle's texture is bound from, the layer is zero for textures of their own
+	struct Binding
+	{
+		GLenum target;
+		uint32_t texture;
+		int layer;
+	};
+
+	TextureStreamer() = default;
+	~TextureStreamer();
+
+	// When disabled, requested textures are loaded and uploaded with all their levels before request returns. Texture
+	// arrays need streaming, as the pages are filled as the loads finish.
+	void init(GLStateCache& glState, bool enabled, size_t uploadBudget, float uploadBudgetMs, int evictFrames, bool packMaterials,
+		bool textureArrays, int layersPerPage);
+
+	// Deletes the textures still requested, the pages, the fallback page and the staging buffer. Called by the renderer with its state
+	// cache after the scene has released its textures.
+	void destroy(GLStateCache& glState);
+
+	// Returns a handle to the texture of the resource, shared by all requests for the same file until each has
+	// released it. With texture arrays the texture is a layer of a page.
+	uint32_t request(GLStateCache& glState, const std::string& file, const glm::vec4& fallback);
+
+	// Cube map with the faces in the order of the GL_TEXTURE_CUBE_MAP_POSITIVE_X onwards targets. Only the base
+	// levels of the faces are used, and they are never evicted.
+	uint32_t requestCubeMap(GLStateCache& glState, const std::vector<std::string>& faces, const glm::vec4& fallback);
+
+	// Packing needs the decoded pixels, so both maps have to be images rather than compressed textures. The packed
+	// texture is read from the source images even when the asset cooker has converted them.
+	bool canPackMaterial(const std::string& specularFile, const std::string& reflectionFile) const;
+
+	// Specular intensity in red, reflection mask in green and shininess / 255 in blue. Without a reflection map
+	// the mask is zero, and the reflection map is resampled if its size differs from the specular map's.
+	uint32_t requestPackedMaterial(GLStateCache& glState, const std::string& specularFile, const std::string& reflectionFile, float shininess);
+	void release(GLStateCache& glState, uint32_t handle);
+
+	// 2D textures are requested as layers of GL_TEXTURE_2D_ARRAY pages
+	bool textureArrays() const { return m_textureArrays; }
+
+	// Layers are bound from a page of fallback colours until their page has the levels the page is sampled from
+	Binding binding(uint32_t handle) const;
+
+	// Records the height in pixels the texture is drawn with this frame, assuming it's mapped once across the
+	// object. Has to be called on the render thread before update.
+	void touch(uint32_t handle, float pixels);
+
+	// Uploads decoded levels within the budgets and drops the levels that are no longer needed
+	void update(GLStateCache& glState);
+
+	size_t residentBytes() const { return m_residentBytes; }
+	size_t lastFrameBytes() const { return m_lastFrameBytes; }
+	size_t nStreaming() const;
+	size_t nPages() const;
+
+	// Levels too large for a frame's region of the pixel buffer are uploaded from client memory
+	uint32_t nDirectUploads() const { return m_nDirectUploads; }
+
+private:
+	static const int TAIL_SIZE = 32;
+
+	struct MipLevel
+	{
+		int width;
+		int height;
+		size_t offset;
+		size_t size;
+	};
+
+	// Mip chain of a texture decoded by the worker thread, uploaded a level at a time. The faces of a cube map
+	// follow each other in each level, size is the size of one face.
+	struct LoadedTexture
+	{
+		uint32_t handle = 0;
+		std::string key;
+		bool success = false;
+		bool compressed = false;
+		GLenum internalFormat = 0;
+		GLenum format = 0;
+		std::vector<MipLevel> levels;
+		std::vector<char> data;
+	};
+
+	struct StreamedTexture
+	{
+		// The file, or the face files separated by semicolons
+		std::string key;
+		std::vector<std::string> files;
+		GLenum target = GL_TEXTURE_2D;
+		int refs = 0;
+
+		// Texture of its own, zero for a layer. A layer gets its page after the first load, and is bound from the
+		// fallback page until it's visible.
+		uint32_t texture = 0;
+		int page = -1;
+		int layer = 0;
+		int fallbackLayer = 0;
+		bool visible = false;
+
+		// Packed from the specular and reflection map files, the latter may be empty
+		bool packed = false;
+		float shininess = 0.0f;
+
+		// Zero until the first load has finished
+		int nLevels = 0;
+		int width = 0;
+		int height = 0;
+		bool compressed = false;
+		GLenum internalFormat = 0;
+		GLenum format = 0;
+		std::vector<size_t> levelSizes;
+
+		// Finest level on the GPU, nLevels while the fallback colour is the only level
+		int residentLevel = 0;
+
+		// Largest height on screen since the last update, and the last frame the resident levels were all needed
+		float pixels = 0.0f;
+		uint64_t lastNeededFrame = 0;
+
+		bool loading = false;
+		std::shared_ptr<LoadedTexture> loaded;
+	};
+
+	// Texture array shared by layers of the same size, format and mip count. Levels are allocated for all the
+	// layers at once and freed when no layer has them any more. The page is sampled from the coarsest level any of
+	// its visible layers has, and a layer becomes visible once it has that level, so no layer is sampled from
+	// levels it hasn't been uploaded to.
+	struct Page
+	{
+		uint32_t texture = 0;
+		int width = 0;
+		int height = 0;
+		bool compressed = false;
+		GLenum internalFormat = 0;
+		GLenum format = 0;
+
+		// Sizes of one layer
+		std::vector<MipLevel> levels;
+
+		// Handles of the layers, zero for free layers
+		std::vector<uint32_t> layers;
+
+		// Finest allocated level, the number of levels while none are
+		int allocatedLevel = 0;
+		int baseLevel = 0;
+
+		// Finest level any of the layers needs this frame, the layers are streamed to it together
+		int wantedLevel = 0;
+	};
+
+	struct LoadRequest
+	{
+		uint32_t handle;
+		std::string key;
+		std::vector<std::string> files;
+		std::vector<std::string> paths;
+		bool packed;
+		float shininess;
+	};
+
+	// Key, files, target and packing are taken from the prototype
+	uint32_t create(GLStateCache& glState, const StreamedTexture& prototype, const glm::vec4& fallback);
+	uint32_t createTexture(GLStateCache& glState, const StreamedTexture& prototype, const glm::vec4& fallback);
+	static std::string path(const StreamedTexture& streamed, const std::string& file);
+
+	// Layer of the colour in the fallback page, which is grown as new colours are requested
+	int fallbackLayer(GLStateCache& glState, const glm::vec4& fallback);
+
+	void workerMain();
+	static void load(const LoadRequest& request, LoadedTexture& loaded);
+	static bool loadFile(const std::string& file, const std::string& path, bool mipmaps, LoadedTexture& loaded);
+	static bool loadPacked(const LoadRequest& request, LoadedTexture& loaded);
+	static void appendMipChain(std::vector<uint8_t> pixels, int width, int height, int nChannels, bool mipmaps, LoadedTexture& loaded);
+
+	void queueLoad(uint32_t handle, StreamedTexture& streamed);
+	void finishLoad(GLStateCache& glState, std::shared_ptr<LoadedTexture> loaded);
+
+	// Puts the layer into a page with a free layer and the same size, format and mip count, or into a new page
+	void assignPage(GLStateCache& glState, uint32_t handle, StreamedTexture& streamed, const LoadedTexture& loaded);
+
+	// Finest level needed for the height on screen, never coarser than the first level of TAIL_SIZE texels or less
+	int wantedLevel(const StreamedTexture& streamed) const;
+	void uploadLevel(GLStateCache& glState, StreamedTexture& streamed, int level);
+
+	// Drops the levels finer than level. The levels of a layer stay allocated until the whole page drops them.
+	void evictLevels(GLStateCache& glState, StreamedTexture& streamed, int level);
+
+	void allocatePageLevels(GLStateCache& glState, Page& page, int level);
+
+	// Moves the base level to the coarsest level of the visible layers, makes the layers that have it visible and
+	// frees the levels no layer has
+	void updatePage(GLStateCache& glState, Page& page);
+
+	bool m_enabled = false;
+	size_t m_uploadBudget = 1024 * 1024;
+	float m_uploadBudgetMs = 2.0f;
+	int m_evictFrames = 120;
+	bool m_packMaterials = false;
+	bool m_textureArrays = false;
+	int m_layersPerPage = 16;
+
+	uint32_t m_nextHandle = 1;
+	std::map<uint32_t, StreamedTexture> m_textures;
+	std::map<std::string, uint32_t> m_keyTextures;
+
+	// Pages of released layers are kept in the vector with a zero texture and reused
+	std::vector<Page> m_pages;
+	uint32_t m_fallbackPage = 0;
+	std::vector<uint8_t> m_fallbackColors;
+
+	StreamingBuffer m_stagingBuffer;
+
+	uint64_t m_frame = 0;
+	size_t m_residentBytes = 0;
+	size_t m_lastFrameBytes = 0;
+	uint32_t m_nDirectUploads = 0;
+
+	std::thread m_worker;
+	std::mutex m_mutex;
+	std::condition_variable m_condition;
+	bool m_stop = false;
+	std::deque<LoadRequest> m_requests;
+	std::vector<std::shared_ptr<LoadedTexture>> m_finished;
+};
+
+#endif // !TEXTURE_STREAMER_H
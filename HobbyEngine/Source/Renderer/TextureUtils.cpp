@@ -0,0 +1,73 @@
+#include "TextureUtils.h"
+
+#include <string>
+
+#include "GLExtensions.h"
+#include "../ResourceCache/CompressedTextureLoader.h"
+#include "../ResourceCache/ImageLoader.h"
+#include "../Utils/DebugLogger.h"
+
+bool TextureUtils::uploadTexture(GLenum target, std::shared_ptr<ResHandle> handle, bool mipmaps)
+{
+	auto compressedData = std::dynamic_pointer_cast<CompressedTextureResProcessedData>(handle->processedData);
+	if (compressedData) {
+		if (!compressedFormatSupported(compressedData->internalFormat())) {
+			LOG_DEBUG("TextureUtils::uploadTexture: compressed format of " + handle->name() + " isn't supported by the driver");
+			return false;
+		}
+
+		auto& levels = compressedData->levels();
+		int nLevels = mipmaps ? (int)levels.size() : 1;
+		for (int i = 0; i < nLevels; ++i) {
+			glCompressedTexImage2D(target, i, compressedData->internalFormat(), levels[i].width, levels[i].height, 0, levels[i].size, handle->buffer + levels[i].offset);
+		}
+
+		// Files without a full mip chain would otherwise leave the texture incomplete
+		if (target == GL_TEXTURE_2D) {
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, nLevels - 1);
+		}
+		return true;
+	}
+
+	auto imageData = std::dynamic_pointer_cast<ImageResProcessedData>(handle->processedData);
+	if (!imageData) {
+		LOG_DEBUG("TextureUtils::uploadTexture: " + handle->name() + " isn't an image");
+		return false;
+	}
+
+	GLenum format = imageFormat(imageData->nChannels());
+	glTexImage2D(target, 0, format, imageData->width(), imageData->height(), 0, format, GL_UNSIGNED_BYTE, handle->buffer);
+	if (mipmaps && target == GL_TEXTURE_2D) {
+		glGenerateMipmap(GL_TEXTURE_2D);
+	}
+
+	return true;
+}
+
+GLenum TextureUtils::imageFormat(int nChannels)
+{
+	switch (nChannels) {
+	case 1:
+		return GL_RED;
+	case 2:
+		return GL_RG;
+	case 4:
+		return GL_RGBA;
+	default:
+		return GL_RGB;
+	}
+}
+
+bool TextureUtils::compressedFormatSupported(GLenum internalFormat)
+{
+	switch (internalFormat) {
+	case GL_COMPRESSED_RG_RGTC2:
+		// Core since 3.0
+		return true;
+	case GL_COMPRESSED_RGBA_BPTC_UNORM:
+		return GLAD_GL_VERSION_4_2 || GLExtensions::supported("GL_ARB_texture_compression_bptc");
+	default:
+		// The BC1 and BC3 formats come with S3TC, which every desktop driver exposes as an extension
+		return GLExtensions::supported("GL_EXT_texture_compression_s3tc");
+	}
+}
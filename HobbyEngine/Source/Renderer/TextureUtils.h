@@ -0,0 +1,25 @@
+#ifndef TEXTURE_UTILS_H
+#define TEXTURE_UTILS_H
+
+#include <memory>
+
+#include <glad/glad.h>
+
+#include "../ResourceCache/ResourceCache.h"
+
+class TextureUtils
+{
+public:
+	// Uploads an image or a block compressed texture loaded by the resource cache into the texture bound to
+	// target, which is GL_TEXTURE_2D or a cube map face. With mipmaps, compressed textures get the mip levels of
+	// their file and images generated ones, otherwise only the base level is uploaded.
+	static bool uploadTexture(GLenum target, std::shared_ptr<ResHandle> handle, bool mipmaps);
+
+	// Pixel format of 8-bit images with nChannels channels, also used as their internal format
+	static GLenum imageFormat(int nChannels);
+
+	// Whether the driver can sample the block compressed format
+	static bool compressedFormatSupported(GLenum internalFormat);
+};
+
+#endif // !TEXTURE_UTILS_H
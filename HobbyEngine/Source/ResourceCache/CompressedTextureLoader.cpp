@@ -0,0 +1,302 @@
+#include "CompressedTextureLoader.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include <glad/glad.h>
+
+#include "../Utils/DebugLogger.h"
+
+// S3TC isn't part of core OpenGL, so its formats aren't in the core profile header
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#define GL_COMPRESSED_RGBA_S3TC_DXT1_EXT 0x83F1
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif // !GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+
+#ifndef GL_COMPRESSED_SRGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_SRGB_S3TC_DXT1_EXT 0x8C4C
+#define GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT1_EXT 0x8C4D
+#define GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT 0x8C4F
+#endif // !GL_COMPRESSED_SRGB_S3TC_DXT1_EXT
+
+namespace
+{
+	const uint32_t DDS_MAGIC = 0x20534444; // "DDS "
+	const uint32_t DDS_HEADER_SIZE = 124;
+	const uint32_t DDS_DX10_HEADER_SIZE = 20;
+	const uint32_t DDS_FLAG_MIPMAP_COUNT = 0x20000;
+	const uint32_t DDS_PIXEL_FORMAT_FOURCC = 0x4;
+	const uint32_t DDS_CAPS2_CUBEMAP = 0x200;
+	const uint32_t DDS_CAPS2_VOLUME = 0x200000;
+
+	const uint32_t DXGI_FORMAT_BC1_UNORM = 71;
+	const uint32_t DXGI_FORMAT_BC1_UNORM_SRGB = 72;
+	const uint32_t DXGI_FORMAT_BC3_UNORM = 77;
+	const uint32_t DXGI_FORMAT_BC3_UNORM_SRGB = 78;
+	const uint32_t DXGI_FORMAT_BC5_UNORM = 83;
+	const uint32_t DXGI_FORMAT_BC7_UNORM = 98;
+	const uint32_t DXGI_FORMAT_BC7_UNORM_SRGB = 99;
+
+	const uint8_t KTX_IDENTIFIER[12] = { 0xAB, 'K', 'T', 'X', ' ', '1', '1', 0xBB, '\r', '\n', 0x1A, '\n' };
+	const uint32_t KTX_ENDIANNESS = 0x04030201;
+	const uint32_t KTX_HEADER_SIZE = 64;
+
+	uint32_t fourCC(const char* code)
+	{
+		return (uint32_t)(uint8_t)code[0] | ((uint32_t)(uint8_t)code[1] << 8) | ((uint32_t)(uint8_t)code[2] << 16) | ((uint32_t)(uint8_t)code[3] << 24);
+	}
+
+	uint32_t readUint32(const char* buffer, size_t offset)
+	{
+		uint32_t value;
+		memcpy(&value, buffer + offset, sizeof(value));
+		return value;
+	}
+
+	// Bytes per 4x4 block, or 0 for formats the loader doesn't support
+	size_t blockSize(uint32_t internalFormat)
+	{
+		switch (internalFormat) {
+		case GL_COMPRESSED_RGB_S3TC_DXT1_EXT:
+		case GL_COMPRESSED_RGBA_S3TC_DXT1_EXT:
+			return 8;
+		case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT:
+		case GL_COMPRESSED_RG_RGTC2:
+		case GL_COMPRESSED_RGBA_BPTC_UNORM:
+			return 16;
+		default:
+			return 0;
+		}
+	}
+
+	uint32_t linearFormat(uint32_t internalFormat)
+	{
+		switch (internalFormat) {
+		case GL_COMPRESSED_SRGB_S3TC_DXT1_EXT:
+			return GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+		case GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT1_EXT:
+			return GL_COMPRESSED_RGBA_S3TC_DXT1_EXT;
+		case GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT:
+			return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+		case GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM:
+			return GL_COMPRESSED_RGBA_BPTC_UNORM;
+		default:
+			return internalFormat;
+		}
+	}
+
+	size_t levelSize(uint32_t internalFormat, int width, int height)
+	{
+		return (size_t)((width + 3) / 4) * ((height + 3) / 4) * blockSize(internalFormat);
+	}
+
+	// Levels of a full mip chain down to 1x1, floor(log2(max(width, height))) + 1
+	uint32_t maxLevels(int width, int height)
+	{
+		uint32_t nLevels = 1;
+		while ((std::max(width, height) >> nLevels) > 0) {
+			++nLevels;
+		}
+		return nLevels;
+	}
+}
+
+size_t CompressedTextureLoader::getLoadedResourceSize(char* rawBuffer, size_t rawSize)
+{
+	CompressedTextureResProcessedData data;
+	if (!parse(rawBuffer, rawSize, data)) {
+		return 0;
+	}
+
+	size_t size = 0;
+	for (auto it = data.m_levels.begin(); it != data.m_levels.end(); ++it) {
+		size += it->size;
+	}
+	return size;
+}
+
+bool CompressedTextureLoader::loadResource(char* rawBuffer, size_t rawSize, std::shared_ptr<ResHandle> handle)
+{
+	auto processedData = std::make_shared<CompressedTextureResProcessedData>();
+	bool success = parse(rawBuffer, rawSize, *processedData);
+
+	// The levels are packed together, dropping the headers and KTX's per level sizes and padding
+	size_t offset = 0;
+	for (auto it = processedData->m_levels.begin(); success && it != processedData->m_levels.end(); ++it) {
+		memcpy(handle->buffer + offset, rawBuffer + it->offset, it->size);
+		it->offset = offset;
+		offset += it->size;
+	}
+
+	if (success) {
+		handle->processedData = processedData;
+	}
+	else {
+		LOG_DEBUG("CompressedTextureLoader::loadResource: unsupported or corrupted texture " + handle->name());
+	}
+
+	delete[] rawBuffer;
+
+	return success;
+}
+
+bool CompressedTextureLoader::parse(const char* rawBuffer, size_t rawSize, CompressedTextureResProcessedData& data)
+{
+	bool success = false;
+	if (rawSize >= 4 && readUint32(rawBuffer, 0) == DDS_MAGIC) {
+		success = parseDDS(rawBuffer, rawSize, data);
+	}
+	else if (rawSize >= sizeof(KTX_IDENTIFIER) && memcmp(rawBuffer, KTX_IDENTIFIER, sizeof(KTX_IDENTIFIER)) == 0) {
+		success = parseKTX(rawBuffer, rawSize, data);
+	}
+
+	if (!success || data.m_levels.empty()) {
+		return false;
+	}
+
+	for (auto it = data.m_levels.begin(); it != data.m_levels.end(); ++it) {
+		if (it->offset + it->size > rawSize) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+bool CompressedTextureLoader::parseDDS(const char* rawBuffer, size_t rawSize, CompressedTextureResProcessedData& data)
+{
+	if (rawSize < 4 + DDS_HEADER_SIZE || readUint32(rawBuffer, 4) != DDS_HEADER_SIZE) {
+		return false;
+	}
+
+	const char* header = rawBuffer + 4;
+	uint32_t flags = readUint32(header, 4);
+	int height = (int)readUint32(header, 8);
+	int width = (int)readUint32(header, 12);
+	uint32_t nLevels = (flags & DDS_FLAG_MIPMAP_COUNT) ? std::max(readUint32(header, 24), 1u) : 1;
+	uint32_t pixelFormatFlags = readUint32(header, 76);
+	uint32_t pixelFormatCode = readUint32(header, 80);
+	uint32_t caps2 = readUint32(header, 108);
+
+	if ((caps2 & (DDS_CAPS2_CUBEMAP | DDS_CAPS2_VOLUME)) || !(pixelFormatFlags & DDS_PIXEL_FORMAT_FOURCC)) {
+		return false;
+	}
+
+	size_t offset = 4 + DDS_HEADER_SIZE;
+	if (pixelFormatCode == fourCC("DXT1")) {
+		data.m_internalFormat = GL_COMPRESSED_RGBA_S3TC_DXT1_EXT;
+	}
+	else if (pixelFormatCode == fourCC("DXT5")) {
+		data.m_internalFormat = GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+	}
+	else if (pixelFormatCode == fourCC("ATI2") || pixelFormatCode == fourCC("BC5U")) {
+		data.m_internalFormat = GL_COMPRESSED_RG_RGTC2;
+	}
+	else if (pixelFormatCode == fourCC("DX10")) {
+		if (rawSize < offset + DDS_DX10_HEADER_SIZE) {
+			return false;
+		}
+
+		uint32_t dxgiFormat = readUint32(rawBuffer, offset);
+		uint32_t arraySize = readUint32(rawBuffer, offset + 12);
+		offset += DDS_DX10_HEADER_SIZE;
+
+		if (arraySize > 1) {
+			return false;
+		}
+
+		switch (dxgiFormat) {
+		case DXGI_FORMAT_BC1_UNORM:
+		case DXGI_FORMAT_BC1_UNORM_SRGB:
+			data.m_internalFormat = GL_COMPRESSED_RGBA_S3TC_DXT1_EXT;
+			break;
+		case DXGI_FORMAT_BC3_UNORM:
+		case DXGI_FORMAT_BC3_UNORM_SRGB:
+			data.m_internalFormat = GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+			break;
+		case DXGI_FORMAT_BC5_UNORM:
+			data.m_internalFormat = GL_COMPRESSED_RG_RGTC2;
+			break;
+		case DXGI_FORMAT_BC7_UNORM:
+		case DXGI_FORMAT_BC7_UNORM_SRGB:
+			data.m_internalFormat = GL_COMPRESSED_RGBA_BPTC_UNORM;
+			break;
+		default:
+			return false;
+		}
+	}
+	else {
+		return false;
+	}
+
+	if (width <= 0 || height <= 0) {
+		return false;
+	}
+
+	// Levels past 1x1 are ignored
+	nLevels = std::min(nLevels, maxLevels(width, height));
+
+	for (uint32_t i = 0; i < nLevels; ++i) {
+		CompressedTextureResProcessedData::MipLevel level;
+		level.width = std::max(width >> i, 1);
+		level.height = std::max(height >> i, 1);
+		level.offset = offset;
+		level.size = levelSize(data.m_internalFormat, level.width, level.height);
+		data.m_levels.push_back(level);
+
+		offset += level.size;
+	}
+
+	return true;
+}
+
+bool CompressedTextureLoader::parseKTX(const char* rawBuffer, size_t rawSize, CompressedTextureResProcessedData& data)
+{
+	if (rawSize < KTX_HEADER_SIZE || readUint32(rawBuffer, 12) != KTX_ENDIANNESS) {
+		return false;
+	}
+
+	uint32_t glType = readUint32(rawBuffer, 16);
+	uint32_t internalFormat = readUint32(rawBuffer, 28);
+	int width = (int)readUint32(rawBuffer, 36);
+	int height = (int)readUint32(rawBuffer, 40);
+	uint32_t depth = readUint32(rawBuffer, 44);
+	uint32_t nArrayElements = readUint32(rawBuffer, 48);
+	uint32_t nFaces = readUint32(rawBuffer, 52);
+	uint32_t nLevels = std::max(readUint32(rawBuffer, 56), 1u);
+	uint32_t keyValueDataSize = readUint32(rawBuffer, 60);
+
+	// Compressed KTX files have a glType of 0
+	data.m_internalFormat = linearFormat(internalFormat);
+	if (glType != 0 || blockSize(data.m_internalFormat) == 0 || depth > 1 || nArrayElements > 1 || nFaces != 1 || width <= 0 || height <= 0) {
+		return false;
+	}
+
+	// A file claiming more levels than the chain down to 1x1 has is malformed
+	if (nLevels > maxLevels(width, height)) {
+		return false;
+	}
+
+	size_t offset = KTX_HEADER_SIZE + keyValueDataSize;
+	for (uint32_t i = 0; i < nLevels; ++i) {
+		if (offset + 4 > rawSize) {
+			return false;
+		}
+
+		CompressedTextureResProcessedData::MipLevel level;
+		level.width = std::max(width >> i, 1);
+		level.height = std::max(height >> i, 1);
+		level.size = readUint32(rawBuffer, offset);
+		level.offset = offset + 4;
+		if (level.size != levelSize(data.m_internalFormat, level.width, level.height)) {
+			return false;
+		}
+		data.m_levels.push_back(level);
+
+		// Levels are padded to four bytes
+		offset = level.offset + (level.size + 3) / 4 * 4;
+	}
+
+	return true;
+}
@@ -0,0 +1,60 @@
+#ifndef COMPRESSED_TEXTURE_LOADER_H
+#define COMPRESSED_TEXTURE_LOADER_H
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "ResourceCache.h"
+
+// Block compressed texture with its mip levels, stored one after another in the handle's buffer in the layout
+// glCompressedTexImage2D takes them
+class CompressedTextureResProcessedData : public IResProcessedData
+{
+	friend class CompressedTextureLoader;
+public:
+	struct MipLevel
+	{
+		int width;
+		int height;
+		size_t offset;
+		size_t size;
+	};
+
+	virtual std::string toString() { return "CompressedTextureResProcessedData"; }
+
+	int width() { return m_levels.empty() ? 0 : m_levels[0].width; }
+	int height() { return m_levels.empty() ? 0 : m_levels[0].height; }
+
+	// GL internal format of the blocks, one of the BC1, BC3, BC5 or BC7 formats
+	uint32_t internalFormat() { return m_internalFormat; }
+	const std::vector<MipLevel>& levels() { return m_levels; }
+
+private:
+	uint32_t m_internalFormat = 0;
+	std::vector<MipLevel> m_levels;
+};
+
+// Loads 2D textures in BC1, BC3, BC5 or BC7 from DDS files, including the DX10 header, and KTX 1 files. The
+// blocks are kept as they are, so the texture is uploaded without decoding and with the mip levels of the file
+// instead of generated ones. sRGB formats are loaded as their UNORM counterparts, as the renderer samples all
+// colour textures as linear.
+class CompressedTextureLoader : public IResLoader
+{
+public:
+	virtual std::string getWildcard() { return ".*\\.(dds|ktx)"; }
+	virtual bool useRawFile() { return false; }
+	virtual size_t getLoadedResourceSize(char* rawBuffer, size_t rawSize);
+	virtual bool isText() { return false; }
+	virtual bool loadResource(char* rawBuffer, size_t rawSize, std::shared_ptr<ResHandle> handle);
+
+private:
+	// Fills the format and levels, with the offsets of the levels in the file. Returns false for files in other
+	// formats or with levels past the end of the file.
+	static bool parse(const char* rawBuffer, size_t rawSize, CompressedTextureResProcessedData& data);
+	static bool parseDDS(const char* rawBuffer, size_t rawSize, CompressedTextureResProcessedData& data);
+	static bool parseKTX(const char* rawBuffer, size_t rawSize, CompressedTextureResProcessedData& data);
+};
+
+#endif // !COMPRESSED_TEXTURE_LOADER_H
@@ -1,16 +1,24 @@
 #ifndef LUA_LOADER_H
 #define LUA_LOADER_H
 
+#include <string_view>
+
 #include "ResourceCache.h"
 
+// Loads Lua source files and the bytecode the asset cooker precompiles them to, which Lua tells apart by the
+// chunk's signature
 class LuaLoader : public IResLoader
 {
 public:
-	virtual std::string getWildcard() { return std::string(".*\\.lua"); }
+	virtual std::string getWildcard() { return std::string(".*\\.(lua|luac)"); }
 	virtual bool useRawFile() { return true; }
 	virtual size_t getLoadedResourceSize(char* rawBuffer, size_t rawSize) { return rawSize; }
 	virtual bool isText() { return true; }
 	virtual bool loadResource(char* rawBuffer, size_t rawSize, std::shared_ptr<ResHandle> handle) { return true; }
+
+	// Bytecode can contain zeros, so the chunk is passed with its size, which leaves out the terminating zero
+	// appended to text resources
+	static std::string_view chunk(ResHandle& handle) { return std::string_view(handle.buffer, handle.size - 1); }
 };
 
 #endif // !LUA_LOADER_H
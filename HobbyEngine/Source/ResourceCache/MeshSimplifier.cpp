@@ -0,0 +1,268 @@
+#include "MeshSimplifier.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <map>
+#include <tuple>
+
+namespace
+{
+	// Open borders are weighted heavily, so the outline of the mesh is kept as long as possible
+	const double BORDER_WEIGHT = 10.0;
+
+	// Sum of squared distances to a set of planes, stored as the upper triangle of a symmetric 4x4 matrix
+	struct Quadric
+	{
+		double a[10] = {};
+
+		void addPlane(const glm::dvec3& n, double d, double weight)
+		{
+			a[0] += weight * n.x * n.x;
+			a[1] += weight * n.x * n.y;
+			a[2] += weight * n.x * n.z;
+			a[3] += weight * n.x * d;
+			a[4] += weight * n.y * n.y;
+			a[5] += weight * n.y * n.z;
+			a[6] += weight * n.y * d;
+			a[7] += weight * n.z * n.z;
+			a[8] += weight * n.z * d;
+			a[9] += weight * d * d;
+		}
+
+		double error(const glm::vec3& p) const
+		{
+			double x = p.x, y = p.y, z = p.z;
+			return a[0] * x * x + 2.0 * a[1] * x * y + 2.0 * a[2] * x * z + 2.0 * a[3] * x
+				+ a[4] * y * y + 2.0 * a[5] * y * z + 2.0 * a[6] * y
+				+ a[7] * z * z + 2.0 * a[8] * z + a[9];
+		}
+
+		Quadric& operator+=(const Quadric& other)
+		{
+			for (int i = 0; i < 10; ++i) {
+				a[i] += other.a[i];
+			}
+			return *this;
+		}
+	};
+
+	struct Collapse
+	{
+		uint32_t from;
+		uint32_t to;
+		double cost;
+	};
+
+	glm::dvec3 triangleNormal(const glm::vec3& a, const glm::vec3& b, const glm::vec3& c)
+	{
+		return glm::cross(glm::dvec3(b - a), glm::dvec3(c - a));
+	}
+}
+
+std::vector<unsigned short> MeshSimplifier::simplify(const std::vector<glm::vec3>& vertices, const std::vector<unsigned short>& indices, size_t targetIndexCount, float& error)
+{
+	std::vector<unsigned short> result(indices);
+	error = 0.0f;
+
+	if (vertices.empty() || result.size() <= targetIndexCount) {
+		return result;
+	}
+
+	// Collapses work on positions, the vertices at a position are moved together
+	std::vector<uint32_t> positionIds(vertices.size());
+	std::vector<glm::vec3> positions;
+	std::map<std::tuple<float, float, float>, uint32_t> positionMap;
+	glm::vec3 boundsMin = vertices[0];
+	glm::vec3 boundsMax = vertices[0];
+	for (size_t i = 0; i < vertices.size(); ++i) {
+		auto key = std::make_tuple(vertices[i].x, vertices[i].y, vertices[i].z);
+		auto it = positionMap.insert(std::make_pair(key, (uint32_t)positions.size())).first;
+		if (it->second == positions.size()) {
+			positions.push_back(vertices[i]);
+		}
+		positionIds[i] = it->second;
+		boundsMin = glm::min(boundsMin, vertices[i]);
+		boundsMax = glm::max(boundsMax, vertices[i]);
+	}
+	double meshSize = std::max((double)glm::length(boundsMax - boundsMin), 1e-6);
+
+	// Each position starts with the planes of its triangles, and the planes along open borders
+	std::vector<Quadric> quadrics(positions.size());
+	std::map<std::pair<uint32_t, uint32_t>, int> edgeCounts;
+	for (size_t t = 0; t < result.size(); t += 3) {
+		for (int e = 0; e < 3; ++e) {
+			uint32_t a = positionIds[result[t + e]];
+			uint32_t b = positionIds[result[t + (e + 1) % 3]];
+			++edgeCounts[std::make_pair(std::min(a, b), std::max(a, b))];
+		}
+	}
+	for (size_t t = 0; t < result.size(); t += 3) {
+		uint32_t ids[3] = { positionIds[result[t]], positionIds[result[t + 1]], positionIds[result[t + 2]] };
+		glm::dvec3 normal = triangleNormal(positions[ids[0]], positions[ids[1]], positions[ids[2]]);
+		double length = glm::length(normal);
+		if (length <= 0.0) {
+			continue;
+		}
+		normal /= length;
+
+		Quadric quadric;
+		quadric.addPlane(normal, -glm::dot(normal, glm::dvec3(positions[ids[0]])), 1.0);
+		for (int i = 0; i < 3; ++i) {
+			quadrics[ids[i]] += quadric;
+		}
+
+		for (int e = 0; e < 3; ++e) {
+			uint32_t a = ids[e];
+			uint32_t b = ids[(e + 1) % 3];
+			if (edgeCounts[std::make_pair(std::min(a, b), std::max(a, b))] != 1) {
+				continue;
+			}
+			glm::dvec3 edge = glm::dvec3(positions[b] - positions[a]);
+			glm::dvec3 borderNormal = glm::cross(edge, normal);
+			double borderLength = glm::length(borderNormal);
+			if (borderLength <= 0.0) {
+				continue;
+			}
+			borderNormal /= borderLength;
+
+			Quadric border;
+			border.addPlane(borderNormal, -glm::dot(borderNormal, glm::dvec3(positions[a])), BORDER_WEIGHT);
+			quadrics[a] += border;
+			quadrics[b] += border;
+		}
+	}
+
+	std::vector<std::vector<uint32_t>> positionVertices(positions.size());
+	for (size_t i = 0; i < vertices.size(); ++i) {
+		positionVertices[positionIds[i]].push_back(i);
+	}
+
+	std::vector<std::vector<uint32_t>> vertexNeighbours(vertices.size());
+	std::vector<std::vector<uint32_t>> positionTriangles(positions.size());
+	std::vector<Collapse> collapses;
+	std::vector<bool> locked(positions.size());
+	std::vector<uint32_t> remap(vertices.size());
+
+	// Each pass collapses the cheapest edges whose neighbourhoods don't overlap, then rebuilds the adjacency
+	while (result.size() > targetIndexCount) {
+		for (size_t i = 0; i < vertices.size(); ++i) {
+			vertexNeighbours[i].clear();
+			remap[i] = i;
+		}
+		for (size_t i = 0; i < positions.size(); ++i) {
+			positionTriangles[i].clear();
+			locked[i] = false;
+		}
+		collapses.clear();
+
+		for (size_t t = 0; t < result.size(); t += 3) {
+			for (int e = 0; e < 3; ++e) {
+				uint32_t a = result[t + e];
+				uint32_t b = result[t + (e + 1) % 3];
+				vertexNeighbours[a].push_back(b);
+				vertexNeighbours[b].push_back(a);
+				positionTriangles[positionIds[a]].push_back(t);
+
+				uint32_t from = positionIds[a];
+				uint32_t to = positionIds[b];
+				Quadric quadric = quadrics[from];
+				quadric += quadrics[to];
+				collapses.push_back({ from, to, quadric.error(positions[to]) });
+				collapses.push_back({ to, from, quadric.error(positions[from]) });
+			}
+		}
+
+		std::sort(collapses.begin(), collapses.end(), [](const Collapse& a, const Collapse& b) {
+			return a.cost < b.cost;
+		});
+
+		size_t nRemoved = 0;
+		size_t maxRemoved = (result.size() - targetIndexCount + 2) / 3;
+		for (auto it = collapses.begin(); it != collapses.end() && nRemoved < maxRemoved; ++it) {
+			if (locked[it->from] || locked[it->to]) {
+				continue;
+			}
+
+			// Every vertex at the collapsed position needs a neighbour at the target to take its attributes from,
+			// otherwise the collapse would open a seam
+			bool valid = true;
+			for (auto v = positionVertices[it->from].begin(); valid && v != positionVertices[it->from].end(); ++v) {
+				auto& neighbours = vertexNeighbours[*v];
+				auto target = std::find_if(neighbours.begin(), neighbours.end(), [&](uint32_t n) { return positionIds[n] == it->to; });
+				if (target != neighbours.end()) {
+					remap[*v] = *target;
+				}
+				else if (!neighbours.empty()) {
+					valid = false;
+				}
+			}
+
+			// The remaining triangles around the collapsed position must not flip over
+			size_t nCollapsedTriangles = 0;
+			for (auto t = positionTriangles[it->from].begin(); valid && t != positionTriangles[it->from].end(); ++t) {
+				uint32_t ids[3] = { positionIds[result[*t]], positionIds[result[*t + 1]], positionIds[result[*t + 2]] };
+				if (ids[0] == it->to || ids[1] == it->to || ids[2] == it->to) {
+					++nCollapsedTriangles;
+					continue;
+				}
+
+				glm::vec3 corners[3];
+				glm::vec3 moved[3];
+				for (int i = 0; i < 3; ++i) {
+					corners[i] = positions[ids[i]];
+					moved[i] = ids[i] == it->from ? positions[it->to] : corners[i];
+				}
+				glm::dvec3 before = triangleNormal(corners[0], corners[1], corners[2]);
+				glm::dvec3 after = triangleNormal(moved[0], moved[1], moved[2]);
+				if (glm::dot(before, after) <= 0.25 * glm::length(before) * glm::length(after)) {
+					valid = false;
+				}
+			}
+
+			if (!valid) {
+				for (auto v = positionVertices[it->from].begin(); v != positionVertices[it->from].end(); ++v) {
+					remap[*v] = *v;
+				}
+				continue;
+			}
+
+			// Everything around the collapse is locked for the rest of the pass, so the checks above stay valid
+			for (auto t = positionTriangles[it->from].begin(); t != positionTriangles[it->from].end(); ++t) {
+				for (int i = 0; i < 3; ++i) {
+					locked[positionIds[result[*t + i]]] = true;
+				}
+			}
+			for (auto t = positionTriangles[it->to].begin(); t != positionTriangles[it->to].end(); ++t) {
+				for (int i = 0; i < 3; ++i) {
+					locked[positionIds[result[*t + i]]] = true;
+				}
+			}
+
+			quadrics[it->to] += quadrics[it->from];
+			error = std::max(error, (float)(std::sqrt(std::max(it->cost, 0.0)) / meshSize));
+			nRemoved += nCollapsedTriangles;
+		}
+
+		if (nRemoved == 0) {
+			break;
+		}
+
+		// Triangles that lost an edge in the collapses are dropped
+		size_t nIndices = 0;
+		for (size_t t = 0; t < result.size(); t += 3) {
+			unsigned short a = remap[result[t]];
+			unsigned short b = remap[result[t + 1]];
+			unsigned short c = remap[result[t + 2]];
+			if (positionIds[a] == positionIds[b] || positionIds[b] == positionIds[c] || positionIds[a] == positionIds[c]) {
+				continue;
+			}
+			result[nIndices++] = a;
+			result[nIndices++] = b;
+			result[nIndices++] = c;
+		}
+		result.resize(nIndices);
+	}
+
+	return result;
+}
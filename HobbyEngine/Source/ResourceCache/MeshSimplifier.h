@@ -0,0 +1,24 @@
+#ifndef MESH_SIMPLIFIER_H
+#define MESH_SIMPLIFIER_H
+
+#include <cstddef>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+// Quadric error metric simplification for generating mesh LODs at load time. Edges are collapsed in order of
+// the error their collapse adds, each vertex moving onto the other end of the edge, so the simplified mesh
+// indexes the original vertices and can share their buffers.
+//
+// Vertices at the same position with different attributes, along UV and normal seams, are collapsed together.
+// A collapse is only done if each of them has a neighbour at the target position to move onto, which keeps the
+// seams from tearing. Open borders are held in place by extra planes along their edges.
+class MeshSimplifier
+{
+public:
+	// Collapses edges until at most targetIndexCount indices are left or no edge can be collapsed. Returns the
+	// new indices, error is set to the largest distance a surface moved relative to the mesh's size.
+	static std::vector<unsigned short> simplify(const std::vector<glm::vec3>& vertices, const std::vector<unsigned short>& indices, size_t targetIndexCount, float& error);
+};
+
+#endif // !MESH_SIMPLIFIER_H
@@ -1,12 +1,32 @@
 #include "ModelLoader.h"
 
+#include <cstring>
 #include <map>
 #include <regex>
 #include <sstream>
 #include <vector>
 
+#include "MeshSimplifier.h"
 #include "../Utils/DebugLogger.h"
 
+const std::vector<unsigned short>& ModelResProcessedData::simplifiedIndices(float ratio)
+{
+	auto it = m_simplifiedIndices.find(ratio);
+	if (it != m_simplifiedIndices.end()) {
+		return it->second;
+	}
+
+	size_t targetIndexCount = (size_t)(m_indices.size() / 3 * ratio) * 3;
+	float error;
+	auto& indices = m_simplifiedIndices[ratio];
+	indices = MeshSimplifier::simplify(m_vertices, m_indices, targetIndexCount, error);
+
+	LOG_DEBUG("ModelResProcessedData::simplifiedIndices: simplified " + std::to_string(m_indices.size() / 3) + " triangles to "
+		+ std::to_string(indices.size() / 3) + ", error " + std::to_string(error));
+
+	return indices;
+}
+
 std::string ObjLoader::getWildcard()
 {
 	return std::string(".*(\\.obj)");
@@ -208,3 +228,88 @@ bool ObjLoader::loadResource(char* rawBuffer, size_t rawSize, std::shared_ptr<Re
 
 	return true;
 }
+
+namespace
+{
+	const uint32_t MESH_FILE_MAGIC = 0x48534D48; // "HMSH"
+	const uint32_t MESH_FILE_VERSION = 1;
+
+	struct MeshFileHeader
+	{
+		uint32_t magic;
+		uint32_t version;
+		uint32_t nVertices;
+		uint32_t nIndices;
+	};
+
+	template <typename T>
+	void appendArray(std::vector<char>& out, const std::vector<T>& data)
+	{
+		const char* bytes = (const char*)data.data();
+		out.insert(out.end(), bytes, bytes + data.size() * sizeof(T));
+	}
+
+	template <typename T>
+	bool readArray(const char*& src, const char* end, size_t count, std::vector<T>& data)
+	{
+		if ((size_t)(end - src) < count * sizeof(T)) {
+			return false;
+		}
+		data.resize(count);
+		memcpy(data.data(), src, count * sizeof(T));
+		src += count * sizeof(T);
+		return true;
+	}
+}
+
+bool BinaryMeshLoader::loadResource(char* rawBuffer, size_t rawSize, std::shared_ptr<ResHandle> handle)
+{
+	MeshFileHeader header;
+	if (rawSize < sizeof(header)) {
+		delete[] rawBuffer;
+		return false;
+	}
+	memcpy(&header, rawBuffer, sizeof(header));
+
+	std::vector<glm::vec3> vertices, normals, tangents, bitangents;
+	std::vector<glm::vec2> uvs;
+	std::vector<unsigned short> indices;
+
+	const char* src = rawBuffer + sizeof(header);
+	const char* end = rawBuffer + rawSize;
+	bool success = header.magic == MESH_FILE_MAGIC && header.version == MESH_FILE_VERSION
+		&& readArray(src, end, header.nVertices, vertices)
+		&& readArray(src, end, header.nVertices, uvs)
+		&& readArray(src, end, header.nVertices, normals)
+		&& readArray(src, end, header.nVertices, tangents)
+		&& readArray(src, end, header.nVertices, bitangents)
+		&& readArray(src, end, header.nIndices, indices);
+
+	delete[] rawBuffer;
+
+	if (!success) {
+		LOG_DEBUG("BinaryMeshLoader::loadResource: corrupted or outdated mesh file " + handle->name());
+		return false;
+	}
+
+	handle->processedData = std::make_shared<ModelResProcessedData>(vertices, uvs, normals, tangents, bitangents, indices);
+	return true;
+}
+
+std::vector<char> BinaryMeshLoader::write(ModelResProcessedData& mesh)
+{
+	MeshFileHeader header;
+	header.magic = MESH_FILE_MAGIC;
+	header.version = MESH_FILE_VERSION;
+	header.nVertices = (uint32_t)mesh.vertices().size();
+	header.nIndices = (uint32_t)mesh.indices().size();
+
+	std::vector<char> out((const char*)&header, (const char*)&header + sizeof(header));
+	appendArray(out, mesh.vertices());
+	appendArray(out, mesh.uvs());
+	appendArray(out, mesh.normals());
+	appendArray(out, mesh.tangents());
+	appendArray(out, mesh.bitangents());
+	appendArray(out, mesh.indices());
+	return out;
+}
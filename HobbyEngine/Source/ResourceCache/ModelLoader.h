@@ -1,6 +1,7 @@
 #ifndef MODEL_LOADER_H
 #define MODEL_LOADER_H
 
+#include <map>
 #include <string>
 #include <vector>
 
@@ -24,6 +25,10 @@ public:
 	std::vector<glm::vec3>& bitangents() { return m_bitangents; }
 	std::vector<unsigned short>& indices() { return m_indices; }
 
+	// Indices of the mesh simplified to about ratio of its triangles, indexing the same vertices. Generated on
+	// first use and kept with the model, so components sharing the model share its LODs.
+	const std::vector<unsigned short>& simplifiedIndices(float ratio);
+
 private:
 	std::vector<glm::vec3> m_vertices;
 	std::vector<glm::vec2> m_uvs;
@@ -31,6 +36,8 @@ private:
 	std::vector<glm::vec3> m_tangents;
 	std::vector<glm::vec3> m_bitangents;
 	std::vector<unsigned short> m_indices;
+
+	std::map<float, std::vector<unsigned short>> m_simplifiedIndices;
 };
 
 class ObjLoader : public IResLoader
@@ -43,4 +50,18 @@ public:
 	virtual bool loadResource(char* rawBuffer, size_t rawSize, std::shared_ptr<ResHandle> handle);
 };
 
+// Meshes cooked from .obj files by the asset cooker: a header with the vertex and index counts, followed by the
+// vertex attribute arrays and the indices exactly as they are uploaded, so loading is a copy
+class BinaryMeshLoader : public IResLoader
+{
+public:
+	virtual std::string getWildcard() { return ".*\\.hmesh"; }
+	virtual bool useRawFile() { return false; }
+	virtual size_t getLoadedResourceSize(char*, size_t) { return 0; }
+	virtual bool isText() { return false; }
+	virtual bool loadResource(char* rawBuffer, size_t rawSize, std::shared_ptr<ResHandle> handle);
+
+	static std::vector<char> write(ModelResProcessedData& mesh);
+};
+
 #endif // !MODEL_LOADER_H
@@ -1,9 +1,13 @@
 #include "ResourceCache.h"
 
+#include <filesystem>
 #include <regex>
 
+#include <tinyxml2/tinyxml2.h>
+
 #include "../Utils/DebugLogger.h"
 #include "../Utils/FileUtils.h"
+#include "../Utils/Profiler.h"
 
 bool ResCache::init()
 {
@@ -20,8 +24,59 @@ void ResCache::registerLoader(std::shared_ptr<IResLoader> loader)
 	m_loaders.push_front(loader);
 }
 
+bool ResCache::loadManifest(const std::string& file)
+{
+	// The manifest is read directly, as loading it through the cache would look it up in itself
+	tinyxml2::XMLDocument doc;
+	if (doc.LoadFile(file.c_str()) != tinyxml2::XML_SUCCESS || !doc.FirstChildElement("Manifest")) {
+		return false;
+	}
+
+	size_t nMissing = 0;
+	size_t nStale = 0;
+	auto root = doc.FirstChildElement("Manifest");
+	auto version = root->Attribute("version");
+	for (auto elem = root->FirstChildElement("Asset"); elem; elem = elem->NextSiblingElement("Asset")) {
+		auto source = elem->Attribute("source");
+		auto cooked = elem->Attribute("cooked");
+		auto hash = elem->Attribute("hash");
+		if (!source || !cooked) {
+			continue;
+		}
+
+		// Missing cooked files fall back to the source, so a partially cooked tree still runs
+		std::string sourcePath = "Resources/" + std::string(source);
+		std::string cookedPath = "Resources/" + std::string(cooked);
+		std::error_code err;
+		auto cookedTime = std::filesystem::last_write_time(cookedPath, err);
+		if (err) {
+			++nMissing;
+			continue;
+		}
+
+		// Sources edited since the last cook are loaded as they are, until the cooker is run again. A newer source
+		// is stale without hashing it, the hash catches the edits that don't show in the modification times. Without
+		// the source, as when only the cooked files are shipped, the cooked file is used as it is.
+		auto sourceTime = std::filesystem::last_write_time(sourcePath, err);
+		std::string sourceHash;
+		if (!err && (sourceTime > cookedTime || !version || !hash
+			|| !FileUtils::hashFile(sourcePath.c_str(), version, sourceHash) || sourceHash != hash)) {
+			LOG_DEBUG("ResCache::loadManifest: " + std::string(source) + " has changed since it was cooked, loading the source");
+			++nStale;
+			continue;
+		}
+		m_cookedFiles[source] = cooked;
+	}
+
+	LOG_DEBUG("ResCache::loadManifest: " + std::to_string(m_cookedFiles.size()) + " cooked resources, " + std::to_string(nMissing) + " missing, "
+		+ std::to_string(nStale) + " stale");
+	return true;
+}
+
 std::shared_ptr<ResHandle> ResCache::getHandle(Resource& resource)
 {
+	PROFILE_FUNCTION();
+
 	auto handle = find(resource);
 
 	if (!handle) {
@@ -31,16 +86,26 @@ std::shared_ptr<ResHandle> ResCache::getHandle(Resource& resource)
 	return handle;
 }
 
+std::string ResCache::fileName(const std::string& name) const
+{
+	auto cooked = m_cookedFiles.find(name);
+	return cooked != m_cookedFiles.end() ? cooked->second : name;
+}
+
 std::shared_ptr<ResHandle> ResCache::load(Resource& resource)
 {
+	PROFILE_FUNCTION();
+
 	std::shared_ptr<IResLoader> loader;
 	std::shared_ptr<ResHandle> handle;
 
+	std::string fileName = this->fileName(resource.name());
+
 	for (auto it = m_loaders.begin(); it != m_loaders.end(); ++it) {
 		auto it_loader = *it;
 		std::regex rgx(it_loader->getWildcard());
 
-		if (std::regex_match(resource.name(), rgx)) {
+		if (std::regex_match(fileName, rgx)) {
 			loader = it_loader;
 			break;
 		}
@@ -51,7 +116,20 @@ std::shared_ptr<ResHandle> ResCache::load(Resource& resource)
 		return std::shared_ptr<ResHandle>();
 	}
 
-	std::string resPath = "Resources/" + resource.name();
+	handle = loadFile(*loader, resource, "Resources/" + fileName);
+
+	if (handle) {
+		m_handles[resource.name()] = handle;
+	}
+
+	return handle;
+}
+
+std::shared_ptr<ResHandle> ResCache::loadFile(IResLoader& loader, Resource& resource, const std::string& resPath)
+{
+	PROFILE_FUNCTION();
+
+	std::shared_ptr<ResHandle> handle;
 
 	int rawSize = FileUtils::fileSize(resPath.c_str());
 
@@ -60,7 +138,7 @@ std::shared_ptr<ResHandle> ResCache::load(Resource& resource)
 		return std::shared_ptr<ResHandle>();
 	}
 
-	rawSize += ((loader->isText()) ? 1 : 0);
+	rawSize += ((loader.isText()) ? 1 : 0);
 	char* rawBuffer = new char[rawSize];
 
 	if (!rawBuffer) {
@@ -75,14 +153,14 @@ std::shared_ptr<ResHandle> ResCache::load(Resource& resource)
 		return std::shared_ptr<ResHandle>();
 	}
 
-	if (loader->isText()) {
+	if (loader.isText()) {
 		rawBuffer[rawSize - 1] = '\0';
 	}
 
-	if (loader->useRawFile()) {
+	if (loader.useRawFile()) {
 		handle = std::shared_ptr<ResHandle>(new ResHandle(resource, rawBuffer, rawSize));
 	} else {
-		size_t loadedSize = loader->getLoadedResourceSize(rawBuffer, rawSize);
+		size_t loadedSize = loader.getLoadedResourceSize(rawBuffer, rawSize);
 		char* buffer = new char[loadedSize];
 
 		if (!buffer) {
@@ -91,7 +169,7 @@ std::shared_ptr<ResHandle> ResCache::load(Resource& resource)
 		}
 
 		handle = std::shared_ptr<ResHandle>(new ResHandle(resource, buffer, loadedSize));
-		bool success = loader->loadResource(rawBuffer, rawSize, handle);
+		bool success = loader.loadResource(rawBuffer, rawSize, handle);
 
 		if (!success) {
 			LOG_DEBUG("Could not allocate " + std::to_string(rawSize) + " bytes for loading resource: " + resource.name());
@@ -99,13 +177,7 @@ std::shared_ptr<ResHandle> ResCache::load(Resource& resource)
 			}
 		}
 
-	if (handle) {
-		m_handles[resource.name()] = handle;
-	}
-
 	return handle;
-
-	return std::shared_ptr<ResHandle>();
 }
 
 std::shared_ptr<ResHandle> ResCache::find(Resource& resource)
@@ -60,8 +60,18 @@ public:
 
 	void registerLoader(std::shared_ptr<IResLoader> loader);
 
+	// Reads the manifest written by the asset cooker. Resources listed in it are loaded from their cooked files,
+	// while the handles keep the names of the source files.
+	bool loadManifest(const std::string& file);
+
 	std::shared_ptr<ResHandle> getHandle(Resource& resource);
 
+	// File the resource is loaded from relative to the resource directory, its cooked file if it has one
+	std::string fileName(const std::string& name) const;
+
+	// Reads the file at path and runs the loader on it, without caching the handle
+	static std::shared_ptr<ResHandle> loadFile(IResLoader& loader, Resource& resource, const std::string& path);
+
 private:
 	std::shared_ptr<ResHandle> load(Resource& resource);
 	std::shared_ptr<ResHandle> find(Resource& resource);
@@ -69,6 +79,9 @@ private:
 	std::map<std::string, std::shared_ptr<ResHandle>> m_handles;
 	std::list<std::shared_ptr<IResLoader>> m_loaders;
 
+	// Cooked file of each source file in the manifest, relative to the resource directory
+	std::map<std::string, std::string> m_cookedFiles;
+
 };
 
 #endif // !RESOURCE_CACHE_H
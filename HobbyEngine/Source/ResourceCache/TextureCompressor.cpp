@@ -0,0 +1,288 @@
+#include "TextureCompressor.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace
+{
+	const uint32_t DDS_MAGIC = 0x20534444; // "DDS "
+	const uint32_t DDS_HEADER_SIZE = 124;
+
+	// DDSD_CAPS | DDSD_HEIGHT | DDSD_WIDTH | DDSD_PIXELFORMAT | DDSD_MIPMAPCOUNT | DDSD_LINEARSIZE
+	const uint32_t DDS_FLAGS = 0x1 | 0x2 | 0x4 | 0x1000 | 0x20000 | 0x80000;
+
+	// DDSCAPS_COMPLEX | DDSCAPS_TEXTURE | DDSCAPS_MIPMAP
+	const uint32_t DDS_CAPS = 0x8 | 0x1000 | 0x400000;
+
+	void writeUint32(std::vector<char>& out, uint32_t value)
+	{
+		char bytes[4];
+		memcpy(bytes, &value, sizeof(bytes));
+		out.insert(out.end(), bytes, bytes + 4);
+	}
+
+	uint16_t packColor565(const float color[3])
+	{
+		int r = std::min(std::max((int)std::lround(color[0] * 31.0f / 255.0f), 0), 31);
+		int g = std::min(std::max((int)std::lround(color[1] * 63.0f / 255.0f), 0), 63);
+		int b = std::min(std::max((int)std::lround(color[2] * 31.0f / 255.0f), 0), 31);
+		return (uint16_t)((r << 11) | (g << 5) | b);
+	}
+
+	void unpackColor565(uint16_t packed, int color[3])
+	{
+		int r = (packed >> 11) & 31;
+		int g = (packed >> 5) & 63;
+		int b = packed & 31;
+		color[0] = (r << 3) | (r >> 2);
+		color[1] = (g << 2) | (g >> 4);
+		color[2] = (b << 3) | (b >> 2);
+	}
+
+	// Next mip level with a 2x2 box filter, odd sizes repeat their last row or column
+	std::vector<uint8_t> downsample(const std::vector<uint8_t>& rgba, int width, int height, int& outWidth, int& outHeight)
+	{
+		outWidth = std::max(width / 2, 1);
+		outHeight = std::max(height / 2, 1);
+		std::vector<uint8_t> res((size_t)outWidth * outHeight * 4);
+		for (int y = 0; y < outHeight; ++y) {
+			int y0 = std::min(y * 2, height - 1);
+			int y1 = std::min(y * 2 + 1, height - 1);
+			for (int x = 0; x < outWidth; ++x) {
+				int x0 = std::min(x * 2, width - 1);
+				int x1 = std::min(x * 2 + 1, width - 1);
+				for (int c = 0; c < 4; ++c) {
+					int sum = rgba[((size_t)y0 * width + x0) * 4 + c] + rgba[((size_t)y0 * width + x1) * 4 + c]
+						+ rgba[((size_t)y1 * width + x0) * 4 + c] + rgba[((size_t)y1 * width + x1) * 4 + c];
+					res[((size_t)y * outWidth + x) * 4 + c] = (uint8_t)((sum + 2) / 4);
+				}
+			}
+		}
+		return res;
+	}
+}
+
+std::vector<char> TextureCompressor::compressToDDS(const unsigned char* pixels, int width, int height, int nChannels)
+{
+	bool alpha = nChannels == 2 || nChannels == 4;
+	size_t blockSize = alpha ? 16 : 8;
+
+	// Everything is encoded from RGBA, greyscale is replicated to the colour channels
+	std::vector<uint8_t> level((size_t)width * height * 4);
+	for (size_t i = 0; i < (size_t)width * height; ++i) {
+		const unsigned char* src = pixels + i * nChannels;
+		uint8_t* dst = &level[i * 4];
+		if (nChannels <= 2) {
+			dst[0] = dst[1] = dst[2] = src[0];
+			dst[3] = nChannels == 2 ? src[1] : 255;
+		}
+		else {
+			dst[0] = src[0];
+			dst[1] = src[1];
+			dst[2] = src[2];
+			dst[3] = nChannels == 4 ? src[3] : 255;
+		}
+	}
+
+	int nLevels = 1;
+	while ((width >> nLevels) > 0 || (height >> nLevels) > 0) {
+		++nLevels;
+	}
+
+	std::vector<char> out;
+	writeUint32(out, DDS_MAGIC);
+	writeUint32(out, DDS_HEADER_SIZE);
+	writeUint32(out, DDS_FLAGS);
+	writeUint32(out, height);
+	writeUint32(out, width);
+	writeUint32(out, (uint32_t)(((width + 3) / 4) * ((height + 3) / 4) * blockSize));
+	writeUint32(out, 0);
+	writeUint32(out, nLevels);
+	for (int i = 0; i < 11; ++i) {
+		writeUint32(out, 0);
+	}
+
+	// Pixel format: size, DDPF_FOURCC and the code, the bit counts and masks are unused
+	writeUint32(out, 32);
+	writeUint32(out, 0x4);
+	out.insert(out.end(), { 'D', 'X', 'T', alpha ? '5' : '1' });
+	for (int i = 0; i < 5; ++i) {
+		writeUint32(out, 0);
+	}
+
+	writeUint32(out, DDS_CAPS);
+	for (int i = 0; i < 4; ++i) {
+		writeUint32(out, 0);
+	}
+
+	int levelWidth = width;
+	int levelHeight = height;
+	for (int i = 0; i < nLevels; ++i) {
+		int blocksX = (levelWidth + 3) / 4;
+		int blocksY = (levelHeight + 3) / 4;
+		size_t offset = out.size();
+		out.resize(offset + (size_t)blocksX * blocksY * blockSize);
+
+		for (int by = 0; by < blocksY; ++by) {
+			for (int bx = 0; bx < blocksX; ++bx) {
+				// Blocks past the edge of the image repeat its last pixels
+				uint8_t block[16][4];
+				for (int p = 0; p < 16; ++p) {
+					int x = std::min(bx * 4 + p % 4, levelWidth - 1);
+					int y = std::min(by * 4 + p / 4, levelHeight - 1);
+					memcpy(block[p], &level[((size_t)y * levelWidth + x) * 4], 4);
+				}
+
+				uint8_t* dst = (uint8_t*)&out[offset + ((size_t)by * blocksX + bx) * blockSize];
+				if (alpha) {
+					encodeAlphaBlock(block, dst);
+					dst += 8;
+				}
+				encodeColorBlock(block, dst);
+			}
+		}
+
+		if (i + 1 < nLevels) {
+			level = downsample(level, levelWidth, levelHeight, levelWidth, levelHeight);
+		}
+	}
+
+	return out;
+}
+
+void TextureCompressor::encodeColorBlock(const uint8_t block[16][4], uint8_t* out)
+{
+	float mean[3] = { 0.0f, 0.0f, 0.0f };
+	for (int p = 0; p < 16; ++p) {
+		for (int c = 0; c < 3; ++c) {
+			mean[c] += block[p][c] / 16.0f;
+		}
+	}
+
+	float covariance[6] = { 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f };
+	for (int p = 0; p < 16; ++p) {
+		float d[3] = { block[p][0] - mean[0], block[p][1] - mean[1], block[p][2] - mean[2] };
+		covariance[0] += d[0] * d[0];
+		covariance[1] += d[0] * d[1];
+		covariance[2] += d[0] * d[2];
+		covariance[3] += d[1] * d[1];
+		covariance[4] += d[1] * d[2];
+		covariance[5] += d[2] * d[2];
+	}
+
+	// Principal axis by power iteration, starting from the luminance direction
+	float axis[3] = { 0.3f, 0.6f, 0.1f };
+	for (int i = 0; i < 8; ++i) {
+		float next[3] = {
+			covariance[0] * axis[0] + covariance[1] * axis[1] + covariance[2] * axis[2],
+			covariance[1] * axis[0] + covariance[3] * axis[1] + covariance[4] * axis[2],
+			covariance[2] * axis[0] + covariance[4] * axis[1] + covariance[5] * axis[2]
+		};
+		float length = std::sqrt(next[0] * next[0] + next[1] * next[1] + next[2] * next[2]);
+		if (length < 1e-6f) {
+			break;
+		}
+		for (int c = 0; c < 3; ++c) {
+			axis[c] = next[c] / length;
+		}
+	}
+
+	float minT = 1e9f;
+	float maxT = -1e9f;
+	for (int p = 0; p < 16; ++p) {
+		float t = (block[p][0] - mean[0]) * axis[0] + (block[p][1] - mean[1]) * axis[1] + (block[p][2] - mean[2]) * axis[2];
+		minT = std::min(minT, t);
+		maxT = std::max(maxT, t);
+	}
+
+	// Insetting the endpoints by a sixteenth of the range lowers the error of the interpolated colours
+	float inset = (maxT - minT) / 16.0f;
+	minT += inset;
+	maxT -= inset;
+
+	float endpoint0[3], endpoint1[3];
+	for (int c = 0; c < 3; ++c) {
+		endpoint0[c] = mean[c] + axis[c] * maxT;
+		endpoint1[c] = mean[c] + axis[c] * minT;
+	}
+
+	uint16_t color0 = packColor565(endpoint0);
+	uint16_t color1 = packColor565(endpoint1);
+
+	// Four colour mode needs color0 > color1
+	if (color0 < color1) {
+		std::swap(color0, color1);
+	}
+
+	uint32_t indices = 0;
+	if (color0 != color1) {
+		int palette[4][3];
+		unpackColor565(color0, palette[0]);
+		unpackColor565(color1, palette[1]);
+		for (int c = 0; c < 3; ++c) {
+			palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+			palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+		}
+
+		for (int p = 0; p < 16; ++p) {
+			int best = 0;
+			int bestError = 1 << 30;
+			for (int i = 0; i < 4; ++i) {
+				int dr = block[p][0] - palette[i][0];
+				int dg = block[p][1] - palette[i][1];
+				int db = block[p][2] - palette[i][2];
+				int error = dr * dr + dg * dg + db * db;
+				if (error < bestError) {
+					bestError = error;
+					best = i;
+				}
+			}
+			indices |= (uint32_t)best << (p * 2);
+		}
+	}
+
+	out[0] = color0 & 0xFF;
+	out[1] = color0 >> 8;
+	out[2] = color1 & 0xFF;
+	out[3] = color1 >> 8;
+	memcpy(out + 4, &indices, 4);
+}
+
+void TextureCompressor::encodeAlphaBlock(const uint8_t block[16][4], uint8_t* out)
+{
+	int alpha0 = 0;
+	int alpha1 = 255;
+	for (int p = 0; p < 16; ++p) {
+		alpha0 = std::max(alpha0, (int)block[p][3]);
+		alpha1 = std::min(alpha1, (int)block[p][3]);
+	}
+
+	uint64_t indices = 0;
+	if (alpha0 != alpha1) {
+		// Eight value mode, alpha0 > alpha1 with six values interpolated between them
+		int palette[8] = { alpha0, alpha1 };
+		for (int i = 1; i < 7; ++i) {
+			palette[i + 1] = ((7 - i) * alpha0 + i * alpha1) / 7;
+		}
+
+		for (int p = 0; p < 16; ++p) {
+			int best = 0;
+			int bestError = 256;
+			for (int i = 0; i < 8; ++i) {
+				int error = std::abs(block[p][3] - palette[i]);
+				if (error < bestError) {
+					bestError = error;
+					best = i;
+				}
+			}
+			indices |= (uint64_t)best << (p * 3);
+		}
+	}
+
+	out[0] = (uint8_t)alpha0;
+	out[1] = (uint8_t)alpha1;
+	for (int i = 0; i < 6; ++i) {
+		out[2 + i] = (uint8_t)(indices >> (i * 8));
+	}
+}
@@ -0,0 +1,21 @@
+#ifndef TEXTURE_COMPRESSOR_H
+#define TEXTURE_COMPRESSOR_H
+
+#include <cstdint>
+#include <vector>
+
+// Encodes images into DDS files with BC1, or BC3 for images with an alpha channel, and a full chain of box
+// filtered mip levels. The endpoints of each block are picked along the principal axis of its colours and inset
+// slightly, which is fast and close to what the slower offline encoders produce for photographic textures.
+class TextureCompressor
+{
+public:
+	// pixels are 8-bit rows with nChannels channels as stb_image loads them
+	static std::vector<char> compressToDDS(const unsigned char* pixels, int width, int height, int nChannels);
+
+private:
+	static void encodeColorBlock(const uint8_t block[16][4], uint8_t* out);
+	static void encodeAlphaBlock(const uint8_t block[16][4], uint8_t* out);
+};
+
+#endif // !TEXTURE_COMPRESSOR_H
@@ -1,11 +1,13 @@
 #include "Font.h"
 
-#include <GLFW/glfw3.h>
+#include "../Engine/GLApplication.h"
 
 #include "../Utils/DebugLogger.h"
 
 bool Font::init(FT_Face& face, uint16_t nglyphs)
 {
+	GLStateCache& glState = Game::instance().renderer().glState();
+
 	for (uint32_t c = 0; c < nglyphs; ++c) {
 		if (FT_Load_Char(face, c, FT_LOAD_RENDER)) {
 			LOG_DEBUG("Font::init: could not load character " + c);
@@ -16,7 +18,7 @@ bool Font::init(FT_Face& face, uint16_t nglyphs)
 		std::shared_ptr<Character> pCh = std::shared_ptr<Character>(ch);
 
 		glGenTextures(1, &ch->textureID);
-		glBindTexture(GL_TEXTURE_2D, ch->textureID);
+		glState.bindTexture(0, GL_TEXTURE_2D, ch->textureID);
 		glTexImage2D(GL_TEXTURE_2D, 0, GL_RED, face->glyph->bitmap.width, face->glyph->bitmap.rows, 0, GL_RED, GL_UNSIGNED_BYTE, face->glyph->bitmap.buffer);
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
@@ -34,5 +36,7 @@ bool Font::init(FT_Face& face, uint16_t nglyphs)
 
 Character::~Character()
 {
-	glDeleteTextures(1, &textureID);
+	GLStateCache& glState = Game::instance().renderer().glState();
+
+	glState.deleteTexture(textureID);
 }
@@ -2,6 +2,7 @@
 
 #include "../Engine/GLApplication.h"
 #include "../ResourceCache/FontLoader.h"
+#include "../ResourceCache/LuaLoader.h"
 #include "../ResourceCache/ResourceCache.h"
 #include "../Utils/DebugLogger.h"
 #include "../Utils/XMLUtils.h"
@@ -71,8 +72,7 @@ bool TextElement::init(tinyxml2::XMLElement* data)
 
 		initLuaState();
 
-		const char* scriptText = scriptHandle->buffer;
-		auto res = m_luaState->script(scriptText);
+		auto res = m_luaState->script(LuaLoader::chunk(*scriptHandle));
 
 		m_luaUpdate = (*m_luaState)["update"];
 
@@ -96,11 +96,8 @@ bool TextElement::init(tinyxml2::XMLElement* data)
 
 	m_text = std::string(textElem->Attribute("text"));
 
+	// The glyph quads are written into the renderer's streaming buffer each frame
 	glGenVertexArrays(1, &m_VAO);
-	glGenBuffers(1, &m_VBO);
-	glBindBuffer(GL_ARRAY_BUFFER, m_VBO);
-	glBufferData(GL_ARRAY_BUFFER, 6 * 4 * sizeof(float), NULL, GL_DYNAMIC_DRAW);
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
 
 	return true;
 }
@@ -119,6 +116,7 @@ bool TextElement::initLuaState()
 
 	m_luaState->set_function("updateText", &TextElement::updateText, this);
 	m_luaState->set_function("lollero", &TextElement::lollero, this);
+	m_luaState->set_function("gpuProfilerReport", []() { return Game::instance().renderer().gpuProfiler().report(); });
 
 	return true;
 }
@@ -24,12 +24,10 @@ public:
 	virtual void update(int deltaTime) {}
 
 	uint32_t vao() { return m_VAO; }
-	uint32_t vbo() { return m_VBO; }
 	glm::vec2 position() { return m_position; }
 
 protected:
 	uint32_t m_VAO;
-	uint32_t m_VBO;
 
 	glm::vec2 m_position;
 };
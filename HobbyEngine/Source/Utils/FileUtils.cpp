@@ -1,5 +1,7 @@
 #include "FileUtils.h"
 
+#include <cstdint>
+#include <cstdio>
 #include <fstream>
 #include <iostream>
 #include <sstream>
@@ -54,3 +56,33 @@ bool FileUtils::readRawFile(const char* filename, char* buffer, size_t length)
 	ifs.close();
 	return true;
 }
+
+bool FileUtils::hashFile(const char* filename, const std::string& salt, std::string& hash)
+{
+	std::ifstream ifs(filename, std::ios::binary);
+
+	if (!ifs.is_open()) {
+		LOG_DEBUG(std::string("FileUtils::hashFile: Could not open file: ") + filename);
+		return false;
+	}
+
+	uint64_t value = 14695981039346656037ull;
+	auto hashBytes = [&value](const char* bytes, size_t size) {
+		for (size_t i = 0; i < size; ++i) {
+			value ^= (uint8_t)bytes[i];
+			value *= 1099511628211ull;
+		}
+	};
+
+	hashBytes(salt.data(), salt.size());
+	char buffer[65536];
+	while (ifs) {
+		ifs.read(buffer, sizeof(buffer));
+		hashBytes(buffer, (size_t)ifs.gcount());
+	}
+
+	char str[17];
+	snprintf(str, sizeof(str), "%016llx", (unsigned long long)value);
+	hash = str;
+	return true;
+}
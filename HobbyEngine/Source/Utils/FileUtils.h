@@ -9,6 +9,9 @@ public:
 	static int readFileStr(const char* filename, std::string& dest);
 	static int fileSize(const char* filename);
 	static bool readRawFile(const char* filename, char* buffer, size_t length);
+
+	// 64-bit FNV-1a of salt followed by the file's contents, as 16 hex digits
+	static bool hashFile(const char* filename, const std::string& salt, std::string& hash);
 };
 
 #endif // !FILE_UTILS_H
@@ -0,0 +1,169 @@
+#include "Profiler.h"
+
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+
+#include "DebugLogger.h"
+
+Profiler Profiler::profilerInstance;
+
+static const auto profilerEpoch = std::chrono::high_resolution_clock::now();
+
+static std::string escapeJSON(const std::string& str)
+{
+	std::string escaped;
+	for (auto c = str.begin(); c != str.end(); ++c) {
+		if (*c == '"' || *c == '\\') {
+			escaped += '\\';
+		}
+		escaped += *c;
+	}
+	return escaped;
+}
+
+uint64_t Profiler::now()
+{
+	auto elapsed = std::chrono::high_resolution_clock::now() - profilerEpoch;
+	// Zero is reserved for zones that started outside a capture
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count() + 1;
+}
+
+void Profiler::beginFrame()
+{
+	if (m_capturing.load(std::memory_order_relaxed)) {
+		if (++m_capturedFrames >= m_captureFrames) {
+			m_capturing.store(false);
+			writeTrace();
+		}
+	}
+
+	if (m_pendingFrames > 0 && !m_capturing.load(std::memory_order_relaxed)) {
+		m_captureFrames = m_pendingFrames;
+		m_capturedFrames = 0;
+		m_pendingFrames = 0;
+
+		// Threads notice the new generation and reset their own buffers on the next zone they record
+		m_generation.fetch_add(1);
+		m_capturing.store(true);
+	}
+}
+
+void Profiler::startCapture(int nFrames, const std::string& filename)
+{
+	if (m_capturing.load(std::memory_order_relaxed) || nFrames <= 0) {
+		return;
+	}
+
+	m_pendingFrames = nFrames;
+	m_captureFile = filename;
+
+	LOG_DEBUG("Profiler::startCapture: capturing " + std::to_string(nFrames) + " frames to " + filename);
+}
+
+void Profiler::setThreadName(const std::string& name)
+{
+	ThreadBuffer& buffer = threadBuffer();
+
+	std::lock_guard<std::mutex> lock(m_threadsMutex);
+	buffer.name = name;
+}
+
+void Profiler::record(const char* name, uint64_t start, uint64_t end)
+{
+	if (!m_capturing.load(std::memory_order_relaxed)) {
+		return;
+	}
+
+	ThreadBuffer& buffer = threadBuffer();
+
+	uint32_t generation = m_generation.load(std::memory_order_relaxed);
+	if (buffer.generation.load(std::memory_order_relaxed) != generation) {
+		buffer.count.store(0, std::memory_order_relaxed);
+		buffer.dropped.store(0, std::memory_order_relaxed);
+		buffer.generation.store(generation, std::memory_order_release);
+	}
+
+	size_t index = buffer.count.load(std::memory_order_relaxed);
+	if (index >= MAX_EVENTS_PER_THREAD) {
+		buffer.dropped.fetch_add(1, std::memory_order_relaxed);
+		return;
+	}
+
+	buffer.events[index] = { name, start, end };
+
+	// Publish the event to the thread writing the trace
+	buffer.count.store(index + 1, std::memory_order_release);
+}
+
+Profiler::ThreadBuffer& Profiler::threadBuffer()
+{
+	thread_local ThreadBuffer* threadBuffer = nullptr;
+
+	if (!threadBuffer) {
+		std::lock_guard<std::mutex> lock(m_threadsMutex);
+
+		std::unique_ptr<ThreadBuffer> buffer(new ThreadBuffer);
+		buffer->threadId = m_threads.size() + 1;
+		buffer->name = "Thread " + std::to_string(buffer->threadId);
+		buffer->events = std::unique_ptr<Event[]>(new Event[MAX_EVENTS_PER_THREAD]);
+		buffer->count.store(0);
+		buffer->dropped.store(0);
+		buffer->generation.store(m_generation.load());
+
+		threadBuffer = buffer.get();
+		m_threads.push_back(std::move(buffer));
+	}
+
+	return *threadBuffer;
+}
+
+bool Profiler::writeTrace()
+{
+	std::ofstream out(m_captureFile);
+	if (!out) {
+		LOG_DEBUG("Profiler::writeTrace: could not open " + m_captureFile);
+		return false;
+	}
+
+	uint32_t generation = m_generation.load();
+	size_t nEvents = 0;
+	size_t nDropped = 0;
+
+	out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+
+	std::lock_guard<std::mutex> lock(m_threadsMutex);
+
+	bool first = true;
+	char event[512];
+	for (auto it = m_threads.begin(); it != m_threads.end(); ++it) {
+		ThreadBuffer& buffer = **it;
+
+		snprintf(event, sizeof(event), "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"%s\"}}",
+			first ? "" : ",", buffer.threadId, escapeJSON(buffer.name).c_str());
+		out << event;
+		first = false;
+
+		if (buffer.generation.load(std::memory_order_acquire) != generation) {
+			continue;
+		}
+
+		size_t count = buffer.count.load(std::memory_order_acquire);
+		for (size_t i = 0; i < count; ++i) {
+			const Event& e = buffer.events[i];
+			snprintf(event, sizeof(event), ",\n{\"name\":\"%s\",\"cat\":\"cpu\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}",
+				escapeJSON(e.name).c_str(), buffer.threadId, e.start / 1000.0, (e.end - e.start) / 1000.0);
+			out << event;
+		}
+
+		nEvents += count;
+		nDropped += buffer.dropped.load(std::memory_order_relaxed);
+	}
+
+	out << "\n]}\n";
+
+	LOG_DEBUG("Profiler::writeTrace: wrote " + std::to_string(nEvents) + " zones of " + std::to_string(m_captureFrames) + " frames to " + m_captureFile
+		+ (nDropped > 0 ? ", " + std::to_string(nDropped) + " zones dropped" : ""));
+
+	return true;
+}
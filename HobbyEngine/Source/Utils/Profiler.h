@@ -0,0 +1,104 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#ifdef PROFILE_ENABLED
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+#define PROFILE_SCOPE(name) ProfileZone PROFILE_CONCAT(profileZone, __LINE__)(name)
+#define PROFILE_FUNCTION() PROFILE_SCOPE(__FUNCTION__)
+#define PROFILE_FRAME() Profiler::instance().beginFrame()
+#define PROFILE_THREAD_NAME(name) Profiler::instance().setThreadName(name)
+#else
+#define PROFILE_SCOPE(name)
+#define PROFILE_FUNCTION()
+#define PROFILE_FRAME()
+#define PROFILE_THREAD_NAME(name)
+#endif // PROFILE_ENABLED
+
+// CPU profiler recording scoped zones into per thread buffers. Only the owning thread writes to a buffer, so
+// recording a zone takes no locks; a mutex is taken only the first time a thread records anything. Zones are
+// recorded only while a capture is running, and a capture of N frames is written out in the Chrome trace event
+// format, which can be opened in chrome://tracing or Perfetto.
+// Zone names must outlive the capture, so use string literals.
+class Profiler
+{
+public:
+	static Profiler& instance() { return profilerInstance; }
+
+	// Marks the start of a new frame, starting and ending captures on frame boundaries
+	void beginFrame();
+
+	// The capture starts at the next frame and is written to the file after nFrames frames
+	void startCapture(int nFrames, const std::string& filename);
+	bool capturing() const { return m_capturing.load(std::memory_order_relaxed); }
+
+	void setThreadName(const std::string& name);
+
+	void record(const char* name, uint64_t start, uint64_t end);
+
+	// Nanoseconds since the profiler was created
+	static uint64_t now();
+
+private:
+	static const size_t MAX_EVENTS_PER_THREAD = 1 << 18;
+
+	struct Event
+	{
+		const char* name;
+		uint64_t start;
+		uint64_t end;
+	};
+
+	struct ThreadBuffer
+	{
+		uint32_t threadId;
+		std::string name;
+		std::unique_ptr<Event[]> events;
+		std::atomic<size_t> count;
+		std::atomic<size_t> dropped;
+		std::atomic<uint32_t> generation;
+	};
+
+	Profiler() = default;
+
+	ThreadBuffer& threadBuffer();
+	bool writeTrace();
+
+	static Profiler profilerInstance;
+
+	std::atomic<bool> m_capturing{ false };
+	std::atomic<uint32_t> m_generation{ 0 };
+
+	int m_pendingFrames = 0;
+	int m_captureFrames = 0;
+	int m_capturedFrames = 0;
+	std::string m_captureFile;
+
+	std::mutex m_threadsMutex;
+	std::vector<std::unique_ptr<ThreadBuffer>> m_threads;
+};
+
+class ProfileZone
+{
+public:
+	explicit ProfileZone(const char* name) : m_name(name), m_start(Profiler::instance().capturing() ? Profiler::now() : 0) {}
+	~ProfileZone()
+	{
+		if (m_start != 0) {
+			Profiler::instance().record(m_name, m_start, Profiler::now());
+		}
+	}
+
+private:
+	const char* m_name;
+	uint64_t m_start;
+};
+
+#endif // !PROFILER_H